@@ -0,0 +1,165 @@
+#include "benchmark.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <numeric>
+
+BenchmarkOptions BenchmarkOptions::parse(int argc, char** argv) {
+	BenchmarkOptions options;
+	for (int i = 1; i < argc; ++i) {
+		const bool has_value = i + 1 < argc;
+		if (strcmp(argv[i], "--headless") == 0) {
+			options.headless = true;
+		} else if (strcmp(argv[i], "--frames") == 0 && has_value) {
+			options.frames = std::max(1, atoi(argv[++i]));
+		} else if (strcmp(argv[i], "--warmup") == 0 && has_value) {
+			options.warmup = std::max(0, atoi(argv[++i]));
+		} else if (strcmp(argv[i], "--output") == 0 && has_value) {
+			options.output = argv[++i];
+		} else if (strcmp(argv[i], "--instances") == 0 && has_value) {
+			options.instances = std::max(0, atoi(argv[++i]));
+		} else if (strcmp(argv[i], "--lights") == 0 && has_value) {
+			options.lights = std::max(0, atoi(argv[++i]));
+		} else if (strcmp(argv[i], "--no-program-cache") == 0) {
+			options.program_cache = false;
+		} else if (strcmp(argv[i], "--shadow-filter") == 0 && has_value) {
+			const char* filter = argv[++i];
+			if (strcmp(filter, "hardware") == 0) {
+				options.shadow_filter = ShadowFilter::Hardware;
+			} else if (strcmp(filter, "gather") == 0) {
+				options.shadow_filter = ShadowFilter::Gather;
+			} else if (strcmp(filter, "pcf") == 0) {
+				options.shadow_filter = ShadowFilter::OptimizedPCF;
+			} else if (strcmp(filter, "poisson") == 0) {
+				options.shadow_filter = ShadowFilter::Poisson;
+			} else if (strcmp(filter, "vsm") == 0) {
+				options.shadow_filter = ShadowFilter::Variance;
+			} else if (strcmp(filter, "evsm") == 0) {
+				options.shadow_filter = ShadowFilter::ExponentialVariance;
+			} else {
+				std::cout << "Unknown shadow filter : " << filter << std::endl;
+			}
+		} else {
+			std::cout << "Unknown argument : " << argv[i] << std::endl;
+		}
+	}
+	return options;
+}
+
+GpuTimer::GpuTimer(size_t latency) : queries_(std::max<size_t>(latency, 1)), pending_(queries_.size(), false) {
+	glGenQueries(static_cast<GLsizei>(queries_.size()), queries_.data());
+}
+
+GpuTimer::~GpuTimer() {
+	glDeleteQueries(static_cast<GLsizei>(queries_.size()), queries_.data());
+}
+
+void GpuTimer::begin() {
+	// the slot about to be reused was issued `latency` frames ago
+	collect(current_);
+	glBeginQuery(GL_TIME_ELAPSED, queries_[current_]);
+}
+
+void GpuTimer::end() {
+	glEndQuery(GL_TIME_ELAPSED);
+	pending_[current_] = true;
+	current_ = (current_ + 1) % queries_.size();
+}
+
+void GpuTimer::flush() {
+	// oldest first, to keep samples in frame order
+	for (size_t i = 0; i < queries_.size(); ++i) {
+		collect((current_ + i) % queries_.size());
+	}
+}
+
+void GpuTimer::collect(size_t slot) {
+	if (!pending_[slot]) return;
+	GLuint64 elapsed_ns = 0;
+	glGetQueryObjectui64v(queries_[slot], GL_QUERY_RESULT, &elapsed_ns);
+	samples_ms_.push_back(static_cast<double>(elapsed_ns) / 1.0e6);
+	pending_[slot] = false;
+}
+
+std::map<std::string, double> FrameCounters::averages() const {
+	std::map<std::string, double> averages;
+	for (const auto& iter : sums_) {
+		averages[iter.first] = frames_ ? iter.second / frames_ : 0.0;
+	}
+	return averages;
+}
+
+FrameTimeSummary summarizeFrameTimes(std::vector<double> samples_ms) {
+	FrameTimeSummary summary;
+	if (samples_ms.empty()) return summary;
+
+	std::sort(samples_ms.begin(), samples_ms.end());
+	// nearest-rank percentile
+	auto percentile = [&samples_ms](double p) {
+		size_t rank = static_cast<size_t>(std::ceil(p / 100.0 * samples_ms.size()));
+		return samples_ms[std::min(std::max<size_t>(rank, 1), samples_ms.size()) - 1];
+	};
+	summary.min = samples_ms.front();
+	summary.max = samples_ms.back();
+	summary.mean = std::accumulate(samples_ms.begin(), samples_ms.end(), 0.0) / samples_ms.size();
+	summary.p50 = percentile(50.0);
+	summary.p95 = percentile(95.0);
+	summary.p99 = percentile(99.0);
+	return summary;
+}
+
+static std::string jsonString(const char* str) {
+	std::string out = "\"";
+	for (; str && *str; ++str) {
+		if (*str == '"' || *str == '\\') out += '\\';
+		out += *str;
+	}
+	return out + "\"";
+}
+
+static void writeSummary(std::ostream& os, const char* name, const std::vector<double>& samples_ms) {
+	FrameTimeSummary s = summarizeFrameTimes(samples_ms);
+	os << "  \"" << name << "\": { \"samples\": " << samples_ms.size()
+		<< ", \"min\": " << s.min << ", \"max\": " << s.max << ", \"mean\": " << s.mean
+		<< ", \"p50\": " << s.p50 << ", \"p95\": " << s.p95 << ", \"p99\": " << s.p99 << " }";
+}
+
+static void writeObject(std::ostream& os, const char* name, const std::map<std::string, double>& values) {
+	os << "  \"" << name << "\": {";
+	const char* separator = " ";
+	for (const auto& iter : values) {
+		os << separator << jsonString(iter.first.c_str()) << ": " << iter.second;
+		separator = ", ";
+	}
+	os << " }";
+}
+
+bool writeBenchmarkReport(const BenchmarkOptions& options, int width, int height,
+	const std::vector<double>& cpu_ms, const std::vector<double>& gpu_ms, const FrameCounters& counters,
+	const std::map<std::string, double>& startup) {
+	std::ofstream file{ options.output };
+	if (!file) {
+		std::cout << "Benchmark : failed to open " << options.output << std::endl;
+		return false;
+	}
+
+	file << "{\n";
+	file << "  \"renderer\": " << jsonString(reinterpret_cast<const char*>(glGetString(GL_RENDERER))) << ",\n";
+	file << "  \"version\": " << jsonString(reinterpret_cast<const char*>(glGetString(GL_VERSION))) << ",\n";
+	file << "  \"width\": " << width << ",\n";
+	file << "  \"height\": " << height << ",\n";
+	file << "  \"warmup\": " << options.warmup << ",\n";
+	file << "  \"frames\": " << options.frames << ",\n";
+	writeSummary(file, "cpu_ms", cpu_ms);
+	file << ",\n";
+	writeSummary(file, "gpu_ms", gpu_ms);
+	file << ",\n";
+	writeObject(file, "startup", startup);
+	file << ",\n";
+	writeObject(file, "counters_per_frame", counters.averages());
+	file << "\n}\n";
+	return true;
+}
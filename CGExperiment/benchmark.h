@@ -0,0 +1,91 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+#include <glad/glad.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+// Command line switches of the frame-time harness:
+//   --headless         render into an offscreen FBO through a hidden window
+//   --frames <n>       number of measured frames
+//   --warmup <n>       frames rendered before measuring starts
+//   --output <file>    where the JSON report is written
+//   --instances <n>    extra cubes added to the scene to stress draw submission
+//   --lights <n>       dynamic point/spot lights, shaded through clustered lighting
+//   --no-program-cache compile every program from source (cold start)
+//   --shadow-filter <f> hardware, gather, pcf, poisson, vsm or evsm (see shaders/shadow.glsl)
+// values of the SHADOW_FILTER define in shaders/shadow.glsl
+enum class ShadowFilter {
+	Hardware = 0,
+	Gather = 1,
+	OptimizedPCF = 2,
+	Poisson = 3,
+	Variance = 4,
+	ExponentialVariance = 5,
+};
+
+struct BenchmarkOptions {
+	bool headless = false;
+	int frames = 600;
+	int warmup = 60;
+	std::string output = "benchmark.json";
+	int instances = 0;
+	int lights = 0;
+	bool program_cache = true;
+	ShadowFilter shadow_filter = ShadowFilter::OptimizedPCF;
+
+	static BenchmarkOptions parse(int argc, char** argv);
+};
+
+// GL_TIME_ELAPSED queries kept in a small ring. A query result is read back
+// `latency` frames after it was issued, so collecting never stalls the GPU.
+class GpuTimer {
+public:
+	explicit GpuTimer(size_t latency = 4);
+	GpuTimer(const GpuTimer&) = delete;
+	GpuTimer& operator=(const GpuTimer&) = delete;
+	~GpuTimer();
+
+	void begin();
+	void end();
+	/// read back every outstanding query, blocking if necessary
+	void flush();
+
+	const std::vector<double>& samples() const { return samples_ms_; }
+
+private:
+	void collect(size_t slot);
+
+	std::vector<GLuint> queries_;
+	std::vector<bool> pending_;
+	size_t current_ = 0;
+	std::vector<double> samples_ms_;
+};
+
+// Per-frame counters (ring buffer bytes, fence waits, ...) averaged over the measured frames.
+class FrameCounters {
+public:
+	void add(const std::string& name, double value) { sums_[name] += value; }
+	void endFrame() { ++frames_; }
+
+	std::map<std::string, double> averages() const;
+
+private:
+	std::map<std::string, double> sums_;
+	int frames_ = 0;
+};
+
+struct FrameTimeSummary {
+	double min = 0.0, max = 0.0, mean = 0.0;
+	double p50 = 0.0, p95 = 0.0, p99 = 0.0;
+};
+
+FrameTimeSummary summarizeFrameTimes(std::vector<double> samples_ms);
+
+// `startup` holds one-off measurements taken before the first frame (program link time, cache hits, ...)
+bool writeBenchmarkReport(const BenchmarkOptions& options, int width, int height,
+	const std::vector<double>& cpu_ms, const std::vector<double>& gpu_ms, const FrameCounters& counters,
+	const std::map<std::string, double>& startup);
+
+#endif // !BENCHMARK_H
@@ -0,0 +1,125 @@
+#include "clustered_lighting.h"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+// must match local_size_x in shaders/cluster_cull.comp
+const GLuint kCullGroupSize = 128;
+// average lights per cluster the index list is sized for
+const GLuint kAverageLightsPerCluster = 32;
+
+const GLuint kClusterDataBinding = 1;
+const GLuint kLightBinding = 1;
+const GLuint kBoundsBinding = 2;
+const GLuint kGridBinding = 3;
+const GLuint kIndexBinding = 4;
+} // namespace
+
+static_assert(sizeof(ClusteredLighting::Light) == 48, "lights are copied as-is into a std430 Light[]");
+
+ClusteredLighting::ClusteredLighting(gl460::ProgramVariantCache& programs, int tile_size, int slices,
+	int max_lights_per_cluster)
+	: tile_size_(tile_size), slices_(slices) {
+	gl460::ShaderDefines defines;
+	defines.set("MAX_LIGHTS_PER_CLUSTER", max_lights_per_cluster);
+	cull_program_ = &programs.get({ {gl460::ShaderType::Compute, "shaders/cluster_cull.comp"} }, defines);
+}
+
+void ClusteredLighting::track(gl460::ProgramReloader& reloader) {
+	reloader.track(*cull_program_);
+}
+
+void ClusteredLighting::setProjection(int width, int height, float fov_y, float near_plane, float far_plane) {
+	if (width == width_ && height == height_ && fov_y == fov_y_ && near_plane == near_ && far_plane == far_) return;
+	width_ = width;
+	height_ = height;
+	fov_y_ = fov_y;
+	near_ = near_plane;
+	far_ = far_plane;
+	buildBounds();
+}
+
+void ClusteredLighting::buildBounds() {
+	const glm::ivec3 grid((width_ + tile_size_ - 1) / tile_size_, (height_ + tile_size_ - 1) / tile_size_, slices_);
+	const size_t count = static_cast<size_t>(grid.x) * grid.y * grid.z;
+	const float tan_y = std::tan(fov_y_ * 0.5f);
+	const float tan_x = tan_y * width_ / height_;
+
+	// view-space AABB of every cluster: the tile's side planes between the
+	// slice's near and far depth, slices spaced exponentially
+	std::vector<glm::vec4> bounds(2 * count);
+	for (int z = 0; z < grid.z; ++z) {
+		const float depth_near = near_ * std::pow(far_ / near_, static_cast<float>(z) / grid.z);
+		const float depth_far = near_ * std::pow(far_ / near_, static_cast<float>(z + 1) / grid.z);
+		for (int y = 0; y < grid.y; ++y) {
+			const float ndc_y0 = 2.0f * y * tile_size_ / height_ - 1.0f;
+			const float ndc_y1 = std::min(2.0f * (y + 1) * tile_size_ / height_ - 1.0f, 1.0f);
+			for (int x = 0; x < grid.x; ++x) {
+				const float ndc_x0 = 2.0f * x * tile_size_ / width_ - 1.0f;
+				const float ndc_x1 = std::min(2.0f * (x + 1) * tile_size_ / width_ - 1.0f, 1.0f);
+				glm::vec3 lower(1e30f), upper(-1e30f);
+				for (float depth : { depth_near, depth_far }) {
+					for (float ndc_x : { ndc_x0, ndc_x1 }) {
+						for (float ndc_y : { ndc_y0, ndc_y1 }) {
+							const glm::vec3 corner(ndc_x * depth * tan_x, ndc_y * depth * tan_y, -depth);
+							lower = glm::min(lower, corner);
+							upper = glm::max(upper, corner);
+						}
+					}
+				}
+				const size_t index = x + grid.x * (y + grid.y * static_cast<size_t>(z));
+				bounds[2 * index] = glm::vec4(lower, 0.0f);
+				bounds[2 * index + 1] = glm::vec4(upper, 0.0f);
+			}
+		}
+	}
+
+	if (grid != grid_) {
+		grid_ = grid;
+		index_capacity_ = static_cast<GLuint>(count) * kAverageLightsPerCluster;
+		light_grid_ = gl460::Buffer(count * sizeof(GLuint) * 2, nullptr, 0);
+		// the allocation counter comes first
+		light_indices_ = gl460::Buffer((1 + static_cast<GLsizeiptr>(index_capacity_)) * sizeof(GLuint), nullptr, 0);
+		bounds_ = gl460::Buffer(bounds.size() * sizeof(glm::vec4), bounds.data());
+	} else {
+		bounds_.subData(0, bounds.size() * sizeof(glm::vec4), bounds.data());
+	}
+	stats_.clusters = static_cast<uint32_t>(count);
+}
+
+void ClusteredLighting::cull(const std::vector<Light>& lights, gl460::RingBuffer& ring, gl460::StateCache& state) {
+	stats_.lights = static_cast<uint32_t>(lights.size());
+	if (!grid_.x) return;
+
+	block_.clear();
+	block_.write(static_cast<GLint>(grid_.x));
+	block_.write(static_cast<GLint>(grid_.y));
+	block_.write(static_cast<GLint>(grid_.z));
+	block_.write(static_cast<GLint>(tile_size_));
+	// slice = floor(log(depth / near) / log(far / near) * slices)
+	const float scale = grid_.z / std::log(far_ / near_);
+	block_.write(glm::vec4(scale, -std::log(near_) * scale, static_cast<float>(index_capacity_), 0.0f));
+	block_.finish();
+	auto cluster_data = ring.upload(block_.data(), block_.size(), gl460::RingBuffer::uniformAlignment());
+	if (!cluster_data) return;
+	ring.bindRange(gl460::BufferTarget::Uniform, kClusterDataBinding, cluster_data);
+	bounds_.bindBase(gl460::BufferTarget::ShaderStorage, kBoundsBinding);
+	light_grid_.bindBase(gl460::BufferTarget::ShaderStorage, kGridBinding);
+	light_indices_.bindBase(gl460::BufferTarget::ShaderStorage, kIndexBinding);
+
+	// an empty range cannot be bound; with no lights (or no program yet) every
+	// cluster gets an empty range and the lights buffer is never read
+	auto light_data = lights.empty() ? gl460::RingBuffer::Allocation()
+		: ring.upload(lights.data(), lights.size() * sizeof(Light), gl460::RingBuffer::storageAlignment());
+	const GLuint zero = 0;
+	glClearNamedBufferSubData(light_indices_.id(), GL_R32UI, 0, sizeof(GLuint), GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+	if (!light_data || !ready()) {
+		glClearNamedBufferData(light_grid_.id(), GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+		return;
+	}
+	ring.bindRange(gl460::BufferTarget::ShaderStorage, kLightBinding, light_data);
+	state.useProgram(cull_program_->id());
+	glDispatchCompute((stats_.clusters + kCullGroupSize - 1) / kCullGroupSize, 1, 1);
+	// the lit pass reads the grid and the indices as storage buffers
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+}
@@ -0,0 +1,75 @@
+#ifndef CLUSTERED_LIGHTING_H
+#define CLUSTERED_LIGHTING_H
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include "gl460/block_layout.h"
+#include "gl460/buffer.h"
+#include "gl460/program_reloader.h"
+#include "gl460/program_variants.h"
+#include "gl460/ring_buffer.h"
+#include "gl460/state_cache.h"
+
+#include <cstdint>
+#include <vector>
+
+// Clustered forward lighting for point and spot lights. The view frustum is
+// cut into screen tiles x exponentially spaced depth slices; a compute pass
+// (shaders/cluster_cull.comp) bins the lights into those clusters every
+// frame, and the lit pass only shades the lights of the fragment's cluster
+// (shaders/clusters.glsl). Bindings: ClusterData uniform 1; storage 1 lights,
+// 2 cluster bounds, 3 light grid, 4 light indices.
+class ClusteredLighting {
+public:
+	// matches struct Light in shaders/clusters.glsl (std430)
+	struct Light {
+		glm::vec3 position;
+		float range = 1.0f;
+		glm::vec3 color;
+		float cos_inner = -1.0f;
+		glm::vec3 direction = glm::vec3(0.0f, -1.0f, 0.0f);
+		float cos_outer = -2.0f;	// point light: every direction is inside the cone
+	};
+
+	struct Stats {
+		uint32_t lights = 0;
+		uint32_t clusters = 0;
+	};
+
+	// the culling program is built through `programs`, which must outlive this
+	explicit ClusteredLighting(gl460::ProgramVariantCache& programs, int tile_size = 64, int slices = 24,
+		int max_lights_per_cluster = 64);
+	ClusteredLighting(const ClusteredLighting&) = delete;
+	ClusteredLighting& operator=(const ClusteredLighting&) = delete;
+
+	bool ready() const { return cull_program_->linked(); }
+	void track(gl460::ProgramReloader& reloader);
+
+	// rebuilds the cluster bounds when the viewport or the projection changed
+	void setProjection(int width, int height, float fov_y, float near_plane, float far_plane);
+
+	// uploads the lights and the cluster constants, binds everything the lit
+	// pass reads and dispatches the culling; the FrameData block must be bound
+	void cull(const std::vector<Light>& lights, gl460::RingBuffer& ring, gl460::StateCache& state);
+
+	const Stats& stats() const { return stats_; }
+
+private:
+	void buildBounds();
+
+	gl460::Program* cull_program_;
+	int tile_size_;
+	int slices_;
+
+	int width_ = 0, height_ = 0;
+	float fov_y_ = 0.0f, near_ = 0.0f, far_ = 0.0f;
+	glm::ivec3 grid_ = glm::ivec3(0);
+
+	gl460::Buffer bounds_;
+	gl460::Buffer light_grid_;
+	gl460::Buffer light_indices_;
+	GLuint index_capacity_ = 0;
+	gl460::BlockWriter<gl460::Std140> block_;
+	Stats stats_;
+};
+
+#endif // !CLUSTERED_LIGHTING_H
@@ -0,0 +1,85 @@
+#ifndef GL_BLOCK_LAYOUT_H
+#define GL_BLOCK_LAYOUT_H
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <cstring>
+#include <vector>
+
+namespace gl460 {
+/// Layout tags, see GLSL 4.60 spec 7.6.2.2 "Standard Uniform Block Layout".
+struct Std140 {
+	/// array elements and structures are rounded up to a vec4
+	static constexpr size_t kMinArrayAlignment = 16;
+};
+struct Std430 {
+	static constexpr size_t kMinArrayAlignment = 4;
+};
+
+/// Base alignment and size of a member type.
+template <typename T> struct BlockMember;
+template <> struct BlockMember<float> { static constexpr size_t alignment = 4, size = 4; };
+template <> struct BlockMember<GLint> { static constexpr size_t alignment = 4, size = 4; };
+template <> struct BlockMember<GLuint> { static constexpr size_t alignment = 4, size = 4; };
+template <> struct BlockMember<glm::vec2> { static constexpr size_t alignment = 8, size = 8; };
+template <> struct BlockMember<glm::vec3> { static constexpr size_t alignment = 16, size = 12; };
+template <> struct BlockMember<glm::vec4> { static constexpr size_t alignment = 16, size = 16; };
+/// column major: an array of four vec4 columns in both layouts
+template <> struct BlockMember<glm::mat4> { static constexpr size_t alignment = 16, size = 64; };
+
+/// Packs values into a CPU-side byte image of a uniform or storage block.
+/// Members are written in declaration order; each write returns its offset.
+template <typename Layout>
+class BlockWriter {
+public:
+	static constexpr size_t alignUp(size_t value, size_t alignment) {
+		return (value + alignment - 1) / alignment * alignment;
+	}
+
+	/// stride between consecutive elements of `T[]`
+	template <typename T>
+	static constexpr size_t arrayStride() {
+		return alignUp(BlockMember<T>::size, arrayAlignment<T>());
+	}
+
+	template <typename T>
+	size_t write(const T& value) {
+		return writeBytes(BlockMember<T>::alignment, &value, BlockMember<T>::size);
+	}
+
+	template <typename T>
+	size_t writeArray(const T* values, size_t count) {
+		const size_t offset = alignUp(data_.size(), arrayAlignment<T>());
+		const size_t stride = arrayStride<T>();
+		data_.resize(offset + stride * count, 0);
+		for (size_t i = 0; i < count; ++i) {
+			std::memcpy(&data_[offset + i * stride], &values[i], BlockMember<T>::size);
+		}
+		return offset;
+	}
+
+	/// pad the end of the block as if it were a structure
+	void finish() { data_.resize(alignUp(data_.size(), Layout::kMinArrayAlignment), 0); }
+	void clear() { data_.clear(); }
+
+	const void* data() const { return data_.data(); }
+	size_t size() const { return data_.size(); }
+
+private:
+	template <typename T>
+	static constexpr size_t arrayAlignment() {
+		return BlockMember<T>::alignment > Layout::kMinArrayAlignment ? BlockMember<T>::alignment : Layout::kMinArrayAlignment;
+	}
+
+	size_t writeBytes(size_t alignment, const void* bytes, size_t size) {
+		const size_t offset = alignUp(data_.size(), alignment);
+		data_.resize(offset + size, 0);
+		std::memcpy(&data_[offset], bytes, size);
+		return offset;
+	}
+
+	std::vector<unsigned char> data_;
+};
+} // namespace gl460
+
+#endif // !GL_BLOCK_LAYOUT_H
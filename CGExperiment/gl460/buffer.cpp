@@ -0,0 +1,39 @@
+#include "buffer.h"
+#include <utility>
+
+namespace gl460 {
+
+Buffer::Buffer(GLsizeiptr size, const void* data, GLbitfield flags) : size_(size) {
+	glCreateBuffers(1, &id_);
+	glNamedBufferStorage(id_, size, data, flags);
+}
+
+Buffer::Buffer(Buffer&& other) noexcept : id_(other.id_), size_(other.size_) {
+	other.id_ = 0;
+	other.size_ = 0;
+}
+
+Buffer& Buffer::operator=(Buffer&& other) noexcept {
+	std::swap(id_, other.id_);
+	std::swap(size_, other.size_);
+	return *this;
+}
+
+Buffer::~Buffer() {
+	if (id_) {
+		glDeleteBuffers(1, &id_);
+	}
+}
+
+void Buffer::subData(GLintptr offset, GLsizeiptr size, const void* data) {
+	glNamedBufferSubData(id_, offset, size, data);
+}
+
+void Buffer::bindBase(BufferTarget target, GLuint index) const {
+	glBindBufferBase(static_cast<GLenum>(target), index, id_);
+}
+
+void Buffer::bindRange(BufferTarget target, GLuint index, GLintptr offset, GLsizeiptr size) const {
+	glBindBufferRange(static_cast<GLenum>(target), index, id_, offset, size);
+}
+} // namespace gl460
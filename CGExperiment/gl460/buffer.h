@@ -0,0 +1,42 @@
+#ifndef GL_BUFFER_H
+#define GL_BUFFER_H
+#include <glad/glad.h>
+
+namespace gl460 {
+enum class BufferTarget : GLenum {
+	Array = GL_ARRAY_BUFFER,
+	ElementArray = GL_ELEMENT_ARRAY_BUFFER,
+	Uniform = GL_UNIFORM_BUFFER,
+	ShaderStorage = GL_SHADER_STORAGE_BUFFER,
+	DrawIndirect = GL_DRAW_INDIRECT_BUFFER
+};
+
+/// Immutable-storage buffer object created with DSA (glCreateBuffers/glNamedBufferStorage).
+class Buffer {
+public:
+	explicit Buffer() noexcept {}
+	explicit Buffer(GLsizeiptr size, const void* data = nullptr, GLbitfield flags = GL_DYNAMIC_STORAGE_BIT);
+	Buffer(const Buffer&) = delete;
+	Buffer(Buffer&& other) noexcept;
+
+	~Buffer();
+
+	Buffer& operator=(const Buffer&) = delete;
+	Buffer& operator=(Buffer&& other) noexcept;
+
+	GLuint id() const { return id_; }
+	GLsizeiptr size() const { return size_; }
+
+	/// requires GL_DYNAMIC_STORAGE_BIT
+	void subData(GLintptr offset, GLsizeiptr size, const void* data);
+
+	void bindBase(BufferTarget target, GLuint index) const;
+	void bindRange(BufferTarget target, GLuint index, GLintptr offset, GLsizeiptr size) const;
+
+private:
+	GLuint id_ = 0;
+	GLsizeiptr size_ = 0;
+};
+} // namespace gl460
+
+#endif // !GL_BUFFER_H
@@ -0,0 +1,79 @@
+#include "compile_queue.h"
+#include "extensions.h"
+#include <iostream>
+#include <utility>
+
+namespace gl460 {
+
+namespace {
+typedef void (APIENTRYP PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)(GLuint count);
+PFNGLMAXSHADERCOMPILERTHREADSKHRPROC glMaxShaderCompilerThreadsKHR = nullptr;
+bool parallel_compile_supported = false;
+} // namespace
+
+bool loadParallelShaderCompile(GLADloadproc load) {
+	parallel_compile_supported = false;
+	if (hasExtension("GL_KHR_parallel_shader_compile")) {
+		glMaxShaderCompilerThreadsKHR = reinterpret_cast<PFNGLMAXSHADERCOMPILERTHREADSKHRPROC>(load("glMaxShaderCompilerThreadsKHR"));
+	} else if (hasExtension("GL_ARB_parallel_shader_compile")) {
+		// same enums, the entry point only differs in its suffix
+		glMaxShaderCompilerThreadsKHR = reinterpret_cast<PFNGLMAXSHADERCOMPILERTHREADSKHRPROC>(load("glMaxShaderCompilerThreadsARB"));
+	}
+	if (glMaxShaderCompilerThreadsKHR) {
+		// 0xFFFFFFFF: implementation-defined maximum
+		glMaxShaderCompilerThreadsKHR(0xFFFFFFFFu);
+		parallel_compile_supported = true;
+	}
+	return parallel_compile_supported;
+}
+
+bool parallelShaderCompileSupported() {
+	return parallel_compile_supported;
+}
+
+void CompileQueue::submit(Program& program, ProgramBinaryCache* cache, ReadyCallback on_ready) {
+	Pending pending{ &program, std::move(on_ready) };
+	program.linkAsync(cache);
+	// a binary cache hit is already done, no need to wait a frame
+	if (program.linkStatus() != Program::LinkStatus::Pending) {
+		complete(pending);
+		return;
+	}
+	pending_.push_back(std::move(pending));
+}
+
+size_t CompileQueue::poll(size_t max_finish) {
+	// take the ready programs out first: a callback may submit() more, which
+	// must not reallocate pending_ under it
+	std::vector<Pending> ready;
+	for (size_t i = 0; i < pending_.size() && ready.size() < max_finish;) {
+		if (!pending_[i].program->completionReady()) {
+			++i;
+			continue;
+		}
+		ready.push_back(std::move(pending_[i]));
+		pending_.erase(pending_.begin() + i);
+	}
+	for (auto& pending : ready) {
+		complete(pending);
+	}
+	return ready.size();
+}
+
+void CompileQueue::finishAll() {
+	// programs submitted from callbacks join pending_ and get the next round
+	while (!pending_.empty()) {
+		std::vector<Pending> batch;
+		batch.swap(pending_);
+		for (auto& pending : batch) {
+			complete(pending);
+		}
+	}
+}
+
+void CompileQueue::complete(Pending& pending) {
+	if (pending.program->finishLink() && pending.on_ready) {
+		pending.on_ready(*pending.program);
+	}
+}
+} // namespace gl460
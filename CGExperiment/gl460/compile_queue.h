@@ -0,0 +1,57 @@
+#ifndef GL_COMPILE_QUEUE_H
+#define GL_COMPILE_QUEUE_H
+#include <glad/glad.h>
+#include "program.h"
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+// GL_KHR_parallel_shader_compile, not part of the generated glad loader
+#ifndef GL_MAX_SHADER_COMPILER_THREADS_KHR
+#define GL_MAX_SHADER_COMPILER_THREADS_KHR 0x91B0
+#endif
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+
+namespace gl460 {
+/// Loads GL_KHR_parallel_shader_compile if the driver has it and lets it use
+/// as many compiler threads as it wants. Call once after gladLoadGLLoader.
+bool loadParallelShaderCompile(GLADloadproc load);
+/// true when GL_COMPLETION_STATUS_KHR can be polled
+bool parallelShaderCompileSupported();
+
+/// Programs submitted here are compiled and linked without waiting on the
+/// driver. poll() once per frame finishes the ones whose completion status
+/// reports done and runs their callback; until then the caller renders with
+/// a fallback. Without the extension every program is finished on the first
+/// poll(), which blocks like a plain link().
+class CompileQueue {
+public:
+	using ReadyCallback = std::function<void(Program&)>;
+
+	/// the program must outlive its stay in the queue
+	void submit(Program& program, ProgramBinaryCache* cache = nullptr, ReadyCallback on_ready = {});
+
+	/// finishes at most `max_finish` ready programs, returns how many finished
+	size_t poll(size_t max_finish = SIZE_MAX);
+	/// blocks until everything submitted is finished, including programs
+	/// submitted from the callbacks
+	void finishAll();
+
+	size_t pending() const { return pending_.size(); }
+
+private:
+	struct Pending {
+		Program* program;
+		ReadyCallback on_ready;
+	};
+
+	static void complete(Pending& pending);
+
+	std::vector<Pending> pending_;
+};
+} // namespace gl460
+
+#endif // !GL_COMPILE_QUEUE_H
@@ -0,0 +1,170 @@
+#include "draw_list.h"
+#include "block_layout.h"
+#include <algorithm>
+#include <cstddef>
+#include <iostream>
+#include <map>
+
+namespace gl460 {
+
+static_assert(sizeof(glm::mat4) == BlockWriter<Std430>::arrayStride<glm::mat4>(),
+	"transforms are copied as-is into a std430 mat4[]");
+
+MeshPool::~MeshPool() {
+	if (vao_) {
+		glDeleteVertexArrays(1, &vao_);
+	}
+}
+
+MeshHandle MeshPool::add(const std::vector<Vertex>& vertices, const std::vector<GLuint>& indices) {
+	if (vao_) {
+		std::cout << "MeshPool::add : pool already uploaded" << std::endl;
+		return {};
+	}
+	MeshHandle mesh;
+	mesh.id = mesh_count_++;
+	mesh.index_count = static_cast<GLuint>(indices.size());
+	mesh.first_index = static_cast<GLuint>(indices_.size());
+	mesh.base_vertex = static_cast<GLint>(vertices_.size());
+	if (!vertices.empty()) {
+		glm::vec3 lower = vertices.front().position, upper = lower;
+		for (const auto& vertex : vertices) {
+			lower = glm::min(lower, vertex.position);
+			upper = glm::max(upper, vertex.position);
+		}
+		mesh.center = (lower + upper) * 0.5f;
+		for (const auto& vertex : vertices) {
+			mesh.radius = std::max(mesh.radius, glm::distance(mesh.center, vertex.position));
+		}
+	}
+	vertices_.insert(vertices_.end(), vertices.begin(), vertices.end());
+	indices_.insert(indices_.end(), indices.begin(), indices.end());
+	return mesh;
+}
+
+MeshHandle MeshPool::addTriangles(const float* interleaved, GLsizei vertex_count) {
+	std::vector<Vertex> vertices;
+	std::vector<GLuint> indices;
+	std::map<std::vector<float>, GLuint> unique;
+	for (GLsizei i = 0; i < vertex_count; ++i) {
+		const float* v = interleaved + i * 8;
+		auto inserted = unique.emplace(std::vector<float>(v, v + 8), static_cast<GLuint>(vertices.size()));
+		if (inserted.second) {
+			Vertex vertex;
+			vertex.position = glm::vec3(v[0], v[1], v[2]);
+			vertex.normal = glm::vec3(v[3], v[4], v[5]);
+			vertex.tex_coords = glm::vec2(v[6], v[7]);
+			vertices.push_back(vertex);
+		}
+		indices.push_back(inserted.first->second);
+	}
+	return add(vertices, indices);
+}
+
+void MeshPool::upload(GLuint max_instances) {
+	max_instances_ = max_instances;
+	vertex_buffer_ = Buffer(vertices_.size() * sizeof(Vertex), vertices_.data(), 0);
+	index_buffer_ = Buffer(indices_.size() * sizeof(GLuint), indices_.data(), 0);
+	std::vector<GLuint> draw_ids(max_instances_);
+	for (GLuint i = 0; i < max_instances_; ++i) {
+		draw_ids[i] = i;
+	}
+	draw_id_buffer_ = Buffer(draw_ids.size() * sizeof(GLuint), draw_ids.data(), 0);
+
+	glCreateVertexArrays(1, &vao_);
+	glVertexArrayVertexBuffer(vao_, 0, vertex_buffer_.id(), 0, sizeof(Vertex));
+	glVertexArrayElementBuffer(vao_, index_buffer_.id());
+	glVertexArrayAttribFormat(vao_, 0, 3, GL_FLOAT, GL_FALSE, offsetof(Vertex, position));
+	glVertexArrayAttribFormat(vao_, 1, 3, GL_FLOAT, GL_FALSE, offsetof(Vertex, normal));
+	glVertexArrayAttribFormat(vao_, 2, 2, GL_FLOAT, GL_FALSE, offsetof(Vertex, tex_coords));
+	for (GLuint attrib = 0; attrib < 3; ++attrib) {
+		glVertexArrayAttribBinding(vao_, attrib, 0);
+		glEnableVertexArrayAttrib(vao_, attrib);
+	}
+
+	glVertexArrayVertexBuffer(vao_, 1, draw_id_buffer_.id(), 0, sizeof(GLuint));
+	glVertexArrayBindingDivisor(vao_, 1, 1);
+	glVertexArrayAttribIFormat(vao_, 3, 1, GL_UNSIGNED_INT, 0);
+	glVertexArrayAttribBinding(vao_, 3, 1);
+	glEnableVertexArrayAttrib(vao_, 3);
+
+	vertices_.clear();
+	vertices_.shrink_to_fit();
+	indices_.clear();
+	indices_.shrink_to_fit();
+}
+
+void DrawList::clear() {
+	items_.clear();
+	commands_.clear();
+	transforms_.clear();
+}
+
+void DrawList::add(const MeshHandle& mesh, const glm::mat4& model) {
+	items_.push_back({ mesh, model });
+}
+
+void DrawList::addVisible(const DrawList& source, const Frustum& frustum, bool test_near) {
+	for (const Item& item : source.items_) {
+		const glm::vec3 center = glm::vec3(item.model * glm::vec4(item.mesh.center, 1.0f));
+		// the largest axis scale keeps the sphere conservative under non-uniform scaling
+		const float scale = std::max(glm::length(glm::vec3(item.model[0])),
+			std::max(glm::length(glm::vec3(item.model[1])), glm::length(glm::vec3(item.model[2]))));
+		if (frustum.intersects(center, item.mesh.radius * scale, test_near)) {
+			items_.push_back(item);
+		}
+	}
+}
+
+void DrawList::build() {
+	commands_.clear();
+	transforms_.clear();
+	std::stable_sort(items_.begin(), items_.end(),
+		[](const Item& a, const Item& b) { return a.mesh.id < b.mesh.id; });
+
+	transforms_.reserve(items_.size());
+	for (size_t i = 0; i < items_.size(); ++i) {
+		const Item& item = items_[i];
+		if (i == 0 || item.mesh.id != items_[i - 1].mesh.id) {
+			DrawElementsIndirectCommand command;
+			command.count = item.mesh.index_count;
+			command.instance_count = 0;
+			command.first_index = item.mesh.first_index;
+			command.base_vertex = item.mesh.base_vertex;
+			command.base_instance = static_cast<GLuint>(transforms_.size());
+			commands_.push_back(command);
+		}
+		++commands_.back().instance_count;
+		transforms_.push_back(item.model);
+	}
+}
+
+void DrawList::upload(RingBuffer& ring, GLuint transform_binding) {
+	indirect_buffer_ = 0;
+	if (commands_.empty()) return;
+
+	auto transforms = ring.upload(transforms_.data(), transforms_.size() * sizeof(glm::mat4), RingBuffer::storageAlignment());
+	auto commands = ring.upload(commands_.data(), commands_.size() * sizeof(DrawElementsIndirectCommand));
+	if (!transforms || !commands) return;
+
+	transform_binding_ = transform_binding;
+	transform_range_ = transforms;
+	indirect_buffer_ = ring.id();
+	indirect_offset_ = commands.offset;
+}
+
+void DrawList::draw(const MeshPool& pool, StateCache& state) const {
+	if (!indirect_buffer_) return;
+	if (transforms_.size() > pool.maxInstances()) {
+		std::cout << "DrawList::draw : " << transforms_.size() << " instances exceed the pool's draw IDs" << std::endl;
+		return;
+	}
+	// several lists share the binding point, so every draw binds its own range
+	glBindBufferRange(GL_SHADER_STORAGE_BUFFER, transform_binding_, indirect_buffer_,
+		transform_range_.offset, transform_range_.size);
+	state.bindVertexArray(pool.vao());
+	state.bindBuffer(GL_DRAW_INDIRECT_BUFFER, indirect_buffer_);
+	glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, reinterpret_cast<const void*>(indirect_offset_),
+		static_cast<GLsizei>(commands_.size()), 0);
+}
+} // namespace gl460
@@ -0,0 +1,112 @@
+#ifndef GL_DRAW_LIST_H
+#define GL_DRAW_LIST_H
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include "buffer.h"
+#include "frustum.h"
+#include "ring_buffer.h"
+#include "state_cache.h"
+
+#include <vector>
+
+namespace gl460 {
+/// Interleaved vertex of the static meshes: position, normal, texcoords.
+struct Vertex {
+	glm::vec3 position;
+	glm::vec3 normal;
+	glm::vec2 tex_coords;
+};
+
+/// Layout of one glMultiDrawElementsIndirect command.
+struct DrawElementsIndirectCommand {
+	GLuint count;
+	GLuint instance_count;
+	GLuint first_index;
+	GLint base_vertex;
+	GLuint base_instance;
+};
+
+struct MeshHandle {
+	GLuint id = 0;
+	GLuint index_count = 0;
+	GLuint first_index = 0;
+	GLint base_vertex = 0;
+	/// bounding sphere in model space
+	glm::vec3 center = glm::vec3(0.0f);
+	float radius = 0.0f;
+};
+
+/// Every static mesh lives in one shared vertex/index buffer behind a single
+/// VAO, so any mix of meshes can be submitted by one multi-draw call.
+/// Attribute 3 is an instanced uint (0..max_instances-1); offset by a command's
+/// base instance it gives each instance its index into the transform SSBO.
+class MeshPool {
+public:
+	MeshPool() = default;
+	MeshPool(const MeshPool&) = delete;
+	MeshPool& operator=(const MeshPool&) = delete;
+	~MeshPool();
+
+	MeshHandle add(const std::vector<Vertex>& vertices, const std::vector<GLuint>& indices);
+	/// non-indexed triangle list of interleaved pos3/normal3/uv2 floats; duplicate vertices are merged
+	MeshHandle addTriangles(const float* interleaved, GLsizei vertex_count);
+
+	/// creates the GPU buffers and the VAO, no mesh can be added afterwards;
+	/// the pool then draws lists of up to `max_instances` instances
+	void upload(GLuint max_instances);
+
+	GLuint vao() const { return vao_; }
+	GLuint maxInstances() const { return max_instances_; }
+
+private:
+	GLuint max_instances_ = 0;
+	GLuint mesh_count_ = 0;
+	std::vector<Vertex> vertices_;
+	std::vector<GLuint> indices_;
+
+	GLuint vao_ = 0;
+	Buffer vertex_buffer_;
+	Buffer index_buffer_;
+	Buffer draw_id_buffer_;
+};
+
+/// Per-frame list of mesh instances. build() groups instances by mesh into one
+/// indirect command each; the same commands and transforms are uploaded once
+/// and then replayed by every pass (shadow, lit, ...).
+class DrawList {
+public:
+	void clear();
+	void add(const MeshHandle& mesh, const glm::mat4& model);
+	/// adds the instances of `source` whose bounding sphere touches the frustum
+	void addVisible(const DrawList& source, const Frustum& frustum, bool test_near = true);
+
+	void build();
+
+	/// uploads commands and transforms into the ring
+	void upload(RingBuffer& ring, GLuint transform_binding);
+	/// binds the list's transforms SSBO range, then one glMultiDrawElementsIndirect
+	/// for the whole list
+	void draw(const MeshPool& pool, StateCache& state) const;
+
+	const std::vector<DrawElementsIndirectCommand>& commands() const { return commands_; }
+	const std::vector<glm::mat4>& transforms() const { return transforms_; }
+	size_t instanceCount() const { return items_.size(); }
+
+private:
+	struct Item {
+		MeshHandle mesh;
+		glm::mat4 model;
+	};
+
+	std::vector<Item> items_;
+	std::vector<DrawElementsIndirectCommand> commands_;
+	std::vector<glm::mat4> transforms_;
+
+	GLuint indirect_buffer_ = 0;
+	GLintptr indirect_offset_ = 0;
+	GLuint transform_binding_ = 0;
+	RingBuffer::Allocation transform_range_;
+};
+} // namespace gl460
+
+#endif // !GL_DRAW_LIST_H
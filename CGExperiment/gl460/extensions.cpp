@@ -0,0 +1,24 @@
+#include "extensions.h"
+#include <cstring>
+
+namespace gl460 {
+
+bool hasExtension(const char* name) {
+	GLint count = 0;
+	glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+	for (GLint i = 0; i < count; ++i) {
+		const char* extension = reinterpret_cast<const char*>(glGetStringi(GL_EXTENSIONS, i));
+		if (extension && strcmp(extension, name) == 0) return true;
+	}
+	return false;
+}
+
+float maxAnisotropy() {
+	if (!hasExtension("GL_ARB_texture_filter_anisotropic") && !hasExtension("GL_EXT_texture_filter_anisotropic")) {
+		return 1.0f;
+	}
+	GLfloat max_anisotropy = 1.0f;
+	glGetFloatv(GL_MAX_TEXTURE_MAX_ANISOTROPY, &max_anisotropy);
+	return max_anisotropy;
+}
+} // namespace gl460
@@ -0,0 +1,21 @@
+#ifndef GL_EXTENSIONS_H
+#define GL_EXTENSIONS_H
+#include <glad/glad.h>
+
+// GL_ARB_texture_filter_anisotropic (core in 4.6), not part of the generated glad loader
+#ifndef GL_TEXTURE_MAX_ANISOTROPY
+#define GL_TEXTURE_MAX_ANISOTROPY 0x84FE
+#endif
+#ifndef GL_MAX_TEXTURE_MAX_ANISOTROPY
+#define GL_MAX_TEXTURE_MAX_ANISOTROPY 0x84FF
+#endif
+
+namespace gl460 {
+/// true when the current context lists `name` in GL_EXTENSIONS
+bool hasExtension(const char* name);
+
+/// largest GL_TEXTURE_MAX_ANISOTROPY the context accepts, 1 without the extension
+float maxAnisotropy();
+} // namespace gl460
+
+#endif // !GL_EXTENSIONS_H
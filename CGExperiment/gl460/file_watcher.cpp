@@ -0,0 +1,127 @@
+#include "file_watcher.h"
+#include <chrono>
+#include <filesystem>
+#include <iostream>
+#include <map>
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+namespace gl460 {
+
+FileWatcher::FileWatcher() {
+#ifdef __linux__
+	inotify_fd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (inotify_fd_ < 0) {
+		std::cout << "FileWatcher : inotify_init1 failed, shader reload is disabled" << std::endl;
+		return;
+	}
+#endif
+	thread_ = std::thread(&FileWatcher::run, this);
+}
+
+FileWatcher::~FileWatcher() {
+	stop_ = true;
+	if (thread_.joinable()) {
+		thread_.join();
+	}
+#ifdef __linux__
+	if (inotify_fd_ >= 0) {
+		close(inotify_fd_);
+	}
+#endif
+}
+
+std::string FileWatcher::normalize(const std::string& path) {
+	return std::filesystem::path(path).lexically_normal().generic_string();
+}
+
+void FileWatcher::watch(const std::string& path) {
+	const std::string file = normalize(path);
+	std::lock_guard<std::mutex> lock(mutex_);
+	if (!files_.insert(file).second) return;
+#ifdef __linux__
+	std::string directory = std::filesystem::path(file).parent_path().generic_string();
+	if (directory.empty()) directory = ".";
+	for (const auto& watched : directories_) {
+		if (watched.second == directory) return;
+	}
+	if (inotify_fd_ < 0) return;
+	const int wd = inotify_add_watch(inotify_fd_, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE);
+	if (wd < 0) {
+		std::cout << "FileWatcher : cannot watch " << directory << std::endl;
+		return;
+	}
+	directories_.push_back({ wd, directory });
+#endif
+}
+
+std::vector<std::string> FileWatcher::changes() {
+	std::lock_guard<std::mutex> lock(mutex_);
+	std::vector<std::string> changes(changed_.begin(), changed_.end());
+	changed_.clear();
+	return changes;
+}
+
+void FileWatcher::notify(const std::string& path) {
+	std::lock_guard<std::mutex> lock(mutex_);
+	if (files_.count(path)) {
+		changed_.insert(path);
+	}
+}
+
+#ifdef __linux__
+void FileWatcher::run() {
+	alignas(inotify_event) char buffer[4096];
+	while (!stop_) {
+		pollfd fd{ inotify_fd_, POLLIN, 0 };
+		// wake up regularly to see stop_
+		if (::poll(&fd, 1, 100) <= 0) continue;
+
+		const ssize_t length = read(inotify_fd_, buffer, sizeof(buffer));
+		for (ssize_t offset = 0; offset < length;) {
+			const inotify_event* event = reinterpret_cast<const inotify_event*>(buffer + offset);
+			offset += sizeof(inotify_event) + event->len;
+			if (!event->len) continue;
+
+			std::string directory;
+			{
+				std::lock_guard<std::mutex> lock(mutex_);
+				for (const auto& watched : directories_) {
+					if (watched.first == event->wd) directory = watched.second;
+				}
+			}
+			if (!directory.empty()) {
+				notify(normalize(directory + "/" + event->name));
+			}
+		}
+	}
+}
+#else
+void FileWatcher::run() {
+	std::map<std::string, std::filesystem::file_time_type> times;
+	while (!stop_) {
+		std::vector<std::string> files;
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			files.assign(files_.begin(), files_.end());
+		}
+		for (const auto& file : files) {
+			std::error_code error;
+			const auto time = std::filesystem::last_write_time(file, error);
+			if (error) continue;
+			auto iter = times.find(file);
+			if (iter == times.end()) {
+				times[file] = time;
+			} else if (iter->second != time) {
+				iter->second = time;
+				notify(file);
+			}
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(250));
+	}
+}
+#endif
+} // namespace gl460
@@ -0,0 +1,44 @@
+#ifndef GL_FILE_WATCHER_H
+#define GL_FILE_WATCHER_H
+#include <atomic>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace gl460 {
+/// Watches files from a background thread and collects the ones that changed.
+/// On Linux it uses inotify on the parent directories, so editors that save
+/// through a rename are seen as well; elsewhere it polls modification times.
+/// No GL calls, the owner drains changes() on its own thread.
+class FileWatcher {
+public:
+	explicit FileWatcher();
+	FileWatcher(const FileWatcher&) = delete;
+	FileWatcher& operator=(const FileWatcher&) = delete;
+	~FileWatcher();
+
+	void watch(const std::string& path);
+	/// changed files since the last call, normalized as by normalize()
+	std::vector<std::string> changes();
+
+	static std::string normalize(const std::string& path);
+
+private:
+	void run();
+	void notify(const std::string& path);
+
+	std::mutex mutex_;
+	std::set<std::string> files_;
+	std::set<std::string> changed_;
+	std::atomic<bool> stop_{ false };
+#ifdef __linux__
+	int inotify_fd_ = -1;
+	std::vector<std::pair<int, std::string>> directories_;	// watch descriptor, directory
+#endif
+	std::thread thread_;
+};
+} // namespace gl460
+
+#endif // !GL_FILE_WATCHER_H
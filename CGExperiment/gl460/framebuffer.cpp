@@ -0,0 +1,102 @@
+#include "framebuffer.h"
+#include <iostream>
+#include <utility>
+#include <vector>
+
+namespace gl460 {
+
+Framebuffer::Framebuffer(const Viewport& viewport) : id_(0), view_port_(viewport) {
+	glCreateFramebuffers(1, &id_);
+}
+
+Framebuffer::Framebuffer(Framebuffer&& other) noexcept : id_(other.id_), view_port_(other.view_port_) {
+	other.id_ = 0;
+}
+
+Framebuffer& Framebuffer::operator=(Framebuffer&& other) noexcept {
+	std::swap(id_, other.id_);
+	std::swap(view_port_, other.view_port_);
+	return *this;
+}
+
+Framebuffer::~Framebuffer() {
+	if (id_) {
+		glDeleteFramebuffers(1, &id_);
+	}
+}
+
+Framebuffer& Framebuffer::attach(GLenum attachment, const Texture& texture, GLint level) {
+	glNamedFramebufferTexture(id_, attachment, texture.id(), level);
+	return *this;
+}
+
+Framebuffer& Framebuffer::attachLayer(GLenum attachment, const Texture& texture, GLint layer, GLint level) {
+	glNamedFramebufferTextureLayer(id_, attachment, texture.id(), level, layer);
+	return *this;
+}
+
+Framebuffer& Framebuffer::detach(GLenum attachment) {
+	glNamedFramebufferTexture(id_, attachment, 0, 0);
+	return *this;
+}
+
+Framebuffer& Framebuffer::drawBuffers(std::initializer_list<ColorAttachment> attachments) {
+	if (attachments.size() == 0) {
+		glNamedFramebufferDrawBuffer(id_, GL_NONE);
+		glNamedFramebufferReadBuffer(id_, GL_NONE);
+		return *this;
+	}
+	std::vector<GLenum> buffers;
+	buffers.reserve(attachments.size());
+	for (const auto& attachment : attachments) {
+		buffers.push_back(static_cast<GLenum>(attachment));
+	}
+	glNamedFramebufferDrawBuffers(id_, static_cast<GLsizei>(buffers.size()), buffers.data());
+	glNamedFramebufferReadBuffer(id_, buffers.front());
+	return *this;
+}
+
+Framebuffer::Status Framebuffer::checkStatus(FramebufferTarget target) const {
+	return static_cast<Status>(glCheckNamedFramebufferStatus(id_, static_cast<GLenum>(target)));
+}
+
+bool Framebuffer::validate(const char* name) const {
+	const Status status = checkStatus(FramebufferTarget::ReadWrite);
+	if (status != Status::Complete) {
+		std::cout << "Framebuffer : " << name << " is not complete, status 0x" << std::hex
+			<< static_cast<GLenum>(status) << std::dec << std::endl;
+		return false;
+	}
+	return true;
+}
+
+Framebuffer& Framebuffer::clearColor(GLint draw_buffer, const glm::vec4& color) {
+	glClearNamedFramebufferfv(id_, GL_COLOR, draw_buffer, &color[0]);
+	return *this;
+}
+
+Framebuffer& Framebuffer::clearDepth(GLfloat depth) {
+	glClearNamedFramebufferfv(id_, GL_DEPTH, 0, &depth);
+	return *this;
+}
+
+Framebuffer& Framebuffer::clearDepthStencil(GLfloat depth, GLint stencil) {
+	glClearNamedFramebufferfi(id_, GL_DEPTH_STENCIL, 0, depth, stencil);
+	return *this;
+}
+
+void Framebuffer::bind(StateCache& state, FramebufferTarget target) const {
+	state.bindFramebuffer(static_cast<GLenum>(target), id_);
+	if (target != FramebufferTarget::Read) {
+		state.viewport(view_port_);
+	}
+}
+
+void Framebuffer::blit(const Framebuffer& source, const Framebuffer& dest, GLbitfield mask, GLenum filter) {
+	const Viewport& src = source.view_port_;
+	const Viewport& dst = dest.view_port_;
+	glBlitNamedFramebuffer(source.id_, dest.id_,
+		src.x, src.y, src.x + src.w, src.y + src.h,
+		dst.x, dst.y, dst.x + dst.w, dst.y + dst.h, mask, filter);
+}
+} // namespace gl460
@@ -3,10 +3,16 @@
 #include <glm/glm.hpp>
 #include <glad/glad.h>
 #include "common.h"
+#include "state_cache.h"
+#include "texture.h"
 
+#include <initializer_list>
+
+namespace gl460 {
+/// Framebuffer object driven through DSA: attaching, clearing and checking
+/// never touch the current binding. Only bind() changes context state.
 class Framebuffer {
 public:
-	//static void blit(Framebuffer& source, Framebuffer&dest, )
 	struct ColorAttachment{
 		GLenum attachment;
 		constexpr explicit ColorAttachment(uint32_t id) : attachment(GL_COLOR_ATTACHMENT0 + id) {}
@@ -15,7 +21,8 @@ public:
 
 	enum class FramebufferTarget : GLenum {
 		Read = GL_READ_FRAMEBUFFER,
-		Write = GL_DRAW_FRAMEBUFFER
+		Write = GL_DRAW_FRAMEBUFFER,
+		ReadWrite = GL_FRAMEBUFFER
 	};
 
 	enum class Status: GLenum{
@@ -29,7 +36,8 @@ public:
 		IncompleteLayerTargets		= GL_FRAMEBUFFER_INCOMPLETE_LAYER_TARGETS
 	};
 
-	explicit Framebuffer() noexcept { id_ = 0; }
+	/// the window's default framebuffer
+	explicit Framebuffer() noexcept : id_(0), view_port_{ 0, 0, 0, 0 } {}
 	explicit Framebuffer(const Viewport& viewport);
 	Framebuffer(const Framebuffer&) = delete;
 	Framebuffer(Framebuffer&& other) noexcept;
@@ -40,12 +48,37 @@ public:
 	Framebuffer& operator=(Framebuffer&& other) noexcept;
 
 	GLuint id() const { return id_; }
-	Status checkStatus(FramebufferTarget target);
-	Framebuffer& clearColor()
+	const Viewport& viewport() const { return view_port_; }
+	void setViewport(const Viewport& viewport) { view_port_ = viewport; }
+
+	Framebuffer& attach(GLenum attachment, const Texture& texture, GLint level = 0);
+	Framebuffer& attach(ColorAttachment attachment, const Texture& texture, GLint level = 0) {
+		return attach(static_cast<GLenum>(attachment), texture, level);
+	}
+	/// one layer of an array texture
+	Framebuffer& attachLayer(GLenum attachment, const Texture& texture, GLint layer, GLint level = 0);
+	Framebuffer& detach(GLenum attachment);
+
+	/// an empty list means depth only (GL_NONE for draw and read buffer)
+	Framebuffer& drawBuffers(std::initializer_list<ColorAttachment> attachments);
+
+	Status checkStatus(FramebufferTarget target) const;
+	/// logs the status and returns false if the framebuffer is not complete
+	bool validate(const char* name) const;
+
+	Framebuffer& clearColor(GLint draw_buffer, const glm::vec4& color);
+	Framebuffer& clearDepth(GLfloat depth = 1.0f);
+	Framebuffer& clearDepthStencil(GLfloat depth = 1.0f, GLint stencil = 0);
+
+	/// binds the framebuffer and sets its viewport
+	void bind(StateCache& state, FramebufferTarget target = FramebufferTarget::ReadWrite) const;
+
+	static void blit(const Framebuffer& source, const Framebuffer& dest, GLbitfield mask, GLenum filter = GL_NEAREST);
 
 private:
 	GLuint id_;
 	Viewport view_port_;
 };
+} // namespace gl460
 
 #endif
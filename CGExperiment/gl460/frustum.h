@@ -0,0 +1,44 @@
+#ifndef GL_FRUSTUM_H
+#define GL_FRUSTUM_H
+#include <glm/glm.hpp>
+
+namespace gl460 {
+/// Six planes extracted from a view-projection matrix (Gribb/Hartmann),
+/// normals point inwards. Plane order: left, right, bottom, top, near, far.
+struct Frustum {
+	enum Plane { Left, Right, Bottom, Top, Near, Far, PlaneCount };
+
+	glm::vec4 planes[PlaneCount];
+
+	static Frustum fromMatrix(const glm::mat4& m) {
+		// glm is column-major: row i is (m[0][i], m[1][i], m[2][i], m[3][i])
+		auto row = [&m](int i) { return glm::vec4(m[0][i], m[1][i], m[2][i], m[3][i]); };
+		Frustum frustum;
+		frustum.planes[Left] = row(3) + row(0);
+		frustum.planes[Right] = row(3) - row(0);
+		frustum.planes[Bottom] = row(3) + row(1);
+		frustum.planes[Top] = row(3) - row(1);
+		frustum.planes[Near] = row(3) + row(2);
+		frustum.planes[Far] = row(3) - row(2);
+		for (auto& plane : frustum.planes) {
+			plane = plane / glm::length(glm::vec3(plane.x, plane.y, plane.z));
+		}
+		return frustum;
+	}
+
+	/// conservative sphere test; shadow casters skip the near plane because
+	/// anything between the light and the volume still casts into it
+	bool intersects(const glm::vec3& center, float radius, bool test_near = true) const {
+		for (int i = 0; i < PlaneCount; ++i) {
+			if (i == Near && !test_near) continue;
+			const glm::vec4& p = planes[i];
+			if (p.x * center.x + p.y * center.y + p.z * center.z + p.w < -radius) {
+				return false;
+			}
+		}
+		return true;
+	}
+};
+} // namespace gl460
+
+#endif // !GL_FRUSTUM_H
@@ -1,23 +1,42 @@
 #include "program.h"
+#include "program_cache.h"
+#include "compile_queue.h"
 #include <algorithm>
 #include <iostream>
 #include <fstream>
 
 namespace gl460{
 
-Shader::Shader(const ShaderType type, const char* shader_file) {
+Shader::Shader(const ShaderType type) : type_(type) {
 	id_ = glCreateShader(static_cast<GLenum>(type));
+}
+
+Shader::Shader(const ShaderType type, const char* shader_file) : Shader(type) {
+	readSource(shader_file, code_);
+}
+
+Shader Shader::fromSource(const ShaderType type, std::string code) {
+	Shader shader(type);
+	shader.code_ = std::move(code);
+	return shader;
+}
+
+Shader::Shader(Shader&& other) noexcept : id_(other.id_), type_(other.type_), code_(std::move(other.code_)) {
+	other.id_ = 0;
+}
+
+bool Shader::readSource(const char* shader_file, std::string& code) {
 	std::ifstream file{ shader_file, std::ifstream::binary };
 	if (!file) {
-		std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ" << std::endl;
-	} else {
-		file.seekg(0, std::ios::end);
-		size_t sz = file.tellg();
-		file.seekg(0, std::ios::beg);
-		//std::vector<char> source(sz);
-		code_.resize(sz);
-		file.read(code_.data(), sz);
+		std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ : " << shader_file << std::endl;
+		return false;
 	}
+	file.seekg(0, std::ios::end);
+	size_t sz = file.tellg();
+	file.seekg(0, std::ios::beg);
+	code.resize(sz);
+	file.read(code.data(), sz);
+	return true;
 }
 
 bool Shader::compile() {
@@ -46,13 +65,25 @@ Program::Program() {
 	program_id_ = glCreateProgram();
 }
 
-Program::Program(Program&& other) noexcept : program_id_(other.program_id_) {
+Program::Program(Program&& other) noexcept : program_id_(other.program_id_), sources_(std::move(other.sources_)),
+	stages_(std::move(other.stages_)), dependencies_(std::move(other.dependencies_)), generation_(other.generation_),
+	status_(other.status_), pending_shaders_(std::move(other.pending_shaders_)), pending_cache_(other.pending_cache_),
+	pending_key_(other.pending_key_), uniforms_(std::move(other.uniforms_)) {
 	other.program_id_ = 0;
 }
 
 Program & gl460::Program::operator=(Program && other) noexcept
 {
 	std::swap(program_id_, other.program_id_);
+	std::swap(sources_, other.sources_);
+	std::swap(stages_, other.stages_);
+	std::swap(dependencies_, other.dependencies_);
+	std::swap(generation_, other.generation_);
+	std::swap(status_, other.status_);
+	std::swap(pending_shaders_, other.pending_shaders_);
+	std::swap(pending_cache_, other.pending_cache_);
+	std::swap(pending_key_, other.pending_key_);
+	std::swap(uniforms_, other.uniforms_);
 	return *this;
 }
 
@@ -76,8 +107,53 @@ std::pair<bool, std::string> Program::validate() {
 	return {success, std::move(log)};
 }
 
-bool Program::link() {
+bool Program::link(ProgramBinaryCache* cache) {
+	linkAsync(cache);
+	return finishLink();
+}
+
+void Program::linkAsync(ProgramBinaryCache* cache) {
+	pending_cache_ = cache && cache->enabled() ? cache : nullptr;
+	pending_key_ = pending_cache_ ? sourceKey(*pending_cache_) : 0;
+	if (pending_cache_ && pending_cache_->load(pending_key_, program_id_)) {
+		pending_cache_ = nullptr;
+		reflectUniforms();
+		status_ = LinkStatus::Linked;
+		return;
+	}
+
+	if (pending_cache_) {
+		glProgramParameteri(program_id_, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+	}
+	// no status query in between: with parallel compile the driver works on
+	// every stage and the link in the background
+	pending_shaders_.clear();
+	pending_shaders_.reserve(sources_.size());
+	for (const auto& source : sources_) {
+		pending_shaders_.push_back(Shader::fromSource(source.first, source.second));
+		const char* shader_str = pending_shaders_.back().code().c_str();
+		glShaderSource(pending_shaders_.back().id(), 1, &shader_str, nullptr);
+		glCompileShader(pending_shaders_.back().id());
+		glAttachShader(program_id_, pending_shaders_.back().id());
+	}
 	glLinkProgram(program_id_);
+	status_ = LinkStatus::Pending;
+}
+
+bool Program::completionReady() const {
+	if (status_ != LinkStatus::Pending || !parallelShaderCompileSupported()) {
+		return true;
+	}
+	GLint done = GL_FALSE;
+	glGetProgramiv(program_id_, GL_COMPLETION_STATUS_KHR, &done);
+	return done == GL_TRUE;
+}
+
+bool Program::finishLink() {
+	if (status_ != LinkStatus::Pending) {
+		return status_ == LinkStatus::Linked;
+	}
+
 	GLint success = true, log_length = 0;
 	glGetProgramiv(program_id_, GL_LINK_STATUS, &success);
 	glGetProgramiv(program_id_, GL_INFO_LOG_LENGTH, &log_length);
@@ -87,22 +163,177 @@ bool Program::link() {
 	}
 	log.resize(std::max(log_length, 1) - 1);
 	if (!success) {
+		reportCompileErrors();
 		std::cout << "Link Program Failed : " << log << std::endl;
+	} else {
+		reflectUniforms();
+		if (pending_cache_) {
+			pending_cache_->store(pending_key_, program_id_);
+		}
 	}
 
+	// the shader objects are not needed once linked, detach so they can be freed
+	for (const auto& shader : pending_shaders_) {
+		glDetachShader(program_id_, shader.id());
+	}
+	pending_shaders_.clear();
+	pending_cache_ = nullptr;
+	status_ = success ? LinkStatus::Linked : LinkStatus::Failed;
 	return success;
 }
 
+void Program::reportCompileErrors() {
+	for (const auto& shader : pending_shaders_) {
+		GLint success = GL_TRUE, log_length = 0;
+		glGetShaderiv(shader.id(), GL_COMPILE_STATUS, &success);
+		if (success) continue;
+		glGetShaderiv(shader.id(), GL_INFO_LOG_LENGTH, &log_length);
+		std::string message(std::max(log_length, 1), '\0');
+		glGetShaderInfoLog(shader.id(), log_length, nullptr, &message[0]);
+		std::cout << "Shader::compile error : " << message << std::endl;
+	}
+}
 
-void Program::attachShaders(gl460::ShaderType type, const std::string& path) {
-	Shader s(type, path.c_str());
-	s.compile();
-	glAttachShader(program_id_, s.id());
+uint64_t Program::sourceKey(const ProgramBinaryCache& cache) const {
+	uint64_t key = cache.seed();
+	for (const auto& source : sources_) {
+		const GLenum type = static_cast<GLenum>(source.first);
+		key = ProgramBinaryCache::hash(key, &type, sizeof(type));
+		key = ProgramBinaryCache::hash(key, source.second.data(), source.second.size() + 1);
+	}
+	return key;
+}
+
+void Program::reflectUniforms() {
+	uniforms_.clear();
+	GLint count = 0, max_name_length = 0;
+	glGetProgramInterfaceiv(program_id_, GL_UNIFORM, GL_ACTIVE_RESOURCES, &count);
+	glGetProgramInterfaceiv(program_id_, GL_UNIFORM, GL_MAX_NAME_LENGTH, &max_name_length);
+
+	const GLenum props[] = { GL_BLOCK_INDEX, GL_LOCATION, GL_TYPE, GL_ARRAY_SIZE };
+	std::string name(std::max(max_name_length, 1), '\0');
+	uniforms_.reserve(count);
+	for (GLint i = 0; i < count; ++i) {
+		GLint values[4] = {};
+		glGetProgramResourceiv(program_id_, GL_UNIFORM, i, 4, props, 4, nullptr, values);
+		// members of uniform blocks have no location of their own
+		if (values[0] != -1 || values[1] < 0) continue;
+
+		GLsizei length = 0;
+		glGetProgramResourceName(program_id_, GL_UNIFORM, i, max_name_length, &length, &name[0]);
+		std::string uniform_name(name.data(), length);
+		if (uniform_name.size() > 3 && uniform_name.compare(uniform_name.size() - 3, 3, "[0]") == 0) {
+			uniform_name.resize(uniform_name.size() - 3);
+		}
+		uniforms_.push_back({ std::move(uniform_name), values[1], static_cast<GLenum>(values[2]), values[3] });
+	}
+	std::sort(uniforms_.begin(), uniforms_.end(),
+		[](const UniformInfo& a, const UniformInfo& b) { return a.name < b.name; });
+}
+
+const UniformInfo* Program::findUniform(const std::string& name) const {
+	auto iter = std::lower_bound(uniforms_.begin(), uniforms_.end(), name,
+		[](const UniformInfo& info, const std::string& key) { return info.name < key; });
+	if (iter == uniforms_.end() || iter->name != name) {
+		return nullptr;
+	}
+	return &*iter;
+}
+
+void Program::reportTypeMismatch(const UniformInfo& info) {
+	std::cout << "Program::uniform type mismatch : " << info.name << " is 0x" << std::hex << info.type << std::dec << std::endl;
+}
+
+
+void Program::attachShaders(gl460::ShaderType type, const std::string& path, const ShaderDefines& defines) {
+	stages_.push_back({ type, path, defines });
+	ShaderSource source;
+	if (source.load(path, defines)) {
+		sources_.emplace_back(type, source.code());
+	}
+	for (const auto& file : source.files()) {
+		if (std::find(dependencies_.begin(), dependencies_.end(), file) == dependencies_.end()) {
+			dependencies_.push_back(file);
+		}
+	}
+}
+
+Program Program::reloaded() const {
+	Program program;
+	for (const auto& stage : stages_) {
+		program.attachShaders(stage.type, stage.path, stage.defines);
+	}
+	return program;
+}
+
+void Program::replaceWith(Program&& other) {
+	other.copyUniformValues(*this);
+	const uint32_t generation = generation_;
+	*this = std::move(other);
+	// `other` now holds the old GL program and deletes it
+	generation_ = generation + 1;
+}
+
+namespace {
+enum class ComponentType { Float, Int, Uint };
+
+/// component count of the uniform types gl460 sets, 0 for anything else
+int uniformComponents(GLenum type, ComponentType& component) {
+	component = ComponentType::Float;
+	switch (type) {
+	case GL_FLOAT: return 1;
+	case GL_FLOAT_VEC2: return 2;
+	case GL_FLOAT_VEC3: return 3;
+	case GL_FLOAT_VEC4: return 4;
+	case GL_FLOAT_MAT3: return 9;
+	case GL_FLOAT_MAT4: return 16;
+	case GL_UNSIGNED_INT: component = ComponentType::Uint; return 1;
+	default:
+		component = ComponentType::Int;
+		return UniformTraits<int>::matches(type) ? 1 : 0;
+	}
+}
+} // namespace
+
+void Program::copyUniformValues(const Program& from) {
+	for (const auto& info : from.uniforms_) {
+		const UniformInfo* target = findUniform(info.name);
+		if (!target || target->type != info.type) continue;
+		ComponentType component;
+		const int components = uniformComponents(info.type, component);
+		if (!components) continue;
+		// array elements have consecutive locations
+		const GLint count = std::min(info.array_size, target->array_size);
+		for (GLint i = 0; i < count; ++i) {
+			GLfloat f[16];
+			GLint n[16];
+			GLuint u[16];
+			switch (component) {
+			case ComponentType::Float:
+				glGetUniformfv(from.program_id_, info.location + i, f);
+				if (components == 16) glProgramUniformMatrix4fv(program_id_, target->location + i, 1, GL_FALSE, f);
+				else if (components == 9) glProgramUniformMatrix3fv(program_id_, target->location + i, 1, GL_FALSE, f);
+				else if (components == 4) glProgramUniform4fv(program_id_, target->location + i, 1, f);
+				else if (components == 3) glProgramUniform3fv(program_id_, target->location + i, 1, f);
+				else if (components == 2) glProgramUniform2fv(program_id_, target->location + i, 1, f);
+				else glProgramUniform1fv(program_id_, target->location + i, 1, f);
+				break;
+			case ComponentType::Int:
+				glGetUniformiv(from.program_id_, info.location + i, n);
+				glProgramUniform1iv(program_id_, target->location + i, 1, n);
+				break;
+			case ComponentType::Uint:
+				glGetUniformuiv(from.program_id_, info.location + i, u);
+				glProgramUniform1uiv(program_id_, target->location + i, 1, u);
+				break;
+			}
+		}
+	}
 }
 
-void Program::attachShaders(std::map<gl460::ShaderType, std::string> shaders) {
+void Program::attachShaders(std::map<gl460::ShaderType, std::string> shaders, const ShaderDefines& defines) {
 	for (auto& iter : shaders) {
-		attachShaders(iter.first, iter.second);
+		attachShaders(iter.first, iter.second, defines);
 	}
 }
 
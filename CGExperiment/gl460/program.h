@@ -3,10 +3,13 @@
 #include <glad/glad.h>
 #include <glm/glm.hpp>
 #include <glm/gtc/type_ptr.hpp>
+#include "shader_source.h"
 
+#include <cstdint>
 #include <utility>
 #include <string>
 #include <map>
+#include <vector>
 
 namespace gl460 {
 enum class ShaderType : GLenum {
@@ -21,17 +24,88 @@ enum class ShaderType : GLenum {
 class Shader {
 public:
 	explicit Shader(const ShaderType type, const char* shader_file);
+	/// for source already in memory
+	static Shader fromSource(const ShaderType type, std::string code);
+	Shader(const Shader&) = delete;
+	Shader(Shader&& other) noexcept;
+	Shader& operator=(const Shader&) = delete;
+
+	static bool readSource(const char* shader_file, std::string& code);
+
 	GLuint id() const { return id_; }
+	ShaderType type() const { return type_; }
+	const std::string& code() const { return code_; }
 	bool compile();
 	~Shader();
 private:
+	explicit Shader(const ShaderType type);
+
 	GLuint id_;
 	ShaderType type_;
 	std::string code_;
 };
 
+class ProgramBinaryCache;
+
+/// Uniform type checks done once when a handle is resolved.
+template <typename T> struct UniformTraits;
+template <> struct UniformTraits<float> {
+	static bool matches(GLenum type) { return type == GL_FLOAT; }
+};
+template <> struct UniformTraits<int> {
+	// samplers and images are set through their texture unit
+	static bool matches(GLenum type) {
+		return type == GL_INT || type == GL_BOOL
+			|| (type >= GL_SAMPLER_1D && type <= GL_SAMPLER_2D_SHADOW)
+			|| (type >= GL_SAMPLER_1D_ARRAY && type <= GL_SAMPLER_CUBE_SHADOW)
+			|| (type >= GL_INT_SAMPLER_1D && type <= GL_UNSIGNED_INT_SAMPLER_BUFFER)
+			|| (type >= GL_SAMPLER_2D_RECT && type <= GL_SAMPLER_2D_RECT_SHADOW)
+			|| (type >= GL_SAMPLER_CUBE_MAP_ARRAY && type <= GL_UNSIGNED_INT_SAMPLER_CUBE_MAP_ARRAY)
+			|| (type >= GL_SAMPLER_2D_MULTISAMPLE && type <= GL_UNSIGNED_INT_SAMPLER_2D_MULTISAMPLE_ARRAY)
+			|| (type >= GL_IMAGE_1D && type <= GL_UNSIGNED_INT_IMAGE_2D_MULTISAMPLE_ARRAY);
+	}
+};
+template <> struct UniformTraits<GLuint> {
+	static bool matches(GLenum type) { return type == GL_UNSIGNED_INT; }
+};
+template <> struct UniformTraits<glm::vec2> {
+	static bool matches(GLenum type) { return type == GL_FLOAT_VEC2; }
+};
+template <> struct UniformTraits<glm::vec3> {
+	static bool matches(GLenum type) { return type == GL_FLOAT_VEC3; }
+};
+template <> struct UniformTraits<glm::vec4> {
+	static bool matches(GLenum type) { return type == GL_FLOAT_VEC4; }
+};
+template <> struct UniformTraits<glm::mat4> {
+	static bool matches(GLenum type) { return type == GL_FLOAT_MAT4; }
+};
+
+/// Pre-resolved uniform location. Setting through a handle is a single
+/// glProgramUniform* call: no name lookup and no driver query.
+template <typename T>
+struct Uniform {
+	GLint location = -1;
+	bool valid() const { return location >= 0; }
+};
+
+/// One active default-block uniform, as reflected at link time.
+struct UniformInfo {
+	std::string name;	// array uniforms are stored without the trailing "[0]"
+	GLint location;
+	GLenum type;
+	GLint array_size;
+};
+
 class Program {
 public:
+	enum class LinkStatus {
+		Unlinked,
+		Pending,	// compile and link were issued, the driver may still be working
+		Linked,
+		Failed
+	};
+
 	explicit Program();
 	Program(const Program&) = delete;
 	Program(Program&& other) noexcept;
@@ -40,38 +114,117 @@ public:
 
 	~Program();
 
-	/// shader source
-	void attachShaders(gl460::ShaderType type, const std::string& path);
-	void attachShaders(std::map<gl460::ShaderType, std::string> shaders);
-
-
+	/// shader source, preprocessed now (see ShaderSource) and compiled at link
+	/// time unless the binary cache hits
+	void attachShaders(gl460::ShaderType type, const std::string& path, const ShaderDefines& defines = {});
+	void attachShaders(std::map<gl460::ShaderType, std::string> shaders, const ShaderDefines& defines = {});
 
 	GLuint id() const { return program_id_; }
 	std::pair<bool, std::string> validate();
 	
 	// void dispatchCompute(const Vector3ui& work_group_count);
 
-	bool link();
+	/// linkAsync() followed by finishLink()
+	bool link(ProgramBinaryCache* cache = nullptr);
+	/// issues compile and link without querying any status, see CompileQueue
+	void linkAsync(ProgramBinaryCache* cache = nullptr);
+	/// GL_COMPLETION_STATUS_KHR, never blocks; true without the extension
+	bool completionReady() const;
+	/// reads the link status (blocking if the driver is not done), reflects
+	/// uniforms and stores the binary
+	bool finishLink();
+
+	LinkStatus linkStatus() const { return status_; }
+	bool linked() const { return status_ == LinkStatus::Linked; }
+
+	/// every file the sources were built from, includes too
+	const std::vector<std::string>& dependencies() const { return dependencies_; }
+	/// a new, unlinked program reading the same files with the same defines
+	Program reloaded() const;
+	/// takes over `other`'s GL program (which must be linked) and carries the
+	/// current default-block uniform values across. Locations may move, so
+	/// handles resolved before must be resolved again; generation() tells.
+	void replaceWith(Program&& other);
+	uint32_t generation() const { return generation_; }
 	void use();
 
-	GLuint uniformLocation(const std::string& name) {
-		const GLint location = glGetUniformLocation(program_id_, name.c_str());
-		return location;
+	/// active uniforms of the last successful link, sorted by name
+	const std::vector<UniformInfo>& uniforms() const { return uniforms_; }
+	const UniformInfo* findUniform(const std::string& name) const;
+
+	GLint uniformLocation(const std::string& name) const {
+		const UniformInfo* info = findUniform(name);
+		return info ? info->location : -1;
 	}
 
-	
+	/// resolve once after link(), then set through the handle every frame
+	template <typename T>
+	Uniform<T> uniform(const std::string& name) const {
+		const UniformInfo* info = findUniform(name);
+		if (!info) {
+			return {};
+		}
+		if (!UniformTraits<T>::matches(info->type)) {
+			reportTypeMismatch(*info);
+			return {};
+		}
+		return { info->location };
+	}
+
+	void set(Uniform<glm::mat4> u, const glm::mat4& mat) {
+		glProgramUniformMatrix4fv(program_id_, u.location, 1, GL_FALSE, glm::value_ptr(mat));
+	}
+	void set(Uniform<glm::vec4> u, const glm::vec4& v) {
+		glProgramUniform4fv(program_id_, u.location, 1, glm::value_ptr(v));
+	}
+	void set(Uniform<glm::vec3> u, const glm::vec3& v) {
+		glProgramUniform3fv(program_id_, u.location, 1, glm::value_ptr(v));
+	}
+	void set(Uniform<glm::vec2> u, const glm::vec2& v) {
+		glProgramUniform2fv(program_id_, u.location, 1, glm::value_ptr(v));
+	}
+	void set(Uniform<float> u, float v) {
+		glProgramUniform1f(program_id_, u.location, v);
+	}
+	void set(Uniform<int> u, int v) {
+		glProgramUniform1i(program_id_, u.location, v);
+	}
+	void set(Uniform<GLuint> u, GLuint v) {
+		glProgramUniform1ui(program_id_, u.location, v);
+	}
 
 	void setMat4(const std::string &name, const glm::mat4 &mat) {
-		//glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
-		glProgramUniformMatrix4fv(program_id_, uniformLocation(name), 1, GL_FALSE, glm::value_ptr(mat));
+		set(Uniform<glm::mat4>{ uniformLocation(name) }, mat);
 	}
 
 	void setVec3(const std::string& name, const glm::vec3 v) {
-		glProgramUniform3fv(program_id_, uniformLocation(name), 1, glm::value_ptr(v));
+		set(Uniform<glm::vec3>{ uniformLocation(name) }, v);
 	}
 
 private:
+	struct Stage {
+		ShaderType type;
+		std::string path;
+		ShaderDefines defines;
+	};
+
+	uint64_t sourceKey(const ProgramBinaryCache& cache) const;
+	void copyUniformValues(const Program& from);
+	void reportCompileErrors();
+	void reflectUniforms();
+	static void reportTypeMismatch(const UniformInfo& info);
+
 	GLuint program_id_ = 0;
+	std::vector<std::pair<ShaderType, std::string>> sources_;
+	std::vector<Stage> stages_;
+	std::vector<std::string> dependencies_;
+	uint32_t generation_ = 0;
+	LinkStatus status_ = LinkStatus::Unlinked;
+	// alive while a link is pending
+	std::vector<Shader> pending_shaders_;
+	ProgramBinaryCache* pending_cache_ = nullptr;
+	uint64_t pending_key_ = 0;
+	std::vector<UniformInfo> uniforms_;
 };
 }
 
@@ -0,0 +1,119 @@
+#include "program_cache.h"
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <utility>
+#include <vector>
+
+namespace gl460 {
+
+namespace {
+constexpr uint32_t kMagic = 0x42504C47;	// "GLPB"
+constexpr uint32_t kVersion = 1;
+constexpr uint64_t kFnvOffset = 14695981039346656037ull;
+constexpr uint64_t kFnvPrime = 1099511628211ull;
+
+struct FileHeader {
+	uint32_t magic;
+	uint32_t version;
+	uint64_t key;
+	uint32_t format;
+	uint32_t length;
+};
+} // namespace
+
+ProgramBinaryCache::ProgramBinaryCache(std::string directory) : directory_(std::move(directory)) {
+	GLint formats = 0;
+	glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+	enabled_ = formats > 0;
+
+	driver_hash_ = kFnvOffset;
+	for (GLenum name : { GL_VENDOR, GL_RENDERER, GL_VERSION }) {
+		const char* str = reinterpret_cast<const char*>(glGetString(name));
+		if (str) driver_hash_ = hash(driver_hash_, str, strlen(str) + 1);
+	}
+
+	if (enabled_) {
+		std::error_code error;
+		std::filesystem::create_directories(directory_, error);
+		if (error) {
+			std::cout << "ProgramBinaryCache : cannot create " << directory_ << " : " << error.message() << std::endl;
+			enabled_ = false;
+		}
+	}
+}
+
+uint64_t ProgramBinaryCache::hash(uint64_t hash, const void* data, size_t size) {
+	const unsigned char* bytes = static_cast<const unsigned char*>(data);
+	for (size_t i = 0; i < size; ++i) {
+		hash ^= bytes[i];
+		hash *= kFnvPrime;
+	}
+	return hash;
+}
+
+std::string ProgramBinaryCache::path(uint64_t key) const {
+	char name[32];
+	snprintf(name, sizeof(name), "%016llx.bin", static_cast<unsigned long long>(key));
+	return directory_ + "/" + name;
+}
+
+bool ProgramBinaryCache::load(uint64_t key, GLuint program) {
+	if (!enabled_) return false;
+
+	std::ifstream file{ path(key), std::ifstream::binary };
+	FileHeader header{};
+	if (!file || !file.read(reinterpret_cast<char*>(&header), sizeof(header))
+		|| header.magic != kMagic || header.version != kVersion || header.key != key) {
+		++stats_.misses;
+		return false;
+	}
+	std::vector<char> binary(header.length);
+	if (!file.read(binary.data(), binary.size())) {
+		++stats_.misses;
+		return false;
+	}
+
+	glProgramBinary(program, header.format, binary.data(), header.length);
+	GLint success = GL_FALSE;
+	glGetProgramiv(program, GL_LINK_STATUS, &success);
+	if (!success) {
+		// same key but the driver changed its mind (e.g. a different GPU with equal strings)
+		++stats_.rejected;
+		return false;
+	}
+	++stats_.hits;
+	return true;
+}
+
+void ProgramBinaryCache::store(uint64_t key, GLuint program) {
+	if (!enabled_) return;
+
+	GLint length = 0;
+	glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+	if (length <= 0) return;
+
+	std::vector<char> binary(length);
+	GLenum format = 0;
+	glGetProgramBinary(program, length, nullptr, &format, binary.data());
+
+	// write to a temporary first, a crash mid-write must not leave a truncated entry
+	const std::string final_path = path(key);
+	const std::string temp_path = final_path + ".tmp";
+	{
+		std::ofstream file{ temp_path, std::ofstream::binary | std::ofstream::trunc };
+		if (!file) {
+			std::cout << "ProgramBinaryCache : failed to open " << temp_path << std::endl;
+			return;
+		}
+		FileHeader header{ kMagic, kVersion, key, format, static_cast<uint32_t>(length) };
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		file.write(binary.data(), binary.size());
+	}
+	std::error_code error;
+	std::filesystem::rename(temp_path, final_path, error);
+	if (!error) ++stats_.stores;
+}
+} // namespace gl460
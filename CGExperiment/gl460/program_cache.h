@@ -0,0 +1,52 @@
+#ifndef GL_PROGRAM_CACHE_H
+#define GL_PROGRAM_CACHE_H
+#include <glad/glad.h>
+
+#include <cstdint>
+#include <string>
+
+namespace gl460 {
+/// On-disk cache of linked program binaries (glGetProgramBinary/glProgramBinary).
+/// Entries are keyed by a hash of the shader sources and the driver strings,
+/// so a driver update or any source change simply misses. A binary the driver
+/// refuses is counted as rejected and the caller compiles from source.
+class ProgramBinaryCache {
+public:
+	struct Stats {
+		uint32_t hits = 0;
+		uint32_t misses = 0;
+		uint32_t rejected = 0;
+		uint32_t stores = 0;
+	};
+
+	/// needs a current context, the driver strings are part of every key
+	explicit ProgramBinaryCache(std::string directory);
+	ProgramBinaryCache(const ProgramBinaryCache&) = delete;
+	ProgramBinaryCache& operator=(const ProgramBinaryCache&) = delete;
+
+	/// false when the driver exposes no binary formats, load/store are no-ops then
+	bool enabled() const { return enabled_; }
+
+	/// FNV-1a, seeded with GL_VENDOR/GL_RENDERER/GL_VERSION; feed every stage
+	/// (type and final source text) in a stable order
+	uint64_t seed() const { return driver_hash_; }
+	static uint64_t hash(uint64_t hash, const void* data, size_t size);
+
+	/// loads the binary into `program` and checks the link status
+	bool load(uint64_t key, GLuint program);
+	/// program must have been linked with GL_PROGRAM_BINARY_RETRIEVABLE_HINT
+	void store(uint64_t key, GLuint program);
+
+	const Stats& stats() const { return stats_; }
+
+private:
+	std::string path(uint64_t key) const;
+
+	std::string directory_;
+	uint64_t driver_hash_ = 0;
+	bool enabled_ = false;
+	Stats stats_;
+};
+} // namespace gl460
+
+#endif // !GL_PROGRAM_CACHE_H
@@ -0,0 +1,52 @@
+#include "program_reloader.h"
+#include <algorithm>
+#include <iostream>
+#include <utility>
+
+namespace gl460 {
+
+void ProgramReloader::track(Program& program, CompileQueue::ReadyCallback on_reload) {
+	for (const auto& file : program.dependencies()) {
+		watcher_.watch(file);
+	}
+	tracked_.push_back({ &program, std::move(on_reload), nullptr });
+}
+
+size_t ProgramReloader::poll() {
+	const std::vector<std::string> changes = watcher_.changes();
+	for (auto& tracked : tracked_) {
+		const auto& dependencies = tracked.program->dependencies();
+		const bool changed = std::any_of(dependencies.begin(), dependencies.end(), [&changes](const std::string& file) {
+			return std::find(changes.begin(), changes.end(), FileWatcher::normalize(file)) != changes.end();
+		});
+		if (!changed) continue;
+		// a newer save supersedes a replacement that is still compiling
+		tracked.replacement = std::make_unique<Program>(tracked.program->reloaded());
+		tracked.replacement->linkAsync(cache_);
+	}
+
+	size_t swapped = 0;
+	for (auto& tracked : tracked_) {
+		if (!tracked.replacement || !tracked.replacement->completionReady()) continue;
+		if (tracked.replacement->finishLink()) {
+			tracked.program->replaceWith(std::move(*tracked.replacement));
+			if (tracked.on_reload) {
+				tracked.on_reload(*tracked.program);
+			}
+			// a new include may have appeared
+			for (const auto& file : tracked.program->dependencies()) {
+				watcher_.watch(file);
+			}
+			if (!tracked.program->dependencies().empty()) {
+				std::cout << "ProgramReloader : reloaded " << tracked.program->dependencies().front() << std::endl;
+			}
+			++swapped;
+		} else {
+			std::cout << "ProgramReloader : keeping the previous program" << std::endl;
+		}
+		// the old GL program (or the failed one) goes away with the replacement
+		tracked.replacement.reset();
+	}
+	return swapped;
+}
+} // namespace gl460
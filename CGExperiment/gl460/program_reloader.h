@@ -0,0 +1,42 @@
+#ifndef GL_PROGRAM_RELOADER_H
+#define GL_PROGRAM_RELOADER_H
+#include "compile_queue.h"
+#include "file_watcher.h"
+#include "program.h"
+
+#include <memory>
+#include <vector>
+
+namespace gl460 {
+/// Hot reload for tracked programs. When a source or include of a program
+/// changes on disk, a replacement is compiled in the background (see
+/// Program::linkAsync) while the old program keeps rendering. Only when the
+/// replacement links it is swapped in with Program::replaceWith(); on error
+/// the log is printed and the old program stays.
+class ProgramReloader {
+public:
+	explicit ProgramReloader(ProgramBinaryCache* cache = nullptr) : cache_(cache) {}
+	ProgramReloader(const ProgramReloader&) = delete;
+	ProgramReloader& operator=(const ProgramReloader&) = delete;
+
+	/// `on_reload` runs after every swap, e.g. to resolve uniform handles again;
+	/// the program must outlive the reloader
+	void track(Program& program, CompileQueue::ReadyCallback on_reload = {});
+
+	/// call once per frame, returns the number of programs swapped
+	size_t poll();
+
+private:
+	struct Tracked {
+		Program* program;
+		CompileQueue::ReadyCallback on_reload;
+		std::unique_ptr<Program> replacement;
+	};
+
+	FileWatcher watcher_;
+	ProgramBinaryCache* cache_;
+	std::vector<Tracked> tracked_;
+};
+} // namespace gl460
+
+#endif // !GL_PROGRAM_RELOADER_H
@@ -0,0 +1,29 @@
+#include "program_variants.h"
+#include <utility>
+
+namespace gl460 {
+
+std::string ProgramVariantCache::key(const Stages& stages, const ShaderDefines& defines) {
+	std::string key;
+	for (const auto& stage : stages) {
+		key += std::to_string(static_cast<GLenum>(stage.first)) + ":" + stage.second + "|";
+	}
+	return key + defines.key();
+}
+
+Program& ProgramVariantCache::get(const Stages& stages, const ShaderDefines& defines, CompileQueue::ReadyCallback on_ready) {
+	const std::string variant_key = key(stages, defines);
+	auto iter = variants_.find(variant_key);
+	if (iter != variants_.end()) {
+		++stats_.hits;
+		return *iter->second;
+	}
+	++stats_.misses;
+	auto program = std::make_unique<Program>();
+	program->attachShaders(stages, defines);
+	Program& result = *program;
+	variants_.emplace(variant_key, std::move(program));
+	queue_.submit(result, binaries_, std::move(on_ready));
+	return result;
+}
+} // namespace gl460
@@ -0,0 +1,48 @@
+#ifndef GL_PROGRAM_VARIANTS_H
+#define GL_PROGRAM_VARIANTS_H
+#include "compile_queue.h"
+#include "program.h"
+#include "shader_source.h"
+
+#include <map>
+#include <memory>
+#include <string>
+
+namespace gl460 {
+/// Programs by (stage files, defines). Each permutation is built the first
+/// time a scene asks for it and shared afterwards, so only the variants in
+/// use are ever compiled and the shaders branch at compile time instead of
+/// at runtime.
+class ProgramVariantCache {
+public:
+	using Stages = std::map<ShaderType, std::string>;
+
+	struct Stats {
+		uint32_t hits = 0;
+		uint32_t misses = 0;
+	};
+
+	/// new variants go through `queue`; both must outlive the cache
+	explicit ProgramVariantCache(CompileQueue& queue, ProgramBinaryCache* binaries = nullptr)
+		: queue_(queue), binaries_(binaries) {}
+	ProgramVariantCache(const ProgramVariantCache&) = delete;
+	ProgramVariantCache& operator=(const ProgramVariantCache&) = delete;
+
+	/// the returned program may still be linking, check Program::linked();
+	/// `on_ready` only runs for a variant built by this call
+	Program& get(const Stages& stages, const ShaderDefines& defines, CompileQueue::ReadyCallback on_ready = {});
+
+	size_t size() const { return variants_.size(); }
+	const Stats& stats() const { return stats_; }
+
+private:
+	static std::string key(const Stages& stages, const ShaderDefines& defines);
+
+	CompileQueue& queue_;
+	ProgramBinaryCache* binaries_;
+	std::map<std::string, std::unique_ptr<Program>> variants_;
+	Stats stats_;
+};
+} // namespace gl460
+
+#endif // !GL_PROGRAM_VARIANTS_H
@@ -0,0 +1,54 @@
+#include "render_target_pool.h"
+#include <algorithm>
+#include <iostream>
+#include <utility>
+
+namespace gl460 {
+
+Texture& RenderTargetPool::acquire(const TextureDesc& desc) {
+	for (auto& entry : entries_) {
+		if (!entry.in_use && entry.texture->desc() == desc) {
+			entry.in_use = true;
+			entry.last_used = frame_;
+			return *entry.texture;
+		}
+	}
+	Entry entry;
+	entry.texture = std::make_unique<Texture>(desc);
+	entry.in_use = true;
+	entry.last_used = frame_;
+	entries_.push_back(std::move(entry));
+	++allocations_;
+	return *entries_.back().texture;
+}
+
+void RenderTargetPool::release(const Texture& texture) {
+	for (auto& entry : entries_) {
+		if (entry.texture.get() == &texture) {
+			entry.in_use = false;
+			entry.last_used = frame_;
+			return;
+		}
+	}
+	std::cout << "RenderTargetPool::release : texture " << texture.id() << " does not belong to the pool" << std::endl;
+}
+
+void RenderTargetPool::beginFrame() {
+	++frame_;
+	allocations_ = 0;
+	entries_.erase(std::remove_if(entries_.begin(), entries_.end(), [this](const Entry& entry) {
+		return !entry.in_use && frame_ - entry.last_used > max_idle_frames_;
+	}), entries_.end());
+}
+
+RenderTargetPool::Stats RenderTargetPool::stats() const {
+	Stats stats;
+	stats.textures = static_cast<uint32_t>(entries_.size());
+	stats.allocations = allocations_;
+	for (const auto& entry : entries_) {
+		if (entry.in_use) ++stats.in_use;
+		stats.bytes += entry.texture->byteSize();
+	}
+	return stats;
+}
+} // namespace gl460
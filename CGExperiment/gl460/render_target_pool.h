@@ -0,0 +1,52 @@
+#ifndef GL_RENDER_TARGET_POOL_H
+#define GL_RENDER_TARGET_POOL_H
+#include <glad/glad.h>
+#include "texture.h"
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace gl460 {
+/// Recycles transient render target textures by TextureDesc. A pass acquires
+/// what it needs and releases it when done; the next acquire with the same
+/// description gets the same texture back instead of new GPU memory.
+/// Textures nobody asked for within `max_idle_frames` (e.g. the old size
+/// after a resize) are freed in beginFrame().
+class RenderTargetPool {
+public:
+	struct Stats {
+		uint32_t textures = 0;
+		uint32_t in_use = 0;
+		uint32_t allocations = 0;	// since the last beginFrame()
+		GLsizeiptr bytes = 0;
+	};
+
+	explicit RenderTargetPool(uint32_t max_idle_frames = 60) : max_idle_frames_(max_idle_frames) {}
+	RenderTargetPool(const RenderTargetPool&) = delete;
+	RenderTargetPool& operator=(const RenderTargetPool&) = delete;
+
+	/// the reference stays valid until the texture is evicted, i.e. at least
+	/// while it is acquired
+	Texture& acquire(const TextureDesc& desc);
+	void release(const Texture& texture);
+
+	void beginFrame();
+
+	Stats stats() const;
+
+private:
+	struct Entry {
+		std::unique_ptr<Texture> texture;
+		bool in_use = false;
+		uint64_t last_used = 0;
+	};
+
+	std::vector<Entry> entries_;
+	uint64_t frame_ = 0;
+	uint32_t max_idle_frames_;
+	uint32_t allocations_ = 0;
+};
+} // namespace gl460
+
+#endif // !GL_RENDER_TARGET_POOL_H
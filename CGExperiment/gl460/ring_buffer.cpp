@@ -0,0 +1,122 @@
+#include "ring_buffer.h"
+#include <algorithm>
+#include <iostream>
+#include <cstring>
+#include <utility>
+
+namespace gl460 {
+
+RingBuffer::RingBuffer(GLsizeiptr frame_size, uint32_t frame_count)
+	: frame_size_(frame_size), fences_(std::max<uint32_t>(frame_count, 1), nullptr) {
+	const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+	const GLsizeiptr total_size = frame_size_ * static_cast<GLsizeiptr>(fences_.size());
+	glCreateBuffers(1, &id_);
+	glNamedBufferStorage(id_, total_size, nullptr, flags);
+	mapped_ = static_cast<unsigned char*>(glMapNamedBufferRange(id_, 0, total_size, flags));
+	if (!mapped_) {
+		std::cout << "RingBuffer : failed to map " << total_size << " bytes" << std::endl;
+	}
+}
+
+RingBuffer::RingBuffer(RingBuffer&& other) noexcept
+	: id_(other.id_), mapped_(other.mapped_), frame_size_(other.frame_size_), frame_(other.frame_),
+	head_(other.head_), fences_(std::move(other.fences_)), stats_(other.stats_), last_stats_(other.last_stats_) {
+	other.id_ = 0;
+	other.mapped_ = nullptr;
+}
+
+RingBuffer& RingBuffer::operator=(RingBuffer&& other) noexcept {
+	std::swap(id_, other.id_);
+	std::swap(mapped_, other.mapped_);
+	std::swap(frame_size_, other.frame_size_);
+	std::swap(frame_, other.frame_);
+	std::swap(head_, other.head_);
+	std::swap(fences_, other.fences_);
+	std::swap(stats_, other.stats_);
+	std::swap(last_stats_, other.last_stats_);
+	return *this;
+}
+
+RingBuffer::~RingBuffer() {
+	release();
+}
+
+void RingBuffer::release() {
+	for (GLsync& fence : fences_) {
+		if (fence) {
+			glDeleteSync(fence);
+			fence = nullptr;
+		}
+	}
+	if (id_) {
+		glUnmapNamedBuffer(id_);
+		glDeleteBuffers(1, &id_);
+		id_ = 0;
+		mapped_ = nullptr;
+	}
+}
+
+void RingBuffer::beginFrame() {
+	stats_ = FrameStats{};
+	head_ = 0;
+
+	GLsync& fence = fences_[frame_];
+	if (!fence) return;
+
+	GLenum result = glClientWaitSync(fence, 0, 0);
+	if (result == GL_TIMEOUT_EXPIRED) {
+		// the GPU is still reading this region: a real stall
+		++stats_.fence_waits;
+		do {
+			result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+		} while (result == GL_TIMEOUT_EXPIRED);
+	}
+	if (result == GL_WAIT_FAILED) {
+		std::cout << "RingBuffer : glClientWaitSync failed" << std::endl;
+	}
+	glDeleteSync(fence);
+	fence = nullptr;
+}
+
+void RingBuffer::endFrame() {
+	fences_[frame_] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	frame_ = (frame_ + 1) % fences_.size();
+	last_stats_ = stats_;
+}
+
+RingBuffer::Allocation RingBuffer::allocate(GLsizeiptr size, GLsizeiptr alignment) {
+	const GLintptr offset = placeAllocation(frame_size_, frame_, head_, size, alignment);
+	if (!mapped_ || offset < 0) {
+		std::cout << "RingBuffer : frame region of " << frame_size_ << " bytes exhausted" << std::endl;
+		return {};
+	}
+	head_ = offset + size - static_cast<GLintptr>(frame_) * frame_size_;
+	stats_.bytes_used = head_;
+
+	Allocation allocation;
+	allocation.offset = offset;
+	allocation.data = mapped_ + allocation.offset;
+	allocation.size = size;
+	return allocation;
+}
+
+RingBuffer::Allocation RingBuffer::upload(const void* data, GLsizeiptr size, GLsizeiptr alignment) {
+	Allocation allocation = allocate(size, alignment);
+	if (allocation) {
+		std::memcpy(allocation.data, data, size);
+	}
+	return allocation;
+}
+
+GLsizeiptr RingBuffer::uniformAlignment() {
+	static GLint alignment = 0;
+	if (!alignment) glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+	return alignment;
+}
+
+GLsizeiptr RingBuffer::storageAlignment() {
+	static GLint alignment = 0;
+	if (!alignment) glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &alignment);
+	return alignment;
+}
+} // namespace gl460
@@ -0,0 +1,85 @@
+#ifndef GL_RING_BUFFER_H
+#define GL_RING_BUFFER_H
+#include <glad/glad.h>
+#include "buffer.h"
+
+#include <cstdint>
+#include <vector>
+
+namespace gl460 {
+/// Persistently mapped, coherent buffer split into `frame_count` regions.
+/// Each frame bump-allocates from its own region; the region is fenced at
+/// endFrame() and only waited on when it comes around again, so the CPU never
+/// writes memory the GPU may still read and the driver never has to orphan.
+class RingBuffer {
+public:
+	struct Allocation {
+		void* data = nullptr;
+		GLintptr offset = 0;
+		GLsizeiptr size = 0;
+		explicit operator bool() const { return data != nullptr; }
+	};
+
+	struct FrameStats {
+		GLsizeiptr bytes_used = 0;
+		uint32_t fence_waits = 0;
+	};
+
+	explicit RingBuffer() noexcept {}
+	explicit RingBuffer(GLsizeiptr frame_size, uint32_t frame_count = 3);
+	RingBuffer(const RingBuffer&) = delete;
+	RingBuffer(RingBuffer&& other) noexcept;
+
+	~RingBuffer();
+
+	RingBuffer& operator=(const RingBuffer&) = delete;
+	RingBuffer& operator=(RingBuffer&& other) noexcept;
+
+	GLuint id() const { return id_; }
+
+	/// waits (if needed) until the GPU is done with the region of this frame
+	void beginFrame();
+	/// fences everything allocated since beginFrame()
+	void endFrame();
+
+	/// returns an empty allocation when the frame region is exhausted
+	Allocation allocate(GLsizeiptr size, GLsizeiptr alignment = 16);
+	Allocation upload(const void* data, GLsizeiptr size, GLsizeiptr alignment = 16);
+
+	void bindRange(BufferTarget target, GLuint index, const Allocation& allocation) const {
+		glBindBufferRange(static_cast<GLenum>(target), index, id_, allocation.offset, allocation.size);
+	}
+
+	/// usage of the last completed frame
+	const FrameStats& frameStats() const { return last_stats_; }
+
+	/// offset alignments required by glBindBufferRange
+	static GLsizeiptr uniformAlignment();
+	static GLsizeiptr storageAlignment();
+
+	/// buffer offset of `size` bytes placed at `head` of region `frame`, or -1
+	/// when they do not fit. Regions start at multiples of `frame_size`, which
+	/// need not be aligned, so the alignment applies to the buffer offset.
+	static GLintptr placeAllocation(GLsizeiptr frame_size, uint32_t frame, GLsizeiptr head, GLsizeiptr size, GLsizeiptr alignment) {
+		alignment = alignment > 0 ? alignment : 1;
+		const GLintptr base = static_cast<GLintptr>(frame) * frame_size;
+		const GLintptr offset = (base + head + alignment - 1) / alignment * alignment;
+		return offset + size <= base + frame_size ? offset : -1;
+	}
+
+private:
+	void release();
+
+	GLuint id_ = 0;
+	unsigned char* mapped_ = nullptr;
+	GLsizeiptr frame_size_ = 0;
+	uint32_t frame_ = 0;
+	GLsizeiptr head_ = 0;
+	std::vector<GLsync> fences_;
+
+	FrameStats stats_;
+	FrameStats last_stats_;
+};
+} // namespace gl460
+
+#endif // !GL_RING_BUFFER_H
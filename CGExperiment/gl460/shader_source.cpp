@@ -0,0 +1,160 @@
+#include "shader_source.h"
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+
+namespace gl460 {
+
+ShaderDefines::ShaderDefines(std::initializer_list<std::pair<std::string, std::string>> defines) {
+	for (const auto& define : defines) {
+		set(define.first, define.second);
+	}
+}
+
+ShaderDefines& ShaderDefines::set(const std::string& name, const std::string& value) {
+	auto iter = std::lower_bound(values_.begin(), values_.end(), name,
+		[](const std::pair<std::string, std::string>& define, const std::string& key) { return define.first < key; });
+	if (iter != values_.end() && iter->first == name) {
+		iter->second = value;
+	} else {
+		values_.insert(iter, { name, value });
+	}
+	return *this;
+}
+
+std::string ShaderDefines::key() const {
+	std::string key;
+	for (const auto& define : values_) {
+		key += define.first + "=" + define.second + ";";
+	}
+	return key;
+}
+
+namespace {
+std::string directoryOf(const std::string& path) {
+	const size_t slash = path.find_last_of("/\\");
+	return slash == std::string::npos ? std::string() : path.substr(0, slash + 1);
+}
+
+/// `#include "file"` or `#include <file>`, returns false for any other line
+bool parseInclude(const std::string& line, std::string& file) {
+	size_t pos = line.find_first_not_of(" \t");
+	if (pos == std::string::npos || line.compare(pos, 8, "#include") != 0) return false;
+	const size_t open = line.find_first_of("\"<", pos + 8);
+	if (open == std::string::npos) return false;
+	const size_t close = line.find(line[open] == '"' ? '"' : '>', open + 1);
+	if (close == std::string::npos) return false;
+	file = line.substr(open + 1, close - open - 1);
+	return true;
+}
+
+/// resolves "." and ".." segments, so one file has one path
+std::string normalizePath(const std::string& path) {
+	std::vector<std::string> segments;
+	size_t start = 0;
+	while (start <= path.size()) {
+		size_t end = path.find_first_of("/\\", start);
+		if (end == std::string::npos) end = path.size();
+		const std::string segment = path.substr(start, end - start);
+		if (segment == "..") {
+			if (!segments.empty() && segments.back() != ".." && !segments.back().empty()) {
+				segments.pop_back();
+			} else {
+				segments.push_back(segment);
+			}
+		} else if (segment != "." && !(segment.empty() && !segments.empty())) {
+			// an empty first segment keeps an absolute path absolute
+			segments.push_back(segment);
+		}
+		start = end + 1;
+	}
+	std::string normalized;
+	for (size_t i = 0; i < segments.size(); ++i) {
+		normalized += (i ? "/" : "") + segments[i];
+	}
+	return segments.size() == 1 && segments[0].empty() && !path.empty() ? "/" : normalized;
+}
+
+bool isVersion(const std::string& line) {
+	const size_t pos = line.find_first_not_of(" \t");
+	return pos != std::string::npos && line.compare(pos, 8, "#version") == 0;
+}
+} // namespace
+
+bool ShaderSource::load(const std::string& path, const ShaderDefines& defines) {
+	code_.clear();
+	files_.clear();
+	open_files_.clear();
+	defines_ = &defines;
+	const bool success = append(path, true);
+	defines_ = nullptr;
+	return success;
+}
+
+bool ShaderSource::append(const std::string& include_path, bool root) {
+	const std::string path = normalizePath(include_path);
+	// a file including itself, directly or not: its guard is defined already
+	if (std::find(open_files_.begin(), open_files_.end(), path) != open_files_.end()) {
+		return true;
+	}
+	std::ifstream file{ path };
+	if (!file) {
+		std::cout << "ShaderSource : failed to read " << path << std::endl;
+		return false;
+	}
+	// a file included again keeps its source string number
+	const auto known = std::find(files_.begin(), files_.end(), path);
+	const size_t file_index = static_cast<size_t>(known - files_.begin());
+	if (known == files_.end()) {
+		files_.push_back(path);
+	}
+	open_files_.push_back(path);
+	if (!root) {
+		const std::string guard = "GL460_INCLUDED_" + std::to_string(file_index);
+		code_ += "#ifndef " + guard + "\n#define " + guard + "\n#line 1 " + std::to_string(file_index) + "\n";
+	}
+
+	bool defines_written = !root;
+	auto writeDefines = [this, &defines_written]() {
+		for (const auto& define : defines_->values()) {
+			code_ += "#define " + define.first + " " + define.second + "\n";
+		}
+		defines_written = true;
+	};
+
+	std::string line;
+	int line_number = 0;
+	while (std::getline(file, line)) {
+		++line_number;
+		if (isVersion(line)) {
+			// only the root file may (and must) start with #version
+			if (root) {
+				code_ += line + "\n";
+				writeDefines();
+				code_ += "#line " + std::to_string(line_number + 1) + " " + std::to_string(file_index) + "\n";
+			}
+			continue;
+		}
+		if (!defines_written) {
+			writeDefines();
+			code_ += "#line " + std::to_string(line_number) + " " + std::to_string(file_index) + "\n";
+		}
+
+		std::string include;
+		if (parseInclude(line, include)) {
+			if (!append(directoryOf(path) + include, false)) {
+				std::cout << "ShaderSource : included from " << path << "(" << line_number << ")" << std::endl;
+				return false;
+			}
+			code_ += "#line " + std::to_string(line_number + 1) + " " + std::to_string(file_index) + "\n";
+			continue;
+		}
+		code_ += line + "\n";
+	}
+	if (!root) {
+		code_ += "#endif\n";
+	}
+	open_files_.pop_back();
+	return true;
+}
+} // namespace gl460
@@ -0,0 +1,50 @@
+#ifndef GL_SHADER_SOURCE_H
+#define GL_SHADER_SOURCE_H
+#include <initializer_list>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace gl460 {
+/// Permutation keys of a shader variant, kept sorted so equal sets give equal keys.
+class ShaderDefines {
+public:
+	ShaderDefines() = default;
+	ShaderDefines(std::initializer_list<std::pair<std::string, std::string>> defines);
+
+	ShaderDefines& set(const std::string& name, const std::string& value = "1");
+	ShaderDefines& set(const std::string& name, int value) { return set(name, std::to_string(value)); }
+
+	/// "NAME=VALUE;..." in name order
+	std::string key() const;
+	bool empty() const { return values_.empty(); }
+	const std::vector<std::pair<std::string, std::string>>& values() const { return values_; }
+
+private:
+	std::vector<std::pair<std::string, std::string>> values_;
+};
+
+/// GLSL front-end: resolves `#include "file"` (relative to the including
+/// file) and puts the defines right after `#version`. Includes are expanded
+/// whether or not they sit in a live `#if` branch, so each included text is
+/// wrapped in a generated include guard: the compiler keeps the first copy in
+/// live code. `#line` directives keep compiler messages pointing into the
+/// original files; the source string number N in a message is files()[N].
+class ShaderSource {
+public:
+	bool load(const std::string& path, const ShaderDefines& defines = {});
+
+	const std::string& code() const { return code_; }
+	const std::vector<std::string>& files() const { return files_; }
+
+private:
+	bool append(const std::string& path, bool root);
+
+	std::string code_;
+	std::vector<std::string> files_;	// normalized paths
+	std::vector<std::string> open_files_;	// being appended, for include cycles
+	const ShaderDefines* defines_ = nullptr;
+};
+} // namespace gl460
+
+#endif // !GL_SHADER_SOURCE_H
@@ -0,0 +1,101 @@
+#include "state_cache.h"
+#include <algorithm>
+
+namespace gl460 {
+
+StateCache::StateCache() {
+	GLint units = 0;
+	glGetIntegerv(GL_MAX_COMBINED_TEXTURE_IMAGE_UNITS, &units);
+	textures_.resize(units);
+	samplers_.resize(units);
+	invalidate();
+}
+
+void StateCache::invalidate() {
+	program_ = kUnknown;
+	vertex_array_ = kUnknown;
+	draw_indirect_buffer_ = kUnknown;
+	dispatch_indirect_buffer_ = kUnknown;
+	draw_framebuffer_ = kUnknown;
+	read_framebuffer_ = kUnknown;
+	viewport_known_ = false;
+	std::fill(textures_.begin(), textures_.end(), kUnknown);
+	std::fill(samplers_.begin(), samplers_.end(), kUnknown);
+}
+
+void StateCache::useProgram(GLuint program) {
+	if (update(program_, program)) {
+		glUseProgram(program);
+	}
+}
+
+void StateCache::bindVertexArray(GLuint vao) {
+	if (update(vertex_array_, vao)) {
+		glBindVertexArray(vao);
+	}
+}
+
+void StateCache::bindBuffer(GLenum target, GLuint buffer) {
+	GLuint* cached = target == GL_DRAW_INDIRECT_BUFFER ? &draw_indirect_buffer_
+		: target == GL_DISPATCH_INDIRECT_BUFFER ? &dispatch_indirect_buffer_ : nullptr;
+	if (!cached) {
+		++counters_.issued;
+		glBindBuffer(target, buffer);
+		return;
+	}
+	if (update(*cached, buffer)) {
+		glBindBuffer(target, buffer);
+	}
+}
+
+void StateCache::bindTextureUnit(GLuint unit, GLuint texture) {
+	if (unit >= textures_.size()) {
+		++counters_.issued;
+		glBindTextureUnit(unit, texture);
+		return;
+	}
+	if (update(textures_[unit], texture)) {
+		glBindTextureUnit(unit, texture);
+	}
+}
+
+void StateCache::bindSampler(GLuint unit, GLuint sampler) {
+	if (unit >= samplers_.size()) {
+		++counters_.issued;
+		glBindSampler(unit, sampler);
+		return;
+	}
+	if (update(samplers_[unit], sampler)) {
+		glBindSampler(unit, sampler);
+	}
+}
+
+void StateCache::bindFramebuffer(GLenum target, GLuint framebuffer) {
+	if (target == GL_FRAMEBUFFER) {
+		if (draw_framebuffer_ == framebuffer && read_framebuffer_ == framebuffer) {
+			++counters_.elided;
+			return;
+		}
+		draw_framebuffer_ = read_framebuffer_ = framebuffer;
+		++counters_.issued;
+		glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+		return;
+	}
+	GLuint& cached = target == GL_READ_FRAMEBUFFER ? read_framebuffer_ : draw_framebuffer_;
+	if (update(cached, framebuffer)) {
+		glBindFramebuffer(target, framebuffer);
+	}
+}
+
+void StateCache::viewport(const Viewport& viewport) {
+	if (viewport_known_ && viewport_.x == viewport.x && viewport_.y == viewport.y
+		&& viewport_.w == viewport.w && viewport_.h == viewport.h) {
+		++counters_.elided;
+		return;
+	}
+	viewport_ = viewport;
+	viewport_known_ = true;
+	++counters_.issued;
+	glViewport(viewport.x, viewport.y, viewport.w, viewport.h);
+}
+} // namespace gl460
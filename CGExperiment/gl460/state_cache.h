@@ -0,0 +1,68 @@
+#ifndef GL_STATE_CACHE_H
+#define GL_STATE_CACHE_H
+#include <glad/glad.h>
+#include "common.h"
+
+#include <cstdint>
+#include <vector>
+
+namespace gl460 {
+/// Shadows the bind state of the context and drops calls that would not
+/// change it. Everything that binds program, VAO, textures, samplers,
+/// framebuffers or viewport must go through the cache, otherwise call
+/// invalidate() after touching the state directly.
+class StateCache {
+public:
+	struct Counters {
+		uint32_t issued = 0;
+		uint32_t elided = 0;
+	};
+
+	explicit StateCache();
+
+	void useProgram(GLuint program);
+	void bindVertexArray(GLuint vao);
+	/// GL_DRAW_INDIRECT_BUFFER, GL_DISPATCH_INDIRECT_BUFFER, ... (not the VAO owned element buffer)
+	void bindBuffer(GLenum target, GLuint buffer);
+	/// DSA bind, no glActiveTexture selector involved
+	void bindTextureUnit(GLuint unit, GLuint texture);
+	void bindSampler(GLuint unit, GLuint sampler);
+	/// GL_FRAMEBUFFER updates both the draw and the read binding
+	void bindFramebuffer(GLenum target, GLuint framebuffer);
+	void viewport(const Viewport& viewport);
+
+	/// forget the shadowed state, the next bind of anything is issued
+	void invalidate();
+
+	const Counters& counters() const { return counters_; }
+	void resetCounters() { counters_ = Counters{}; }
+
+private:
+	static constexpr GLuint kUnknown = 0xFFFFFFFFu;
+
+	bool update(GLuint& cached, GLuint value) {
+		if (cached == value) {
+			++counters_.elided;
+			return false;
+		}
+		cached = value;
+		++counters_.issued;
+		return true;
+	}
+
+	GLuint program_;
+	GLuint vertex_array_;
+	GLuint draw_indirect_buffer_;
+	GLuint dispatch_indirect_buffer_;
+	GLuint draw_framebuffer_;
+	GLuint read_framebuffer_;
+	Viewport viewport_;
+	bool viewport_known_;
+	std::vector<GLuint> textures_;
+	std::vector<GLuint> samplers_;
+
+	Counters counters_;
+};
+} // namespace gl460
+
+#endif // !GL_STATE_CACHE_H
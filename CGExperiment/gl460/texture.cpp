@@ -0,0 +1,74 @@
+#include "texture.h"
+#include <utility>
+
+namespace gl460 {
+
+GLenum TextureDesc::target() const {
+	const bool is_array = array || layers > 1;
+	if (samples > 1) {
+		return is_array ? GL_TEXTURE_2D_MULTISAMPLE_ARRAY : GL_TEXTURE_2D_MULTISAMPLE;
+	}
+	return is_array ? GL_TEXTURE_2D_ARRAY : GL_TEXTURE_2D;
+}
+
+Texture::Texture(const TextureDesc& desc) : desc_(desc) {
+	const GLenum target = desc.target();
+	glCreateTextures(target, 1, &id_);
+	switch (target) {
+	case GL_TEXTURE_2D:
+		glTextureStorage2D(id_, desc.levels, desc.format, desc.width, desc.height);
+		break;
+	case GL_TEXTURE_2D_ARRAY:
+		glTextureStorage3D(id_, desc.levels, desc.format, desc.width, desc.height, desc.layers);
+		break;
+	case GL_TEXTURE_2D_MULTISAMPLE:
+		glTextureStorage2DMultisample(id_, desc.samples, desc.format, desc.width, desc.height, GL_TRUE);
+		break;
+	case GL_TEXTURE_2D_MULTISAMPLE_ARRAY:
+		glTextureStorage3DMultisample(id_, desc.samples, desc.format, desc.width, desc.height, desc.layers, GL_TRUE);
+		break;
+	}
+}
+
+Texture::Texture(Texture&& other) noexcept : id_(other.id_), desc_(other.desc_) {
+	other.id_ = 0;
+}
+
+Texture& Texture::operator=(Texture&& other) noexcept {
+	std::swap(id_, other.id_);
+	std::swap(desc_, other.desc_);
+	return *this;
+}
+
+Texture::~Texture() {
+	if (id_) {
+		glDeleteTextures(1, &id_);
+	}
+}
+
+void Texture::setParameter(GLenum name, GLint value) {
+	glTextureParameteri(id_, name, value);
+}
+
+void Texture::setParameter(GLenum name, const GLfloat* values) {
+	glTextureParameterfv(id_, name, values);
+}
+
+static GLsizeiptr bytesPerTexel(GLenum format) {
+	switch (format) {
+	case GL_R8: return 1;
+	case GL_RG8: case GL_R16F: case GL_DEPTH_COMPONENT16: return 2;
+	case GL_RGB8: case GL_DEPTH_COMPONENT24: return 3;
+	case GL_RGBA16F: case GL_RG32F: return 8;
+	case GL_RGBA32F: return 16;
+	default: return 4;
+	}
+}
+
+GLsizeiptr Texture::byteSize() const {
+	GLsizeiptr texels = static_cast<GLsizeiptr>(desc_.width) * desc_.height * desc_.layers * desc_.samples;
+	// a full mip chain adds a third
+	if (desc_.levels > 1) texels += texels / 3;
+	return texels * bytesPerTexel(desc_.format);
+}
+} // namespace gl460
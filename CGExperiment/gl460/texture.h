@@ -0,0 +1,55 @@
+#ifndef GL_TEXTURE_H
+#define GL_TEXTURE_H
+#include <glad/glad.h>
+
+namespace gl460 {
+/// Everything that decides the storage of a texture. `layers > 1` (or `array`)
+/// makes an array texture, `samples > 1` a multisample one.
+struct TextureDesc {
+	GLenum format = GL_RGBA8;
+	GLsizei width = 0;
+	GLsizei height = 0;
+	GLsizei samples = 1;
+	GLsizei layers = 1;
+	GLsizei levels = 1;
+	bool array = false;
+
+	GLenum target() const;
+
+	bool operator==(const TextureDesc& other) const {
+		return format == other.format && width == other.width && height == other.height
+			&& samples == other.samples && layers == other.layers && levels == other.levels
+			&& array == other.array;
+	}
+	bool operator!=(const TextureDesc& other) const { return !(*this == other); }
+};
+
+/// Immutable-storage texture created with DSA (glCreateTextures/glTextureStorage*).
+class Texture {
+public:
+	explicit Texture() noexcept {}
+	explicit Texture(const TextureDesc& desc);
+	Texture(const Texture&) = delete;
+	Texture(Texture&& other) noexcept;
+
+	~Texture();
+
+	Texture& operator=(const Texture&) = delete;
+	Texture& operator=(Texture&& other) noexcept;
+
+	GLuint id() const { return id_; }
+	const TextureDesc& desc() const { return desc_; }
+
+	void setParameter(GLenum name, GLint value);
+	void setParameter(GLenum name, const GLfloat* values);
+
+	/// rough size of the storage, used for the pool statistics
+	GLsizeiptr byteSize() const;
+
+private:
+	GLuint id_ = 0;
+	TextureDesc desc_;
+};
+} // namespace gl460
+
+#endif // !GL_TEXTURE_H
@@ -11,17 +11,46 @@
 #include <learnopengl/camera.h>
 //#include <learnopengl/model.h>
 #include "gl460/program.h"
-
+#include "gl460/program_cache.h"
+#include "gl460/compile_queue.h"
+#include "gl460/program_variants.h"
+#include "gl460/program_reloader.h"
+#include "gl460/buffer.h"
+#include "gl460/block_layout.h"
+#include "gl460/ring_buffer.h"
+#include "gl460/draw_list.h"
+#include "gl460/state_cache.h"
+#include "gl460/framebuffer.h"
+#include "gl460/render_target_pool.h"
+#include "benchmark.h"
+#include "shadow_cascades.h"
+#include "shadow_cache.h"
+#include "shadow_moments.h"
+#include "clustered_lighting.h"
+
+#include <chrono>
+#include <cmath>
 #include <iostream>
+#include <map>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
 
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
 void mouse_callback(GLFWwindow* window, double xpos, double ypos);
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset);
 void processInput(GLFWwindow *window);
+void followCameraPath(int frame);
 unsigned int loadTexture(const char *path);
-void renderScene(gl460::Program &shader);
-void renderCube();
-void renderQuad();
+gl460::MeshHandle createPlaneMesh(gl460::MeshPool& pool);
+gl460::MeshHandle createCubeMesh(gl460::MeshPool& pool);
+void buildScene(gl460::DrawList& drawList, const gl460::MeshHandle& plane, const gl460::MeshHandle& cube, int extraInstances);
+std::vector<ClusteredLighting::Light> createLights(int count);
+void animateLights(const std::vector<ClusteredLighting::Light>& base, std::vector<ClusteredLighting::Light>& lights, float time);
+void writeFrameData(gl460::BlockWriter<gl460::Std140>& block, const glm::mat4& projection, const glm::mat4& view,
+	const ShadowCascades& cascades, const glm::vec3& viewPos, const glm::vec3& lightDirection);
+void renderQuad(gl460::StateCache& state);
 
 // settings
 const unsigned int SCR_WIDTH = 1280;
@@ -33,21 +62,41 @@ float lastX = (float)SCR_WIDTH / 2.0;
 float lastY = (float)SCR_HEIGHT / 2.0;
 bool firstMouse = true;
 
+// shader permutation of the lit pass, the shadow filter comes from --shadow-filter
+const int PCF_KERNEL_SIZE = 5;
+// box radius in texels of the VSM/EVSM blur
+const int SHADOW_BLUR_RADIUS = 2;
+
+// shadows: cascades of a directional light, see shaders/shadow.glsl
+const int SHADOW_CASCADES = 4;
+const int SHADOW_RESOLUTION = 1024;
+const float SHADOW_DISTANCE = 40.0f;
+const float CAMERA_NEAR = 0.1f;
+const float CAMERA_FAR = 100.0f;
+
 // timing
 float deltaTime = 0.0f;
 float lastFrame = 0.0f;
+// animation step of headless runs, which advance by frames, not wall clock
+const float BENCH_FRAME_TIME = 1.0f / 60.0f;
 
-// meshes
-unsigned int planeVAO;
+// uniform/storage block binding points, see shadow_mapping*.vs
+const GLuint FRAME_DATA_BINDING = 0;
+const GLuint OBJECT_DATA_BINDING = 0;
 
-int main()
+int main(int argc, char** argv)
 {
+	BenchmarkOptions bench = BenchmarkOptions::parse(argc, argv);
+
 	// glfw: initialize and configure
 	// ------------------------------
 	glfwInit();
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
-	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 5);
 	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+	// headless runs still need a context, the window just never shows up
+	if (bench.headless)
+		glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
 
 	// glfw window creation
 	// --------------------
@@ -59,12 +108,15 @@ int main()
 		return -1;
 	}
 	glfwMakeContextCurrent(window);
-	glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
-	glfwSetCursorPosCallback(window, mouse_callback);
-	glfwSetScrollCallback(window, scroll_callback);
+	if (!bench.headless)
+	{
+		glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
+		glfwSetCursorPosCallback(window, mouse_callback);
+		glfwSetScrollCallback(window, scroll_callback);
 
-	// tell GLFW to capture our mouse
-	glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+		// tell GLFW to capture our mouse
+		glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+	}
 
 	// glad: load all OpenGL function pointers
 	// ---------------------------------------
@@ -73,92 +125,204 @@ int main()
 		std::cout << "Failed to initialize GLAD" << std::endl;
 		return -1;
 	}
+	gl460::loadParallelShaderCompile((GLADloadproc)glfwGetProcAddress);
 
 	// configure global opengl state
 	// -----------------------------
 	glEnable(GL_DEPTH_TEST);
+	// from here on binds go through the cache, which skips the redundant ones
+	gl460::StateCache state;
+	const bool debugShadowMap = false;
+
+	// build and compile shaders, linked binaries are reused from the last run when nothing changed
+	// ---------------------------------------------------------------------------------------------
+	const auto linkStart = std::chrono::steady_clock::now();
+	gl460::ProgramBinaryCache programCache("shader_cache");
+	gl460::ProgramBinaryCache* programCachePtr = bench.program_cache ? &programCache : nullptr;
+
+	// the fallback is tiny and linked right away, everything else compiles in the
+	// background and is swapped in by compileQueue.poll() once the driver is done
+	gl460::Program fallbackShader;
+	fallbackShader.attachShaders({ {gl460::ShaderType::Vertex, "shaders/fallback.vs"},
+		{gl460::ShaderType::Fragment, "shaders/fallback.fs" } });
+	fallbackShader.link(programCachePtr);
+
+	gl460::CompileQueue compileQueue;
+	gl460::ProgramVariantCache programVariants(compileQueue, programCachePtr);
+	// the lit program is a permutation of shadow_mapping.fs, only this one variant gets compiled
+	gl460::ShaderDefines litDefines;
+	litDefines.set("SHADOW_ENABLED", 1).set("SHADOW_FILTER", static_cast<int>(bench.shadow_filter))
+		.set("PCF_KERNEL_SIZE", PCF_KERNEL_SIZE).set("NORMAL_MAPPING", 0).set("CLUSTERED_LIGHTING", bench.lights > 0 ? 1 : 0);
+	gl460::Program& shader = programVariants.get({ {gl460::ShaderType::Vertex, "shaders/shadow_mapping.vs"},
+		{gl460::ShaderType::Fragment, "shaders/shadow_mapping.fs" } }, litDefines, [](gl460::Program& program) {
+		program.set(program.uniform<int>("diffuseTexture"), 0);
+		program.set(program.uniform<int>("shadowMap"), 1);
+	});
+	// VSM/EVSM receivers read blurred moments instead of the depth map
+	std::unique_ptr<ShadowMoments> shadowMoments;
+	if (bench.shadow_filter == ShadowFilter::Variance || bench.shadow_filter == ShadowFilter::ExponentialVariance)
+	{
+		const auto kind = bench.shadow_filter == ShadowFilter::Variance ?
+			ShadowMoments::Kind::Variance : ShadowMoments::Kind::ExponentialVariance;
+		shadowMoments = std::make_unique<ShadowMoments>(kind, SHADOW_RESOLUTION, SHADOW_CASCADES, SHADOW_BLUR_RADIUS, programVariants);
+	}
 
-	// build and compile shaders
-	gl460::Program shader;
-	shader.attachShaders({ {gl460::ShaderType::Vertex, "shaders/shadow_mapping.vs"},
-		{gl460::ShaderType::Fragment, "shaders/shadow_mapping.fs" } });
-	shader.link();
+	// point and spot lights are binned into clusters by a compute pass
+	std::unique_ptr<ClusteredLighting> clusteredLighting;
+	if (bench.lights > 0)
+		clusteredLighting = std::make_unique<ClusteredLighting>(programVariants);
 
 	//shader.validate();
 	gl460::Program simpleDepthShader;
 	simpleDepthShader.attachShaders({ {gl460::ShaderType::Vertex, "shaders/shadow_mapping_depth.vs"},
 		{gl460::ShaderType::Fragment, "shaders/shadow_mapping_depth.fs" } });
-	simpleDepthShader.link();
+	gl460::Uniform<int> depthCascade;
+	auto resolveDepthHandles = [&](gl460::Program& program) {
+		depthCascade = program.uniform<int>("cascade");
+	};
+	compileQueue.submit(simpleDepthShader, programCachePtr, resolveDepthHandles);
 
+	// resolve uniform handles once, the render loop only sets through them
+	gl460::Uniform<int> debugLayer;
 	gl460::Program debugDepthQuad;
-	debugDepthQuad.attachShaders({ {gl460::ShaderType::Vertex, "shaders/shadow_mapping_depth.vs"},
-		{gl460::ShaderType::Fragment, "shaders/shadow_mapping_depth.fs" } });
-	debugDepthQuad.link();
-
-	// set up vertex data (and buffer(s)) and configure vertex attributes
-	// ------------------------------------------------------------------
-	float planeVertices[] = {
-		// positions            // normals         // texcoords
-		 25.0f, -0.5f,  25.0f,  0.0f, 1.0f, 0.0f,  25.0f,  0.0f,
-		-25.0f, -0.5f,  25.0f,  0.0f, 1.0f, 0.0f,   0.0f,  0.0f,
-		-25.0f, -0.5f, -25.0f,  0.0f, 1.0f, 0.0f,   0.0f, 25.0f,
-
-		 25.0f, -0.5f,  25.0f,  0.0f, 1.0f, 0.0f,  25.0f,  0.0f,
-		-25.0f, -0.5f, -25.0f,  0.0f, 1.0f, 0.0f,   0.0f, 25.0f,
-		 25.0f, -0.5f, -25.0f,  0.0f, 1.0f, 0.0f,  25.0f, 25.0f
+	debugDepthQuad.attachShaders({ {gl460::ShaderType::Vertex, "shaders/debug_quad.vs"},
+		{gl460::ShaderType::Fragment, "shaders/debug_quad_depth.fs" } });
+	auto resolveDebugHandles = [&](gl460::Program& program) {
+		debugLayer = program.uniform<int>("layer");
 	};
-	// plane VAO
-	unsigned int planeVBO;
-	glGenVertexArrays(1, &planeVAO);
-	glGenBuffers(1, &planeVBO);
-	glBindVertexArray(planeVAO);
-	glBindBuffer(GL_ARRAY_BUFFER, planeVBO);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(planeVertices), planeVertices, GL_STATIC_DRAW);
-	glEnableVertexAttribArray(0);
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
-	glEnableVertexAttribArray(1);
-	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(3 * sizeof(float)));
-	glEnableVertexAttribArray(2);
-	glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(6 * sizeof(float)));
-	glBindVertexArray(0);
+	compileQueue.submit(debugDepthQuad, programCachePtr, [&](gl460::Program& program) {
+		resolveDebugHandles(program);
+		program.set(program.uniform<int>("depthMap"), 0);
+	});
+
+	// interactive runs pick up shader edits without a restart, uniform values carry over
+	std::unique_ptr<gl460::ProgramReloader> programReloader;
+	if (!bench.headless)
+	{
+		programReloader = std::make_unique<gl460::ProgramReloader>(programCachePtr);
+		programReloader->track(shader);
+		programReloader->track(simpleDepthShader, resolveDepthHandles);
+		programReloader->track(debugDepthQuad, resolveDebugHandles);
+		programReloader->track(fallbackShader);
+		if (shadowMoments)
+			shadowMoments->track(*programReloader);
+		if (clusteredLighting)
+			clusteredLighting->track(*programReloader);
+	}
+
+	std::map<std::string, double> startup;
+	startup["program_submit_ms"] = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - linkStart).count();
+	// measurements must not include fallback frames
+	if (bench.headless)
+		compileQueue.finishAll();
+	bool programsReported = false;
+
+	// set up vertex data: every mesh lives in one pool so a pass is a single multi-draw
+	// ---------------------------------------------------------------------------------
+	gl460::MeshPool meshPool;
+	gl460::MeshHandle planeMesh = createPlaneMesh(meshPool);
+	gl460::MeshHandle cubeMesh = createCubeMesh(meshPool);
+
+	// the scene is static: one draw list, replayed by the shadow and the lit pass;
+	// the culled lists are subsets of it, so it sizes the pool's draw IDs
+	// ----------------------------------------------------------------------------
+	gl460::DrawList drawList;
+	buildScene(drawList, planeMesh, cubeMesh, bench.instances);
+	drawList.build();
+	meshPool.upload(static_cast<GLuint>(drawList.instanceCount()));
+
+	// per-frame data: one uniform block shared by the depth and the lit program
+	// --------------------------------------------------------------------------
+	gl460::BlockWriter<gl460::Std140> frameBlock;
+
+	// dynamic lights: the base placement stays, a copy is animated every frame
+	const std::vector<ClusteredLighting::Light> baseLights = createLights(bench.lights);
+	std::vector<ClusteredLighting::Light> lights = baseLights;
+
+	// all per-frame dynamic data is sub-allocated from a triple-buffered persistent ring
+	// (the camera list plus one culled list per cascade at most, and the lights)
+	gl460::RingBuffer dynamicData((1 << 20) + (1 + SHADOW_CASCADES) * drawList.instanceCount() * sizeof(glm::mat4)
+		+ lights.size() * sizeof(ClusteredLighting::Light));
+
+	// shadow casters are culled per cascade into their own lists
+	ShadowCascades cascades(SHADOW_CASCADES, SHADOW_RESOLUTION);
+	std::vector<gl460::DrawList> cascadeLists(cascades.count());
 
 	// load textures
 	// -------------
 	unsigned int woodTexture = loadTexture("textures/wood.png");
 
-	// configure depth map FBO
-	// -----------------------
-	const unsigned int SHADOW_WIDTH = 1024, SHADOW_HEIGHT = 1024;
-	unsigned int depthMapFBO;
-	glGenFramebuffers(1, &depthMapFBO);
-	// create depth texture
-	unsigned int depthMap;
-	glGenTextures(1, &depthMap);
-	glBindTexture(GL_TEXTURE_2D, depthMap);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT, SHADOW_WIDTH, SHADOW_HEIGHT, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+	// render targets: textures come from the pool, the framebuffers only reference them
+	// -----------------------------------------------------------------------------------
+	gl460::RenderTargetPool renderTargets;
+	// the shadow map keeps its content across frames (see ShadowCache), so it is
+	// owned here instead of being a transient pool texture
+	gl460::TextureDesc shadowMapDesc;
+	shadowMapDesc.format = GL_DEPTH_COMPONENT24;
+	shadowMapDesc.width = SHADOW_RESOLUTION;
+	shadowMapDesc.height = SHADOW_RESOLUTION;
+	shadowMapDesc.layers = cascades.count();
+	shadowMapDesc.array = true;
+	gl460::Texture depthMap(shadowMapDesc);
+	// one framebuffer per cascade, each renders into its own layer of the array
+	std::vector<gl460::Framebuffer> cascadeFBOs;
+	cascadeFBOs.reserve(cascades.count());
+	for (int i = 0; i < cascades.count(); ++i)
+	{
+		cascadeFBOs.emplace_back(Viewport{ 0, 0, SHADOW_RESOLUTION, SHADOW_RESOLUTION });
+		cascadeFBOs.back().attachLayer(GL_DEPTH_ATTACHMENT, depthMap, i).drawBuffers({});
+		cascadeFBOs.back().validate("shadow cascade");
+	}
+	ShadowCache shadowCache(cascades.count());
+
+	// pooled textures are shared by every pass with the same description, so
+	// sampling state lives in a sampler object instead of the texture
+	// the lit pass compares in the sampler (sampler2DArrayShadow): with linear
+	// filtering every fetch returns four filtered depth tests
+	GLuint shadowSampler, depthSampler;
+	glCreateSamplers(1, &shadowSampler);
+	glSamplerParameteri(shadowSampler, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glSamplerParameteri(shadowSampler, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glSamplerParameteri(shadowSampler, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+	glSamplerParameteri(shadowSampler, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
 	float borderColor[] = { 1.0, 1.0, 1.0, 1.0 };
-	glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, borderColor);
-	// attach depth texture as FBO's depth buffer
-	glBindFramebuffer(GL_FRAMEBUFFER, depthMapFBO);
-	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthMap, 0);
-	glDrawBuffer(GL_NONE);
-	glReadBuffer(GL_NONE);
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
-
+	glSamplerParameterfv(shadowSampler, GL_TEXTURE_BORDER_COLOR, borderColor);
+	glSamplerParameteri(shadowSampler, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+	glSamplerParameteri(shadowSampler, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+	// the debug view reads raw depth
+	glCreateSamplers(1, &depthSampler);
+	glSamplerParameteri(depthSampler, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glSamplerParameteri(depthSampler, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+	// offscreen scene target (headless only, the window's framebuffer is used otherwise)
+	// ------------------------------------------------------------------------------------
+	gl460::Framebuffer sceneFBO;
+	sceneFBO.setViewport({ 0, 0, SCR_WIDTH, SCR_HEIGHT });
+	if (bench.headless)
+	{
+		gl460::TextureDesc colorDesc;
+		colorDesc.format = GL_RGBA8;
+		colorDesc.width = SCR_WIDTH;
+		colorDesc.height = SCR_HEIGHT;
+		gl460::TextureDesc depthDesc = colorDesc;
+		depthDesc.format = GL_DEPTH_COMPONENT24;
+
+		sceneFBO = gl460::Framebuffer({ 0, 0, SCR_WIDTH, SCR_HEIGHT });
+		sceneFBO.attach(gl460::Framebuffer::ColorAttachment(0), renderTargets.acquire(colorDesc))
+			.attach(GL_DEPTH_ATTACHMENT, renderTargets.acquire(depthDesc))
+			.drawBuffers({ gl460::Framebuffer::ColorAttachment(0) });
+		sceneFBO.validate("scene");
+	}
 
-	// shader configuration
-	// --------------------
-	shader.use();	
-	glProgramUniform1i(shader.id(), shader.uniformLocation("diffuseTexture"), 0);
-	glProgramUniform1i(shader.id(), shader.uniformLocation("shadowMap"), 1);
+	// frame timing
+	// ------------
+	GpuTimer gpuTimer;
+	std::vector<double> cpuFrameTimes;
+	cpuFrameTimes.reserve(bench.frames);
+	FrameCounters frameCounters;
+	const int totalFrames = bench.warmup + bench.frames;
+	int frame = 0;
 
-	debugDepthQuad.use();
-	//debugDepthQuad.setInt("depthMap", 0);
-	glProgramUniform1i(debugDepthQuad.id(), shader.uniformLocation("shadowMap"), 0);
 
 	// lighting info
 	// -------------
@@ -166,208 +330,370 @@ int main()
 
 	// render loop
 	// -----------
-	while (!glfwWindowShouldClose(window))
+	while (bench.headless ? frame < totalFrames : !glfwWindowShouldClose(window))
 	{
+		const bool timed = bench.headless && frame >= bench.warmup;
+		const auto cpuStart = std::chrono::steady_clock::now();
+		if (timed)
+			gpuTimer.begin();
+
 		// per-frame time logic
 		// --------------------
 		float currentFrame = glfwGetTime();
 		deltaTime = currentFrame - lastFrame;
 		lastFrame = currentFrame;
+		// like the camera path, so every benchmark run animates the same
+		const float animationTime = bench.headless ? frame * BENCH_FRAME_TIME : currentFrame;
+
+		// swap in programs the driver finished compiling
+		// ----------------------------------------------
+		compileQueue.poll();
+		if (programReloader)
+			programReloader->poll();
+		if (!programsReported && compileQueue.pending() == 0)
+		{
+			startup["program_ready_ms"] = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - linkStart).count();
+			startup["program_cache_hits"] = programCache.stats().hits;
+			startup["program_cache_misses"] = programCache.stats().misses;
+			startup["program_cache_rejected"] = programCache.stats().rejected;
+			std::cout << "Programs ready after " << startup["program_ready_ms"] << " ms, binary cache "
+				<< programCache.stats().hits << " hits / " << programCache.stats().misses << " misses" << std::endl;
+			programsReported = true;
+		}
 
 		// input
 		// -----
-		processInput(window);
+		if (bench.headless)
+			followCameraPath(frame);
+		else
+			processInput(window);
 
 		// change light position over time
 		//lightPos.x = sin(glfwGetTime()) * 3.0f;
 		//lightPos.z = cos(glfwGetTime()) * 2.0f;
 		//lightPos.y = 5.0 + cos(glfwGetTime()) * 1.0f;
 
-		// render
-		// ------
-		glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
-		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+		// per-frame constants, uploaded once for both passes
+		// --------------------------------------------------
+		// directional light shining from lightPos towards the origin
+		const glm::vec3 lightDir = glm::normalize(-lightPos);
+		const float aspect = (float)SCR_WIDTH / (float)SCR_HEIGHT;
+		glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), aspect, CAMERA_NEAR, CAMERA_FAR);
+		glm::mat4 view = camera.GetViewMatrix();
+		cascades.update(view, glm::radians(camera.Zoom), aspect, CAMERA_NEAR, SHADOW_DISTANCE, lightDir);
+		dynamicData.beginFrame();
+		frameBlock.clear();
+		writeFrameData(frameBlock, projection, view, cascades, camera.Position, -lightDir);
+		auto frameData = dynamicData.upload(frameBlock.data(), frameBlock.size(), gl460::RingBuffer::uniformAlignment());
+		dynamicData.bindRange(gl460::BufferTarget::Uniform, FRAME_DATA_BINDING, frameData);
+		drawList.upload(dynamicData, OBJECT_DATA_BINDING);
+
+		// each cascade only draws the casters inside its own light volume, and
+		// only when its matrix or those casters changed since it was last drawn
+		shadowCache.beginFrame(depthMap.id(), simpleDepthShader.generation() + (shadowMoments ? shadowMoments->generation() : 0));
+		size_t shadowCasters = 0;
+		std::vector<int> dirtyCascades;
+		for (int i = 0; i < cascades.count(); ++i)
+		{
+			gl460::DrawList& casters = cascadeLists[i];
+			casters.clear();
+			casters.addVisible(drawList, gl460::Frustum::fromMatrix(cascades.cascade(i).view_projection), false);
+			casters.build();
+			if (!shadowCache.dirty(i, cascades.cascade(i).view_projection, casters))
+				continue;
+			casters.upload(dynamicData, OBJECT_DATA_BINDING);
+			shadowCasters += casters.instanceCount();
+			dirtyCascades.push_back(i);
+		}
 
 		// 1. render depth of scene to texture (from light's perspective)
 		// --------------------------------------------------------------
-		glm::mat4 lightProjection, lightView;
-		glm::mat4 lightSpaceMatrix;
-		float near_plane = 1.0f, far_plane = 7.5f;
-		//lightProjection = glm::perspective(glm::radians(45.0f), (GLfloat)SHADOW_WIDTH / (GLfloat)SHADOW_HEIGHT, near_plane, far_plane); // note that if you use a perspective projection matrix you'll have to change the light position as the current light position isn't enough to reflect the whole scene
-		lightProjection = glm::ortho(-10.0f, 10.0f, -10.0f, 10.0f, near_plane, far_plane);
-		lightView = glm::lookAt(lightPos, glm::vec3(0.0f), glm::vec3(0.0, 1.0, 0.0));
-		lightSpaceMatrix = lightProjection * lightView;
-		// render scene from light's point of view
-		simpleDepthShader.use();
-		simpleDepthShader.setMat4("lightSpaceMatrix", lightSpaceMatrix);
-
-		glViewport(0, 0, SHADOW_WIDTH, SHADOW_HEIGHT);
-		glBindFramebuffer(GL_FRAMEBUFFER, depthMapFBO);
-		glClear(GL_DEPTH_BUFFER_BIT);
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, woodTexture);
-		renderScene(simpleDepthShader);
-		glBindFramebuffer(GL_FRAMEBUFFER, 0);
-
-		// reset viewport
-		glViewport(0, 0, SCR_WIDTH, SCR_HEIGHT);
-		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+		renderTargets.beginFrame();
+		// without the programs the map stays cleared, i.e. nothing is in shadow,
+		// and the cascades stay dirty until the programs are ready
+		const bool shadowProgramsReady = simpleDepthShader.linked() && (!shadowMoments || shadowMoments->ready());
+		if (!dirtyCascades.empty())
+		{
+			// casters in front of a cascade's near plane are clamped onto it instead of clipped
+			glEnable(GL_DEPTH_CLAMP);
+			for (int i : dirtyCascades)
+			{
+				cascadeFBOs[i].bind(state);
+				cascadeFBOs[i].clearDepth();
+				if (shadowProgramsReady)
+				{
+					state.useProgram(simpleDepthShader.id());
+					simpleDepthShader.set(depthCascade, i);
+					cascadeLists[i].draw(meshPool, state);
+				}
+			}
+			glDisable(GL_DEPTH_CLAMP);
+
+			// prefiltered maps: blur the new depth into moments, then rebuild the mips
+			if (shadowProgramsReady)
+			{
+				for (int i : dirtyCascades)
+				{
+					if (shadowMoments)
+						shadowMoments->filter(depthMap, i, renderTargets, state);
+					shadowCache.markClean(i);
+				}
+				if (shadowMoments)
+					shadowMoments->generateMips();
+			}
+		}
+
+		// bin this frame's lights into the clusters of the current view
+		// -------------------------------------------------------------
+		if (clusteredLighting)
+		{
+			animateLights(baseLights, lights, animationTime);
+			clusteredLighting->setProjection(SCR_WIDTH, SCR_HEIGHT, glm::radians(camera.Zoom), CAMERA_NEAR, CAMERA_FAR);
+			clusteredLighting->cull(lights, dynamicData, state);
+		}
 
 		// 2. render scene as normal using the generated depth/shadow map  
 		// --------------------------------------------------------------
-		glViewport(0, 0, SCR_WIDTH, SCR_HEIGHT);
-		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-		shader.use();
-		glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
-		glm::mat4 view = camera.GetViewMatrix();
-		shader.setMat4("projection", projection);
-		shader.setMat4("view", view);
-		// set light uniforms
-		shader.setVec3("viewPos", camera.Position);
-		shader.setVec3("lightPos", lightPos);
-		shader.setMat4("lightSpaceMatrix", lightSpaceMatrix);
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, woodTexture);
-		glActiveTexture(GL_TEXTURE1);
-		glBindTexture(GL_TEXTURE_2D, depthMap);
-		renderScene(shader);
+		sceneFBO.bind(state);
+		sceneFBO.clearColor(0, glm::vec4(0.1f, 0.1f, 0.1f, 1.0f)).clearDepth();
+		state.useProgram(shader.linked() ? shader.id() : fallbackShader.id());
+		state.bindTextureUnit(0, woodTexture);
+		if (shadowMoments)
+		{
+			state.bindTextureUnit(1, shadowMoments->texture().id());
+			state.bindSampler(1, shadowMoments->sampler());
+		}
+		else
+		{
+			state.bindTextureUnit(1, depthMap.id());
+			state.bindSampler(1, shadowSampler);
+		}
+		drawList.draw(meshPool, state);
 
 		// render Depth map to quad for visual debugging
 		// ---------------------------------------------
-		debugDepthQuad.use();
-		//debugDepthQuad.setFloat("near_plane", near_plane);
-		//debugDepthQuad.setFloat("far_plane", far_plane);
-		glProgramUniform1f(debugDepthQuad.id(), shader.uniformLocation("near_plane"), near_plane);
-		glProgramUniform1f(debugDepthQuad.id(), shader.uniformLocation("shadowMap"), far_plane);
-
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, depthMap);
-		//renderQuad();
+		if (debugShadowMap && debugDepthQuad.linked())
+		{
+			state.useProgram(debugDepthQuad.id());
+			debugDepthQuad.set(debugLayer, 0);
+			state.bindTextureUnit(0, depthMap.id());
+			state.bindSampler(0, depthSampler);
+			renderQuad(state);
+			state.bindSampler(0, 0);
+		}
+
+		dynamicData.endFrame();
+		if (timed)
+			gpuTimer.end();
 
 		// glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
 		// -------------------------------------------------------------------------------
-		glfwSwapBuffers(window);
+		if (!bench.headless)
+			glfwSwapBuffers(window);
 		glfwPollEvents();
+
+		if (timed)
+		{
+			cpuFrameTimes.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - cpuStart).count());
+			frameCounters.add("ring_bytes", static_cast<double>(dynamicData.frameStats().bytes_used));
+			frameCounters.add("ring_fence_waits", dynamicData.frameStats().fence_waits);
+			frameCounters.add("state_changes_issued", state.counters().issued);
+			frameCounters.add("state_changes_elided", state.counters().elided);
+			frameCounters.add("shadow_casters", static_cast<double>(shadowCasters));
+			frameCounters.add("shadow_cascades_rendered", shadowCache.stats().rendered);
+			if (clusteredLighting)
+				frameCounters.add("light_clusters", clusteredLighting->stats().clusters);
+			frameCounters.add("render_target_allocations", renderTargets.stats().allocations);
+			frameCounters.add("render_target_bytes", static_cast<double>(renderTargets.stats().bytes));
+			frameCounters.endFrame();
+		}
+		state.resetCounters();
+		++frame;
+	}
+
+	if (bench.headless)
+	{
+		gpuTimer.flush();
+		if (writeBenchmarkReport(bench, SCR_WIDTH, SCR_HEIGHT, cpuFrameTimes, gpuTimer.samples(), frameCounters, startup))
+			std::cout << "Benchmark report written to " << bench.output << std::endl;
 	}
 
 	// optional: de-allocate all resources once they've outlived their purpose:
 	// ------------------------------------------------------------------------
-	glDeleteVertexArrays(1, &planeVAO);
-	glDeleteBuffers(1, &planeVBO);
+	glDeleteSamplers(1, &shadowSampler);
+	glDeleteSamplers(1, &depthSampler);
 
 	glfwTerminate();
 	return 0;
 }
 
-// renders the 3D scene
-// --------------------
-void renderScene(gl460::Program &shader)
+// fills the draw list: the floor, the three cubes and, for stress runs, a grid of
+// small cubes spread over the floor
+// --------------------------------------------------------------------------------
+void buildScene(gl460::DrawList& drawList, const gl460::MeshHandle& plane, const gl460::MeshHandle& cube, int extraInstances)
 {
 	// floor
 	glm::mat4 model = glm::mat4(1.0f);
-	shader.setMat4("model", model);
-	glBindVertexArray(planeVAO);
-	glDrawArrays(GL_TRIANGLES, 0, 6);
+	drawList.add(plane, model);
 	// cubes
 	model = glm::mat4(1.0f);
 	model = glm::translate(model, glm::vec3(0.0f, 1.5f, 0.0));
 	model = glm::scale(model, glm::vec3(0.5f));
-	shader.setMat4("model", model);
-	renderCube();
+	drawList.add(cube, model);
 	model = glm::mat4(1.0f);
 	model = glm::translate(model, glm::vec3(2.0f, 0.0f, 1.0));
 	model = glm::scale(model, glm::vec3(0.5f));
-	shader.setMat4("model", model);
-	renderCube();
+	drawList.add(cube, model);
 	model = glm::mat4(1.0f);
 	model = glm::translate(model, glm::vec3(-1.0f, 0.0f, 2.0));
 	model = glm::rotate(model, glm::radians(60.0f), glm::normalize(glm::vec3(1.0, 0.0, 1.0)));
 	model = glm::scale(model, glm::vec3(0.25));
-	shader.setMat4("model", model);
-	renderCube();
+	drawList.add(cube, model);
+
+	const int side = static_cast<int>(std::ceil(std::sqrt(static_cast<float>(extraInstances))));
+	for (int i = 0; i < extraInstances; ++i)
+	{
+		const float x = -24.0f + 48.0f * ((i % side) + 0.5f) / side;
+		const float z = -24.0f + 48.0f * ((i / side) + 0.5f) / side;
+		model = glm::mat4(1.0f);
+		model = glm::translate(model, glm::vec3(x, -0.3f, z));
+		model = glm::scale(model, glm::vec3(0.2f));
+		drawList.add(cube, model);
+	}
 }
 
+// scatters `count` point and spot lights of random color over the floor,
+// seeded so that every run gets the same lights
+// ----------------------------------------------------------------------
+std::vector<ClusteredLighting::Light> createLights(int count)
+{
+	std::mt19937 random(7);
+	std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+	std::vector<ClusteredLighting::Light> lights(count);
+	for (auto& light : lights)
+	{
+		light.position = glm::vec3(-24.0f + 48.0f * unit(random), 0.2f + 1.8f * unit(random), -24.0f + 48.0f * unit(random));
+		light.range = 1.5f + 2.5f * unit(random);
+		light.color = glm::vec3(unit(random), unit(random), unit(random)) * 2.0f;
+		// every fourth light is a spot pointing down
+		if (unit(random) < 0.25f)
+		{
+			light.direction = glm::vec3(0.0f, -1.0f, 0.0f);
+			light.cos_outer = std::cos(glm::radians(35.0f));
+			light.cos_inner = std::cos(glm::radians(25.0f));
+		}
+	}
+	return lights;
+}
 
-// renderCube() renders a 1x1 3D cube in NDC.
-// -------------------------------------------------
-unsigned int cubeVAO = 0;
-unsigned int cubeVBO = 0;
-void renderCube()
+// every light circles its base position with its own phase
+// --------------------------------------------------------
+void animateLights(const std::vector<ClusteredLighting::Light>& base, std::vector<ClusteredLighting::Light>& lights, float time)
 {
-	// initialize (if necessary)
-	if (cubeVAO == 0)
+	for (size_t i = 0; i < base.size(); ++i)
 	{
-		float vertices[] = {
-			// back face
-			-1.0f, -1.0f, -1.0f,  0.0f,  0.0f, -1.0f, 0.0f, 0.0f, // bottom-left
-			 1.0f,  1.0f, -1.0f,  0.0f,  0.0f, -1.0f, 1.0f, 1.0f, // top-right
-			 1.0f, -1.0f, -1.0f,  0.0f,  0.0f, -1.0f, 1.0f, 0.0f, // bottom-right         
-			 1.0f,  1.0f, -1.0f,  0.0f,  0.0f, -1.0f, 1.0f, 1.0f, // top-right
-			-1.0f, -1.0f, -1.0f,  0.0f,  0.0f, -1.0f, 0.0f, 0.0f, // bottom-left
-			-1.0f,  1.0f, -1.0f,  0.0f,  0.0f, -1.0f, 0.0f, 1.0f, // top-left
-			// front face
-			-1.0f, -1.0f,  1.0f,  0.0f,  0.0f,  1.0f, 0.0f, 0.0f, // bottom-left
-			 1.0f, -1.0f,  1.0f,  0.0f,  0.0f,  1.0f, 1.0f, 0.0f, // bottom-right
-			 1.0f,  1.0f,  1.0f,  0.0f,  0.0f,  1.0f, 1.0f, 1.0f, // top-right
-			 1.0f,  1.0f,  1.0f,  0.0f,  0.0f,  1.0f, 1.0f, 1.0f, // top-right
-			-1.0f,  1.0f,  1.0f,  0.0f,  0.0f,  1.0f, 0.0f, 1.0f, // top-left
-			-1.0f, -1.0f,  1.0f,  0.0f,  0.0f,  1.0f, 0.0f, 0.0f, // bottom-left
-			// left face
-			-1.0f,  1.0f,  1.0f, -1.0f,  0.0f,  0.0f, 1.0f, 0.0f, // top-right
-			-1.0f,  1.0f, -1.0f, -1.0f,  0.0f,  0.0f, 1.0f, 1.0f, // top-left
-			-1.0f, -1.0f, -1.0f, -1.0f,  0.0f,  0.0f, 0.0f, 1.0f, // bottom-left
-			-1.0f, -1.0f, -1.0f, -1.0f,  0.0f,  0.0f, 0.0f, 1.0f, // bottom-left
-			-1.0f, -1.0f,  1.0f, -1.0f,  0.0f,  0.0f, 0.0f, 0.0f, // bottom-right
-			-1.0f,  1.0f,  1.0f, -1.0f,  0.0f,  0.0f, 1.0f, 0.0f, // top-right
-			// right face
-			 1.0f,  1.0f,  1.0f,  1.0f,  0.0f,  0.0f, 1.0f, 0.0f, // top-left
-			 1.0f, -1.0f, -1.0f,  1.0f,  0.0f,  0.0f, 0.0f, 1.0f, // bottom-right
-			 1.0f,  1.0f, -1.0f,  1.0f,  0.0f,  0.0f, 1.0f, 1.0f, // top-right         
-			 1.0f, -1.0f, -1.0f,  1.0f,  0.0f,  0.0f, 0.0f, 1.0f, // bottom-right
-			 1.0f,  1.0f,  1.0f,  1.0f,  0.0f,  0.0f, 1.0f, 0.0f, // top-left
-			 1.0f, -1.0f,  1.0f,  1.0f,  0.0f,  0.0f, 0.0f, 0.0f, // bottom-left     
-			// bottom face
-			-1.0f, -1.0f, -1.0f,  0.0f, -1.0f,  0.0f, 0.0f, 1.0f, // top-right
-			 1.0f, -1.0f, -1.0f,  0.0f, -1.0f,  0.0f, 1.0f, 1.0f, // top-left
-			 1.0f, -1.0f,  1.0f,  0.0f, -1.0f,  0.0f, 1.0f, 0.0f, // bottom-left
-			 1.0f, -1.0f,  1.0f,  0.0f, -1.0f,  0.0f, 1.0f, 0.0f, // bottom-left
-			-1.0f, -1.0f,  1.0f,  0.0f, -1.0f,  0.0f, 0.0f, 0.0f, // bottom-right
-			-1.0f, -1.0f, -1.0f,  0.0f, -1.0f,  0.0f, 0.0f, 1.0f, // top-right
-			// top face
-			-1.0f,  1.0f, -1.0f,  0.0f,  1.0f,  0.0f, 0.0f, 1.0f, // top-left
-			 1.0f,  1.0f , 1.0f,  0.0f,  1.0f,  0.0f, 1.0f, 0.0f, // bottom-right
-			 1.0f,  1.0f, -1.0f,  0.0f,  1.0f,  0.0f, 1.0f, 1.0f, // top-right     
-			 1.0f,  1.0f,  1.0f,  0.0f,  1.0f,  0.0f, 1.0f, 0.0f, // bottom-right
-			-1.0f,  1.0f, -1.0f,  0.0f,  1.0f,  0.0f, 0.0f, 1.0f, // top-left
-			-1.0f,  1.0f,  1.0f,  0.0f,  1.0f,  0.0f, 0.0f, 0.0f  // bottom-left        
-		};
-		glGenVertexArrays(1, &cubeVAO);
-		glGenBuffers(1, &cubeVBO);
-		// fill buffer
-		glBindBuffer(GL_ARRAY_BUFFER, cubeVBO);
-		glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
-		// link vertex attributes
-		glBindVertexArray(cubeVAO);
-		glEnableVertexAttribArray(0);
-		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
-		glEnableVertexAttribArray(1);
-		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(3 * sizeof(float)));
-		glEnableVertexAttribArray(2);
-		glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(6 * sizeof(float)));
-		glBindBuffer(GL_ARRAY_BUFFER, 0);
-		glBindVertexArray(0);
+		const float phase = time + static_cast<float>(i) * 0.37f;
+		lights[i].position = base[i].position + glm::vec3(std::sin(phase), 0.0f, std::cos(phase)) * 0.75f;
 	}
-	// render Cube
-	glBindVertexArray(cubeVAO);
-	glDrawArrays(GL_TRIANGLES, 0, 36);
-	glBindVertexArray(0);
+}
+
+// packs the FrameData uniform block, member order must match shadow_mapping*.vs
+// -----------------------------------------------------------------------------
+void writeFrameData(gl460::BlockWriter<gl460::Std140>& block, const glm::mat4& projection, const glm::mat4& view,
+	const ShadowCascades& cascades, const glm::vec3& viewPos, const glm::vec3& lightDirection)
+{
+	glm::mat4 lightSpaceMatrices[ShadowCascades::kMaxCascades];
+	glm::vec4 splits(0.0f), texelSizes(0.0f);
+	for (int i = 0; i < cascades.count(); ++i)
+	{
+		lightSpaceMatrices[i] = cascades.cascade(i).view_projection;
+		splits[i] = cascades.cascade(i).split_far;
+		texelSizes[i] = 2.0f * cascades.cascade(i).radius / cascades.resolution();
+	}
+	block.write(projection);
+	block.write(view);
+	block.writeArray(lightSpaceMatrices, ShadowCascades::kMaxCascades);
+	block.write(splits);
+	block.write(texelSizes);
+	block.write(viewPos);
+	block.write(static_cast<GLint>(cascades.count()));
+	block.write(lightDirection);
+	block.finish();
+}
+
+// floor: a 50x50 quad at y = -0.5
+// --------------------------------
+gl460::MeshHandle createPlaneMesh(gl460::MeshPool& pool)
+{
+	float planeVertices[] = {
+		// positions            // normals         // texcoords
+		 25.0f, -0.5f,  25.0f,  0.0f, 1.0f, 0.0f,  25.0f,  0.0f,
+		-25.0f, -0.5f,  25.0f,  0.0f, 1.0f, 0.0f,   0.0f,  0.0f,
+		-25.0f, -0.5f, -25.0f,  0.0f, 1.0f, 0.0f,   0.0f, 25.0f,
+
+		 25.0f, -0.5f,  25.0f,  0.0f, 1.0f, 0.0f,  25.0f,  0.0f,
+		-25.0f, -0.5f, -25.0f,  0.0f, 1.0f, 0.0f,   0.0f, 25.0f,
+		 25.0f, -0.5f, -25.0f,  0.0f, 1.0f, 0.0f,  25.0f, 25.0f
+	};
+	return pool.addTriangles(planeVertices, 6);
+}
+
+// a 1x1 3D cube in NDC
+// --------------------
+gl460::MeshHandle createCubeMesh(gl460::MeshPool& pool)
+{
+	float vertices[] = {
+		// back face
+		-1.0f, -1.0f, -1.0f,  0.0f,  0.0f, -1.0f, 0.0f, 0.0f, // bottom-left
+		 1.0f,  1.0f, -1.0f,  0.0f,  0.0f, -1.0f, 1.0f, 1.0f, // top-right
+		 1.0f, -1.0f, -1.0f,  0.0f,  0.0f, -1.0f, 1.0f, 0.0f, // bottom-right         
+		 1.0f,  1.0f, -1.0f,  0.0f,  0.0f, -1.0f, 1.0f, 1.0f, // top-right
+		-1.0f, -1.0f, -1.0f,  0.0f,  0.0f, -1.0f, 0.0f, 0.0f, // bottom-left
+		-1.0f,  1.0f, -1.0f,  0.0f,  0.0f, -1.0f, 0.0f, 1.0f, // top-left
+		// front face
+		-1.0f, -1.0f,  1.0f,  0.0f,  0.0f,  1.0f, 0.0f, 0.0f, // bottom-left
+		 1.0f, -1.0f,  1.0f,  0.0f,  0.0f,  1.0f, 1.0f, 0.0f, // bottom-right
+		 1.0f,  1.0f,  1.0f,  0.0f,  0.0f,  1.0f, 1.0f, 1.0f, // top-right
+		 1.0f,  1.0f,  1.0f,  0.0f,  0.0f,  1.0f, 1.0f, 1.0f, // top-right
+		-1.0f,  1.0f,  1.0f,  0.0f,  0.0f,  1.0f, 0.0f, 1.0f, // top-left
+		-1.0f, -1.0f,  1.0f,  0.0f,  0.0f,  1.0f, 0.0f, 0.0f, // bottom-left
+		// left face
+		-1.0f,  1.0f,  1.0f, -1.0f,  0.0f,  0.0f, 1.0f, 0.0f, // top-right
+		-1.0f,  1.0f, -1.0f, -1.0f,  0.0f,  0.0f, 1.0f, 1.0f, // top-left
+		-1.0f, -1.0f, -1.0f, -1.0f,  0.0f,  0.0f, 0.0f, 1.0f, // bottom-left
+		-1.0f, -1.0f, -1.0f, -1.0f,  0.0f,  0.0f, 0.0f, 1.0f, // bottom-left
+		-1.0f, -1.0f,  1.0f, -1.0f,  0.0f,  0.0f, 0.0f, 0.0f, // bottom-right
+		-1.0f,  1.0f,  1.0f, -1.0f,  0.0f,  0.0f, 1.0f, 0.0f, // top-right
+		// right face
+		 1.0f,  1.0f,  1.0f,  1.0f,  0.0f,  0.0f, 1.0f, 0.0f, // top-left
+		 1.0f, -1.0f, -1.0f,  1.0f,  0.0f,  0.0f, 0.0f, 1.0f, // bottom-right
+		 1.0f,  1.0f, -1.0f,  1.0f,  0.0f,  0.0f, 1.0f, 1.0f, // top-right         
+		 1.0f, -1.0f, -1.0f,  1.0f,  0.0f,  0.0f, 0.0f, 1.0f, // bottom-right
+		 1.0f,  1.0f,  1.0f,  1.0f,  0.0f,  0.0f, 1.0f, 0.0f, // top-left
+		 1.0f, -1.0f,  1.0f,  1.0f,  0.0f,  0.0f, 0.0f, 0.0f, // bottom-left     
+		// bottom face
+		-1.0f, -1.0f, -1.0f,  0.0f, -1.0f,  0.0f, 0.0f, 1.0f, // top-right
+		 1.0f, -1.0f, -1.0f,  0.0f, -1.0f,  0.0f, 1.0f, 1.0f, // top-left
+		 1.0f, -1.0f,  1.0f,  0.0f, -1.0f,  0.0f, 1.0f, 0.0f, // bottom-left
+		 1.0f, -1.0f,  1.0f,  0.0f, -1.0f,  0.0f, 1.0f, 0.0f, // bottom-left
+		-1.0f, -1.0f,  1.0f,  0.0f, -1.0f,  0.0f, 0.0f, 0.0f, // bottom-right
+		-1.0f, -1.0f, -1.0f,  0.0f, -1.0f,  0.0f, 0.0f, 1.0f, // top-right
+		// top face
+		-1.0f,  1.0f, -1.0f,  0.0f,  1.0f,  0.0f, 0.0f, 1.0f, // top-left
+		 1.0f,  1.0f , 1.0f,  0.0f,  1.0f,  0.0f, 1.0f, 0.0f, // bottom-right
+		 1.0f,  1.0f, -1.0f,  0.0f,  1.0f,  0.0f, 1.0f, 1.0f, // top-right     
+		 1.0f,  1.0f,  1.0f,  0.0f,  1.0f,  0.0f, 1.0f, 0.0f, // bottom-right
+		-1.0f,  1.0f, -1.0f,  0.0f,  1.0f,  0.0f, 0.0f, 1.0f, // top-left
+		-1.0f,  1.0f,  1.0f,  0.0f,  1.0f,  0.0f, 0.0f, 0.0f  // bottom-left        
+	};
+	return pool.addTriangles(vertices, 36);
 }
 
 // renderQuad() renders a 1x1 XY quad in NDC
 // -----------------------------------------
 unsigned int quadVAO = 0;
 unsigned int quadVBO;
-void renderQuad()
+void renderQuad(gl460::StateCache& state)
 {
 	if (quadVAO == 0)
 	{
@@ -381,7 +707,7 @@ void renderQuad()
 		// setup plane VAO
 		glGenVertexArrays(1, &quadVAO);
 		glGenBuffers(1, &quadVBO);
-		glBindVertexArray(quadVAO);
+		state.bindVertexArray(quadVAO);
 		glBindBuffer(GL_ARRAY_BUFFER, quadVBO);
 		glBufferData(GL_ARRAY_BUFFER, sizeof(quadVertices), &quadVertices, GL_STATIC_DRAW);
 		glEnableVertexAttribArray(0);
@@ -389,9 +715,8 @@ void renderQuad()
 		glEnableVertexAttribArray(1);
 		glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)(3 * sizeof(float)));
 	}
-	glBindVertexArray(quadVAO);
+	state.bindVertexArray(quadVAO);
 	glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
-	glBindVertexArray(0);
 }
 
 // process all input: query GLFW whether relevant keys are pressed/released this frame and react accordingly
@@ -411,6 +736,19 @@ void processInput(GLFWwindow *window)
 		camera.ProcessKeyboard(RIGHT, deltaTime);
 }
 
+// fixed camera path for headless runs: one orbit around the scene every 360 frames,
+// so every run renders exactly the same sequence of views
+// ---------------------------------------------------------------------------------
+void followCameraPath(int frame)
+{
+	const float angle = glm::radians(static_cast<float>(frame % 360));
+	camera.Position = glm::vec3(6.0f * std::cos(angle), 2.5f, 6.0f * std::sin(angle));
+	glm::vec3 front = glm::normalize(-camera.Position);
+	camera.Yaw = glm::degrees(std::atan2(front.z, front.x));
+	camera.Pitch = glm::degrees(std::asin(front.y));
+	camera.ProcessMouseMovement(0.0f, 0.0f);
+}
+
 // glfw: whenever the window size changed (by OS or user resize) this callback function executes
 // ---------------------------------------------------------------------------------------------
 void framebuffer_size_callback(GLFWwindow* window, int width, int height)
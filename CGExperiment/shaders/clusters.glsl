@@ -0,0 +1,61 @@
+// Clustered lights, shared by cluster_cull.comp and the lit programs (ClusteredLighting).
+// The view frustum is cut into screen tiles x exponential depth slices; the
+// culling pass stores for every cluster the range of its lights in lightIndices.
+
+struct Light {
+    vec3 position;
+    float range;        // the light has no effect beyond this distance
+    vec3 color;
+    float cosInner;     // spot cone, full intensity inside
+    vec3 direction;     // spot direction
+    float cosOuter;     // spot cone, no light outside; -2 for point lights
+};
+
+layout (std140, binding = 1) uniform ClusterData {
+    ivec4 clusterGrid;      // tiles x, tiles y, depth slices, tile size in pixels
+    vec4 clusterSlicing;    // slice = log(viewDepth) * x + y, z: capacity of lightIndices
+};
+
+layout (std430, binding = 1) readonly buffer LightData {
+    Light lights[];
+};
+
+// per cluster: offset into lightIndices and light count
+layout (std430, binding = 3) buffer LightGrid {
+    uvec2 lightGrid[];
+};
+
+layout (std430, binding = 4) buffer LightIndices {
+    uint lightIndexCount;   // allocation counter of the culling pass
+    uint lightIndices[];
+};
+
+uint ClusterIndex(vec2 fragCoord, float viewDepth)
+{
+    ivec2 tile = ivec2(fragCoord) / clusterGrid.w;
+    int slice = clamp(int(log(viewDepth) * clusterSlicing.x + clusterSlicing.y), 0, clusterGrid.z - 1);
+    return uint(tile.x + clusterGrid.x * (tile.y + clusterGrid.y * slice));
+}
+
+// Blinn-Phong of the lights of the fragment's cluster; the cost follows the
+// local light density, not the total light count
+vec3 ShadeClusteredLights(vec3 fragPos, float viewDepth, vec3 normal, vec3 viewDir)
+{
+    uvec2 range = lightGrid[ClusterIndex(gl_FragCoord.xy, viewDepth)];
+    vec3 result = vec3(0.0);
+    for(uint i = 0u; i < range.y; ++i)
+    {
+        Light light = lights[lightIndices[range.x + i]];
+        vec3 toLight = light.position - fragPos;
+        float distance = length(toLight);
+        vec3 lightDir = toLight / distance;
+        // smooth window to zero at the range, on top of inverse square falloff
+        float window = clamp(1.0 - pow(distance / light.range, 4.0), 0.0, 1.0);
+        float attenuation = window * window / (distance * distance + 1.0);
+        attenuation *= smoothstep(light.cosOuter, light.cosInner, dot(-lightDir, light.direction));
+        float diff = max(dot(normal, lightDir), 0.0);
+        float spec = pow(max(dot(normal, normalize(lightDir + viewDir)), 0.0), 64.0);
+        result += (diff + spec) * attenuation * light.color;
+    }
+    return result;
+}
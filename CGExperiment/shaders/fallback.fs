@@ -0,0 +1,14 @@
+#version 450 core
+out vec4 FragColor;
+
+in vec3 FragPos;
+in vec3 Normal;
+
+#include "frame_data.glsl"
+
+void main()
+{
+    // flat grey lambert, no textures and no shadows
+    float diff = max(dot(normalize(Normal), normalize(lightDirection)), 0.0);
+    FragColor = vec4(vec3(0.3 + 0.5 * diff), 1.0);
+}
@@ -0,0 +1,21 @@
+#version 450 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aNormal;
+layout (location = 3) in uint aDrawID;
+
+// stand-in while the real programs compile in the background,
+// same inputs as shadow_mapping.vs so it can draw the same draw list
+#include "frame_data.glsl"
+
+#include "object_data.glsl"
+
+out vec3 FragPos;
+out vec3 Normal;
+
+void main()
+{
+    mat4 model = models[aDrawID];
+    FragPos = vec3(model * vec4(aPos, 1.0));
+    Normal = mat3(model) * aNormal;
+    gl_Position = projection * view * vec4(FragPos, 1.0);
+}
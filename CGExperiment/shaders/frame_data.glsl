@@ -0,0 +1,13 @@
+// per-frame constants, shared by every program of the frame (gl460::BlockWriter<Std140>)
+#define MAX_CASCADES 4
+
+layout (std140, binding = 0) uniform FrameData {
+    mat4 projection;
+    mat4 view;
+    mat4 lightSpaceMatrices[MAX_CASCADES];
+    vec4 cascadeSplits;         // view-space distance where each cascade ends
+    vec4 cascadeTexelSizes;     // world-space size of one shadow texel per cascade
+    vec3 viewPos;
+    int cascadeCount;
+    vec3 lightDirection;        // towards the (directional) light
+};
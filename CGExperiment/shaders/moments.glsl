@@ -0,0 +1,30 @@
+// Moments of the prefiltered shadow maps, shared by shadow_moments.comp and shadow.glsl.
+// EVSM: exponential variance shadow maps, 4 moments in rgba16f; otherwise VSM,
+// 2 moments in rg32f.
+#ifndef EVSM
+#define EVSM 0
+#endif
+
+#if EVSM
+// warp exponents, 5.54 keeps exp() of depth in [-1, 1] within half float range
+const vec2 EVSM_EXPONENTS = vec2(5.54, 5.54);
+
+// positive and negative warp of a [0,1] depth
+vec2 WarpDepth(float depth)
+{
+    depth = 2.0 * depth - 1.0;
+    return vec2(exp(EVSM_EXPONENTS.x * depth), -exp(-EVSM_EXPONENTS.y * depth));
+}
+
+// (positive, negative, positive^2, negative^2)
+vec4 ComputeMoments(float depth)
+{
+    vec2 warped = WarpDepth(depth);
+    return vec4(warped, warped * warped);
+}
+#else
+vec4 ComputeMoments(float depth)
+{
+    return vec4(depth, depth * depth, 0.0, 0.0);
+}
+#endif
@@ -0,0 +1,18 @@
+// Tangent-space normal mapping without tangent attributes: the TBN frame is
+// rebuilt per pixel from screen-space derivatives of position and uv.
+uniform sampler2D normalMap;
+
+vec3 PerturbNormal(vec3 normal, vec3 position, vec2 uv)
+{
+    vec3 dp1 = dFdx(position);
+    vec3 dp2 = dFdy(position);
+    vec2 duv1 = dFdx(uv);
+    vec2 duv2 = dFdy(uv);
+    vec3 dp2perp = cross(dp2, normal);
+    vec3 dp1perp = cross(normal, dp1);
+    vec3 T = dp2perp * duv1.x + dp1perp * duv2.x;
+    vec3 B = dp2perp * duv1.y + dp1perp * duv2.y;
+    float invmax = inversesqrt(max(dot(T, T), dot(B, B)));
+    mat3 TBN = mat3(T * invmax, B * invmax, normal);
+    return normalize(TBN * (texture(normalMap, uv).xyz * 2.0 - 1.0));
+}
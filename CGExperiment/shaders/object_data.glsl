@@ -0,0 +1,4 @@
+// per-object model matrices, indexed by the instanced draw ID
+layout (std430, binding = 0) readonly buffer ObjectData {
+    mat4 models[];
+};
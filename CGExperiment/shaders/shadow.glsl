@@ -0,0 +1,224 @@
+// Cascaded shadow map lookup shared by the lit programs, needs frame_data.glsl.
+// The map is sampled through a comparison sampler (GL_TEXTURE_COMPARE_MODE with
+// GL_LEQUAL and linear filtering), so every tap returns the bilinear blend of
+// four depth tests.
+// SHADOW_FILTER selects the kernel:
+//   SHADOW_FILTER_HARDWARE  one tap, 2x2 bilinear PCF
+//   SHADOW_FILTER_GATHER    four textureGather, 3x3 bilinear-weighted PCF
+//   SHADOW_FILTER_PCF       PCF_KERNEL_SIZE (3, 5 or 7) wide tent in 4, 9 or 16
+//                           taps by merging neighbouring weights into bilinear taps
+//   SHADOW_FILTER_POISSON   POISSON_TAPS taps of a Poisson disk rotated per pixel,
+//                           radius PCF_KERNEL_SIZE / 2 texels
+//   SHADOW_FILTER_VSM       variance shadow map, one trilinear fetch of the blurred,
+//   SHADOW_FILTER_EVSM      mipmapped moments (see shadow_moments.comp); the map
+//                           bound to shadowMap is then the moments array
+#define SHADOW_FILTER_HARDWARE 0
+#define SHADOW_FILTER_GATHER 1
+#define SHADOW_FILTER_PCF 2
+#define SHADOW_FILTER_POISSON 3
+#define SHADOW_FILTER_VSM 4
+#define SHADOW_FILTER_EVSM 5
+#ifndef SHADOW_FILTER
+#define SHADOW_FILTER SHADOW_FILTER_PCF
+#endif
+#ifndef PCF_KERNEL_SIZE
+#define PCF_KERNEL_SIZE 5
+#endif
+#ifndef POISSON_TAPS
+#define POISSON_TAPS 12
+#endif
+// cuts off the tail of the Chebyshev bound to hide light bleeding of (E)VSM
+#ifndef LIGHT_BLEEDING_REDUCTION
+#define LIGHT_BLEEDING_REDUCTION 0.2
+#endif
+
+#define SHADOW_MOMENTS (SHADOW_FILTER == SHADOW_FILTER_VSM || SHADOW_FILTER == SHADOW_FILTER_EVSM)
+#if SHADOW_MOMENTS
+#define EVSM (SHADOW_FILTER == SHADOW_FILTER_EVSM)
+#include "moments.glsl"
+uniform sampler2DArray shadowMap;
+#else
+uniform sampler2DArrayShadow shadowMap;
+#endif
+
+// first cascade whose far split lies beyond the fragment, -1 past the shadow distance
+int SelectCascade(float viewDepth)
+{
+    for(int i = 0; i < cascadeCount; ++i)
+    {
+        if(viewDepth < cascadeSplits[i])
+            return i;
+    }
+    return -1;
+}
+
+#if !SHADOW_MOMENTS
+// fraction of the four texels around uv that pass the depth test (1.0 = lit)
+float ShadowTap(vec2 uv, float layer, float depth)
+{
+    return texture(shadowMap, vec4(uv, layer, depth));
+}
+#endif
+
+#if SHADOW_FILTER == SHADOW_FILTER_GATHER
+// 3x3 bilinear PCF from the 4x4 texel footprint: each gather returns four raw
+// compares, weighted per texel by how much of the 3x3 box of bilinear taps covers it
+float ShadowGather(vec2 uv, float layer, float depth, vec2 mapSize)
+{
+    vec2 texel = uv * mapSize - 0.5;
+    vec2 base = floor(texel);
+    vec2 f = texel - base;
+    // per-axis weights of the texel columns/rows base-1 .. base+2
+    vec4 wx = vec4(1.0 - f.x, 1.0, 1.0, f.x);
+    vec4 wy = vec4(1.0 - f.y, 1.0, 1.0, f.y);
+    float lit = 0.0;
+    for(int j = 0; j < 2; ++j)
+    {
+        for(int i = 0; i < 2; ++i)
+        {
+            // a texel corner gathers the 2x2 block with columns base-1+2i.. and rows base-1+2j..
+            vec2 corner = (base + vec2(2 * i, 2 * j)) / mapSize;
+            // components: x (left, top), y (right, top), z (right, bottom), w (left, bottom)
+            vec4 g = textureGather(shadowMap, vec3(corner, layer), depth);
+            float x0 = wx[2 * i], x1 = wx[2 * i + 1];
+            float y0 = wy[2 * j], y1 = wy[2 * j + 1];
+            lit += dot(g, vec4(x0 * y1, x1 * y1, x1 * y0, x0 * y0));
+        }
+    }
+    return lit / 9.0;
+}
+#endif
+
+#if SHADOW_FILTER == SHADOW_FILTER_PCF
+// Tent-filtered PCF as in "The Witness": the kernel weights are grouped in
+// pairs per axis, each pair becomes one bilinear compare tap placed so that
+// the hardware filter reproduces the pair's weights.
+float ShadowOptimizedPCF(vec2 uv, float layer, float depth, vec2 mapSize)
+{
+    vec2 texel = uv * mapSize;
+    vec2 base = floor(texel + 0.5);
+    float s = texel.x + 0.5 - base.x;
+    float t = texel.y + 0.5 - base.y;
+    base = (base - 0.5) / mapSize;
+    vec2 inv = 1.0 / mapSize;
+    float lit = 0.0;
+#if PCF_KERNEL_SIZE <= 3
+    vec2 uw = vec2(3.0 - 2.0 * s, 1.0 + 2.0 * s);
+    vec2 u = vec2((2.0 - s) / uw.x - 1.0, s / uw.y + 1.0);
+    vec2 vw = vec2(3.0 - 2.0 * t, 1.0 + 2.0 * t);
+    vec2 v = vec2((2.0 - t) / vw.x - 1.0, t / vw.y + 1.0);
+    for(int j = 0; j < 2; ++j)
+        for(int i = 0; i < 2; ++i)
+            lit += uw[i] * vw[j] * ShadowTap(base + vec2(u[i], v[j]) * inv, layer, depth);
+    return lit / 16.0;
+#elif PCF_KERNEL_SIZE <= 5
+    vec3 uw = vec3(4.0 - 3.0 * s, 7.0, 1.0 + 3.0 * s);
+    vec3 u = vec3((3.0 - 2.0 * s) / uw.x - 2.0, (3.0 + s) / uw.y, s / uw.z + 2.0);
+    vec3 vw = vec3(4.0 - 3.0 * t, 7.0, 1.0 + 3.0 * t);
+    vec3 v = vec3((3.0 - 2.0 * t) / vw.x - 2.0, (3.0 + t) / vw.y, t / vw.z + 2.0);
+    for(int j = 0; j < 3; ++j)
+        for(int i = 0; i < 3; ++i)
+            lit += uw[i] * vw[j] * ShadowTap(base + vec2(u[i], v[j]) * inv, layer, depth);
+    return lit / 144.0;
+#else
+    vec4 uw = vec4(5.0 * s - 6.0, 11.0 * s - 28.0, -(11.0 * s + 17.0), -(5.0 * s + 1.0));
+    vec4 u = vec4((4.0 * s - 5.0) / uw.x - 3.0, (4.0 * s - 16.0) / uw.y - 1.0,
+        -(7.0 * s + 5.0) / uw.z + 1.0, -s / uw.w + 3.0);
+    vec4 vw = vec4(5.0 * t - 6.0, 11.0 * t - 28.0, -(11.0 * t + 17.0), -(5.0 * t + 1.0));
+    vec4 v = vec4((4.0 * t - 5.0) / vw.x - 3.0, (4.0 * t - 16.0) / vw.y - 1.0,
+        -(7.0 * t + 5.0) / vw.z + 1.0, -t / vw.w + 3.0);
+    for(int j = 0; j < 4; ++j)
+        for(int i = 0; i < 4; ++i)
+            lit += uw[i] * vw[j] * ShadowTap(base + vec2(u[i], v[j]) * inv, layer, depth);
+    return lit / 2704.0;
+#endif
+}
+#endif
+
+#if SHADOW_FILTER == SHADOW_FILTER_POISSON
+const vec2 poissonDisk[16] = vec2[](
+    vec2(-0.94201624, -0.39906216), vec2(0.94558609, -0.76890725),
+    vec2(-0.09418410, -0.92938870), vec2(0.34495938, 0.29387760),
+    vec2(-0.91588581, 0.45771432), vec2(-0.81544232, -0.87912464),
+    vec2(-0.38277543, 0.27676845), vec2(0.97484398, 0.75648379),
+    vec2(0.44323325, -0.97511554), vec2(0.53742981, -0.47373420),
+    vec2(-0.26496911, -0.41893023), vec2(0.79197514, 0.19090188),
+    vec2(-0.24188840, 0.99706507), vec2(-0.81409955, 0.91437590),
+    vec2(0.19984126, 0.78641367), vec2(0.14383161, -0.14100790)
+);
+
+// rotating the disk per pixel trades the banding of a fixed pattern for noise
+float ShadowPoisson(vec2 uv, float layer, float depth, vec2 mapSize)
+{
+    // interleaved gradient noise, stable per pixel
+    float angle = 6.2831853 * fract(52.9829189 * fract(dot(gl_FragCoord.xy, vec2(0.06711056, 0.00583715))));
+    mat2 rotation = mat2(cos(angle), sin(angle), -sin(angle), cos(angle));
+    vec2 radius = max(float(PCF_KERNEL_SIZE / 2), 1.0) / mapSize;
+    float lit = 0.0;
+    for(int i = 0; i < POISSON_TAPS; ++i)
+        lit += ShadowTap(uv + rotation * poissonDisk[i] * radius, layer, depth);
+    return lit / float(POISSON_TAPS);
+}
+#endif
+
+#if SHADOW_MOMENTS
+// upper bound of the fraction of the filter region that is not nearer than `mean`
+float ChebyshevUpperBound(vec2 moments, float mean, float minVariance)
+{
+    float variance = max(moments.y - moments.x * moments.x, minVariance);
+    float d = mean - moments.x;
+    float pMax = variance / (variance + d * d);
+    pMax = clamp((pMax - LIGHT_BLEEDING_REDUCTION) / (1.0 - LIGHT_BLEEDING_REDUCTION), 0.0, 1.0);
+    return mean <= moments.x ? 1.0 : pMax;
+}
+
+// the moments were blurred and mipmapped, so one hardware-filtered fetch covers the kernel
+float ShadowMoments(vec2 uv, float layer, float depth)
+{
+    vec4 moments = texture(shadowMap, vec3(uv, layer));
+#if EVSM
+    vec2 warped = WarpDepth(depth);
+    // the minimum variance has to follow the slope of the warp
+    vec2 depthScale = 0.0001 * EVSM_EXPONENTS * warped;
+    vec2 minVariance = depthScale * depthScale;
+    return min(ChebyshevUpperBound(moments.xz, warped.x, minVariance.x),
+        ChebyshevUpperBound(moments.yw, warped.y, minVariance.y));
+#else
+    return ChebyshevUpperBound(moments.xy, depth, 0.00002);
+#endif
+}
+#endif
+
+float ShadowCalculation(vec3 fragPos, float viewDepth, vec3 normal, vec3 lightDir)
+{
+    int cascade = SelectCascade(viewDepth);
+    if(cascade < 0)
+        return 0.0;
+    // normal offset: push the lookup off the surface by about a texel of this
+    // cascade, more at grazing angles, instead of one depth bias for every cascade
+    float cosTheta = clamp(dot(normal, lightDir), 0.0, 1.0);
+    vec3 offsetPos = fragPos + normal * cascadeTexelSizes[cascade] * (1.0 + 2.0 * (1.0 - cosTheta));
+    vec4 fragPosLightSpace = lightSpaceMatrices[cascade] * vec4(offsetPos, 1.0);
+    // perform perspective divide and transform to [0,1] range
+    vec3 projCoords = fragPosLightSpace.xyz / fragPosLightSpace.w * 0.5 + 0.5;
+    // keep the shadow at 0.0 when outside the far_plane region of the light's frustum.
+    if(projCoords.z > 1.0)
+        return 0.0;
+    const float bias = 0.0005;
+    float depth = projCoords.z - bias;
+    float layer = float(cascade);
+    vec2 mapSize = vec2(textureSize(shadowMap, 0).xy);
+#if SHADOW_FILTER == SHADOW_FILTER_GATHER
+    float lit = ShadowGather(projCoords.xy, layer, depth, mapSize);
+#elif SHADOW_FILTER == SHADOW_FILTER_PCF
+    float lit = ShadowOptimizedPCF(projCoords.xy, layer, depth, mapSize);
+#elif SHADOW_FILTER == SHADOW_FILTER_POISSON
+    float lit = ShadowPoisson(projCoords.xy, layer, depth, mapSize);
+#elif SHADOW_MOMENTS
+    // the variance takes the place of the depth bias
+    float lit = ShadowMoments(projCoords.xy, layer, clamp(projCoords.z, 0.0, 1.0));
+#else
+    float lit = ShadowTap(projCoords.xy, layer, depth);
+#endif
+    return 1.0 - lit;
+}
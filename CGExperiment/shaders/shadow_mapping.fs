@@ -1,64 +1,50 @@
-#version 430 core
+#version 450 core
 out vec4 FragColor;
 
 in VS_OUT {
     vec3 FragPos;
     vec3 Normal;
     vec2 TexCoords;
-    vec4 FragPosLightSpace;
+    float ViewDepth;
 } fs_in;
 
 uniform sampler2D diffuseTexture;
-uniform sampler2D shadowMap;
 
-uniform vec3 lightPos;
-uniform vec3 viewPos;
+#include "frame_data.glsl"
 
-float ShadowCalculation(vec4 fragPosLightSpace)
-{
-    // perform perspective divide
-    vec3 projCoords = fragPosLightSpace.xyz / fragPosLightSpace.w;
-    // transform to [0,1] range
-    projCoords = projCoords * 0.5 + 0.5;
-    // get closest depth value from light's perspective (using [0,1] range fragPosLight as coords)
-    float closestDepth = texture(shadowMap, projCoords.xy).r; 
-    // get depth of current fragment from light's perspective
-    float currentDepth = projCoords.z;
-    // calculate bias (based on depth map resolution and slope)
-    vec3 normal = normalize(fs_in.Normal);
-    vec3 lightDir = normalize(lightPos - fs_in.FragPos);
-    float bias = max(0.05 * (1.0 - dot(normal, lightDir)), 0.005);
-    // check whether current frag pos is in shadow
-    // float shadow = currentDepth - bias > closestDepth  ? 1.0 : 0.0;
-    // PCF
-    float shadow = 0.0;
-    vec2 texelSize = 1.0 / textureSize(shadowMap, 0);
-    for(int x = -1; x <= 1; ++x)
-    {
-        for(int y = -1; y <= 1; ++y)
-        {
-            float pcfDepth = texture(shadowMap, projCoords.xy + vec2(x, y) * texelSize).r; 
-            shadow += currentDepth - bias > pcfDepth  ? 1.0 : 0.0;        
-        }    
-    }
-    shadow /= 9.0;
-    
-    // keep the shadow at 0.0 when outside the far_plane region of the light's frustum.
-    if(projCoords.z > 1.0)
-        shadow = 0.0;
-        
-    return shadow;
-}
+#ifndef SHADOW_ENABLED
+#define SHADOW_ENABLED 1
+#endif
+#ifndef NORMAL_MAPPING
+#define NORMAL_MAPPING 0
+#endif
+// point and spot lights binned by ClusteredLighting, on top of the shadowed sun
+#ifndef CLUSTERED_LIGHTING
+#define CLUSTERED_LIGHTING 0
+#endif
+
+#if SHADOW_ENABLED
+#include "shadow.glsl"
+#endif
+#if NORMAL_MAPPING
+#include "normal_mapping.glsl"
+#endif
+#if CLUSTERED_LIGHTING
+#include "clusters.glsl"
+#endif
 
 void main()
 {           
     vec3 color = texture(diffuseTexture, fs_in.TexCoords).rgb;
     vec3 normal = normalize(fs_in.Normal);
+#if NORMAL_MAPPING
+    normal = PerturbNormal(normal, fs_in.FragPos, fs_in.TexCoords);
+#endif
     vec3 lightColor = vec3(0.3);
     // ambient
     vec3 ambient = 0.3 * color;
     // diffuse
-    vec3 lightDir = normalize(lightPos - fs_in.FragPos);
+    vec3 lightDir = normalize(lightDirection);
     float diff = max(dot(lightDir, normal), 0.0);
     vec3 diffuse = diff * lightColor;
     // specular
@@ -69,8 +55,15 @@ void main()
     spec = pow(max(dot(normal, halfwayDir), 0.0), 64.0);
     vec3 specular = spec * lightColor;    
     // calculate shadow
-    float shadow = ShadowCalculation(fs_in.FragPosLightSpace);                      
+#if SHADOW_ENABLED
+    float shadow = ShadowCalculation(fs_in.FragPos, fs_in.ViewDepth, normal, lightDir);
+#else
+    float shadow = 0.0;
+#endif
     vec3 lighting = (ambient + (1.0 - shadow) * (diffuse + specular)) * color;    
+#if CLUSTERED_LIGHTING
+    lighting += ShadeClusteredLights(fs_in.FragPos, fs_in.ViewDepth, normal, viewDir) * color;
+#endif
     
     FragColor = vec4(lighting, 1.0);
 }
\ No newline at end of file
@@ -1,7 +1,8 @@
-#version 430 core
+#version 450 core
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 aNormal;
 layout (location = 2) in vec2 aTexCoords;
+layout (location = 3) in uint aDrawID;
 
 out vec2 TexCoords;
 
@@ -9,19 +10,20 @@ out VS_OUT {
     vec3 FragPos;
     vec3 Normal;
     vec2 TexCoords;
-    vec4 FragPosLightSpace;
+    float ViewDepth;
 } vs_out;
 
-uniform mat4 projection;
-uniform mat4 view;
-uniform mat4 model;
-uniform mat4 lightSpaceMatrix;
+#include "frame_data.glsl"
+
+#include "object_data.glsl"
 
 void main()
 {
+    mat4 model = models[aDrawID];
     vs_out.FragPos = vec3(model * vec4(aPos, 1.0));
     vs_out.Normal = transpose(inverse(mat3(model))) * aNormal;
     vs_out.TexCoords = aTexCoords;
-    vs_out.FragPosLightSpace = lightSpaceMatrix * vec4(vs_out.FragPos, 1.0);
-    gl_Position = projection * view * model * vec4(aPos, 1.0);
+    vec4 viewPosition = view * vec4(vs_out.FragPos, 1.0);
+    vs_out.ViewDepth = -viewPosition.z;
+    gl_Position = projection * viewPosition;
 }
\ No newline at end of file
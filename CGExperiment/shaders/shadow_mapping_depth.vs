@@ -1,10 +1,14 @@
-#version 330 core
+#version 450 core
 layout (location = 0) in vec3 aPos;
+layout (location = 3) in uint aDrawID;
 
-uniform mat4 lightSpaceMatrix;
-uniform mat4 model;
+#include "frame_data.glsl"
+
+#include "object_data.glsl"
+
+uniform int cascade;
 
 void main()
 {
-    gl_Position = lightSpaceMatrix * model * vec4(aPos, 1.0);
+    gl_Position = lightSpaceMatrices[cascade] * models[aDrawID] * vec4(aPos, 1.0);
 }
\ No newline at end of file
@@ -0,0 +1,58 @@
+#include "shadow_cache.h"
+
+ShadowCache::ShadowCache(int count) : cascades_(count) {
+}
+
+void ShadowCache::beginFrame(GLuint shadow_map, uint32_t program_generation) {
+	if (shadow_map != shadow_map_ || program_generation != program_generation_) {
+		invalidate();
+		shadow_map_ = shadow_map;
+		program_generation_ = program_generation;
+	}
+	stats_ = Stats();
+}
+
+bool ShadowCache::dirty(int i, const glm::mat4& view_projection, const gl460::DrawList& casters) {
+	Cascade& cascade = cascades_[i];
+	cascade.pending_view_projection = view_projection;
+	cascade.pending_casters = hashCasters(casters);
+	// matrices are compared exactly: the cascade origins are texel-snapped, so
+	// an unchanged cascade produces bit-identical matrices
+	if (cascade.valid && cascade.view_projection == view_projection && cascade.casters == cascade.pending_casters) {
+		++stats_.skipped;
+		return false;
+	}
+	++stats_.rendered;
+	return true;
+}
+
+void ShadowCache::markClean(int i) {
+	Cascade& cascade = cascades_[i];
+	cascade.view_projection = cascade.pending_view_projection;
+	cascade.casters = cascade.pending_casters;
+	cascade.valid = true;
+}
+
+void ShadowCache::invalidate() {
+	for (auto& cascade : cascades_) {
+		cascade.valid = false;
+	}
+}
+
+uint64_t ShadowCache::hashCasters(const gl460::DrawList& casters) {
+	// FNV-1a over the built commands and transforms: covers casters entering or
+	// leaving the cascade, changing mesh and moving
+	uint64_t hash = 14695981039346656037ull;
+	auto mix = [&hash](const void* data, size_t size) {
+		const unsigned char* bytes = static_cast<const unsigned char*>(data);
+		for (size_t i = 0; i < size; ++i) {
+			hash ^= bytes[i];
+			hash *= 1099511628211ull;
+		}
+	};
+	const auto& commands = casters.commands();
+	const auto& transforms = casters.transforms();
+	if (!commands.empty()) mix(commands.data(), commands.size() * sizeof(commands[0]));
+	if (!transforms.empty()) mix(transforms.data(), transforms.size() * sizeof(transforms[0]));
+	return hash;
+}
@@ -0,0 +1,56 @@
+#ifndef SHADOW_CACHE_H
+#define SHADOW_CACHE_H
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include "gl460/draw_list.h"
+
+#include <cstdint>
+#include <vector>
+
+// Remembers what each cascade of one light's shadow map was last rendered
+// with, so the depth pass can skip cascades whose content would not change.
+// A cascade is dirty when its light matrix changed (light moved, or the
+// camera moved it by at least a texel) or when the set of casters inside it
+// or any of their transforms changed. Everything is dirty again when the
+// shadow map texture or the depth program is replaced.
+class ShadowCache {
+public:
+	struct Stats {
+		uint32_t rendered = 0;
+		uint32_t skipped = 0;
+	};
+
+	explicit ShadowCache(int count);
+
+	// drops every cascade if the target or the program changed since last frame
+	void beginFrame(GLuint shadow_map, uint32_t program_generation);
+
+	// true when cascade `i` must be re-rendered; `casters` must be built
+	bool dirty(int i, const glm::mat4& view_projection, const gl460::DrawList& casters);
+	// cascade `i` now holds what the last dirty() call was given
+	void markClean(int i);
+
+	void invalidate();
+
+	// counts of the current frame
+	const Stats& stats() const { return stats_; }
+
+private:
+	struct Cascade {
+		bool valid = false;
+		glm::mat4 view_projection = glm::mat4(1.0f);
+		uint64_t casters = 0;
+		// what dirty() saw, committed by markClean()
+		glm::mat4 pending_view_projection = glm::mat4(1.0f);
+		uint64_t pending_casters = 0;
+	};
+
+	static uint64_t hashCasters(const gl460::DrawList& casters);
+
+	std::vector<Cascade> cascades_;
+	GLuint shadow_map_ = 0;
+	uint32_t program_generation_ = 0;
+	Stats stats_;
+};
+
+#endif // !SHADOW_CACHE_H
@@ -0,0 +1,64 @@
+#include "shadow_cascades.h"
+#include <glm/gtc/matrix_transform.hpp>
+#include <algorithm>
+#include <cmath>
+
+ShadowCascades::ShadowCascades(int count, int resolution, float split_lambda)
+	: resolution_(resolution), split_lambda_(split_lambda), cascades_(std::min(std::max(count, 1), kMaxCascades)) {
+}
+
+void ShadowCascades::update(const glm::mat4& view, float fov_y, float aspect, float near_plane, float shadow_distance,
+	const glm::vec3& light_dir) {
+	const glm::mat4 inverse_view = glm::inverse(view);
+	const float tan_y = std::tan(fov_y * 0.5f);
+	const float tan_x = tan_y * aspect;
+
+	// the light view is anchored at the origin, only the projection follows the camera
+	const glm::vec3 up = std::abs(light_dir.y) > 0.99f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+	const glm::mat4 light_view = glm::lookAt(glm::vec3(0.0f), light_dir, up);
+
+	float split_near = near_plane;
+	const int n = count();
+	for (int i = 0; i < n; ++i) {
+		const float p = static_cast<float>(i + 1) / n;
+		const float log_split = near_plane * std::pow(shadow_distance / near_plane, p);
+		const float uniform_split = near_plane + (shadow_distance - near_plane) * p;
+		const float split_far = split_lambda_ * log_split + (1.0f - split_lambda_) * uniform_split;
+
+		// corners of the slice in world space
+		glm::vec3 corners[8];
+		int corner = 0;
+		for (float depth : { split_near, split_far }) {
+			for (float sx : { -1.0f, 1.0f }) {
+				for (float sy : { -1.0f, 1.0f }) {
+					const glm::vec4 v(sx * depth * tan_x, sy * depth * tan_y, -depth, 1.0f);
+					corners[corner++] = glm::vec3(inverse_view * v);
+				}
+			}
+		}
+		glm::vec3 center(0.0f);
+		for (const auto& c : corners) center += c;
+		center = center / 8.0f;
+		// a sphere does not change size when the camera rotates; rounding it
+		// keeps float noise from changing the texel size frame to frame
+		float radius = 0.0f;
+		for (const auto& c : corners) radius = std::max(radius, glm::length(c - center));
+		radius = std::ceil(radius * 16.0f) / 16.0f;
+
+		// move the center in whole texels only
+		const float texel = 2.0f * radius / resolution_;
+		glm::vec4 origin = light_view * glm::vec4(center, 1.0f);
+		origin.x = std::floor(origin.x / texel) * texel;
+		origin.y = std::floor(origin.y / texel) * texel;
+
+		// casters between the light and the slice are caught by the near plane
+		// margin and by depth clamping in the shadow pass
+		const glm::mat4 projection = glm::ortho(origin.x - radius, origin.x + radius, origin.y - radius, origin.y + radius,
+			-origin.z - 2.0f * radius, -origin.z + radius);
+
+		cascades_[i].view_projection = projection * light_view;
+		cascades_[i].split_far = split_far;
+		cascades_[i].radius = radius;
+		split_near = split_far;
+	}
+}
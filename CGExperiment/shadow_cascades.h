@@ -0,0 +1,40 @@
+#ifndef SHADOW_CASCADES_H
+#define SHADOW_CASCADES_H
+#include <glm/glm.hpp>
+
+#include <vector>
+
+struct ShadowCascade {
+	glm::mat4 view_projection;
+	// view-space distance where this cascade ends
+	float split_far = 0.0f;
+	// world-space radius of the bounding sphere, half the ortho width
+	float radius = 0.0f;
+};
+
+// Cascaded shadow maps for a directional light. The view frustum up to
+// `shadow_distance` is split with the practical split scheme (a blend of
+// logarithmic and uniform splits). Each slice gets a sphere-fitted
+// orthographic projection whose origin is snapped to whole shadow texels,
+// so the maps do not shimmer while the camera moves or rotates.
+class ShadowCascades {
+public:
+	static constexpr int kMaxCascades = 4;
+
+	explicit ShadowCascades(int count = kMaxCascades, int resolution = 1024, float split_lambda = 0.75f);
+
+	// light_dir points from the light into the scene
+	void update(const glm::mat4& view, float fov_y, float aspect, float near_plane, float shadow_distance,
+		const glm::vec3& light_dir);
+
+	int count() const { return static_cast<int>(cascades_.size()); }
+	int resolution() const { return resolution_; }
+	const ShadowCascade& cascade(int i) const { return cascades_[i]; }
+
+private:
+	int resolution_;
+	float split_lambda_;
+	std::vector<ShadowCascade> cascades_;
+};
+
+#endif // !SHADOW_CASCADES_H
@@ -0,0 +1,95 @@
+#include "shadow_moments.h"
+#include "gl460/extensions.h"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+// must match local_size_x in shaders/shadow_moments.comp
+const GLuint kBlurGroupSize = 128;
+} // namespace
+
+ShadowMoments::ShadowMoments(Kind kind, int resolution, int layers, int blur_radius,
+	gl460::ProgramVariantCache& programs)
+	: format_(kind == Kind::ExponentialVariance ? GL_RGBA16F : GL_RG32F) {
+	gl460::TextureDesc desc;
+	desc.format = format_;
+	desc.width = resolution;
+	desc.height = resolution;
+	desc.layers = layers;
+	desc.array = true;
+	desc.levels = static_cast<GLsizei>(std::floor(std::log2(static_cast<float>(resolution)))) + 1;
+	moments_ = gl460::Texture(desc);
+
+	glCreateSamplers(1, &sampler_);
+	glSamplerParameteri(sampler_, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glSamplerParameteri(sampler_, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glSamplerParameteri(sampler_, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glSamplerParameteri(sampler_, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	const float anisotropy = std::min(gl460::maxAnisotropy(), 8.0f);
+	if (anisotropy > 1.0f) {
+		glSamplerParameterf(sampler_, GL_TEXTURE_MAX_ANISOTROPY, anisotropy);
+	}
+
+	const gl460::ProgramVariantCache::Stages stages = { {gl460::ShaderType::Compute, "shaders/shadow_moments.comp"} };
+	gl460::ShaderDefines defines;
+	defines.set("EVSM", kind == Kind::ExponentialVariance ? 1 : 0).set("BLUR_RADIUS", blur_radius);
+	defines.set("HORIZONTAL", 1);
+	horizontal_.program = &programs.get(stages, defines, [this](gl460::Program& program) {
+		program.set(program.uniform<int>("source"), 0);
+		horizontal_.layer = program.uniform<int>("layer");
+	});
+	defines.set("HORIZONTAL", 0);
+	vertical_.program = &programs.get(stages, defines, [](gl460::Program& program) {
+		program.set(program.uniform<int>("source"), 0);
+	});
+}
+
+ShadowMoments::~ShadowMoments() {
+	glDeleteSamplers(1, &sampler_);
+}
+
+bool ShadowMoments::ready() const {
+	return horizontal_.program->linked() && vertical_.program->linked();
+}
+
+uint32_t ShadowMoments::generation() const {
+	return horizontal_.program->generation() + vertical_.program->generation();
+}
+
+void ShadowMoments::track(gl460::ProgramReloader& reloader) {
+	reloader.track(*horizontal_.program, [this](gl460::Program& program) {
+		horizontal_.layer = program.uniform<int>("layer");
+	});
+	reloader.track(*vertical_.program);
+}
+
+void ShadowMoments::filter(const gl460::Texture& depth, int layer, gl460::RenderTargetPool& targets,
+	gl460::StateCache& state) {
+	gl460::TextureDesc desc = moments_.desc();
+	desc.layers = 1;
+	desc.levels = 1;
+	gl460::Texture& scratch = targets.acquire(desc);
+
+	horizontal_.program->set(horizontal_.layer, layer);
+	dispatch(horizontal_, depth.id(), scratch, 0, state);
+	dispatch(vertical_, scratch.id(), moments_, layer, state);
+
+	targets.release(scratch);
+}
+
+void ShadowMoments::generateMips() {
+	glGenerateTextureMipmap(moments_.id());
+}
+
+void ShadowMoments::dispatch(const Pass& pass, GLuint source, const gl460::Texture& destination,
+	GLint destination_layer, gl460::StateCache& state) {
+	// texelFetch ignores filtering, but a comparing sampler on the unit would not
+	state.bindTextureUnit(0, source);
+	state.bindSampler(0, 0);
+	glBindImageTexture(0, destination.id(), 0, GL_FALSE, destination_layer, GL_WRITE_ONLY, format_);
+	state.useProgram(pass.program->id());
+	const GLuint length = static_cast<GLuint>(destination.desc().width);
+	glDispatchCompute((length + kBlurGroupSize - 1) / kBlurGroupSize, length, 1);
+	// the next pass (or the mip generation and the receivers) read the result as a texture
+	glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT | GL_TEXTURE_UPDATE_BARRIER_BIT);
+}
@@ -0,0 +1,62 @@
+#ifndef SHADOW_MOMENTS_H
+#define SHADOW_MOMENTS_H
+#include <glad/glad.h>
+#include "gl460/program_reloader.h"
+#include "gl460/program_variants.h"
+#include "gl460/render_target_pool.h"
+#include "gl460/state_cache.h"
+#include "gl460/texture.h"
+
+#include <cstdint>
+
+// Prefiltered shadow maps. After the depth pass each re-rendered cascade is
+// turned into moments (VSM: depth and depth^2 in RG32F; EVSM: the same for a
+// positive and a negative exponential warp in RGBA16F), box-blurred by a
+// separable compute pass (shaders/shadow_moments.comp) and mipmapped, so
+// receivers get wide soft penumbrae from one trilinear/anisotropic fetch.
+class ShadowMoments {
+public:
+	enum class Kind {
+		Variance,
+		ExponentialVariance,
+	};
+
+	// the blur programs are built through `programs`, which must outlive this
+	ShadowMoments(Kind kind, int resolution, int layers, int blur_radius, gl460::ProgramVariantCache& programs);
+	ShadowMoments(const ShadowMoments&) = delete;
+	ShadowMoments& operator=(const ShadowMoments&) = delete;
+	~ShadowMoments();
+
+	// both blur programs are linked
+	bool ready() const;
+	// sums the programs' generations, any change means the moments are stale
+	uint32_t generation() const;
+	void track(gl460::ProgramReloader& reloader);
+
+	// depth layer `layer` -> blurred moments of the same layer; the intermediate
+	// target comes from `targets`
+	void filter(const gl460::Texture& depth, int layer, gl460::RenderTargetPool& targets, gl460::StateCache& state);
+	// rebuilds the mip chain, once after the last filter() of a frame
+	void generateMips();
+
+	const gl460::Texture& texture() const { return moments_; }
+	// trilinear, anisotropic when available
+	GLuint sampler() const { return sampler_; }
+
+private:
+	struct Pass {
+		gl460::Program* program = nullptr;
+		gl460::Uniform<int> layer;
+	};
+
+	void dispatch(const Pass& pass, GLuint source, const gl460::Texture& destination, GLint destination_layer,
+		gl460::StateCache& state);
+
+	GLenum format_;
+	gl460::Texture moments_;
+	GLuint sampler_ = 0;
+	Pass horizontal_;
+	Pass vertical_;
+};
+
+#endif // !SHADOW_MOMENTS_H
@@ -0,0 +1,153 @@
+#include "bindless_table.h"
+#include <stdexcept>
+#include <string>
+
+BindlessTable::BindlessTable(VkDevice device, uint32_t image_capacity, uint32_t buffer_capacity, VkShaderStageFlags stages)
+	: vk_device(device) {
+	images.capacity = image_capacity;
+	buffers.capacity = buffer_capacity;
+
+	VkDescriptorSetLayoutBinding bindings[2] = {};
+	bindings[0].binding = kImageBinding;
+	bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	bindings[0].descriptorCount = image_capacity;
+	bindings[0].stageFlags = stages;
+	bindings[1].binding = kBufferBinding;
+	bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	bindings[1].descriptorCount = buffer_capacity;
+	bindings[1].stageFlags = stages;
+	const VkDescriptorBindingFlags flags = VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT |
+		VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT | VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT;
+	const VkDescriptorBindingFlags binding_flags[2] = { flags, flags };
+
+	VkDescriptorSetLayoutBindingFlagsCreateInfo binding_flags_create_info = {};
+	binding_flags_create_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO;
+	binding_flags_create_info.bindingCount = 2;
+	binding_flags_create_info.pBindingFlags = binding_flags;
+	VkDescriptorSetLayoutCreateInfo set_layout_create_info = {};
+	{
+		set_layout_create_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+		set_layout_create_info.pNext = &binding_flags_create_info;
+		set_layout_create_info.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT;
+		set_layout_create_info.bindingCount = 2;
+		set_layout_create_info.pBindings = bindings;
+	}
+	if (vkCreateDescriptorSetLayout(vk_device, &set_layout_create_info, nullptr, &vk_set_layout) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to create bindless descriptor set layout!");
+	}
+
+	VkDescriptorPoolSize pool_sizes[] = {
+		{ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, image_capacity },
+		{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, buffer_capacity },
+	};
+	VkDescriptorPoolCreateInfo pool_create_info = {};
+	{
+		pool_create_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+		pool_create_info.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT;
+		pool_create_info.maxSets = 1;
+		pool_create_info.poolSizeCount = 2;
+		pool_create_info.pPoolSizes = pool_sizes;
+	}
+	if (vkCreateDescriptorPool(vk_device, &pool_create_info, nullptr, &vk_pool) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to create bindless descriptor pool!");
+	}
+
+	VkDescriptorSetAllocateInfo set_alloc_info = {};
+	{
+		set_alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+		set_alloc_info.descriptorPool = vk_pool;
+		set_alloc_info.descriptorSetCount = 1;
+		set_alloc_info.pSetLayouts = &vk_set_layout;
+	}
+	if (vkAllocateDescriptorSets(vk_device, &set_alloc_info, &vk_set) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to allocate bindless descriptor set!");
+	}
+}
+
+BindlessTable::~BindlessTable() {
+	// frees the set with it
+	vkDestroyDescriptorPool(vk_device, vk_pool, nullptr);
+	vkDestroyDescriptorSetLayout(vk_device, vk_set_layout, nullptr);
+}
+
+uint32_t BindlessTable::Acquire(SlotArray& slots, const char* kind) {
+	if (!slots.free.empty()) {
+		const uint32_t slot = slots.free.back();
+		slots.free.pop_back();
+		return slot;
+	}
+	if (slots.next == slots.capacity) {
+		throw std::runtime_error(std::string("BindlessTable: out of ") + kind + " slots");
+	}
+	return slots.next++;
+}
+
+void BindlessTable::Retire(SlotArray& slots, uint32_t slot, uint64_t last_use) {
+	slots.retired.emplace_back(last_use, slot);
+}
+
+void BindlessTable::CollectSlots(SlotArray& slots, uint64_t completed) {
+	while (!slots.retired.empty() && slots.retired.front().first <= completed) {
+		slots.free.push_back(slots.retired.front().second);
+		slots.retired.pop_front();
+	}
+}
+
+void BindlessTable::Write(uint32_t binding, uint32_t slot, const VkDescriptorImageInfo* image_info, const VkDescriptorBufferInfo* buffer_info) {
+	VkWriteDescriptorSet write = {};
+	write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	write.dstSet = vk_set;
+	write.dstBinding = binding;
+	write.dstArrayElement = slot;
+	write.descriptorCount = 1;
+	write.descriptorType = image_info ? VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	write.pImageInfo = image_info;
+	write.pBufferInfo = buffer_info;
+	vkUpdateDescriptorSets(vk_device, 1, &write, 0, nullptr);
+	++stats.writes;
+}
+
+uint32_t BindlessTable::AddImage(VkImageView view, VkSampler sampler, VkImageLayout layout) {
+	const uint32_t slot = Acquire(images, "image");
+	UpdateImage(slot, view, sampler, layout);
+	++stats.images;
+	return slot;
+}
+
+uint32_t BindlessTable::AddBuffer(VkBuffer buffer, VkDeviceSize offset, VkDeviceSize range) {
+	const uint32_t slot = Acquire(buffers, "buffer");
+	UpdateBuffer(slot, buffer, offset, range);
+	++stats.buffers;
+	return slot;
+}
+
+void BindlessTable::UpdateImage(uint32_t slot, VkImageView view, VkSampler sampler, VkImageLayout layout) {
+	VkDescriptorImageInfo image_info = {};
+	image_info.sampler = sampler;
+	image_info.imageView = view;
+	image_info.imageLayout = layout;
+	Write(kImageBinding, slot, &image_info, nullptr);
+}
+
+void BindlessTable::UpdateBuffer(uint32_t slot, VkBuffer buffer, VkDeviceSize offset, VkDeviceSize range) {
+	VkDescriptorBufferInfo buffer_info = {};
+	buffer_info.buffer = buffer;
+	buffer_info.offset = offset;
+	buffer_info.range = range;
+	Write(kBufferBinding, slot, nullptr, &buffer_info);
+}
+
+void BindlessTable::RemoveImage(uint32_t slot, uint64_t last_use) {
+	Retire(images, slot, last_use);
+	--stats.images;
+}
+
+void BindlessTable::RemoveBuffer(uint32_t slot, uint64_t last_use) {
+	Retire(buffers, slot, last_use);
+	--stats.buffers;
+}
+
+void BindlessTable::Collect(uint64_t completed) {
+	CollectSlots(images, completed);
+	CollectSlots(buffers, completed);
+}
@@ -0,0 +1,80 @@
+#ifndef BINDLESS_TABLE_H
+#define BINDLESS_TABLE_H
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <deque>
+#include <utility>
+#include <vector>
+
+// Every sampled texture and storage buffer of the renderer in one descriptor
+// set of two large arrays (Vulkan 1.2 descriptor indexing). The set is bound
+// once per command buffer; shaders index the arrays with slots passed in push
+// constants, so a new material or buffer costs one descriptor write instead
+// of a set to allocate, update and bind per draw.
+//
+// Both bindings are update-after-bind, partially bound and may be updated
+// while unused by pending command buffers: slots are written without waiting
+// for the GPU, empty slots are simply never read. A removed slot may still be
+// read by frames in flight, so it only goes back to the free list once
+// Collect() is passed a timeline value past its last use.
+class BindlessTable {
+public:
+	// set 0 bindings, must match the shaders
+	static const uint32_t kImageBinding = 0;	// sampler2D textures[]
+	static const uint32_t kBufferBinding = 1;	// buffer ... buffers[]
+
+	struct Stats {
+		uint32_t images = 0;	// slots in use
+		uint32_t buffers = 0;
+		uint64_t writes = 0;	// descriptor writes since creation
+	};
+
+	// capacities within maxPerStageDescriptorUpdateAfterBind* and
+	// maxDescriptorSetUpdateAfterBind* of the device
+	BindlessTable(VkDevice device, uint32_t image_capacity, uint32_t buffer_capacity, VkShaderStageFlags stages);
+	BindlessTable(const BindlessTable&) = delete;
+	BindlessTable& operator=(const BindlessTable&) = delete;
+	~BindlessTable();
+
+	VkDescriptorSetLayout Layout() const { return vk_set_layout; }
+	VkDescriptorSet Set() const { return vk_set; }
+
+	// return the slot; throw when the array is full
+	uint32_t AddImage(VkImageView view, VkSampler sampler, VkImageLayout layout);
+	uint32_t AddBuffer(VkBuffer buffer, VkDeviceSize offset = 0, VkDeviceSize range = VK_WHOLE_SIZE);
+	// rewrite a slot in place: no pending command buffer may use it
+	void UpdateImage(uint32_t slot, VkImageView view, VkSampler sampler, VkImageLayout layout);
+	void UpdateBuffer(uint32_t slot, VkBuffer buffer, VkDeviceSize offset = 0, VkDeviceSize range = VK_WHOLE_SIZE);
+	// `last_use`: timeline value of the last submission that may read the slot
+	void RemoveImage(uint32_t slot, uint64_t last_use);
+	void RemoveBuffer(uint32_t slot, uint64_t last_use);
+	// frees the removed slots whose last use is at most `completed`
+	void Collect(uint64_t completed);
+
+	const Stats& GetStats() const { return stats; }
+
+private:
+	// free list of one binding: slots below `next` were handed out before
+	struct SlotArray {
+		uint32_t capacity = 0;
+		uint32_t next = 0;
+		std::vector<uint32_t> free;
+		std::deque<std::pair<uint64_t, uint32_t>> retired;	// last use, slot; by last use
+	};
+
+	static uint32_t Acquire(SlotArray& slots, const char* kind);
+	static void Retire(SlotArray& slots, uint32_t slot, uint64_t last_use);
+	static void CollectSlots(SlotArray& slots, uint64_t completed);
+	void Write(uint32_t binding, uint32_t slot, const VkDescriptorImageInfo* image_info, const VkDescriptorBufferInfo* buffer_info);
+
+	VkDevice vk_device;
+	VkDescriptorSetLayout vk_set_layout{ VK_NULL_HANDLE };
+	VkDescriptorPool vk_pool{ VK_NULL_HANDLE };
+	VkDescriptorSet vk_set{ VK_NULL_HANDLE };
+	SlotArray images;
+	SlotArray buffers;
+	Stats stats;
+};
+
+#endif // !BINDLESS_TABLE_H
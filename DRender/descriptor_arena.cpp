@@ -0,0 +1,84 @@
+#include "descriptor_arena.h"
+#include <stdexcept>
+#include <utility>
+
+DescriptorArena::DescriptorArena(VkDevice device, std::vector<VkDescriptorPoolSize> pool_sizes,
+	uint32_t sets_per_pool, uint32_t frame_count)
+	: vk_device(device), pool_sizes(std::move(pool_sizes)), sets_per_pool(sets_per_pool), frames(frame_count) {
+	for (auto& frame_pools : frames) {
+		frame_pools.pools.push_back(CreatePool());
+	}
+}
+
+DescriptorArena::~DescriptorArena() {
+	for (auto& frame_pools : frames) {
+		for (auto pool : frame_pools.pools) {
+			vkDestroyDescriptorPool(vk_device, pool, nullptr);
+		}
+	}
+}
+
+VkDescriptorPool DescriptorArena::CreatePool() {
+	VkDescriptorPoolCreateInfo pool_create_info = {};
+	{
+		pool_create_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+		pool_create_info.maxSets = sets_per_pool;
+		pool_create_info.poolSizeCount = static_cast<uint32_t>(pool_sizes.size());
+		pool_create_info.pPoolSizes = pool_sizes.data();
+	}
+	VkDescriptorPool pool;
+	if (vkCreateDescriptorPool(vk_device, &pool_create_info, nullptr, &pool) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to create descriptor pool!");
+	}
+	return pool;
+}
+
+void DescriptorArena::BeginFrame(uint32_t frame) {
+	this->frame = frame;
+	sets = 0;
+	auto& frame_pools = frames[frame];
+	for (size_t i = 0; i <= frame_pools.current; ++i) {
+		vkResetDescriptorPool(vk_device, frame_pools.pools[i], 0);
+	}
+	frame_pools.current = 0;
+	frame_pools.current_sets = 0;
+}
+
+VkDescriptorSet DescriptorArena::Allocate(VkDescriptorSetLayout layout) {
+	auto& frame_pools = frames[frame];
+	VkDescriptorSetAllocateInfo set_alloc_info = {};
+	{
+		set_alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+		set_alloc_info.descriptorSetCount = 1;
+		set_alloc_info.pSetLayouts = &layout;
+	}
+	for (;;) {
+		set_alloc_info.descriptorPool = frame_pools.pools[frame_pools.current];
+		VkDescriptorSet set;
+		VkResult result = vkAllocateDescriptorSets(vk_device, &set_alloc_info, &set);
+		if (result == VK_SUCCESS) {
+			++frame_pools.current_sets;
+			++sets;
+			return set;
+		}
+		if (result != VK_ERROR_OUT_OF_POOL_MEMORY && result != VK_ERROR_FRAGMENTED_POOL) {
+			throw std::runtime_error("Failed to allocate descriptor set!");
+		}
+		// an empty pool that cannot hold the set never will
+		if (frame_pools.current_sets == 0) {
+			throw std::runtime_error("Failed to fit descriptor set in an empty pool!");
+		}
+		frame_pools.current_sets = 0;
+		if (++frame_pools.current == frame_pools.pools.size()) {
+			frame_pools.pools.push_back(CreatePool());
+		}
+	}
+}
+
+uint32_t DescriptorArena::PoolCount() const {
+	size_t count = 0;
+	for (auto& frame_pools : frames) {
+		count += frame_pools.pools.size();
+	}
+	return static_cast<uint32_t>(count);
+}
@@ -0,0 +1,46 @@
+#ifndef DESCRIPTOR_ARENA_H
+#define DESCRIPTOR_ARENA_H
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <vector>
+
+// Descriptor sets that live for one frame. Each frame in flight owns a list
+// of pools; sets are allocated from its current pool, moving on to the next
+// one (created on demand) when a pool runs out, and BeginFrame() resets all
+// of the frame's pools at once. Nothing is freed one by one and the pools
+// grow to the frame's peak instead of being sized up front. The caller must
+// have waited on the fence of the frame the pools last belonged to.
+class DescriptorArena {
+public:
+	// `pool_sizes`: descriptor counts of one pool, holding `sets_per_pool` sets
+	DescriptorArena(VkDevice device, std::vector<VkDescriptorPoolSize> pool_sizes,
+		uint32_t sets_per_pool, uint32_t frame_count);
+	DescriptorArena(const DescriptorArena&) = delete;
+	DescriptorArena& operator=(const DescriptorArena&) = delete;
+	~DescriptorArena();
+
+	void BeginFrame(uint32_t frame);
+	VkDescriptorSet Allocate(VkDescriptorSetLayout layout);
+
+	uint32_t PoolCount() const;
+	uint32_t FrameSets() const { return sets; }
+
+private:
+	struct FramePools {
+		std::vector<VkDescriptorPool> pools;
+		size_t current = 0;
+		uint32_t current_sets = 0;	// allocated from pools[current]
+	};
+
+	VkDescriptorPool CreatePool();
+
+	VkDevice vk_device;
+	std::vector<VkDescriptorPoolSize> pool_sizes;
+	uint32_t sets_per_pool;
+	std::vector<FramePools> frames;
+	uint32_t frame{ 0 };
+	uint32_t sets{ 0 };
+};
+
+#endif // !DESCRIPTOR_ARENA_H
@@ -6,9 +6,29 @@
 #include <optional>
 #include <cstring>
 #include <set>
+#include <map>
 #include <algorithm>
 #include <fstream>
+#include <array>
+#include <limits>
+#include <cstddef>
+#include <stdexcept>
+#include <cstdlib>
+#include <memory>
+#include <chrono>
+#include <thread>
 #include <vulkan/vulkan.h>
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include "pipeline_cache.h"
+#include "memory_allocator.h"
+#include "worker_pool.h"
+#include "render_graph.h"
+#include "upload_queue.h"
+#include "bindless_table.h"
+#include "descriptor_arena.h"
 
 const std::vector<const char*> kValidationLayers = {
 	"VK_LAYER_KHRONOS_validation"
@@ -16,7 +36,48 @@ const std::vector<const char*> kValidationLayers = {
 const std::vector<const char*> kDeviceExtensions = {
 	VK_KHR_SWAPCHAIN_EXTENSION_NAME
 };
-const size_t kMaxFramesInFlight = 2;
+// frames the CPU may record ahead of the GPU: more hides CPU spikes, fewer
+// cuts input latency. Overridden by --frames-in-flight.
+const size_t kDefaultFramesInFlight = 2;
+// threads recording the G-buffer subpass, the main thread included. 0 picks
+// one per hardware thread, up to kMaxAutoRecordThreads: the draw list is short,
+// more threads only add wake-ups. Overridden by --record-threads.
+const size_t kDefaultRecordThreads = 0;
+const size_t kMaxAutoRecordThreads = 4;
+// driver pipeline cache, kept next to the executable's working directory
+const char* kPipelineCachePath = "pipeline_cache.bin";
+// staging ring of the upload queue. At most one slot is submitted per frame,
+// so a large asset streams in at up to kUploadSlotSize per frame.
+const VkDeviceSize kUploadSlotSize = 2 << 20;
+const uint32_t kUploadSlotCount = 4;
+// floor texture, generated at startup and streamed in by the upload queue
+const uint32_t kFloorTextureSize = 2048;
+// slots of the bindless arrays, clamped to the device's update-after-bind limits
+const uint32_t kBindlessImageCapacity = 4096;
+const uint32_t kBindlessBufferCapacity = 1024;
+const uint32_t kNoBindlessSlot = std::numeric_limits<uint32_t>::max();
+// per-frame descriptor sets: each pool of the arena holds this many
+const uint32_t kFrameDescriptorSetsPerPool = 16;
+
+// G-buffer targets: albedo, normal and material are color attachments, then
+// depth. The lighting pass reads all of them as input attachments, in this
+// order, which are the bindings of lighting.frag.
+const uint32_t kGBufferColorCount = 3;
+const uint32_t kGBufferImageCount = kGBufferColorCount + 1;
+
+// light clusters: screen tiles times slices of view depth between the near
+// and far planes, must match light_cull.comp and lighting.frag
+const uint32_t kClusterTilesX = 16;
+const uint32_t kClusterTilesY = 9;
+const uint32_t kClusterSlices = 24;
+const uint32_t kLightCullGroupSize = 16;	// local_size_x of light_cull.comp
+const float kNearPlane = 0.1f;
+const float kFarPlane = 100.0f;
+
+// scene: a floor plus kSceneGrid x kSceneGrid boxes, generated in gbuffer.vert
+const int kSceneGrid = 12;
+const int kSceneSpacing = 2;
+const uint32_t kCubeVertexCount = 36;
 
 #ifdef _DEBUG
 const bool kEnableValidationLayers = true;
@@ -27,6 +88,9 @@ const bool kEnableValidationLayers = false;
 struct QueueFamilyIndex {
 	std::optional<uint32_t> graphics_family;
 	std::optional<uint32_t> present_family;
+	std::optional<uint32_t> transfer_family;	// may be the graphics family
+	std::optional<uint32_t> compute_family;	// async compute, never the graphics family
+	uint32_t compute_queue = 0;	// within compute_family
 	bool IsComplete() {
 		return graphics_family.has_value() && present_family.has_value();
 	}
@@ -38,9 +102,71 @@ struct SwapChainSupportDetails {
 	std::vector<VkPresentModeKHR> present_modes;
 };
 
+// push constants, must match the shaders. Bindless resources are referenced
+// by their BindlessTable slot.
+struct GBufferPushConstants {
+	glm::mat4 view_projection;
+	glm::ivec4 grid;	// x: boxes per row, y: spacing
+	glm::ivec4 material;	// x: texture slot or -1, pushed per draw
+};
+
+struct LightingPushConstants {
+	glm::mat4 inverse_view_projection;
+	glm::vec4 camera_position;
+	glm::vec4 depth_range;	// x: near plane, y: far plane
+	glm::uvec4 bindless;	// x: cluster lights slot
+};
+
+struct LightCullPushConstants {
+	glm::mat4 inverse_view_projection;
+	glm::vec4 depth_range;
+	glm::uvec4 bindless;	// x: cluster lights slot
+};
+
+// the material is pushed per draw and read by gbuffer.frag
+const VkShaderStageFlags kGBufferPushStages = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+
+struct SceneTexture {
+	VkImage image{ VK_NULL_HANDLE };
+	Allocation memory;
+	VkImageView view{ VK_NULL_HANDLE };
+};
+
+// one draw of the G-buffer subpass: a run of procedural cube instances
+struct DrawItem {
+	uint32_t first_instance;
+	uint32_t instance_count;
+	int32_t texture;	// bindless slot, -1 for none
+};
+
+// command buffers of one frame in flight. Every pool is transient and reset
+// as a whole once the frame's fence signals; each recording thread owns one
+// of worker_pools, so recording never contends on a pool.
+struct FrameCommands {
+	VkCommandPool pool{ VK_NULL_HANDLE };
+	VkCommandBuffer primary{ VK_NULL_HANDLE };
+	VkCommandPool compute_pool{ VK_NULL_HANDLE };	// async compute family
+	VkCommandBuffer compute{ VK_NULL_HANDLE };
+	std::vector<VkCommandPool> worker_pools;
+	std::vector<VkCommandBuffer> secondaries;	// one per worker, G-buffer subpass
+};
+
+struct PipelineDesc {
+	const char* vert_shader;
+	const char* frag_shader;
+	VkPipelineLayout layout;
+	VkRenderPass render_pass;
+	uint32_t subpass;
+	uint32_t color_attachment_count;
+	bool depth_test;
+	VkCullModeFlags cull_mode;
+};
+
 class VkDRender {
 public:
-	explicit VkDRender(int w, int h) : width(h), height(h) {}
+	explicit VkDRender(int w, int h, size_t frames_in_flight = kDefaultFramesInFlight, size_t record_threads = kDefaultRecordThreads)
+		: width(w), height(h), max_frames_in_flight(std::max<size_t>(frames_in_flight, 1)),
+		worker_pool(record_threads ? record_threads : std::clamp<size_t>(std::thread::hardware_concurrency(), 1, kMaxAutoRecordThreads)) {}
 
 	void Run() {
 		InitWindow();
@@ -55,8 +181,9 @@ private:
 		glfwInit();
 		glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
 		glfwWindowHint(GLFW_RESIZABLE, GLFW_TRUE);
-		//window = glfwCreateWindow(width, height, "Vulkan Deferred Renderer", nullptr, nullptr);
-		window = glfwCreateWindow(800, 600, "Vulkan Deferred Renderer", nullptr, nullptr);
+		window = glfwCreateWindow(width, height, "Vulkan Deferred Renderer", nullptr, nullptr);
+		glfwSetWindowUserPointer(window, this);
+		glfwSetFramebufferSizeCallback(window, FramebufferResizeCallback);
 	}
 
 	void InitVulkan() {
@@ -65,13 +192,19 @@ private:
 		CreateSurface();
 		PickPhysicalDevice();
 		CreateLogicalDevice();
+		CreatePipelineCache();
+		CreateMemoryAllocator();
+		CreateUploadQueue();
+		CreateFloorTexture();
 		CreateSwapChain();
-		CreateRenderPass();
-		CreateGraphicsPileline();
-		CreateFramebuffers();
-		CreateCommandPool();
-		CreateCommandBuffers();
+		CreateRenderGraph();
+		CreateDescriptorTables();
+		CreatePipelines();
+		BuildDrawList();
+		CreateFrameCommands();
 		CreateSyncObjects();
+		// persist what was compiled now rather than only on a clean exit
+		pipeline_cache->Save();
 	}
 
 	void MainLoop() {
@@ -80,26 +213,100 @@ private:
 			DrawFrame();
 		}
 		vkDeviceWaitIdle(vk_logical_device);
+		if (recorded_frames) {
+			const double record_ms = std::chrono::duration<double, std::milli>(record_time).count() / recorded_frames;
+			std::cout << "Command recording: " << record_ms << " ms/frame on " << worker_pool.ThreadCount() << " threads" << std::endl;
+		}
+		std::cout << "Uploads: " << upload_queue->UploadedBytes() / (1024.0 * 1024.0) << " MiB in "
+			<< upload_queue->Submissions() << " transfer submissions" << std::endl;
+		const BindlessTable::Stats& bindless_stats = bindless->GetStats();
+		std::cout << "Descriptors: " << bindless_stats.images << " bindless images, " << bindless_stats.buffers << " bindless buffers, "
+			<< bindless_stats.writes << " bindless writes, " << frame_descriptors->PoolCount() << " per-frame pools" << std::endl;
+	}
+
+	// everything sized by the swapchain, the swapchain itself is kept alive to be
+	// handed to its successor as oldSwapchain
+	void CleanUpSwapChain() {
+		for (auto img_view : vk_swapchain_image_views) {
+			vkDestroyImageView(vk_logical_device, img_view, nullptr);
+		}
+		vk_swapchain_image_views.clear();
+		for (auto semaphore : vk_reder_finished_semaphores) {
+			vkDestroySemaphore(vk_logical_device, semaphore, nullptr);
+		}
+		vk_reder_finished_semaphores.clear();
+	}
+
+	void RecreateSwapChain() {
+		// minimized: nothing to present to until the window comes back
+		int fb_width = 0, fb_height = 0;
+		glfwGetFramebufferSize(window, &fb_width, &fb_height);
+		while ((fb_width == 0 || fb_height == 0) && !glfwWindowShouldClose(window)) {
+			glfwWaitEvents();
+			glfwGetFramebufferSize(window, &fb_width, &fb_height);
+		}
+		if (fb_width == 0 || fb_height == 0) {
+			return;
+		}
+		vkDeviceWaitIdle(vk_logical_device);
+
+		CleanUpSwapChain();
+		VkFormat old_format = vk_swapchain_image_format;
+		SelectPhysicalDeviceSwapChainSupportDetails(vk_physical_device);
+		CreateSwapChain();
+		// viewport and scissor are dynamic and the graph's render passes only
+		// depend on formats, so a resize just reallocates the graph's images;
+		// only a new surface format invalidates the render passes and pipelines
+		if (vk_swapchain_image_format != old_format) {
+			DestroyPipelines();
+			CreateRenderGraph();
+			CreatePipelines();
+		} else {
+			render_graph->Realize(vk_swapchain_image_extent);
+		}
+		UpdateBindlessBuffers();
+		CreateImageSyncObjects();
+		framebuffer_resized = false;
+	}
+
+	void DestroyPipelines() {
+		// the cache keys pipelines by layout and render pass handle, none may outlive them
+		pipeline_cache->DestroyPipelines();
+		vkDestroyPipelineLayout(vk_logical_device, vk_gbuffer_pipeline_layout, nullptr);
+		vkDestroyPipelineLayout(vk_logical_device, vk_lighting_pipeline_layout, nullptr);
+		vkDestroyPipelineLayout(vk_logical_device, vk_light_cull_pipeline_layout, nullptr);
 	}
 
 	void CleanUp() {
-		for (size_t i = 0; i < kMaxFramesInFlight; ++i) {
+		for (size_t i = 0; i < max_frames_in_flight; ++i) {
 			vkDestroySemaphore(vk_logical_device, vk_image_available_semaphores[i], nullptr);
-			vkDestroySemaphore(vk_logical_device, vk_reder_finished_semaphores[i], nullptr);
 			vkDestroyFence(vk_logical_device, vk_fences[i], nullptr);
 		}
-		vkDestroyCommandPool(vk_logical_device, vk_command_pool, nullptr);
-		for (auto fb : vk_framebuffers) {
-			vkDestroyFramebuffer(vk_logical_device, fb, nullptr);
-		}
-		vkDestroyPipeline(vk_logical_device, vk_pipeline, nullptr);
-		vkDestroyPipelineLayout(vk_logical_device, vk_pipeline_layout,nullptr);
-		vkDestroyRenderPass(vk_logical_device, vk_render_pass, nullptr);
-
-		for (auto img_view : vk_swapchain_image_views) {
-			vkDestroyImageView(vk_logical_device, img_view, nullptr);
+		vkDestroySemaphore(vk_logical_device, vk_graphics_timeline, nullptr);
+		vkDestroySemaphore(vk_logical_device, vk_compute_timeline, nullptr);
+		CleanUpSwapChain();
+		for (auto& frame : vk_frame_commands) {
+			vkDestroyCommandPool(vk_logical_device, frame.pool, nullptr);
+			vkDestroyCommandPool(vk_logical_device, frame.compute_pool, nullptr);
+			for (auto pool : frame.worker_pools) {
+				vkDestroyCommandPool(vk_logical_device, pool, nullptr);
+			}
 		}
+		vk_frame_commands.clear();
+		DestroyPipelines();
+		frame_descriptors.reset();
+		bindless.reset();
+		vkDestroyDescriptorSetLayout(vk_logical_device, vk_lighting_set_layout, nullptr);
+		render_graph.reset();
+		upload_queue.reset();
+		vkDestroySampler(vk_logical_device, vk_floor_sampler, nullptr);
+		vkDestroyImageView(vk_logical_device, floor_texture.view, nullptr);
+		vkDestroyImage(vk_logical_device, floor_texture.image, nullptr);
+		memory_allocator->Free(floor_texture.memory);
 		vkDestroySwapchainKHR(vk_logical_device, vk_swapchain, nullptr);
+		pipeline_cache.reset();
+		memory_allocator->DumpStats(std::cout);
+		memory_allocator.reset();
 		vkDestroyDevice(vk_logical_device, nullptr);
 
 		if (kEnableValidationLayers) {
@@ -119,6 +326,11 @@ private:
 		return VK_FALSE;
 	}
 	
+	static void FramebufferResizeCallback(GLFWwindow* window, int width, int height) {
+		auto render = reinterpret_cast<VkDRender*>(glfwGetWindowUserPointer(window));
+		render->framebuffer_resized = true;
+	}
+
 	static std::vector<char> ReadFile(const std::string& filename) {
 		std::ifstream file(filename, std::ios::ate | std::ios::binary);
 		if (!file.is_open()) {
@@ -193,6 +405,39 @@ private:
 				break;
 			}
 		}
+
+		// uploads: a transfer-only family (the copy engines) copies alongside
+		// rendering, a compute family without graphics comes next; otherwise
+		// they share the graphics queue
+		vk_queue_family_index.transfer_family = vk_queue_family_index.graphics_family;
+		int best_transfer_score = 0;
+		for (uint32_t idx = 0; idx < queue_families.size(); ++idx) {
+			const VkQueueFlags flags = queue_families[idx].queueFlags;
+			if (queue_families[idx].queueCount == 0 || !(flags & (VK_QUEUE_TRANSFER_BIT | VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT))) {
+				continue;
+			}
+			const int score = (flags & VK_QUEUE_GRAPHICS_BIT) ? 0 : (flags & VK_QUEUE_COMPUTE_BIT) ? 1 : 2;
+			if (score > best_transfer_score) {
+				best_transfer_score = score;
+				vk_queue_family_index.transfer_family = idx;
+			}
+		}
+
+		// async compute: a compute family without graphics, whose queues run
+		// alongside the graphics queue. Preferably not the uploads' family, or
+		// else a second queue of it; sharing their queue still overlaps rendering
+		for (uint32_t idx = 0; idx < queue_families.size(); ++idx) {
+			const VkQueueFlags flags = queue_families[idx].queueFlags;
+			if (queue_families[idx].queueCount == 0 || !(flags & VK_QUEUE_COMPUTE_BIT) || (flags & VK_QUEUE_GRAPHICS_BIT)) {
+				continue;
+			}
+			if (!vk_queue_family_index.compute_family || vk_queue_family_index.compute_family == vk_queue_family_index.transfer_family) {
+				vk_queue_family_index.compute_family = idx;
+			}
+		}
+		if (vk_queue_family_index.compute_family && vk_queue_family_index.compute_family == vk_queue_family_index.transfer_family) {
+			vk_queue_family_index.compute_queue = queue_families[vk_queue_family_index.compute_family.value()].queueCount > 1 ? 1 : 0;
+		}
 	}
 
 	void SelectPhysicalDeviceSwapChainSupportDetails(VkPhysicalDevice physical_device) {
@@ -225,6 +470,43 @@ private:
 		return required_extensions.empty();
 	}
 
+	bool CheckPhysicalDeviceExtensionSupport(VkPhysicalDevice physical_device, const char* extension) {
+		uint32_t extension_count = 0;
+		vkEnumerateDeviceExtensionProperties(physical_device, nullptr, &extension_count, nullptr);
+		std::vector<VkExtensionProperties> available_extensions(extension_count);
+		vkEnumerateDeviceExtensionProperties(physical_device, nullptr, &extension_count, available_extensions.data());
+		for (const auto& ext_prop : available_extensions) {
+			if (strcmp(ext_prop.extensionName, extension) == 0) {
+				return true;
+			}
+		}
+		return false;
+	}
+
+	// Vulkan 1.2 timeline semaphores, which order uploads against rendering,
+	// and the descriptor indexing features of the bindless arrays
+	bool CheckPhysicalDeviceVulkan12Features(VkPhysicalDevice physical_device) {
+		VkPhysicalDeviceProperties properties;
+		vkGetPhysicalDeviceProperties(physical_device, &properties);
+		if (properties.apiVersion < VK_API_VERSION_1_2) {
+			return false;
+		}
+		VkPhysicalDeviceVulkan12Features vulkan12_features = {};
+		vulkan12_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+		VkPhysicalDeviceFeatures2 features = {};
+		features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+		features.pNext = &vulkan12_features;
+		vkGetPhysicalDeviceFeatures2(physical_device, &features);
+		return vulkan12_features.timelineSemaphore == VK_TRUE &&
+			vulkan12_features.runtimeDescriptorArray == VK_TRUE &&
+			vulkan12_features.descriptorBindingPartiallyBound == VK_TRUE &&
+			vulkan12_features.descriptorBindingSampledImageUpdateAfterBind == VK_TRUE &&
+			vulkan12_features.descriptorBindingStorageBufferUpdateAfterBind == VK_TRUE &&
+			vulkan12_features.descriptorBindingUpdateUnusedWhilePending == VK_TRUE &&
+			features.features.shaderSampledImageArrayDynamicIndexing == VK_TRUE &&
+			features.features.shaderStorageBufferArrayDynamicIndexing == VK_TRUE;
+	}
+
 	bool CheckPhysicalDeviceAdequate(VkPhysicalDevice physical_device) {
 		SelectPhysicalDeviceQueueFamilyIndex(physical_device);
 		bool extensions_supported = CheckPhysicalDeviceExtensionsSupport(physical_device);
@@ -233,7 +515,8 @@ private:
 			SelectPhysicalDeviceSwapChainSupportDetails(physical_device);
 			swapchain_adequate = !vk_swapchain_support_details.formats.empty() && !vk_swapchain_support_details.present_modes.empty();
 		}
-		return vk_queue_family_index.IsComplete() && extensions_supported && swapchain_adequate;
+		return vk_queue_family_index.IsComplete() && extensions_supported && swapchain_adequate &&
+			CheckPhysicalDeviceVulkan12Features(physical_device);
 	}
 private:
 	// function helpers
@@ -248,7 +531,7 @@ private:
 			app_info.applicationVersion = VK_MAKE_VERSION(0, 0, 1);
 			app_info.pEngineName = "VK_DR";
 			app_info.engineVersion = VK_MAKE_VERSION(0, 0, 1);
-			app_info.apiVersion = VK_API_VERSION_1_1;
+			app_info.apiVersion = VK_API_VERSION_1_2;
 		}
 
 		VkInstanceCreateInfo instance_create_info = {};
@@ -330,27 +613,54 @@ private:
 
 	void CreateLogicalDevice() {
 		std::vector<VkDeviceQueueCreateInfo> queue_create_infos;
-		std::set<uint32_t> unique_queue_families = {vk_queue_family_index.graphics_family.value(), vk_queue_family_index.present_family.value()};
-		float queue_priority = 1.0f;
+		// queues per family: one each, two when async compute takes the second
+		// queue of the transfer family
+		std::map<uint32_t, uint32_t> queue_counts = {{vk_queue_family_index.graphics_family.value(), 1}, {vk_queue_family_index.present_family.value(), 1},
+			{vk_queue_family_index.transfer_family.value(), 1}};
+		if (vk_queue_family_index.compute_family) {
+			uint32_t& count = queue_counts[vk_queue_family_index.compute_family.value()];
+			count = std::max(count, vk_queue_family_index.compute_queue + 1);
+		}
+		const float queue_priorities[] = { 1.0f, 1.0f };
 
-		for (uint32_t queue_fam_idx : unique_queue_families) {
+		for (const auto& entry : queue_counts) {
 			VkDeviceQueueCreateInfo queue_create_info = {};
 			queue_create_info.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
-			queue_create_info.queueFamilyIndex = queue_fam_idx;
-			queue_create_info.queueCount = 1;
-			queue_create_info.pQueuePriorities = &queue_priority;
+			queue_create_info.queueFamilyIndex = entry.first;
+			queue_create_info.queueCount = entry.second;
+			queue_create_info.pQueuePriorities = queue_priorities;
 			queue_create_infos.push_back(queue_create_info);
 		}
 
+		// optional extensions on top of kDeviceExtensions
+		std::vector<const char*> device_extensions = kDeviceExtensions;
+		memory_budget_supported = CheckPhysicalDeviceExtensionSupport(vk_physical_device, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+		if (memory_budget_supported) {
+			device_extensions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+		}
+
+		// bindless arrays are indexed with push constants: dynamically uniform,
+		// so no non-uniform indexing is needed
 		VkPhysicalDeviceFeatures physical_device_features = {};
+		physical_device_features.shaderSampledImageArrayDynamicIndexing = VK_TRUE;
+		physical_device_features.shaderStorageBufferArrayDynamicIndexing = VK_TRUE;
+		VkPhysicalDeviceVulkan12Features vulkan12_features = {};
+		vulkan12_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+		vulkan12_features.timelineSemaphore = VK_TRUE;
+		vulkan12_features.runtimeDescriptorArray = VK_TRUE;
+		vulkan12_features.descriptorBindingPartiallyBound = VK_TRUE;
+		vulkan12_features.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+		vulkan12_features.descriptorBindingStorageBufferUpdateAfterBind = VK_TRUE;
+		vulkan12_features.descriptorBindingUpdateUnusedWhilePending = VK_TRUE;
 		VkDeviceCreateInfo logical_device_create_info = {};
 		{
 			logical_device_create_info.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+			logical_device_create_info.pNext = &vulkan12_features;
 			logical_device_create_info.queueCreateInfoCount = static_cast<uint32_t>(queue_create_infos.size());
 			logical_device_create_info.pQueueCreateInfos = queue_create_infos.data();
 			logical_device_create_info.pEnabledFeatures = &physical_device_features;
-			logical_device_create_info.enabledExtensionCount = static_cast<uint32_t>(kDeviceExtensions.size());
-			logical_device_create_info.ppEnabledExtensionNames = kDeviceExtensions.data();
+			logical_device_create_info.enabledExtensionCount = static_cast<uint32_t>(device_extensions.size());
+			logical_device_create_info.ppEnabledExtensionNames = device_extensions.data();
 			if (kEnableValidationLayers) {
 				logical_device_create_info.enabledLayerCount = static_cast<uint32_t>(kValidationLayers.size());
 				logical_device_create_info.ppEnabledLayerNames = kValidationLayers.data();
@@ -364,6 +674,10 @@ private:
 		}
 		vkGetDeviceQueue(vk_logical_device, vk_queue_family_index.graphics_family.value(), 0, &vk_graphics_queue);
 		vkGetDeviceQueue(vk_logical_device, vk_queue_family_index.present_family.value(), 0, &vk_present_queue);
+		vkGetDeviceQueue(vk_logical_device, vk_queue_family_index.transfer_family.value(), 0, &vk_transfer_queue);
+		if (vk_queue_family_index.compute_family) {
+			vkGetDeviceQueue(vk_logical_device, vk_queue_family_index.compute_family.value(), vk_queue_family_index.compute_queue, &vk_compute_queue);
+		}
 	}
 
 	void CreateSwapChain() {
@@ -393,12 +707,15 @@ private:
 		};
 
 		auto ChooseSwapchianExtent = [this]() {
-			if (vk_swapchain_support_details.capabilities.currentExtent.width != std::numeric_limits<uint32_t>::max()) {
-				return vk_swapchain_support_details.capabilities.currentExtent;
+			const VkSurfaceCapabilitiesKHR& capabilities = vk_swapchain_support_details.capabilities;
+			if (capabilities.currentExtent.width != std::numeric_limits<uint32_t>::max()) {
+				return capabilities.currentExtent;
 			} else {
-				VkExtent2D extent = {width, height};
-				extent.width = std::max(vk_swapchain_support_details.capabilities.minImageExtent.width, extent.width);
-				extent.height = std::max(vk_swapchain_support_details.capabilities.minImageExtent.height, extent.height);
+				int fb_width = 0, fb_height = 0;
+				glfwGetFramebufferSize(window, &fb_width, &fb_height);
+				VkExtent2D extent = {static_cast<uint32_t>(fb_width), static_cast<uint32_t>(fb_height)};
+				extent.width = std::clamp(extent.width, capabilities.minImageExtent.width, capabilities.maxImageExtent.width);
+				extent.height = std::clamp(extent.height, capabilities.minImageExtent.height, capabilities.maxImageExtent.height);
 				return extent;
 			}
 		};
@@ -433,11 +750,17 @@ private:
 		swapchain_create_info.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
 		swapchain_create_info.presentMode = present_mode;
 		swapchain_create_info.clipped = VK_TRUE;
-		swapchain_create_info.oldSwapchain = VK_NULL_HANDLE;
+		// lets the driver recycle the old images and keeps the presentation of
+		// frames queued on the old swapchain valid
+		VkSwapchainKHR old_swapchain = vk_swapchain;
+		swapchain_create_info.oldSwapchain = old_swapchain;
 
 		if (vkCreateSwapchainKHR(vk_logical_device, &swapchain_create_info, nullptr, &vk_swapchain) != VK_SUCCESS) {
 			throw std::runtime_error("Failed to create swap chain!");
 		}
+		if (old_swapchain != VK_NULL_HANDLE) {
+			vkDestroySwapchainKHR(vk_logical_device, old_swapchain, nullptr);
+		}
 
 		uint32_t swapchain_image_count = 0;
 		vkGetSwapchainImagesKHR(vk_logical_device, vk_swapchain, &swapchain_image_count, nullptr);
@@ -470,72 +793,272 @@ private:
 		}
 	}
 
-	void CreateRenderPass() {
-		VkAttachmentDescription color_attachment = {};
-		{
-			color_attachment.format = vk_swapchain_image_format;
-			color_attachment.samples = VK_SAMPLE_COUNT_1_BIT;
-			color_attachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-			color_attachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-			color_attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-			color_attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-			color_attachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-			color_attachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
-		}
-		VkAttachmentReference color_attach_ref = {};
+	VkFormat ChooseDepthFormat() {
+		const VkFormat candidates[] = { VK_FORMAT_D32_SFLOAT, VK_FORMAT_D32_SFLOAT_S8_UINT, VK_FORMAT_D24_UNORM_S8_UINT };
+		for (VkFormat format : candidates) {
+			VkFormatProperties properties;
+			vkGetPhysicalDeviceFormatProperties(vk_physical_device, format, &properties);
+			if (properties.optimalTilingFeatures & VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT) {
+				return format;
+			}
+		}
+		throw std::runtime_error("Failed to find a supported depth format!");
+	}
+
+	void CreatePipelineCache() {
+		pipeline_cache = std::make_unique<PipelineCache>(vk_physical_device, vk_logical_device, kPipelineCachePath);
+	}
+
+	void CreateMemoryAllocator() {
+		memory_allocator = std::make_unique<MemoryAllocator>(vk_physical_device, vk_logical_device, memory_budget_supported);
+	}
+
+	void CreateUploadQueue() {
+		uint32_t queue_family_count = 0;
+		vkGetPhysicalDeviceQueueFamilyProperties(vk_physical_device, &queue_family_count, nullptr);
+		std::vector<VkQueueFamilyProperties> queue_families(queue_family_count);
+		vkGetPhysicalDeviceQueueFamilyProperties(vk_physical_device, &queue_family_count, queue_families.data());
+		const uint32_t transfer_family = vk_queue_family_index.transfer_family.value();
+		upload_queue = std::make_unique<UploadQueue>(*memory_allocator, vk_logical_device, vk_transfer_queue, transfer_family,
+			vk_queue_family_index.graphics_family.value(), queue_families[transfer_family].minImageTransferGranularity,
+			kUploadSlotSize, kUploadSlotCount);
+	}
+
+	// tiles of varying shade between dark grout; stands in for a texture read
+	// from disk
+	static std::vector<unsigned char> GenerateFloorTexels(uint32_t size) {
+		std::vector<unsigned char> texels(static_cast<size_t>(size) * size * 4);
+		const uint32_t tile = std::max<uint32_t>(size / 4, 1);
+		const uint32_t grout = tile / 48 + 1;
+		for (uint32_t y = 0; y < size; ++y) {
+			for (uint32_t x = 0; x < size; ++x) {
+				uint32_t hash = (x / tile) * 73856093u ^ (y / tile) * 19349663u;
+				hash = (hash ^ (hash >> 13)) * 0x5bd1e995u;
+				const uint32_t grain = ((x * 2654435761u) ^ (y * 40503u)) >> 28;
+				const bool is_grout = x % tile < grout || y % tile < grout;
+				const uint32_t shade = is_grout ? 70 : 180 + ((hash >> 8) & 63) + grain;
+				unsigned char* texel = &texels[(static_cast<size_t>(y) * size + x) * 4];
+				texel[0] = static_cast<unsigned char>(std::min<uint32_t>(shade, 255));
+				texel[1] = static_cast<unsigned char>(std::min<uint32_t>(shade * 15 / 16, 255));
+				texel[2] = static_cast<unsigned char>(std::min<uint32_t>(shade * 7 / 8, 255));
+				texel[3] = 255;
+			}
+		}
+		return texels;
+	}
+
+	// the floor texture is far larger than a staging slot, so it takes a few
+	// frames to stream in; the floor draw only references its bindless slot
+	// once it is acquired
+	void CreateFloorTexture() {
+		const VkFormat format = VK_FORMAT_R8G8B8A8_SRGB;
+		VkImageCreateInfo image_create_info = {};
 		{
-			color_attach_ref.attachment = 0;
-			color_attach_ref.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+			image_create_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+			image_create_info.imageType = VK_IMAGE_TYPE_2D;
+			image_create_info.format = format;
+			image_create_info.extent = { kFloorTextureSize, kFloorTextureSize, 1 };
+			image_create_info.mipLevels = 1;
+			image_create_info.arrayLayers = 1;
+			image_create_info.samples = VK_SAMPLE_COUNT_1_BIT;
+			image_create_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+			image_create_info.usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+			// exclusive: the upload queue hands it over to the graphics family
+			image_create_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+			image_create_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		}
+		if (vkCreateImage(vk_logical_device, &image_create_info, nullptr, &floor_texture.image) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to create texture image!");
 		}
-		VkSubpassDescription subpass_desc = {};
+		floor_texture.memory = memory_allocator->AllocateForImage(floor_texture.image, VK_IMAGE_TILING_OPTIMAL, MemoryUsage::GpuOnly);
+
+		VkImageViewCreateInfo image_view_create_info = {};
 		{
-			subpass_desc.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
-			subpass_desc.colorAttachmentCount = 1;
-			subpass_desc.pColorAttachments = &color_attach_ref;
+			image_view_create_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+			image_view_create_info.image = floor_texture.image;
+			image_view_create_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+			image_view_create_info.format = format;
+			image_view_create_info.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+			image_view_create_info.subresourceRange.baseMipLevel = 0;
+			image_view_create_info.subresourceRange.levelCount = 1;
+			image_view_create_info.subresourceRange.baseArrayLayer = 0;
+			image_view_create_info.subresourceRange.layerCount = 1;
+		}
+		if (vkCreateImageView(vk_logical_device, &image_view_create_info, nullptr, &floor_texture.view) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to create texture image view!");
 		}
-		VkSubpassDependency subpass_dependency = {};
+
+		VkSamplerCreateInfo sampler_create_info = {};
 		{
-			subpass_dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
-			subpass_dependency.dstSubpass = 0;
-			subpass_dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-			subpass_dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-			subpass_dependency.srcAccessMask = 0;
-			subpass_dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+			sampler_create_info.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+			sampler_create_info.magFilter = VK_FILTER_LINEAR;
+			sampler_create_info.minFilter = VK_FILTER_LINEAR;
+			sampler_create_info.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+			sampler_create_info.addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+			sampler_create_info.addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+			sampler_create_info.addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+			sampler_create_info.maxLod = 0.0f;
+		}
+		if (vkCreateSampler(vk_logical_device, &sampler_create_info, nullptr, &vk_floor_sampler) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to create texture sampler!");
+		}
+
+		floor_texture_ticket = upload_queue->EnqueueImage(floor_texture.image, { kFloorTextureSize, kFloorTextureSize },
+			VK_IMAGE_ASPECT_COLOR_BIT, GenerateFloorTexels(kFloorTextureSize), VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+			VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+	}
+
+	// the frame as a render graph: the G-buffer pass writes the targets the
+	// lighting pass reads as input attachments, so the graph merges both into
+	// one render pass with two subpasses, keeps the G-buffer transient and
+	// derives the load/store ops, layouts and subpass dependencies. Light
+	// culling only needs the camera, it runs on the async compute queue into a
+	// buffer per frame in flight, so it overlaps the previous frame's rendering.
+	void CreateRenderGraph() {
+		render_graph = std::make_unique<RenderGraph>(vk_physical_device, vk_logical_device, *memory_allocator);
+		if (vk_queue_family_index.compute_family) {
+			render_graph->EnableAsyncCompute(vk_queue_family_index.graphics_family.value(), vk_queue_family_index.compute_family.value());
 		}
+		swapchain_image = render_graph->ImportImage("swapchain", vk_swapchain_image_format, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
+		gbuffer_images[0] = render_graph->CreateImage("albedo", VK_FORMAT_R8G8B8A8_UNORM);
+		gbuffer_images[1] = render_graph->CreateImage("normal", VK_FORMAT_A2B10G10R10_UNORM_PACK32);
+		gbuffer_images[2] = render_graph->CreateImage("material", VK_FORMAT_R8G8B8A8_UNORM);
+		gbuffer_images[3] = render_graph->CreateImage("depth", ChooseDepthFormat());
+		cluster_lights = render_graph->CreateBuffer("cluster lights", sizeof(uint32_t) * kClusterTilesX * kClusterTilesY * kClusterSlices,
+			static_cast<uint32_t>(max_frames_in_flight));
+
+		VkClearValue clear_black = {};
+		clear_black.color = { 0.0f, 0.0f, 0.0f, 1.0f };
+		VkClearValue clear_depth = {};
+		clear_depth.depthStencil = { 1.0f, 0 };
+
+		light_cull_pass = &render_graph->AddPass("light cull", RenderGraph::PassType::AsyncCompute);
+		light_cull_pass->WriteStorage(cluster_lights);
+		light_cull_pass->SetExecute([this](const RenderGraph::PassContext& context) { ExecuteLightCullPass(context); });
+
+		gbuffer_pass = &render_graph->AddPass("gbuffer", RenderGraph::PassType::Graphics);
+		for (uint32_t i = 0; i < kGBufferColorCount; ++i) {
+			gbuffer_pass->WriteColor(gbuffer_images[i], clear_black);
+		}
+		gbuffer_pass->WriteDepth(gbuffer_images[kGBufferColorCount], clear_depth);
+		gbuffer_pass->SetExecute([this](const RenderGraph::PassContext& context) { ExecuteGBufferPass(context); }, true);
+
+		lighting_pass = &render_graph->AddPass("lighting", RenderGraph::PassType::Graphics);
+		for (uint32_t i = 0; i < kGBufferImageCount; ++i) {
+			lighting_pass->ReadInput(gbuffer_images[i]);
+		}
+		lighting_pass->ReadStorage(cluster_lights);
+		lighting_pass->WriteColor(swapchain_image, clear_black);
+		lighting_pass->SetExecute([this](const RenderGraph::PassContext& context) { ExecuteLightingPass(context); });
 
-		VkRenderPassCreateInfo render_pass_create_info = {};
+		render_graph->Compile();
+		render_graph->Realize(vk_swapchain_image_extent);
+		render_graph->DumpStats(std::cout);
+	}
+
+	// set 0 of every pipeline is the bindless table, bound once per command
+	// buffer: the floor texture and the cluster light masks are slots in it.
+	// Set 1 of the lighting pass holds the G-buffer input attachments, which
+	// are per framebuffer, so it is allocated and written each frame from the
+	// frame's descriptor pools.
+	void CreateDescriptorTables() {
+		VkPhysicalDeviceDescriptorIndexingProperties indexing_properties = {};
+		indexing_properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_PROPERTIES;
+		VkPhysicalDeviceProperties2 properties = {};
+		properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+		properties.pNext = &indexing_properties;
+		vkGetPhysicalDeviceProperties2(vk_physical_device, &properties);
+		const uint32_t image_capacity = std::min({ kBindlessImageCapacity,
+			indexing_properties.maxPerStageDescriptorUpdateAfterBindSampledImages, indexing_properties.maxPerStageDescriptorUpdateAfterBindSamplers,
+			indexing_properties.maxDescriptorSetUpdateAfterBindSampledImages, indexing_properties.maxDescriptorSetUpdateAfterBindSamplers });
+		const uint32_t buffer_capacity = std::min({ kBindlessBufferCapacity,
+			indexing_properties.maxPerStageDescriptorUpdateAfterBindStorageBuffers, indexing_properties.maxDescriptorSetUpdateAfterBindStorageBuffers });
+		bindless = std::make_unique<BindlessTable>(vk_logical_device, image_capacity, buffer_capacity,
+			VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_COMPUTE_BIT);
+
+		// written once: the view is valid before the upload completes, the
+		// slot is just not referenced until then
+		floor_texture_slot = bindless->AddImage(floor_texture.view, vk_floor_sampler, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+		UpdateBindlessBuffers();
+
+		// the lighting subpass reads albedo, normal, material and depth
+		std::array<VkDescriptorSetLayoutBinding, kGBufferImageCount> bindings = {};
+		for (uint32_t i = 0; i < bindings.size(); ++i) {
+			bindings[i].binding = i;
+			bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+			bindings[i].descriptorCount = 1;
+			bindings[i].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+		}
+		VkDescriptorSetLayoutCreateInfo set_layout_create_info = {};
 		{
-			render_pass_create_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
-			render_pass_create_info.attachmentCount = 1;
-			render_pass_create_info.pAttachments = &color_attachment;
-			render_pass_create_info.subpassCount = 1;
-			render_pass_create_info.pSubpasses = &subpass_desc;
-			render_pass_create_info.dependencyCount = 1;
-			render_pass_create_info.pDependencies = &subpass_dependency;
+			set_layout_create_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+			set_layout_create_info.bindingCount = static_cast<uint32_t>(bindings.size());
+			set_layout_create_info.pBindings = bindings.data();
 		}
-		if (vkCreateRenderPass(vk_logical_device, &render_pass_create_info, nullptr, &vk_render_pass) != VK_SUCCESS) {
-			throw std::runtime_error("Failed to create render pass!");
+		if (vkCreateDescriptorSetLayout(vk_logical_device, &set_layout_create_info, nullptr, &vk_lighting_set_layout) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to create descriptor set layout!");
 		}
+		frame_descriptors = std::make_unique<DescriptorArena>(vk_logical_device,
+			std::vector<VkDescriptorPoolSize>{ { VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT, kGBufferImageCount * kFrameDescriptorSetsPerPool } },
+			kFrameDescriptorSetsPerPool, static_cast<uint32_t>(max_frames_in_flight));
 	}
 
-	void CreateGraphicsPileline() {
-		// shader
-		std::vector<char> vert_shader_code = ReadFile("shaders/vert.spv");
-		std::vector<char> frag_shader_code = ReadFile("shaders/frag.spv");
-		auto CreateShaderModule = [this](const std::vector<char>& code) {
-			VkShaderModuleCreateInfo shader_module_create_info = {};
-			shader_module_create_info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-			shader_module_create_info.codeSize = code.size();
-			shader_module_create_info.pCode = reinterpret_cast<const uint32_t*>(code.data());
-
-			VkShaderModule shader;
-			if (vkCreateShaderModule(vk_logical_device, &shader_module_create_info, nullptr, &shader) != VK_SUCCESS) {
-				throw std::runtime_error("Failed to create shader module!");
+	// points the bindless buffer slots at the graph's current buffers; the
+	// device must be idle when they already exist
+	void UpdateBindlessBuffers() {
+		cluster_lights_slots.resize(max_frames_in_flight, kNoBindlessSlot);
+		for (uint32_t i = 0; i < max_frames_in_flight; ++i) {
+			const VkBuffer cluster_buffer = render_graph->Buffer(cluster_lights, i);
+			if (cluster_lights_slots[i] == kNoBindlessSlot) {
+				cluster_lights_slots[i] = bindless->AddBuffer(cluster_buffer);
+			} else {
+				bindless->UpdateBuffer(cluster_lights_slots[i], cluster_buffer);
 			}
-			return shader;
-		};
-		VkShaderModule vert_shader_module = CreateShaderModule(vert_shader_code);
-		VkShaderModule frag_shader_module = CreateShaderModule(frag_shader_code);
+		}
+	}
+
+	// G-buffer input attachments of the lighting subpass, valid for this frame
+	VkDescriptorSet AllocateLightingSet() {
+		VkDescriptorSet set = frame_descriptors->Allocate(vk_lighting_set_layout);
+		std::array<VkDescriptorImageInfo, kGBufferImageCount> image_infos = {};
+		std::array<VkWriteDescriptorSet, kGBufferImageCount> writes = {};
+		for (uint32_t i = 0; i < kGBufferImageCount; ++i) {
+			image_infos[i].imageView = render_graph->ImageView(gbuffer_images[i]);
+			image_infos[i].imageLayout = i == kGBufferColorCount ? VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+			writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			writes[i].dstSet = set;
+			writes[i].dstBinding = i;
+			writes[i].descriptorCount = 1;
+			writes[i].descriptorType = VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+			writes[i].pImageInfo = &image_infos[i];
+		}
+		vkUpdateDescriptorSets(vk_logical_device, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+		return set;
+	}
+
+	VkPipelineLayout CreatePipelineLayout(const std::vector<VkDescriptorSetLayout>& set_layouts, VkShaderStageFlags push_stages, uint32_t push_size) {
+		VkPushConstantRange push_range = {};
+		push_range.stageFlags = push_stages;
+		push_range.offset = 0;
+		push_range.size = push_size;
+
+		VkPipelineLayoutCreateInfo pl_layout_create_info = {};
+		pl_layout_create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+		pl_layout_create_info.setLayoutCount = static_cast<uint32_t>(set_layouts.size());
+		pl_layout_create_info.pSetLayouts = set_layouts.data();
+		pl_layout_create_info.pushConstantRangeCount = 1;
+		pl_layout_create_info.pPushConstantRanges = &push_range;
+		VkPipelineLayout layout;
+		if (vkCreatePipelineLayout(vk_logical_device, &pl_layout_create_info, nullptr, &layout) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to create pipeline layout!");
+		}
+		return layout;
+	}
+
+	VkPipeline CreateGraphicsPipeline(const PipelineDesc& desc) {
+		// shader
+		VkShaderModule vert_shader_module = pipeline_cache->ShaderModule(ReadFile(desc.vert_shader));
+		VkShaderModule frag_shader_module = pipeline_cache->ShaderModule(ReadFile(desc.frag_shader));
 
 		VkPipelineShaderStageCreateInfo pl_vert_shader_stage_create_info = {};
 		pl_vert_shader_stage_create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
@@ -548,7 +1071,7 @@ private:
 		pl_frag_shader_stage_create_info.module = frag_shader_module;
 		pl_frag_shader_stage_create_info.pName = "main";
 		VkPipelineShaderStageCreateInfo pl_shader_stage_create_infos[] = { pl_vert_shader_stage_create_info, pl_frag_shader_stage_create_info };
-		// input vertex
+		// input vertex: both passes generate their vertices from gl_VertexIndex
 		VkPipelineVertexInputStateCreateInfo pl_vertexinput_stage_create_info = {};
 		pl_vertexinput_stage_create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
 		pl_vertexinput_stage_create_info.vertexBindingDescriptionCount = 0;
@@ -558,34 +1081,25 @@ private:
 		pl_inputassembly_stage_create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
 		pl_inputassembly_stage_create_info.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
 		pl_inputassembly_stage_create_info.primitiveRestartEnable = VK_FALSE;
-		// view port 
-		VkViewport viewport = {};
-		viewport.x = 0.0f;
-		viewport.y = 0.0f;
-		viewport.width = (float)vk_swapchain_image_extent.width;
-		viewport.height = (float)vk_swapchain_image_extent.height;
-		viewport.minDepth = 0.0f;
-		viewport.maxDepth = 1.0f;
-
-		VkRect2D scissor = {};
-		scissor.offset = {0, 0};
-		scissor.extent = vk_swapchain_image_extent;
-
+		// view port: dynamic, set when recording, so a resize keeps the pipeline
 		VkPipelineViewportStateCreateInfo pl_viewport_stage_create_info = {};
 		pl_viewport_stage_create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
 		pl_viewport_stage_create_info.viewportCount = 1;
-		pl_viewport_stage_create_info.pViewports = &viewport;
 		pl_viewport_stage_create_info.scissorCount = 1;
-		pl_viewport_stage_create_info.pScissors = &scissor;
-		// rasterization
+		VkDynamicState dynamic_states[] = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+		VkPipelineDynamicStateCreateInfo pl_dynamic_state_create_info = {};
+		pl_dynamic_state_create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+		pl_dynamic_state_create_info.dynamicStateCount = static_cast<uint32_t>(std::size(dynamic_states));
+		pl_dynamic_state_create_info.pDynamicStates = dynamic_states;
+		// rasterization, the projection flips y so counter-clockwise stays front facing
 		VkPipelineRasterizationStateCreateInfo pl_rasterization_stage_create_info = {};
 		pl_rasterization_stage_create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
 		pl_rasterization_stage_create_info.depthClampEnable = VK_FALSE;
 		pl_rasterization_stage_create_info.rasterizerDiscardEnable = VK_FALSE;
 		pl_rasterization_stage_create_info.polygonMode = VK_POLYGON_MODE_FILL;
 		pl_rasterization_stage_create_info.lineWidth = 1.0f;
-		pl_rasterization_stage_create_info.cullMode = VK_CULL_MODE_BACK_BIT;
-		pl_rasterization_stage_create_info.frontFace = VK_FRONT_FACE_CLOCKWISE;
+		pl_rasterization_stage_create_info.cullMode = desc.cull_mode;
+		pl_rasterization_stage_create_info.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
 		pl_rasterization_stage_create_info.depthBiasEnable = VK_FALSE;
 
 		// multisample
@@ -594,31 +1108,32 @@ private:
 		pl_multisample_stage_create_info.sampleShadingEnable = VK_FALSE;
 		pl_multisample_stage_create_info.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
 
+		// depth
+		VkPipelineDepthStencilStateCreateInfo pl_depthstencil_state_create_info = {};
+		pl_depthstencil_state_create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+		pl_depthstencil_state_create_info.depthTestEnable = desc.depth_test ? VK_TRUE : VK_FALSE;
+		pl_depthstencil_state_create_info.depthWriteEnable = desc.depth_test ? VK_TRUE : VK_FALSE;
+		pl_depthstencil_state_create_info.depthCompareOp = VK_COMPARE_OP_LESS;
+		pl_depthstencil_state_create_info.depthBoundsTestEnable = VK_FALSE;
+		pl_depthstencil_state_create_info.stencilTestEnable = VK_FALSE;
+
 		// blend 
 		VkPipelineColorBlendAttachmentState color_blend_attachment = {};
 		color_blend_attachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
 		color_blend_attachment.blendEnable = VK_FALSE;
+		std::vector<VkPipelineColorBlendAttachmentState> color_blend_attachments(desc.color_attachment_count, color_blend_attachment);
 
 		VkPipelineColorBlendStateCreateInfo pl_colorblend_state_create_info = {};
 		pl_colorblend_state_create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
 		pl_colorblend_state_create_info.logicOpEnable = VK_FALSE;
 		pl_colorblend_state_create_info.logicOp = VK_LOGIC_OP_COPY;
-		pl_colorblend_state_create_info.attachmentCount = 1;
-		pl_colorblend_state_create_info.pAttachments = &color_blend_attachment;
+		pl_colorblend_state_create_info.attachmentCount = desc.color_attachment_count;
+		pl_colorblend_state_create_info.pAttachments = color_blend_attachments.data();
 		pl_colorblend_state_create_info.blendConstants[0] = 0.0f;
 		pl_colorblend_state_create_info.blendConstants[1] = 0.0f;
 		pl_colorblend_state_create_info.blendConstants[2] = 0.0f;
 		pl_colorblend_state_create_info.blendConstants[3] = 0.0f;
 
-		// pipeline layout
-		VkPipelineLayoutCreateInfo pl_layout_create_info = {};
-		pl_layout_create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-		pl_layout_create_info.setLayoutCount = 0;
-		pl_layout_create_info.pushConstantRangeCount = 0;
-		if (vkCreatePipelineLayout(vk_logical_device, &pl_layout_create_info, nullptr, &vk_pipeline_layout) != VK_SUCCESS) {
-			throw std::runtime_error("Failed to create pipeline layout!");
-		}
-
 		// graphics pipeline 
 		VkGraphicsPipelineCreateInfo graphics_pipeline_create_info = {};
 		graphics_pipeline_create_info.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
@@ -629,90 +1144,308 @@ private:
 		graphics_pipeline_create_info.pViewportState = &pl_viewport_stage_create_info;
 		graphics_pipeline_create_info.pRasterizationState = &pl_rasterization_stage_create_info;
 		graphics_pipeline_create_info.pMultisampleState = &pl_multisample_stage_create_info;
+		graphics_pipeline_create_info.pDepthStencilState = &pl_depthstencil_state_create_info;
 		graphics_pipeline_create_info.pColorBlendState = &pl_colorblend_state_create_info;
-		graphics_pipeline_create_info.layout = vk_pipeline_layout;
-		graphics_pipeline_create_info.renderPass = vk_render_pass;
-		graphics_pipeline_create_info.subpass = 0;
+		graphics_pipeline_create_info.pDynamicState = &pl_dynamic_state_create_info;
+		graphics_pipeline_create_info.layout = desc.layout;
+		graphics_pipeline_create_info.renderPass = desc.render_pass;
+		graphics_pipeline_create_info.subpass = desc.subpass;
 		graphics_pipeline_create_info.basePipelineHandle = VK_NULL_HANDLE;
 
-		if (vkCreateGraphicsPipelines(vk_logical_device, VK_NULL_HANDLE, 1, &graphics_pipeline_create_info, nullptr, &vk_pipeline) != VK_SUCCESS) {
-			throw std::runtime_error("Failed to create graphics pipeline~");
-		}
-		vkDestroyShaderModule(vk_logical_device, frag_shader_module, nullptr);
-		vkDestroyShaderModule(vk_logical_device, vert_shader_module, nullptr);
+		// an identical pipeline comes back from the map, a new one is compiled
+		// through the driver cache
+		return pipeline_cache->GraphicsPipeline(graphics_pipeline_create_info);
 	}
 
-	void CreateFramebuffers() {
-		vk_framebuffers.resize(vk_swapchain_image_views.size());
-		for (size_t i = 0; i < vk_swapchain_image_views.size(); ++i) {
-			VkImageView attachments[] = { vk_swapchain_image_views[i] };
-			VkFramebufferCreateInfo framebuffer_create_info = {};
-			framebuffer_create_info.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
-			framebuffer_create_info.renderPass = vk_render_pass;
-			framebuffer_create_info.attachmentCount = 1;
-			framebuffer_create_info.pAttachments = attachments;
-			framebuffer_create_info.width = vk_swapchain_image_extent.width;
-			framebuffer_create_info.height = vk_swapchain_image_extent.height;
-			framebuffer_create_info.layers = 1;
+	void CreatePipelines() {
+		vk_gbuffer_pipeline_layout = CreatePipelineLayout({ bindless->Layout() }, kGBufferPushStages, sizeof(GBufferPushConstants));
+		vk_lighting_pipeline_layout = CreatePipelineLayout({ bindless->Layout(), vk_lighting_set_layout }, VK_SHADER_STAGE_FRAGMENT_BIT, sizeof(LightingPushConstants));
+
+		PipelineDesc gbuffer = {};
+		gbuffer.vert_shader = "shaders/gbuffer.vert.spv";
+		gbuffer.frag_shader = "shaders/gbuffer.frag.spv";
+		gbuffer.layout = vk_gbuffer_pipeline_layout;
+		gbuffer.render_pass = gbuffer_pass->RenderPass();
+		gbuffer.subpass = gbuffer_pass->Subpass();
+		gbuffer.color_attachment_count = kGBufferColorCount;
+		gbuffer.depth_test = true;
+		gbuffer.cull_mode = VK_CULL_MODE_BACK_BIT;
+		vk_gbuffer_pipeline = CreateGraphicsPipeline(gbuffer);
+
+		// a full-screen triangle per frame, independent of the scene
+		PipelineDesc lighting = {};
+		lighting.vert_shader = "shaders/lighting.vert.spv";
+		lighting.frag_shader = "shaders/lighting.frag.spv";
+		lighting.layout = vk_lighting_pipeline_layout;
+		lighting.render_pass = lighting_pass->RenderPass();
+		lighting.subpass = lighting_pass->Subpass();
+		lighting.color_attachment_count = 1;
+		lighting.depth_test = false;
+		lighting.cull_mode = VK_CULL_MODE_NONE;
+		vk_lighting_pipeline = CreateGraphicsPipeline(lighting);
+
+		vk_light_cull_pipeline_layout = CreatePipelineLayout({ bindless->Layout() }, VK_SHADER_STAGE_COMPUTE_BIT, sizeof(LightCullPushConstants));
+		VkComputePipelineCreateInfo compute_pipeline_create_info = {};
+		compute_pipeline_create_info.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+		compute_pipeline_create_info.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+		compute_pipeline_create_info.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+		compute_pipeline_create_info.stage.module = pipeline_cache->ShaderModule(ReadFile("shaders/light_cull.comp.spv"));
+		compute_pipeline_create_info.stage.pName = "main";
+		compute_pipeline_create_info.layout = vk_light_cull_pipeline_layout;
+		vk_light_cull_pipeline = pipeline_cache->ComputePipeline(compute_pipeline_create_info);
+	}
 
-			if (vkCreateFramebuffer(vk_logical_device, &framebuffer_create_info, nullptr, &vk_framebuffers[i]) != VK_SUCCESS) {
-				throw std::runtime_error("Failed to create famebuffer!");
-			}
+	// the G-buffer draws: the floor, then one draw per row of boxes. The
+	// floor gets its texture once uploaded, see RecordFrame().
+	void BuildDrawList() {
+		draw_list.clear();
+		draw_list.push_back({ 0, 1, -1 });
+		for (int row = 0; row < kSceneGrid; ++row) {
+			draw_list.push_back({ static_cast<uint32_t>(1 + row * kSceneGrid), kSceneGrid, -1 });
 		}
 	}
 
-	void CreateCommandPool() {
+	VkCommandPool CreateTransientCommandPool(uint32_t queue_family) {
+		VkCommandPool pool;
 		VkCommandPoolCreateInfo command_pool_create_info = {};
 		command_pool_create_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
-		command_pool_create_info.queueFamilyIndex = vk_queue_family_index.graphics_family.value();
-		if (vkCreateCommandPool(vk_logical_device, &command_pool_create_info, nullptr, &vk_command_pool) != VK_SUCCESS) {
+		command_pool_create_info.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+		command_pool_create_info.queueFamilyIndex = queue_family;
+		if (vkCreateCommandPool(vk_logical_device, &command_pool_create_info, nullptr, &pool) != VK_SUCCESS) {
 			throw std::runtime_error("Failed to create command pool!");
 		}
+		return pool;
 	}
 
-	void CreateCommandBuffers() {
-		vk_command_buffers.resize(vk_framebuffers.size());
+	void AllocateCommandBuffers(VkCommandPool pool, VkCommandBufferLevel level, uint32_t count, VkCommandBuffer* command_buffers) {
 		VkCommandBufferAllocateInfo command_buffer_alloc_info = {};
 		command_buffer_alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-		command_buffer_alloc_info.commandPool = vk_command_pool;
-		command_buffer_alloc_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-		command_buffer_alloc_info.commandBufferCount = static_cast<uint32_t>(vk_command_buffers.size());
-		if (vkAllocateCommandBuffers(vk_logical_device, &command_buffer_alloc_info, vk_command_buffers.data()) != VK_SUCCESS) {
+		command_buffer_alloc_info.commandPool = pool;
+		command_buffer_alloc_info.level = level;
+		command_buffer_alloc_info.commandBufferCount = count;
+		if (vkAllocateCommandBuffers(vk_logical_device, &command_buffer_alloc_info, command_buffers) != VK_SUCCESS) {
 			throw std::runtime_error("Failed to allocate Command buffers!");
 		}
+	}
 
-		for (size_t i = 0; i < vk_command_buffers.size(); ++i) {
-			VkCommandBufferBeginInfo cb_begin_info = {};
-			cb_begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-			cb_begin_info.flags = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT;
-			if (vkBeginCommandBuffer(vk_command_buffers[i], &cb_begin_info) != VK_SUCCESS) {
-				throw std::runtime_error("Failed to begin recording command buffer!");
+	// command buffers are allocated once and re-recorded every frame; resetting
+	// a transient pool recycles their memory without freeing it
+	void CreateFrameCommands() {
+		const size_t worker_count = worker_pool.ThreadCount();
+		const uint32_t graphics_family = vk_queue_family_index.graphics_family.value();
+		vk_frame_commands.resize(max_frames_in_flight);
+		for (auto& frame : vk_frame_commands) {
+			frame.pool = CreateTransientCommandPool(graphics_family);
+			AllocateCommandBuffers(frame.pool, VK_COMMAND_BUFFER_LEVEL_PRIMARY, 1, &frame.primary);
+			if (render_graph->HasAsyncWork()) {
+				frame.compute_pool = CreateTransientCommandPool(vk_queue_family_index.compute_family.value());
+				AllocateCommandBuffers(frame.compute_pool, VK_COMMAND_BUFFER_LEVEL_PRIMARY, 1, &frame.compute);
+			}
+			frame.worker_pools.resize(worker_count);
+			frame.secondaries.resize(worker_count);
+			for (size_t worker = 0; worker < worker_count; ++worker) {
+				frame.worker_pools[worker] = CreateTransientCommandPool(graphics_family);
+				AllocateCommandBuffers(frame.worker_pools[worker], VK_COMMAND_BUFFER_LEVEL_SECONDARY, 1, &frame.secondaries[worker]);
 			}
+		}
+	}
 
-			VkRenderPassBeginInfo rp_begin_info = {};
-			rp_begin_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-			rp_begin_info.renderPass = vk_render_pass;
-			rp_begin_info.framebuffer = vk_framebuffers[i];
-			rp_begin_info.renderArea.offset = { 0, 0 };
-			rp_begin_info.renderArea.extent = vk_swapchain_image_extent;
-			VkClearValue clear_color = { 0.0f, 0.0f, 0.0f, 1.0f };
-			rp_begin_info.clearValueCount = 1;
-			rp_begin_info.pClearValues = &clear_color;
-
-			vkCmdBeginRenderPass(vk_command_buffers[i], &rp_begin_info, VK_SUBPASS_CONTENTS_INLINE);
-			vkCmdBindPipeline(vk_command_buffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, vk_pipeline);
-			vkCmdDraw(vk_command_buffers[i], 3, 1, 0, 0);
-			vkCmdEndRenderPass(vk_command_buffers[i]);
-			if (vkEndCommandBuffer(vk_command_buffers[i]) != VK_SUCCESS) {
-				throw std::runtime_error("Failed to recode commad buffer!");
+	// worker `worker` of `worker_count` records its contiguous share of the draw
+	// list into its secondary command buffer, which continues the G-buffer subpass
+	void RecordGBufferCommands(FrameCommands& frame, size_t worker, size_t worker_count, const RenderGraph::PassContext& context,
+		GBufferPushConstants constants) {
+		const size_t first_draw = draw_list.size() * worker / worker_count;
+		const size_t last_draw = draw_list.size() * (worker + 1) / worker_count;
+		VkCommandBuffer command_buffer = frame.secondaries[worker];
+
+		VkCommandBufferInheritanceInfo inheritance_info = {};
+		inheritance_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+		inheritance_info.renderPass = context.render_pass;
+		inheritance_info.subpass = context.subpass;
+		inheritance_info.framebuffer = context.framebuffer;
+		VkCommandBufferBeginInfo cb_begin_info = {};
+		cb_begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		cb_begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+		cb_begin_info.pInheritanceInfo = &inheritance_info;
+		if (vkBeginCommandBuffer(command_buffer, &cb_begin_info) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to begin recording command buffer!");
+		}
+
+		// dynamic state is not inherited from the primary
+		VkViewport viewport = { 0.0f, 0.0f, (float)vk_swapchain_image_extent.width, (float)vk_swapchain_image_extent.height, 0.0f, 1.0f };
+		VkRect2D scissor = { { 0, 0 }, vk_swapchain_image_extent };
+		vkCmdSetViewport(command_buffer, 0, 1, &viewport);
+		vkCmdSetScissor(command_buffer, 0, 1, &scissor);
+		vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, vk_gbuffer_pipeline);
+		const VkDescriptorSet bindless_set = bindless->Set();
+		vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, vk_gbuffer_pipeline_layout, 0, 1, &bindless_set, 0, nullptr);
+		vkCmdPushConstants(command_buffer, vk_gbuffer_pipeline_layout, kGBufferPushStages, 0, sizeof(constants), &constants);
+		// a material is a few indices: switching is a push, not a set bind
+		for (size_t i = first_draw; i < last_draw; ++i) {
+			if (draw_list[i].texture != constants.material.x) {
+				constants.material.x = draw_list[i].texture;
+				vkCmdPushConstants(command_buffer, vk_gbuffer_pipeline_layout, kGBufferPushStages,
+					offsetof(GBufferPushConstants, material), sizeof(constants.material), &constants.material);
 			}
+			vkCmdDraw(command_buffer, kCubeVertexCount, draw_list[i].instance_count, 0, draw_list[i].first_instance);
+		}
+		if (vkEndCommandBuffer(command_buffer) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to recode commad buffer!");
 		}
 	}
 
+	// G-buffer subpass: the draw list split across the worker pool, one
+	// secondary per worker; never more workers than draws, so none records an
+	// empty secondary
+	void ExecuteGBufferPass(const RenderGraph::PassContext& context) {
+		FrameCommands& frame = *recording_frame;
+		const size_t worker_count = std::max<size_t>(std::min(frame.secondaries.size(), draw_list.size()), 1);
+		worker_pool.Run([&](size_t worker) {
+			vkResetCommandPool(vk_logical_device, frame.worker_pools[worker], 0);
+			RecordGBufferCommands(frame, worker, worker_count, context, gbuffer_constants);
+		}, worker_count);
+		vkCmdExecuteCommands(context.command_buffer, static_cast<uint32_t>(worker_count), frame.secondaries.data());
+	}
+
+	// lighting subpass, one fullscreen triangle: not worth a secondary
+	void ExecuteLightingPass(const RenderGraph::PassContext& context) {
+		VkViewport viewport = { 0.0f, 0.0f, (float)vk_swapchain_image_extent.width, (float)vk_swapchain_image_extent.height, 0.0f, 1.0f };
+		VkRect2D scissor = { { 0, 0 }, vk_swapchain_image_extent };
+		vkCmdSetViewport(context.command_buffer, 0, 1, &viewport);
+		vkCmdSetScissor(context.command_buffer, 0, 1, &scissor);
+		vkCmdBindPipeline(context.command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, vk_lighting_pipeline);
+		const VkDescriptorSet sets[] = { bindless->Set(), AllocateLightingSet() };
+		vkCmdBindDescriptorSets(context.command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, vk_lighting_pipeline_layout, 0, 2, sets, 0, nullptr);
+		vkCmdPushConstants(context.command_buffer, vk_lighting_pipeline_layout, VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(lighting_constants), &lighting_constants);
+		vkCmdDraw(context.command_buffer, 3, 1, 0, 0);
+	}
+
+	// one invocation per cluster
+	void ExecuteLightCullPass(const RenderGraph::PassContext& context) {
+		vkCmdBindPipeline(context.command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, vk_light_cull_pipeline);
+		const VkDescriptorSet bindless_set = bindless->Set();
+		vkCmdBindDescriptorSets(context.command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, vk_light_cull_pipeline_layout, 0, 1, &bindless_set, 0, nullptr);
+		vkCmdPushConstants(context.command_buffer, vk_light_cull_pipeline_layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(light_cull_constants), &light_cull_constants);
+		vkCmdDispatch(context.command_buffer, (kClusterTilesX + kLightCullGroupSize - 1) / kLightCullGroupSize, kClusterTilesY, kClusterSlices);
+	}
+
+	VkCommandBuffer BeginCommandBuffer(VkCommandPool pool, VkCommandBuffer command_buffer) {
+		vkResetCommandPool(vk_logical_device, pool, 0);
+		VkCommandBufferBeginInfo cb_begin_info = {};
+		cb_begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		cb_begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+		if (vkBeginCommandBuffer(command_buffer, &cb_begin_info) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to begin recording command buffer!");
+		}
+		return command_buffer;
+	}
+
+	// the camera and push constants of the frame in flight the graph records
+	void UpdateFrameConstants() {
+		// camera orbiting the scene, so every frame differs
+		const float angle = static_cast<float>(glfwGetTime()) * 0.2f;
+		const glm::vec3 camera_position(22.0f * std::sin(angle), 14.0f, 22.0f * std::cos(angle));
+		glm::mat4 projection = glm::perspective(glm::radians(45.0f),
+			vk_swapchain_image_extent.width / (float)vk_swapchain_image_extent.height, kNearPlane, kFarPlane);
+		projection[1][1] *= -1.0f;	// Vulkan clip space has y pointing down
+		const glm::mat4 view_projection = projection * glm::lookAt(camera_position, glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+		const glm::mat4 inverse_view_projection = glm::inverse(view_projection);
+		const glm::vec4 depth_range(kNearPlane, kFarPlane, 0.0f, 0.0f);
+		const glm::uvec4 bindless_slots(cluster_lights_slots[vk_current_frame], 0, 0, 0);
+		gbuffer_constants = { view_projection, glm::ivec4(kSceneGrid, kSceneSpacing, 0, 0), glm::ivec4(-1, 0, 0, 0) };
+		lighting_constants = { inverse_view_projection, glm::vec4(camera_position, 1.0f), depth_range, bindless_slots };
+		light_cull_constants = { inverse_view_projection, depth_range, bindless_slots };
+	}
+
+	// records the graph's async compute passes into the frame's compute command
+	// buffer and submits them, signaling the compute timeline at the returned
+	// value. The frame's fence must have signaled.
+	uint64_t SubmitAsyncCompute(FrameCommands& frame) {
+		const auto record_start = std::chrono::steady_clock::now();
+		render_graph->ExecuteAsync(BeginCommandBuffer(frame.compute_pool, frame.compute));
+		if (vkEndCommandBuffer(frame.compute) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to recode commad buffer!");
+		}
+		record_time += std::chrono::steady_clock::now() - record_start;
+
+		const uint64_t compute_value = submitted_computes + 1;
+		VkTimelineSemaphoreSubmitInfo compute_timeline_info = {};
+		compute_timeline_info.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+		compute_timeline_info.signalSemaphoreValueCount = 1;
+		compute_timeline_info.pSignalSemaphoreValues = &compute_value;
+		const VkPipelineStageFlags compute_wait_stage = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+		VkSubmitInfo compute_submit_info = {};
+		compute_submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+		compute_submit_info.pNext = &compute_timeline_info;
+		// only when the async passes reuse what the previous frame's graphics
+		// work may still read; per-frame buffers are guarded by the frame fence
+		if (render_graph->AsyncWaitsForPreviousFrame()) {
+			compute_timeline_info.waitSemaphoreValueCount = 1;
+			compute_timeline_info.pWaitSemaphoreValues = &submitted_frames;
+			compute_submit_info.waitSemaphoreCount = 1;
+			compute_submit_info.pWaitSemaphores = &vk_graphics_timeline;
+			compute_submit_info.pWaitDstStageMask = &compute_wait_stage;
+		}
+		compute_submit_info.commandBufferCount = 1;
+		compute_submit_info.pCommandBuffers = &frame.compute;
+		compute_submit_info.signalSemaphoreCount = 1;
+		compute_submit_info.pSignalSemaphores = &vk_compute_timeline;
+		if (vkQueueSubmit(vk_compute_queue, 1, &compute_submit_info, VK_NULL_HANDLE) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to submit compute command buffer!");
+		}
+		submitted_computes = compute_value;
+		return compute_value;
+	}
+
+	// re-records the frame by executing the render graph into the primary; the
+	// passes pick up the frame from the member set here and the constants
+	// from UpdateFrameConstants(). The frame's fence must have signaled.
+	// Returns what the submission has to wait for on the upload queue.
+	UploadQueue::Wait RecordFrame(FrameCommands& frame, uint32_t image_index) {
+		const auto record_start = std::chrono::steady_clock::now();
+		recording_frame = &frame;
+
+		BeginCommandBuffer(frame.pool, frame.primary);
+		// uploads completed since the last frame are usable from this one on
+		const UploadQueue::Wait upload_wait = upload_queue->RecordAcquires(frame.primary);
+		if (draw_list[0].texture < 0 && upload_queue->IsReady(floor_texture_ticket)) {
+			draw_list[0].texture = static_cast<int32_t>(floor_texture_slot);
+		}
+		render_graph->SetImportedImage(swapchain_image, vk_swapchain_images[image_index], vk_swapchain_image_views[image_index]);
+		render_graph->Execute(frame.primary);
+		if (vkEndCommandBuffer(frame.primary) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to recode commad buffer!");
+		}
+		recording_frame = nullptr;
+
+		record_time += std::chrono::steady_clock::now() - record_start;
+		++recorded_frames;
+		return upload_wait;
+	}
+
+	VkSemaphore CreateTimelineSemaphore() {
+		VkSemaphoreTypeCreateInfo type_create_info = {};
+		type_create_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+		type_create_info.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+		type_create_info.initialValue = 0;
+		VkSemaphoreCreateInfo semaphore_create_info = {};
+		semaphore_create_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+		semaphore_create_info.pNext = &type_create_info;
+		VkSemaphore semaphore;
+		if (vkCreateSemaphore(vk_logical_device, &semaphore_create_info, nullptr, &semaphore) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to create timeline semaphore!");
+		}
+		return semaphore;
+	}
+
 	void CreateSyncObjects() {
-		vk_image_available_semaphores.resize(kMaxFramesInFlight);
-		vk_reder_finished_semaphores.resize(kMaxFramesInFlight);
-		vk_fences.resize(kMaxFramesInFlight);
+		// the value of both is the number of the last submission to the queue:
+		// frames on the graphics queue, async compute work on the compute queue
+		vk_graphics_timeline = CreateTimelineSemaphore();
+		vk_compute_timeline = CreateTimelineSemaphore();
+		vk_image_available_semaphores.resize(max_frames_in_flight);
+		vk_fences.resize(max_frames_in_flight);
+		CreateImageSyncObjects();
 
 		VkSemaphoreCreateInfo semaphore_create_info = {};
 		semaphore_create_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
@@ -721,39 +1454,115 @@ private:
 		fence_create_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
 		fence_create_info.flags = VK_FENCE_CREATE_SIGNALED_BIT;
 
-		for (size_t i = 0; i < kMaxFramesInFlight; ++i) {
+		for (size_t i = 0; i < max_frames_in_flight; ++i) {
 			if (vkCreateSemaphore(vk_logical_device, &semaphore_create_info, nullptr, &vk_image_available_semaphores[i]) != VK_SUCCESS ||
-				vkCreateSemaphore(vk_logical_device, &semaphore_create_info, nullptr, &vk_reder_finished_semaphores[i]) != VK_SUCCESS ||
 				vkCreateFence(vk_logical_device, &fence_create_info, nullptr, &vk_fences[i]) != VK_SUCCESS) {
 				throw std::runtime_error("Failed to create synchronization objects for a frame!");
 			}
 		}
 	}
 
+	// per swapchain image: the present of an image waits on its render
+	// finished semaphore, and only a frame that acquired the same image again,
+	// after the presentation engine let go of it, signals that semaphore next
+	void CreateImageSyncObjects() {
+		VkSemaphoreCreateInfo semaphore_create_info = {};
+		semaphore_create_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+		vk_reder_finished_semaphores.resize(vk_swapchain_images.size());
+		for (auto& semaphore : vk_reder_finished_semaphores) {
+			if (vkCreateSemaphore(vk_logical_device, &semaphore_create_info, nullptr, &semaphore) != VK_SUCCESS) {
+				throw std::runtime_error("Failed to create synchronization objects for a swapchain image!");
+			}
+		}
+		vk_images_in_flight.assign(vk_swapchain_images.size(), VK_NULL_HANDLE);
+	}
+
 	void DrawFrame() {
 		vkWaitForFences(vk_logical_device, 1, &vk_fences[vk_current_frame], VK_TRUE, std::numeric_limits<uint64_t>::max());
-		vkResetFences(vk_logical_device, 1, &vk_fences[vk_current_frame]);
+		// the frame's sets are no longer in use, nor are the bindless slots
+		// removed up to the last completed frame
+		frame_descriptors->BeginFrame(static_cast<uint32_t>(vk_current_frame));
+		uint64_t completed_frames = 0;
+		vkGetSemaphoreCounterValue(vk_logical_device, vk_graphics_timeline, &completed_frames);
+		bindless->Collect(completed_frames);
+
+		// light culling only needs the camera: submit it before waiting for a
+		// swapchain image, so it runs while the previous frame still renders
+		// and is normally done when the graphics queue reaches its results
+		FrameCommands& frame = vk_frame_commands[vk_current_frame];
+		render_graph->SetFrame(static_cast<uint32_t>(vk_current_frame));
+		if (!frame_started) {
+			UpdateFrameConstants();
+			async_compute_value = render_graph->HasAsyncWork() ? SubmitAsyncCompute(frame) : 0;
+			frame_started = true;
+		}
 
 		uint32_t image_index;
-		vkAcquireNextImageKHR(vk_logical_device, vk_swapchain, std::numeric_limits<uint64_t>::max(), 
+		VkResult result = vkAcquireNextImageKHR(vk_logical_device, vk_swapchain, std::numeric_limits<uint64_t>::max(), 
 				vk_image_available_semaphores[vk_current_frame], VK_NULL_HANDLE, &image_index);
+		if (result == VK_ERROR_OUT_OF_DATE_KHR) {
+			// no graphics work was submitted, the frame's fence stays signaled
+			// for the next try; the graph's buffers are new, so it culls again
+			RecreateSwapChain();
+			frame_started = false;
+			return;
+		} else if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR) {
+			throw std::runtime_error("Failed to acquire swap chain image!");
+		}
+
+		// the image can come back while an older frame slot still renders to it
+		// (more images than frames in flight, or out-of-order acquires)
+		if (vk_images_in_flight[image_index] != VK_NULL_HANDLE) {
+			vkWaitForFences(vk_logical_device, 1, &vk_images_in_flight[image_index], VK_TRUE, std::numeric_limits<uint64_t>::max());
+		}
+		vk_images_in_flight[image_index] = vk_fences[vk_current_frame];
+
+		// start the uploads that fit the staging ring, never waiting for space
+		upload_queue->Pump();
+		const UploadQueue::Wait upload_wait = RecordFrame(frame, image_index);
+		const uint64_t frame_value = submitted_frames + 1;
+
 		VkSubmitInfo submit_info = {};
 		submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
 		
-		VkSemaphore wait_semaphores[] = { vk_image_available_semaphores[vk_current_frame] };
-		VkSemaphore signal_semaphores[] = { vk_reder_finished_semaphores[vk_current_frame] };
-		VkPipelineStageFlags wait_stages[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
-		submit_info.waitSemaphoreCount = 1;
-		submit_info.pWaitSemaphores = wait_semaphores;
-		submit_info.pWaitDstStageMask = wait_stages;
+		std::vector<VkSemaphore> wait_semaphores = { vk_image_available_semaphores[vk_current_frame] };
+		std::vector<VkPipelineStageFlags> wait_stages = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
+		// binary semaphores ignore their value
+		std::vector<uint64_t> wait_values = { 0 };
+		if (upload_wait) {
+			wait_semaphores.push_back(upload_queue->Semaphore());
+			wait_stages.push_back(upload_wait.stages);
+			wait_values.push_back(upload_wait.value);
+		}
+		if (render_graph->HasAsyncWork()) {
+			wait_semaphores.push_back(vk_compute_timeline);
+			wait_stages.push_back(render_graph->AsyncWaitStages());
+			wait_values.push_back(async_compute_value);
+		}
+		VkSemaphore signal_semaphores[] = { vk_reder_finished_semaphores[image_index], vk_graphics_timeline };
+		const uint64_t signal_values[] = { 0, frame_value };
+		VkTimelineSemaphoreSubmitInfo timeline_submit_info = {};
+		timeline_submit_info.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+		timeline_submit_info.waitSemaphoreValueCount = static_cast<uint32_t>(wait_values.size());
+		timeline_submit_info.pWaitSemaphoreValues = wait_values.data();
+		timeline_submit_info.signalSemaphoreValueCount = 2;
+		timeline_submit_info.pSignalSemaphoreValues = signal_values;
+		submit_info.pNext = &timeline_submit_info;
+		submit_info.waitSemaphoreCount = static_cast<uint32_t>(wait_semaphores.size());
+		submit_info.pWaitSemaphores = wait_semaphores.data();
+		submit_info.pWaitDstStageMask = wait_stages.data();
 		submit_info.commandBufferCount = 1;
-		submit_info.pCommandBuffers = &vk_command_buffers[image_index];
-		submit_info.signalSemaphoreCount = 1;
+		submit_info.pCommandBuffers = &frame.primary;
+		submit_info.signalSemaphoreCount = 2;
 		submit_info.pSignalSemaphores = signal_semaphores;
 
+		// reset only once a submit is certain to signal it again
+		vkResetFences(vk_logical_device, 1, &vk_fences[vk_current_frame]);
 		if (vkQueueSubmit(vk_graphics_queue, 1, &submit_info, vk_fences[vk_current_frame]) != VK_SUCCESS) {
 			throw std::runtime_error("Failed to submit draw command buffer!");
 		}
+		submitted_frames = frame_value;
+		frame_started = false;
 
 		VkPresentInfoKHR present_info = {};
 		present_info.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
@@ -763,13 +1572,20 @@ private:
 		present_info.swapchainCount = 1;
 		present_info.pSwapchains = swapchains;
 		present_info.pImageIndices = &image_index;
-		vkQueuePresentKHR(vk_present_queue, &present_info);
+		result = vkQueuePresentKHR(vk_present_queue, &present_info);
+		if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR || framebuffer_resized) {
+			RecreateSwapChain();
+		} else if (result != VK_SUCCESS) {
+			throw std::runtime_error("Failed to present swap chain image!");
+		}
 
-		vk_current_frame = (vk_current_frame + 1) % kMaxFramesInFlight;
+		vk_current_frame = (vk_current_frame + 1) % max_frames_in_flight;
 	}
 private:
 	int width;
 	int height;
+	size_t max_frames_in_flight;
+	bool framebuffer_resized{ false };
 	GLFWwindow* window;
 	VkInstance vk_instance;
 	VkDebugUtilsMessengerEXT vk_debug_messenger;
@@ -778,33 +1594,81 @@ private:
 	QueueFamilyIndex vk_queue_family_index;
 	SwapChainSupportDetails vk_swapchain_support_details;
 	VkDevice vk_logical_device;
+	bool memory_budget_supported{ false };
+	std::unique_ptr<MemoryAllocator> memory_allocator;
 
 	VkQueue vk_graphics_queue;
 	VkQueue vk_present_queue;
+	VkQueue vk_transfer_queue;	// may be vk_graphics_queue
+	VkQueue vk_compute_queue{ VK_NULL_HANDLE };	// async compute, may be vk_transfer_queue
+	std::unique_ptr<UploadQueue> upload_queue;
 
-	VkSwapchainKHR vk_swapchain;
+	VkSwapchainKHR vk_swapchain{ VK_NULL_HANDLE };
 	std::vector<VkImage> vk_swapchain_images;
-	VkFormat vk_swapchain_image_format;
+	VkFormat vk_swapchain_image_format{ VK_FORMAT_UNDEFINED };
 	VkExtent2D vk_swapchain_image_extent;
 	std::vector<VkImageView> vk_swapchain_image_views;
 
-	VkRenderPass vk_render_pass;
-	VkPipelineLayout vk_pipeline_layout;
-	VkPipeline vk_pipeline;
-
-	std::vector<VkFramebuffer> vk_framebuffers;
-	VkCommandPool vk_command_pool;
-	std::vector<VkCommandBuffer> vk_command_buffers;
+	std::unique_ptr<RenderGraph> render_graph;
+	RenderGraph::Resource swapchain_image;
+	std::array<RenderGraph::Resource, kGBufferImageCount> gbuffer_images;
+	RenderGraph::Resource cluster_lights;
+	RenderGraph::Pass* light_cull_pass{ nullptr };	// owned by render_graph
+	RenderGraph::Pass* gbuffer_pass{ nullptr };
+	RenderGraph::Pass* lighting_pass{ nullptr };
+	std::unique_ptr<BindlessTable> bindless;
+	std::unique_ptr<DescriptorArena> frame_descriptors;	// per frame in flight
+	VkDescriptorSetLayout vk_lighting_set_layout;
+	std::vector<uint32_t> cluster_lights_slots;	// per frame in flight
+	SceneTexture floor_texture;
+	VkSampler vk_floor_sampler;
+	uint64_t floor_texture_ticket{ 0 };
+	uint32_t floor_texture_slot{ kNoBindlessSlot };
+	VkPipelineLayout vk_gbuffer_pipeline_layout;
+	VkPipelineLayout vk_lighting_pipeline_layout;
+	VkPipelineLayout vk_light_cull_pipeline_layout;
+	VkPipeline vk_gbuffer_pipeline;
+	VkPipeline vk_lighting_pipeline;
+	VkPipeline vk_light_cull_pipeline;	// all owned by pipeline_cache
+	std::unique_ptr<PipelineCache> pipeline_cache;
+
+	std::vector<FrameCommands> vk_frame_commands;	// per frame in flight
+	FrameCommands* recording_frame{ nullptr };	// during RecordFrame()
+	GBufferPushConstants gbuffer_constants;
+	LightingPushConstants lighting_constants;
+	LightCullPushConstants light_cull_constants;
+	std::vector<DrawItem> draw_list;
+	WorkerPool worker_pool;
+	std::chrono::steady_clock::duration record_time{ 0 };
+	uint64_t recorded_frames{ 0 };
 
 	std::vector<VkSemaphore> vk_image_available_semaphores;
-	std::vector<VkSemaphore> vk_reder_finished_semaphores;
+	std::vector<VkSemaphore> vk_reder_finished_semaphores;	// per swapchain image
 	std::vector<VkFence> vk_fences;
+	std::vector<VkFence> vk_images_in_flight;	// per swapchain image, fence of the frame last rendering to it
+	VkSemaphore vk_graphics_timeline{ VK_NULL_HANDLE };
+	VkSemaphore vk_compute_timeline{ VK_NULL_HANDLE };
+	uint64_t submitted_frames{ 0 };
+	uint64_t submitted_computes{ 0 };
+	// the current frame's constants are set and its async compute submitted,
+	// signaling async_compute_value
+	bool frame_started{ false };
+	uint64_t async_compute_value{ 0 };
 
 	size_t vk_current_frame{ 0 };
 };
 
-int main() {
-	VkDRender render(800, 600);
+int main(int argc, char** argv) {
+	size_t frames_in_flight = kDefaultFramesInFlight;
+	size_t record_threads = kDefaultRecordThreads;
+	for (int i = 1; i + 1 < argc; ++i) {
+		if (strcmp(argv[i], "--frames-in-flight") == 0) {
+			frames_in_flight = static_cast<size_t>(std::max(atoi(argv[++i]), 1));
+		} else if (strcmp(argv[i], "--record-threads") == 0) {
+			record_threads = static_cast<size_t>(std::max(atoi(argv[++i]), 0));
+		}
+	}
+	VkDRender render(800, 600, frames_in_flight, record_threads);
 	try {
 		render.Run();
 	} catch (const std::exception& e) {
@@ -0,0 +1,439 @@
+#include "memory_allocator.h"
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+
+struct MemoryBlock {
+	MemoryBlock(VkDeviceMemory memory, VkDeviceSize size, void* mapped, bool linear)
+		: memory(memory), size(size), mapped(mapped), linear(linear), tlsf(size) {}
+
+	VkDeviceMemory memory;
+	VkDeviceSize size;
+	void* mapped;
+	bool linear;
+	Tlsf tlsf;
+};
+
+namespace {
+// the first block of a pool is this fraction of the preferred size, every new
+// block doubles it: small scenes do not reserve hundreds of megabytes
+const uint32_t kBlockSizeSteps = 3;
+
+VkDeviceSize AlignUp(VkDeviceSize value, VkDeviceSize alignment) {
+	return (value + alignment - 1) / alignment * alignment;
+}
+
+uint32_t CountBits(uint32_t x) {
+	uint32_t count = 0;
+	for (; x; x &= x - 1) ++count;
+	return count;
+}
+
+double MiB(VkDeviceSize bytes) {
+	return bytes / (1024.0 * 1024.0);
+}
+} // namespace
+
+MemoryAllocator::MemoryAllocator(VkPhysicalDevice physical_device, VkDevice device, bool memory_budget,
+	VkDeviceSize preferred_block_size)
+	: vk_physical_device(physical_device), vk_device(device), memory_budget(memory_budget),
+	preferred_block_size(preferred_block_size) {
+	vkGetPhysicalDeviceMemoryProperties(vk_physical_device, &vk_memory_properties);
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(vk_physical_device, &properties);
+	non_coherent_atom_size = properties.limits.nonCoherentAtomSize;
+	max_allocation_count = properties.limits.maxMemoryAllocationCount;
+
+	pools.resize(vk_memory_properties.memoryTypeCount * 2);
+	heaps.resize(vk_memory_properties.memoryHeapCount);
+	RefreshBudgets();
+}
+
+MemoryAllocator::~MemoryAllocator() {
+	uint32_t leaked = dedicated_allocations;
+	for (uint32_t type = 0; type < vk_memory_properties.memoryTypeCount; ++type) {
+		for (bool linear : { false, true }) {
+			for (auto& block : GetPool(type, linear).blocks) {
+				leaked += block->tlsf.AllocationCount();
+				FreeDeviceMemory(type, block->size, block->memory);
+			}
+		}
+	}
+	if (leaked) {
+		std::cerr << "MemoryAllocator: " << leaked << " allocations were not freed" << std::endl;
+	}
+}
+
+std::vector<uint32_t> MemoryAllocator::MemoryTypeCandidates(uint32_t type_bits, MemoryUsage usage) const {
+	VkMemoryPropertyFlags required = 0, preferred = 0, avoided = 0;
+	switch (usage) {
+	case MemoryUsage::GpuOnly:
+		preferred = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+		// leave small host visible device local heaps (BAR) to uploads
+		avoided = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+		break;
+	case MemoryUsage::CpuToGpu:
+		required = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+		preferred = VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+		avoided = VK_MEMORY_PROPERTY_HOST_CACHED_BIT;
+		break;
+	case MemoryUsage::GpuToCpu:
+		required = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+		preferred = VK_MEMORY_PROPERTY_HOST_CACHED_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+		break;
+	case MemoryUsage::Transient:
+		preferred = VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT | VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+		avoided = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+		break;
+	}
+	if (usage != MemoryUsage::Transient) {
+		avoided |= VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT;
+	}
+
+	std::vector<std::pair<uint32_t, uint32_t>> scored;	// cost, type
+	for (uint32_t type = 0; type < vk_memory_properties.memoryTypeCount; ++type) {
+		const VkMemoryPropertyFlags flags = vk_memory_properties.memoryTypes[type].propertyFlags;
+		if (!(type_bits & (1u << type)) || (flags & required) != required) {
+			continue;
+		}
+		scored.emplace_back(CountBits(preferred & ~flags) + CountBits(avoided & flags), type);
+	}
+	std::stable_sort(scored.begin(), scored.end(),
+		[](const auto& a, const auto& b) { return a.first < b.first; });
+	std::vector<uint32_t> candidates;
+	for (const auto& entry : scored) {
+		candidates.push_back(entry.second);
+	}
+	return candidates;
+}
+
+bool MemoryAllocator::IsNonCoherent(uint32_t memory_type) const {
+	const VkMemoryPropertyFlags flags = vk_memory_properties.memoryTypes[memory_type].propertyFlags;
+	return (flags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) && !(flags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+}
+
+VkDeviceSize MemoryAllocator::AlignmentFor(uint32_t memory_type, VkDeviceSize alignment) const {
+	// flushes work on whole atoms, which must not be shared between allocations
+	return IsNonCoherent(memory_type) ? std::max(alignment, non_coherent_atom_size) : alignment;
+}
+
+void MemoryAllocator::RefreshBudgets() {
+	if (memory_budget) {
+		VkPhysicalDeviceMemoryBudgetPropertiesEXT budget_properties = {};
+		budget_properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+		VkPhysicalDeviceMemoryProperties2 memory_properties = {};
+		memory_properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2;
+		memory_properties.pNext = &budget_properties;
+		vkGetPhysicalDeviceMemoryProperties2(vk_physical_device, &memory_properties);
+		for (uint32_t heap = 0; heap < heaps.size(); ++heap) {
+			heaps[heap].budget = budget_properties.heapBudget[heap];
+			heaps[heap].usage = budget_properties.heapUsage[heap];
+		}
+	} else {
+		// without the extension: 80% of the heap, and only what we allocated ourselves
+		for (uint32_t heap = 0; heap < heaps.size(); ++heap) {
+			heaps[heap].budget = vk_memory_properties.memoryHeaps[heap].size / 10 * 8;
+			heaps[heap].usage = heaps[heap].device_bytes;
+		}
+	}
+}
+
+bool MemoryAllocator::OverBudget(uint32_t heap, VkDeviceSize size) const {
+	return heaps[heap].usage + size > heaps[heap].budget;
+}
+
+bool MemoryAllocator::AllocateDeviceMemory(uint32_t memory_type, VkDeviceSize size, const void* next, bool within_budget,
+	VkDeviceMemory& memory, void*& mapped) {
+	const uint32_t heap = vk_memory_properties.memoryTypes[memory_type].heapIndex;
+	if (device_memory_allocations >= max_allocation_count || (within_budget && OverBudget(heap, size))) {
+		return false;
+	}
+	VkMemoryAllocateInfo memory_alloc_info = {};
+	{
+		memory_alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+		memory_alloc_info.pNext = next;
+		memory_alloc_info.allocationSize = size;
+		memory_alloc_info.memoryTypeIndex = memory_type;
+	}
+	if (vkAllocateMemory(vk_device, &memory_alloc_info, nullptr, &memory) != VK_SUCCESS) {
+		return false;
+	}
+	mapped = nullptr;
+	if (vk_memory_properties.memoryTypes[memory_type].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+		if (vkMapMemory(vk_device, memory, 0, VK_WHOLE_SIZE, 0, &mapped) != VK_SUCCESS) {
+			vkFreeMemory(vk_device, memory, nullptr);
+			return false;
+		}
+	}
+	++device_memory_allocations;
+	heaps[heap].device_bytes += size;
+	heaps[heap].usage += size;
+	return true;
+}
+
+void MemoryAllocator::FreeDeviceMemory(uint32_t memory_type, VkDeviceSize size, VkDeviceMemory memory) {
+	const uint32_t heap = vk_memory_properties.memoryTypes[memory_type].heapIndex;
+	vkFreeMemory(vk_device, memory, nullptr);
+	--device_memory_allocations;
+	heaps[heap].device_bytes -= size;
+	heaps[heap].usage -= std::min(heaps[heap].usage, size);
+}
+
+Allocation MemoryAllocator::Suballocate(MemoryBlock& block, VkDeviceSize size, VkDeviceSize alignment) {
+	Tlsf::Allocation range = block.tlsf.Allocate(size, alignment);
+	if (!range) {
+		return Allocation();
+	}
+	Allocation allocation;
+	allocation.memory = block.memory;
+	allocation.offset = range.offset;
+	allocation.size = size;
+	allocation.mapped = block.mapped ? static_cast<char*>(block.mapped) + range.offset : nullptr;
+	allocation.block = &block;
+	allocation.node = range.node;
+	return allocation;
+}
+
+Allocation MemoryAllocator::AllocateFromPool(uint32_t memory_type, bool linear, VkDeviceSize size, VkDeviceSize alignment,
+	bool within_budget) {
+	alignment = AlignmentFor(memory_type, alignment);
+	if (IsNonCoherent(memory_type)) {
+		size = AlignUp(size, non_coherent_atom_size);
+	}
+	Pool& pool = GetPool(memory_type, linear);
+	for (auto& block : pool.blocks) {
+		Allocation allocation = Suballocate(*block, size, alignment);
+		if (allocation) {
+			allocation.memory_type = memory_type;
+			return allocation;
+		}
+	}
+
+	// a new block, smaller ones when the heap is tight
+	const uint32_t heap = vk_memory_properties.memoryTypes[memory_type].heapIndex;
+	const VkDeviceSize largest = std::min(preferred_block_size, vk_memory_properties.memoryHeaps[heap].size / 8);
+	const uint32_t step = static_cast<uint32_t>(std::min<size_t>(pool.blocks.size(), kBlockSizeSteps));
+	VkDeviceSize block_size = std::max(largest >> (kBlockSizeSteps - step), size + alignment);
+	RefreshBudgets();
+	for (; block_size >= size + alignment; block_size /= 2) {
+		VkDeviceMemory memory;
+		void* mapped;
+		if (!AllocateDeviceMemory(memory_type, block_size, nullptr, within_budget, memory, mapped)) {
+			continue;
+		}
+		pool.blocks.push_back(std::make_unique<MemoryBlock>(memory, block_size, mapped, linear));
+		Allocation allocation = Suballocate(*pool.blocks.back(), size, alignment);
+		allocation.memory_type = memory_type;
+		return allocation;
+	}
+	return Allocation();
+}
+
+Allocation MemoryAllocator::AllocateDedicated(uint32_t memory_type, VkDeviceSize size,
+	const VkMemoryDedicatedAllocateInfo* dedicated_info, bool within_budget) {
+	RefreshBudgets();
+	Allocation allocation;
+	if (!AllocateDeviceMemory(memory_type, size, dedicated_info, within_budget, allocation.memory, allocation.mapped)) {
+		return Allocation();
+	}
+	allocation.size = size;
+	allocation.memory_type = memory_type;
+	++dedicated_allocations;
+	dedicated_bytes += size;
+	return allocation;
+}
+
+Allocation MemoryAllocator::AllocateInternal(const VkMemoryRequirements& requirements, MemoryUsage usage, bool linear,
+	bool dedicated, const VkMemoryDedicatedAllocateInfo* dedicated_info) {
+	std::vector<uint32_t> candidates = MemoryTypeCandidates(requirements.memoryTypeBits, usage);
+	if (candidates.empty()) {
+		throw std::runtime_error("Failed to find a suitable memory type!");
+	}
+	// lazily allocated memory is committed per allocation, sub-allocating it
+	// would commit the whole block
+	dedicated = dedicated || usage == MemoryUsage::Transient || requirements.size > preferred_block_size / 2;
+
+	std::lock_guard<std::mutex> lock(mutex);
+	// first every type within its heap's budget, then anything that fits
+	for (bool within_budget : { true, false }) {
+		for (uint32_t memory_type : candidates) {
+			Allocation allocation = dedicated
+				? AllocateDedicated(memory_type, requirements.size, dedicated_info, within_budget)
+				: AllocateFromPool(memory_type, linear, requirements.size, requirements.alignment, within_budget);
+			if (allocation) {
+				return allocation;
+			}
+		}
+	}
+	throw std::runtime_error("Failed to allocate device memory!");
+}
+
+Allocation MemoryAllocator::Allocate(const VkMemoryRequirements& requirements, MemoryUsage usage, bool linear, bool dedicated) {
+	return AllocateInternal(requirements, usage, linear, dedicated, nullptr);
+}
+
+Allocation MemoryAllocator::AllocateForBuffer(VkBuffer buffer, MemoryUsage usage) {
+	VkBufferMemoryRequirementsInfo2 requirements_info = {};
+	requirements_info.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_REQUIREMENTS_INFO_2;
+	requirements_info.buffer = buffer;
+	VkMemoryDedicatedRequirements dedicated_requirements = {};
+	dedicated_requirements.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_REQUIREMENTS;
+	VkMemoryRequirements2 requirements = {};
+	requirements.sType = VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2;
+	requirements.pNext = &dedicated_requirements;
+	vkGetBufferMemoryRequirements2(vk_device, &requirements_info, &requirements);
+
+	VkMemoryDedicatedAllocateInfo dedicated_info = {};
+	dedicated_info.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_ALLOCATE_INFO;
+	dedicated_info.buffer = buffer;
+	const bool dedicated = dedicated_requirements.prefersDedicatedAllocation || dedicated_requirements.requiresDedicatedAllocation;
+	Allocation allocation = AllocateInternal(requirements.memoryRequirements, usage, true, dedicated, &dedicated_info);
+	if (vkBindBufferMemory(vk_device, buffer, allocation.memory, allocation.offset) != VK_SUCCESS) {
+		Free(allocation);
+		throw std::runtime_error("Failed to bind buffer memory!");
+	}
+	return allocation;
+}
+
+Allocation MemoryAllocator::AllocateForImage(VkImage image, VkImageTiling tiling, MemoryUsage usage) {
+	VkImageMemoryRequirementsInfo2 requirements_info = {};
+	requirements_info.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_REQUIREMENTS_INFO_2;
+	requirements_info.image = image;
+	VkMemoryDedicatedRequirements dedicated_requirements = {};
+	dedicated_requirements.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_REQUIREMENTS;
+	VkMemoryRequirements2 requirements = {};
+	requirements.sType = VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2;
+	requirements.pNext = &dedicated_requirements;
+	vkGetImageMemoryRequirements2(vk_device, &requirements_info, &requirements);
+
+	VkMemoryDedicatedAllocateInfo dedicated_info = {};
+	dedicated_info.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_ALLOCATE_INFO;
+	dedicated_info.image = image;
+	const bool dedicated = dedicated_requirements.prefersDedicatedAllocation || dedicated_requirements.requiresDedicatedAllocation;
+	Allocation allocation = AllocateInternal(requirements.memoryRequirements, usage, tiling == VK_IMAGE_TILING_LINEAR,
+		dedicated, &dedicated_info);
+	if (vkBindImageMemory(vk_device, image, allocation.memory, allocation.offset) != VK_SUCCESS) {
+		Free(allocation);
+		throw std::runtime_error("Failed to bind image memory!");
+	}
+	return allocation;
+}
+
+void MemoryAllocator::FreeLocked(Allocation& allocation) {
+	if (!allocation) {
+		return;
+	}
+	if (!allocation.block) {
+		FreeDeviceMemory(allocation.memory_type, allocation.size, allocation.memory);
+		--dedicated_allocations;
+		dedicated_bytes -= allocation.size;
+	} else {
+		MemoryBlock* block = allocation.block;
+		block->tlsf.Free(allocation.node);
+		// keep the last block of a pool around, allocation churn would
+		// otherwise free and allocate it over and over
+		Pool& pool = GetPool(allocation.memory_type, block->linear);
+		if (block->tlsf.Empty() && pool.blocks.size() > 1) {
+			FreeDeviceMemory(allocation.memory_type, block->size, block->memory);
+			pool.blocks.erase(std::find_if(pool.blocks.begin(), pool.blocks.end(),
+				[block](const std::unique_ptr<MemoryBlock>& b) { return b.get() == block; }));
+		}
+	}
+	allocation = Allocation();
+}
+
+void MemoryAllocator::Free(Allocation& allocation) {
+	std::lock_guard<std::mutex> lock(mutex);
+	FreeLocked(allocation);
+}
+
+VkMappedMemoryRange MemoryAllocator::MappedRange(const Allocation& allocation, VkDeviceSize offset, VkDeviceSize size) const {
+	const VkDeviceSize memory_size = allocation.block ? allocation.block->size : allocation.size;
+	VkDeviceSize begin = allocation.offset + offset;
+	VkDeviceSize end = size == VK_WHOLE_SIZE ? allocation.offset + allocation.size : begin + size;
+	begin = begin / non_coherent_atom_size * non_coherent_atom_size;
+	end = std::min(AlignUp(end, non_coherent_atom_size), memory_size);
+
+	VkMappedMemoryRange range = {};
+	range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+	range.memory = allocation.memory;
+	range.offset = begin;
+	range.size = end - begin;
+	return range;
+}
+
+void MemoryAllocator::Flush(const Allocation& allocation, VkDeviceSize offset, VkDeviceSize size) {
+	if (!IsNonCoherent(allocation.memory_type)) {
+		return;
+	}
+	VkMappedMemoryRange range = MappedRange(allocation, offset, size);
+	vkFlushMappedMemoryRanges(vk_device, 1, &range);
+}
+
+void MemoryAllocator::Invalidate(const Allocation& allocation, VkDeviceSize offset, VkDeviceSize size) {
+	if (!IsNonCoherent(allocation.memory_type)) {
+		return;
+	}
+	VkMappedMemoryRange range = MappedRange(allocation, offset, size);
+	vkInvalidateMappedMemoryRanges(vk_device, 1, &range);
+}
+
+std::vector<MemoryAllocator::HeapBudget> MemoryAllocator::QueryBudgets() {
+	std::lock_guard<std::mutex> lock(mutex);
+	RefreshBudgets();
+	return heaps;
+}
+
+MemoryAllocator::Stats MemoryAllocator::GetStats() const {
+	std::lock_guard<std::mutex> lock(mutex);
+	Stats stats;
+	stats.device_memory_allocations = device_memory_allocations;
+	stats.dedicated_allocations = dedicated_allocations;
+	stats.dedicated_bytes = dedicated_bytes;
+	stats.allocations = dedicated_allocations;
+	for (const Pool& pool : pools) {
+		for (const auto& block : pool.blocks) {
+			++stats.blocks;
+			stats.block_bytes += block->size;
+			stats.used_bytes += block->tlsf.Used();
+			stats.allocations += block->tlsf.AllocationCount();
+		}
+	}
+	return stats;
+}
+
+void MemoryAllocator::DumpStats(std::ostream& out) {
+	std::vector<HeapBudget> budgets = QueryBudgets();
+	Stats totals = GetStats();
+
+	std::lock_guard<std::mutex> lock(mutex);
+	const std::ios::fmtflags flags = out.flags();
+	out << std::fixed << std::setprecision(1);
+	out << "Device memory: " << totals.device_memory_allocations << "/" << max_allocation_count << " allocations, "
+		<< totals.blocks << " blocks (" << MiB(totals.block_bytes) << " MiB, " << MiB(totals.used_bytes) << " MiB used), "
+		<< totals.dedicated_allocations << " dedicated (" << MiB(totals.dedicated_bytes) << " MiB)" << std::endl;
+	for (uint32_t heap = 0; heap < budgets.size(); ++heap) {
+		out << "  heap " << heap << ": " << MiB(budgets[heap].device_bytes) << " MiB allocated, usage "
+			<< MiB(budgets[heap].usage) << " of " << MiB(budgets[heap].budget) << " MiB budget"
+			<< (memory_budget ? "" : " (estimated)") << std::endl;
+	}
+	for (uint32_t type = 0; type < vk_memory_properties.memoryTypeCount; ++type) {
+		for (bool linear : { true, false }) {
+			const Pool& pool = GetPool(type, linear);
+			if (pool.blocks.empty()) {
+				continue;
+			}
+			out << "  type " << type << (linear ? " linear" : " optimal") << " (heap "
+				<< vk_memory_properties.memoryTypes[type].heapIndex << ", flags 0x" << std::hex
+				<< vk_memory_properties.memoryTypes[type].propertyFlags << std::dec << "):" << std::endl;
+			for (const auto& block : pool.blocks) {
+				const Tlsf::Stats stats = block->tlsf.GetStats();
+				out << "    block " << MiB(block->size) << " MiB: " << stats.allocations << " allocations, "
+					<< MiB(stats.used) << " MiB used, " << stats.free_regions << " free regions, largest "
+					<< MiB(stats.largest_free_region) << " MiB" << std::endl;
+			}
+		}
+	}
+	out.flags(flags);
+}
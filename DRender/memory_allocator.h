@@ -0,0 +1,128 @@
+#ifndef MEMORY_ALLOCATOR_H
+#define MEMORY_ALLOCATOR_H
+#include <vulkan/vulkan.h>
+#include "tlsf.h"
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <vector>
+
+enum class MemoryUsage {
+	GpuOnly,	// device local
+	CpuToGpu,	// host visible, coherent preferred: uploads and per-frame data
+	GpuToCpu,	// host visible, cached preferred: readback
+	Transient,	// lazily allocated where available: render-pass-local attachments
+};
+
+struct MemoryBlock;
+
+// A range of device memory handed out by MemoryAllocator. Plain value: copy it
+// around, but free it exactly once.
+struct Allocation {
+	VkDeviceMemory memory{ VK_NULL_HANDLE };
+	VkDeviceSize offset{ 0 };
+	VkDeviceSize size{ 0 };
+	void* mapped{ nullptr };	// host visible memory stays mapped for its lifetime
+	uint32_t memory_type{ 0 };
+
+	explicit operator bool() const { return memory != VK_NULL_HANDLE; }
+
+private:
+	friend class MemoryAllocator;
+	MemoryBlock* block{ nullptr };	// null: dedicated allocation
+	uint32_t node{ Tlsf::kInvalidNode };
+};
+
+// Sub-allocates buffers and images out of a few large vkAllocateMemory blocks
+// instead of one allocation per resource, which would be slow and run into
+// maxMemoryAllocationCount. Every memory type has two pools of blocks, for
+// linear (buffers) and optimal (images) resources, so neighbours never
+// violate bufferImageGranularity; each block is carved up by a Tlsf. Blocks
+// start small and double up to the preferred block size as a pool grows.
+// Large resources, resources the driver prefers dedicated memory for and
+// lazily allocated attachments get their own allocation. Host visible memory
+// is persistently mapped. Heap budgets come from VK_EXT_memory_budget when
+// enabled and steer new blocks away from heaps that are over budget.
+// Thread safe.
+class MemoryAllocator {
+public:
+	struct HeapBudget {
+		VkDeviceSize budget = 0;	// what the process may use, per the driver or estimated
+		VkDeviceSize usage = 0;	// what the process uses, including other allocators
+		VkDeviceSize device_bytes = 0;	// device memory of this allocator, blocks and dedicated
+	};
+
+	struct Stats {
+		uint32_t device_memory_allocations = 0;
+		uint32_t blocks = 0;
+		uint32_t dedicated_allocations = 0;
+		uint32_t allocations = 0;
+		VkDeviceSize block_bytes = 0;
+		VkDeviceSize used_bytes = 0;
+		VkDeviceSize dedicated_bytes = 0;
+	};
+
+	// `memory_budget`: VK_EXT_memory_budget is enabled on `device`
+	MemoryAllocator(VkPhysicalDevice physical_device, VkDevice device, bool memory_budget,
+		VkDeviceSize preferred_block_size = 256ull << 20);
+	MemoryAllocator(const MemoryAllocator&) = delete;
+	MemoryAllocator& operator=(const MemoryAllocator&) = delete;
+	~MemoryAllocator();
+
+	// allocate and bind; throws when no memory type has room
+	Allocation AllocateForBuffer(VkBuffer buffer, MemoryUsage usage);
+	Allocation AllocateForImage(VkImage image, VkImageTiling tiling, MemoryUsage usage);
+	Allocation Allocate(const VkMemoryRequirements& requirements, MemoryUsage usage, bool linear, bool dedicated = false);
+	void Free(Allocation& allocation);
+
+	// no-ops on coherent memory
+	void Flush(const Allocation& allocation, VkDeviceSize offset = 0, VkDeviceSize size = VK_WHOLE_SIZE);
+	void Invalidate(const Allocation& allocation, VkDeviceSize offset = 0, VkDeviceSize size = VK_WHOLE_SIZE);
+
+	std::vector<HeapBudget> QueryBudgets();
+	Stats GetStats() const;
+	void DumpStats(std::ostream& out);
+
+private:
+	struct Pool {
+		std::vector<std::unique_ptr<MemoryBlock>> blocks;
+	};
+
+	// memory types with the required flags, best match first
+	std::vector<uint32_t> MemoryTypeCandidates(uint32_t type_bits, MemoryUsage usage) const;
+	Pool& GetPool(uint32_t memory_type, bool linear) { return pools[memory_type * 2 + (linear ? 1 : 0)]; }
+	bool AllocateDeviceMemory(uint32_t memory_type, VkDeviceSize size, const void* next, bool within_budget,
+		VkDeviceMemory& memory, void*& mapped);
+	void FreeDeviceMemory(uint32_t memory_type, VkDeviceSize size, VkDeviceMemory memory);
+	Allocation AllocateInternal(const VkMemoryRequirements& requirements, MemoryUsage usage, bool linear, bool dedicated,
+		const VkMemoryDedicatedAllocateInfo* dedicated_info);
+	Allocation AllocateFromPool(uint32_t memory_type, bool linear, VkDeviceSize size, VkDeviceSize alignment, bool within_budget);
+	Allocation AllocateDedicated(uint32_t memory_type, VkDeviceSize size, const VkMemoryDedicatedAllocateInfo* dedicated_info,
+		bool within_budget);
+	Allocation Suballocate(MemoryBlock& block, VkDeviceSize size, VkDeviceSize alignment);
+	void FreeLocked(Allocation& allocation);
+	VkDeviceSize AlignmentFor(uint32_t memory_type, VkDeviceSize alignment) const;
+	VkMappedMemoryRange MappedRange(const Allocation& allocation, VkDeviceSize offset, VkDeviceSize size) const;
+	void RefreshBudgets();
+	bool OverBudget(uint32_t heap, VkDeviceSize size) const;
+	bool IsNonCoherent(uint32_t memory_type) const;
+
+	VkPhysicalDevice vk_physical_device;
+	VkDevice vk_device;
+	VkPhysicalDeviceMemoryProperties vk_memory_properties;
+	VkDeviceSize non_coherent_atom_size;
+	uint32_t max_allocation_count;
+	bool memory_budget;
+	VkDeviceSize preferred_block_size;
+
+	mutable std::mutex mutex;
+	std::vector<Pool> pools;	// two per memory type
+	std::vector<HeapBudget> heaps;
+	uint32_t device_memory_allocations = 0;
+	uint32_t dedicated_allocations = 0;
+	VkDeviceSize dedicated_bytes = 0;
+};
+
+#endif // !MEMORY_ALLOCATOR_H
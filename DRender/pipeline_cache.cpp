@@ -0,0 +1,356 @@
+#include "pipeline_cache.h"
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <utility>
+
+namespace {
+const uint32_t kFileMagic = 0x43504b56;	// "VKPC"
+const uint32_t kFileVersion = 1;
+
+// FNV-1a, guards the cache file against corruption
+uint64_t HashBytes(const void* data, size_t size) {
+	const unsigned char* bytes = static_cast<const unsigned char*>(data);
+	uint64_t hash = 14695981039346656037ull;
+	for (size_t i = 0; i < size; ++i) {
+		hash ^= bytes[i];
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+// serializes the fields of a create info that define the pipeline; the bytes
+// are the map key, so two create infos only share a pipeline when equal
+class KeyWriter {
+public:
+	void Mix(const void* data, size_t size) {
+		key.append(static_cast<const char*>(data), size);
+	}
+	template <typename T>
+	void Mix(const T& value) {
+		Mix(&value, sizeof(T));
+	}
+	// only for arrays of structs without padding
+	template <typename T>
+	void MixArray(const T* values, uint32_t count) {
+		Mix(count);
+		if (count) Mix(values, sizeof(T) * count);
+	}
+	void MixString(const char* s) {
+		Mix(s, std::strlen(s) + 1);
+	}
+	std::string Key() { return std::move(key); }
+private:
+	std::string key;
+};
+
+void MixStage(KeyWriter& key, const VkPipelineShaderStageCreateInfo& stage, uint64_t shader_id) {
+	key.Mix(stage.flags);
+	key.Mix(stage.stage);
+	key.Mix(shader_id);
+	key.MixString(stage.pName);
+	if (const VkSpecializationInfo* specialization = stage.pSpecializationInfo) {
+		key.MixArray(specialization->pMapEntries, specialization->mapEntryCount);
+		key.Mix(specialization->dataSize);
+		key.Mix(specialization->pData, specialization->dataSize);
+	}
+}
+
+void MixStencilOp(KeyWriter& key, const VkStencilOpState& op) {
+	key.Mix(op.failOp);
+	key.Mix(op.passOp);
+	key.Mix(op.depthFailOp);
+	key.Mix(op.compareOp);
+	key.Mix(op.compareMask);
+	key.Mix(op.writeMask);
+	key.Mix(op.reference);
+}
+} // namespace
+
+// prefixed to the driver's data: the Vulkan cache header carries no driver
+// version, and some drivers crash on data from another build instead of
+// rejecting it
+struct PipelineCache::FileHeader {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t vendor_id;
+	uint32_t device_id;
+	uint32_t driver_version;
+	uint8_t cache_uuid[VK_UUID_SIZE];
+	uint32_t reserved;
+	uint64_t data_size;
+	uint64_t data_hash;
+};
+
+PipelineCache::PipelineCache(VkPhysicalDevice physical_device, VkDevice device, std::string path)
+	: vk_device(device), path(std::move(path)) {
+	vkGetPhysicalDeviceProperties(physical_device, &vk_properties);
+	std::vector<char> data = Load();
+
+	VkPipelineCacheCreateInfo cache_create_info = {};
+	{
+		cache_create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+		cache_create_info.initialDataSize = data.size();
+		cache_create_info.pInitialData = data.empty() ? nullptr : data.data();
+	}
+	if (vkCreatePipelineCache(vk_device, &cache_create_info, nullptr, &vk_pipeline_cache) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to create pipeline cache!");
+	}
+}
+
+PipelineCache::~PipelineCache() {
+	Save();
+	DestroyPipelines();
+	for (const auto& module : shader_modules) {
+		vkDestroyShaderModule(vk_device, module.second, nullptr);
+	}
+	vkDestroyPipelineCache(vk_device, vk_pipeline_cache, nullptr);
+}
+
+std::vector<char> PipelineCache::Load() {
+	std::ifstream file(path, std::ios::ate | std::ios::binary);
+	if (!file.is_open()) {
+		return {};
+	}
+	size_t file_size = (size_t)file.tellg();
+	FileHeader header = {};
+	if (file_size < sizeof(header)) {
+		std::cout << "Pipeline cache: " << path << " is truncated, ignored" << std::endl;
+		return {};
+	}
+	file.seekg(0);
+	file.read(reinterpret_cast<char*>(&header), sizeof(header));
+	if (header.magic != kFileMagic || header.version != kFileVersion || header.data_size != file_size - sizeof(header)) {
+		std::cout << "Pipeline cache: " << path << " is not a valid cache file, ignored" << std::endl;
+		return {};
+	}
+	if (header.vendor_id != vk_properties.vendorID || header.device_id != vk_properties.deviceID ||
+		header.driver_version != vk_properties.driverVersion ||
+		std::memcmp(header.cache_uuid, vk_properties.pipelineCacheUUID, VK_UUID_SIZE) != 0) {
+		std::cout << "Pipeline cache: " << path << " was written by another device or driver, ignored" << std::endl;
+		return {};
+	}
+	std::vector<char> data(header.data_size);
+	file.read(data.data(), data.size());
+	if (!file || HashBytes(data.data(), data.size()) != header.data_hash) {
+		std::cout << "Pipeline cache: " << path << " is corrupted, ignored" << std::endl;
+		return {};
+	}
+	return data;
+}
+
+void PipelineCache::Save() {
+	if (!dirty) {
+		return;
+	}
+	size_t data_size = 0;
+	if (vkGetPipelineCacheData(vk_device, vk_pipeline_cache, &data_size, nullptr) != VK_SUCCESS) {
+		return;
+	}
+	std::vector<char> data(data_size);
+	if (vkGetPipelineCacheData(vk_device, vk_pipeline_cache, &data_size, data.data()) != VK_SUCCESS) {
+		return;
+	}
+	data.resize(data_size);
+
+	FileHeader header = {};
+	header.magic = kFileMagic;
+	header.version = kFileVersion;
+	header.vendor_id = vk_properties.vendorID;
+	header.device_id = vk_properties.deviceID;
+	header.driver_version = vk_properties.driverVersion;
+	std::memcpy(header.cache_uuid, vk_properties.pipelineCacheUUID, VK_UUID_SIZE);
+	header.data_size = data.size();
+	header.data_hash = HashBytes(data.data(), data.size());
+
+	// write aside and rename, a crash mid-write must not leave a torn cache
+	const std::string temp_path = path + ".tmp";
+	{
+		std::ofstream file(temp_path, std::ios::binary | std::ios::trunc);
+		if (!file.is_open()) {
+			std::cout << "Pipeline cache: failed to write " << temp_path << std::endl;
+			return;
+		}
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		file.write(data.data(), data.size());
+		if (!file) {
+			std::cout << "Pipeline cache: failed to write " << temp_path << std::endl;
+			return;
+		}
+	}
+	std::error_code error;
+	std::filesystem::rename(temp_path, path, error);
+	if (error) {
+		std::cout << "Pipeline cache: failed to replace " << path << ": " << error.message() << std::endl;
+		return;
+	}
+	dirty = false;
+}
+
+VkShaderModule PipelineCache::ShaderModule(const std::vector<char>& code) {
+	std::string key(code.begin(), code.end());
+	auto it = shader_modules.find(key);
+	if (it != shader_modules.end()) {
+		return it->second;
+	}
+
+	VkShaderModuleCreateInfo shader_module_create_info = {};
+	shader_module_create_info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+	shader_module_create_info.codeSize = code.size();
+	shader_module_create_info.pCode = reinterpret_cast<const uint32_t*>(code.data());
+
+	VkShaderModule shader;
+	if (vkCreateShaderModule(vk_device, &shader_module_create_info, nullptr, &shader) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to create shader module!");
+	}
+	shader_modules.emplace(std::move(key), shader);
+	shader_ids.emplace(shader, shader_ids.size());
+	return shader;
+}
+
+VkPipeline PipelineCache::GraphicsPipeline(const VkGraphicsPipelineCreateInfo& create_info) {
+	std::string key = CreateInfoKey(create_info);
+	auto it = pipelines.find(key);
+	if (it != pipelines.end()) {
+		++stats.hits;
+		return it->second;
+	}
+
+	VkPipeline pipeline;
+	if (vkCreateGraphicsPipelines(vk_device, vk_pipeline_cache, 1, &create_info, nullptr, &pipeline) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to create graphics pipeline~");
+	}
+	++stats.misses;
+	dirty = true;
+	pipelines.emplace(std::move(key), pipeline);
+	return pipeline;
+}
+
+VkPipeline PipelineCache::ComputePipeline(const VkComputePipelineCreateInfo& create_info) {
+	std::string key = CreateInfoKey(create_info);
+	auto it = pipelines.find(key);
+	if (it != pipelines.end()) {
+		++stats.hits;
+		return it->second;
+	}
+
+	VkPipeline pipeline;
+	if (vkCreateComputePipelines(vk_device, vk_pipeline_cache, 1, &create_info, nullptr, &pipeline) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to create compute pipeline!");
+	}
+	++stats.misses;
+	dirty = true;
+	pipelines.emplace(std::move(key), pipeline);
+	return pipeline;
+}
+
+void PipelineCache::DestroyPipelines() {
+	for (const auto& pipeline : pipelines) {
+		vkDestroyPipeline(vk_device, pipeline.second, nullptr);
+	}
+	pipelines.clear();
+}
+
+std::string PipelineCache::CreateInfoKey(const VkGraphicsPipelineCreateInfo& info) const {
+	// field by field: the structs carry pointers and padding
+	KeyWriter key;
+	key.Mix(info.flags);
+	key.Mix(info.stageCount);
+	for (uint32_t i = 0; i < info.stageCount; ++i) {
+		MixStage(key, info.pStages[i], ShaderId(info.pStages[i].module));
+	}
+	if (const VkPipelineVertexInputStateCreateInfo* vertex_input = info.pVertexInputState) {
+		key.MixArray(vertex_input->pVertexBindingDescriptions, vertex_input->vertexBindingDescriptionCount);
+		key.MixArray(vertex_input->pVertexAttributeDescriptions, vertex_input->vertexAttributeDescriptionCount);
+	}
+	if (const VkPipelineInputAssemblyStateCreateInfo* input_assembly = info.pInputAssemblyState) {
+		key.Mix(input_assembly->topology);
+		key.Mix(input_assembly->primitiveRestartEnable);
+	}
+	if (const VkPipelineTessellationStateCreateInfo* tessellation = info.pTessellationState) {
+		key.Mix(tessellation->patchControlPoints);
+	}
+	std::vector<VkDynamicState> dynamic_states;
+	if (const VkPipelineDynamicStateCreateInfo* dynamic = info.pDynamicState) {
+		dynamic_states.assign(dynamic->pDynamicStates, dynamic->pDynamicStates + dynamic->dynamicStateCount);
+		key.MixArray(dynamic->pDynamicStates, dynamic->dynamicStateCount);
+	}
+	auto IsDynamic = [&dynamic_states](VkDynamicState state) {
+		return std::find(dynamic_states.begin(), dynamic_states.end(), state) != dynamic_states.end();
+	};
+	if (const VkPipelineViewportStateCreateInfo* viewport = info.pViewportState) {
+		key.Mix(viewport->viewportCount);
+		key.Mix(viewport->scissorCount);
+		// ignored by the driver when dynamic, may be dangling
+		if (!IsDynamic(VK_DYNAMIC_STATE_VIEWPORT) && viewport->pViewports) {
+			key.MixArray(viewport->pViewports, viewport->viewportCount);
+		}
+		if (!IsDynamic(VK_DYNAMIC_STATE_SCISSOR) && viewport->pScissors) {
+			key.MixArray(viewport->pScissors, viewport->scissorCount);
+		}
+	}
+	if (const VkPipelineRasterizationStateCreateInfo* rasterization = info.pRasterizationState) {
+		key.Mix(rasterization->depthClampEnable);
+		key.Mix(rasterization->rasterizerDiscardEnable);
+		key.Mix(rasterization->polygonMode);
+		key.Mix(rasterization->cullMode);
+		key.Mix(rasterization->frontFace);
+		key.Mix(rasterization->depthBiasEnable);
+		key.Mix(rasterization->depthBiasConstantFactor);
+		key.Mix(rasterization->depthBiasClamp);
+		key.Mix(rasterization->depthBiasSlopeFactor);
+		key.Mix(rasterization->lineWidth);
+	}
+	if (const VkPipelineMultisampleStateCreateInfo* multisample = info.pMultisampleState) {
+		key.Mix(multisample->rasterizationSamples);
+		key.Mix(multisample->sampleShadingEnable);
+		key.Mix(multisample->minSampleShading);
+		if (multisample->pSampleMask) {
+			key.MixArray(multisample->pSampleMask, static_cast<uint32_t>((multisample->rasterizationSamples + 31) / 32));
+		}
+		key.Mix(multisample->alphaToCoverageEnable);
+		key.Mix(multisample->alphaToOneEnable);
+	}
+	if (const VkPipelineDepthStencilStateCreateInfo* depth_stencil = info.pDepthStencilState) {
+		key.Mix(depth_stencil->depthTestEnable);
+		key.Mix(depth_stencil->depthWriteEnable);
+		key.Mix(depth_stencil->depthCompareOp);
+		key.Mix(depth_stencil->depthBoundsTestEnable);
+		key.Mix(depth_stencil->stencilTestEnable);
+		MixStencilOp(key, depth_stencil->front);
+		MixStencilOp(key, depth_stencil->back);
+		key.Mix(depth_stencil->minDepthBounds);
+		key.Mix(depth_stencil->maxDepthBounds);
+	}
+	if (const VkPipelineColorBlendStateCreateInfo* color_blend = info.pColorBlendState) {
+		key.Mix(color_blend->logicOpEnable);
+		key.Mix(color_blend->logicOp);
+		key.MixArray(color_blend->pAttachments, color_blend->attachmentCount);
+		key.Mix(color_blend->blendConstants);
+	}
+	key.Mix(info.layout);
+	key.Mix(info.renderPass);
+	key.Mix(info.subpass);
+	return key.Key();
+}
+
+std::string PipelineCache::CreateInfoKey(const VkComputePipelineCreateInfo& info) const {
+	KeyWriter key;
+	// keeps compute keys apart from graphics ones
+	key.Mix(VK_PIPELINE_BIND_POINT_COMPUTE);
+	key.Mix(info.flags);
+	MixStage(key, info.stage, ShaderId(info.stage.module));
+	key.Mix(info.layout);
+	return key.Key();
+}
+
+uint64_t PipelineCache::ShaderId(VkShaderModule module) const {
+	auto code = shader_ids.find(module);
+	if (code == shader_ids.end()) {
+		throw std::runtime_error("Pipeline cache: shader module was not created by the cache!");
+	}
+	return code->second;
+}
@@ -0,0 +1,69 @@
+#ifndef PIPELINE_CACHE_H
+#define PIPELINE_CACHE_H
+#include <vulkan/vulkan.h>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Two levels of pipeline reuse:
+// - a VkPipelineCache loaded from and saved to `path`, so a warm start only
+//   pays for pipelines the driver has never compiled on this device. The file
+//   is rejected when the vendor, device, driver version or cache UUID differ.
+// - a map from the serialized create info to the pipeline, so creating an
+//   identical pipeline twice returns the first one. The key is the full
+//   serialized state, not a hash of it, so a collision can never return
+//   the wrong pipeline.
+// Shader modules are created through ShaderModule(), one per distinct SPIR-V,
+// so stages are keyed by their code instead of a handle value that may be
+// recycled. Pipeline
+// layouts and render passes are keyed by handle: call DestroyPipelines()
+// before destroying any that the cached pipelines were created with.
+class PipelineCache {
+public:
+	struct Stats {
+		uint32_t hits = 0;
+		uint32_t misses = 0;
+	};
+
+	PipelineCache(VkPhysicalDevice physical_device, VkDevice device, std::string path);
+	PipelineCache(const PipelineCache&) = delete;
+	PipelineCache& operator=(const PipelineCache&) = delete;
+	// saves, then destroys the pipelines, the modules and the cache
+	~PipelineCache();
+
+	VkPipelineCache Handle() const { return vk_pipeline_cache; }
+
+	// owned by the cache, one module per distinct SPIR-V
+	VkShaderModule ShaderModule(const std::vector<char>& code);
+	// owned by the cache; pNext chains are not part of the key
+	VkPipeline GraphicsPipeline(const VkGraphicsPipelineCreateInfo& create_info);
+	VkPipeline ComputePipeline(const VkComputePipelineCreateInfo& create_info);
+	void DestroyPipelines();
+
+	// writes the driver's cache if pipelines were created since the last save
+	void Save();
+
+	const Stats& GetStats() const { return stats; }
+
+private:
+	struct FileHeader;
+
+	std::vector<char> Load();
+	std::string CreateInfoKey(const VkGraphicsPipelineCreateInfo& create_info) const;
+	std::string CreateInfoKey(const VkComputePipelineCreateInfo& create_info) const;
+	uint64_t ShaderId(VkShaderModule module) const;
+
+	VkDevice vk_device;
+	VkPhysicalDeviceProperties vk_properties;
+	VkPipelineCache vk_pipeline_cache{ VK_NULL_HANDLE };
+	std::string path;
+	bool dirty{ false };
+
+	std::unordered_map<std::string, VkShaderModule> shader_modules;	// SPIR-V -> module
+	std::unordered_map<VkShaderModule, uint64_t> shader_ids;	// distinct per SPIR-V
+	std::unordered_map<std::string, VkPipeline> pipelines;	// serialized create info -> pipeline
+	Stats stats;
+};
+
+#endif // !PIPELINE_CACHE_H
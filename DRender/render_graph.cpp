@@ -0,0 +1,969 @@
+#include "render_graph.h"
+#include <algorithm>
+#include <iomanip>
+#include <stdexcept>
+
+namespace {
+const VkAccessFlags kWriteAccess = VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT |
+	VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_HOST_WRITE_BIT | VK_ACCESS_MEMORY_WRITE_BIT;
+
+bool HasWrite(VkAccessFlags access) {
+	return (access & kWriteAccess) != 0;
+}
+
+VkImageAspectFlags AspectOf(VkFormat format) {
+	switch (format) {
+	case VK_FORMAT_D16_UNORM:
+	case VK_FORMAT_X8_D24_UNORM_PACK32:
+	case VK_FORMAT_D32_SFLOAT:
+		return VK_IMAGE_ASPECT_DEPTH_BIT;
+	case VK_FORMAT_D16_UNORM_S8_UINT:
+	case VK_FORMAT_D24_UNORM_S8_UINT:
+	case VK_FORMAT_D32_SFLOAT_S8_UINT:
+		return VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT;
+	case VK_FORMAT_S8_UINT:
+		return VK_IMAGE_ASPECT_STENCIL_BIT;
+	default:
+		return VK_IMAGE_ASPECT_COLOR_BIT;
+	}
+}
+
+VkImageUsageFlags UsageOf(RenderGraph::Access access) {
+	switch (access) {
+	case RenderGraph::Access::ColorAttachment: return VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+	case RenderGraph::Access::DepthAttachment: return VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+	case RenderGraph::Access::InputAttachment: return VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT;
+	case RenderGraph::Access::Sampled: return VK_IMAGE_USAGE_SAMPLED_BIT;
+	case RenderGraph::Access::StorageRead:
+	case RenderGraph::Access::StorageWrite: return VK_IMAGE_USAGE_STORAGE_BIT;
+	}
+	return 0;
+}
+
+bool Overlaps(int first_a, int last_a, int first_b, int last_b) {
+	return !(last_a < first_b || last_b < first_a);
+}
+
+double MiB(VkDeviceSize bytes) {
+	return bytes / (1024.0 * 1024.0);
+}
+} // namespace
+
+RenderGraph::Pass& RenderGraph::Pass::AddUse(Resource resource, Access access, std::optional<VkClearValue> clear) {
+	uses.push_back(Use{ resource, access, clear });
+	return *this;
+}
+
+RenderGraph::Pass& RenderGraph::Pass::WriteColor(Resource resource, std::optional<VkClearValue> clear) {
+	return AddUse(resource, Access::ColorAttachment, clear);
+}
+
+RenderGraph::Pass& RenderGraph::Pass::WriteDepth(Resource resource, std::optional<VkClearValue> clear) {
+	return AddUse(resource, Access::DepthAttachment, clear);
+}
+
+RenderGraph::Pass& RenderGraph::Pass::ReadInput(Resource resource) {
+	return AddUse(resource, Access::InputAttachment, std::nullopt);
+}
+
+RenderGraph::Pass& RenderGraph::Pass::ReadSampled(Resource resource) {
+	return AddUse(resource, Access::Sampled, std::nullopt);
+}
+
+RenderGraph::Pass& RenderGraph::Pass::ReadStorage(Resource resource) {
+	return AddUse(resource, Access::StorageRead, std::nullopt);
+}
+
+RenderGraph::Pass& RenderGraph::Pass::WriteStorage(Resource resource) {
+	return AddUse(resource, Access::StorageWrite, std::nullopt);
+}
+
+RenderGraph::Pass& RenderGraph::Pass::SetExecute(ExecuteFunction execute, bool secondary) {
+	this->execute = std::move(execute);
+	this->secondary = secondary;
+	return *this;
+}
+
+RenderGraph::RenderGraph(VkPhysicalDevice physical_device, VkDevice device, MemoryAllocator& allocator)
+	: vk_physical_device(physical_device), vk_device(device), allocator(allocator) {
+	vkGetPhysicalDeviceMemoryProperties(vk_physical_device, &vk_memory_properties);
+}
+
+RenderGraph::~RenderGraph() {
+	ReleaseResources();
+	ReleaseRenderPasses();
+}
+
+RenderGraph::Resource RenderGraph::CreateImage(const std::string& name, VkFormat format) {
+	GraphResource resource;
+	resource.name = name;
+	resource.format = format;
+	resource.aspect = AspectOf(format);
+	resource.imported = false;
+	resource.final_layout = VK_IMAGE_LAYOUT_UNDEFINED;
+	resources.push_back(resource);
+	return static_cast<Resource>(resources.size() - 1);
+}
+
+RenderGraph::Resource RenderGraph::ImportImage(const std::string& name, VkFormat format, VkImageLayout final_layout) {
+	Resource resource = CreateImage(name, format);
+	resources[resource].imported = true;
+	resources[resource].final_layout = final_layout;
+	return resource;
+}
+
+void RenderGraph::SetImportedImage(Resource resource, VkImage image, VkImageView view) {
+	resources[resource].image = image;
+	resources[resource].view = view;
+}
+
+RenderGraph::Resource RenderGraph::CreateBuffer(const std::string& name, VkDeviceSize size, uint32_t copies) {
+	Resource resource = CreateImage(name, VK_FORMAT_UNDEFINED);
+	resources[resource].size = size;
+	resources[resource].copies = std::max(copies, 1u);
+	return resource;
+}
+
+RenderGraph::Pass& RenderGraph::AddPass(const std::string& name, PassType type) {
+	passes.emplace_back(new Pass(name, type));
+	return *passes.back();
+}
+
+void RenderGraph::EnableAsyncCompute(uint32_t graphics_family, uint32_t compute_family) {
+	async_enabled = true;
+	queue_families[0] = graphics_family;
+	queue_families[1] = compute_family;
+}
+
+RenderGraph::State RenderGraph::UseState(Access access, PassType type, VkImageAspectFlags aspect) {
+	const VkPipelineStageFlags shader_stage = type == PassType::Graphics ? VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT : VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+	const VkImageLayout read_only_layout = (aspect & VK_IMAGE_ASPECT_DEPTH_BIT) ? VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	switch (access) {
+	case Access::ColorAttachment:
+		return { VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT };
+	case Access::DepthAttachment:
+		return { VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+			VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+			VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT };
+	case Access::InputAttachment:
+		return { read_only_layout, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_INPUT_ATTACHMENT_READ_BIT };
+	case Access::Sampled:
+		return { read_only_layout, shader_stage, VK_ACCESS_SHADER_READ_BIT };
+	case Access::StorageRead:
+		return { VK_IMAGE_LAYOUT_GENERAL, shader_stage, VK_ACCESS_SHADER_READ_BIT };
+	case Access::StorageWrite:
+		return { VK_IMAGE_LAYOUT_GENERAL, shader_stage, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT };
+	}
+	return {};
+}
+
+bool RenderGraph::IsWrite(Access access) {
+	return access == Access::ColorAttachment || access == Access::DepthAttachment || access == Access::StorageWrite;
+}
+
+bool RenderGraph::IsAttachment(Access access) {
+	return access == Access::ColorAttachment || access == Access::DepthAttachment || access == Access::InputAttachment;
+}
+
+void RenderGraph::Compile() {
+	ReleaseResources();
+	ReleaseRenderPasses();
+	stats = Stats();
+	stats.passes = static_cast<uint32_t>(passes.size());
+
+	Cull();
+	BuildSteps();
+	compiled = true;
+}
+
+void RenderGraph::Cull() {
+	// walking backwards, a pass lives if it writes an imported image or
+	// something a live pass after it reads; attachments written without a
+	// clear keep their previous contents, so they count as reads too
+	std::vector<bool> needed(resources.size(), false);
+	for (auto it = passes.rbegin(); it != passes.rend(); ++it) {
+		Pass& pass = **it;
+		bool live = false;
+		for (const auto& use : pass.uses) {
+			if (IsWrite(use.access) && (resources[use.resource].imported || needed[use.resource])) {
+				live = true;
+			}
+		}
+		pass.culled = !live;
+		if (!live) {
+			++stats.culled_passes;
+			continue;
+		}
+		for (const auto& use : pass.uses) {
+			if (IsWrite(use.access) && use.clear) {
+				needed[use.resource] = false;
+			}
+		}
+		for (const auto& use : pass.uses) {
+			if (!IsWrite(use.access) || (IsAttachment(use.access) && !use.clear)) {
+				needed[use.resource] = true;
+			}
+		}
+	}
+}
+
+void RenderGraph::BuildSteps() {
+	steps.clear();
+	for (auto& pass_ptr : passes) {
+		Pass& pass = *pass_ptr;
+		if (pass.culled) {
+			continue;
+		}
+		// a graphics pass joins the open render pass unless it needs a result
+		// of it outside the framebuffer (sampled or storage), which takes a
+		// real barrier, or uses one of its shader resources as an attachment
+		bool merge = !steps.empty() && steps.back().type == PassType::Graphics && pass.type == PassType::Graphics;
+		if (merge) {
+			for (const auto& use : pass.uses) {
+				for (const Pass* earlier : steps.back().passes) {
+					for (const auto& earlier_use : earlier->uses) {
+						if (earlier_use.resource == use.resource &&
+							IsAttachment(use.access) != IsAttachment(earlier_use.access)) {
+							merge = false;
+						}
+					}
+				}
+			}
+		}
+		if (!merge) {
+			steps.emplace_back();
+			steps.back().type = pass.type == PassType::Graphics ? PassType::Graphics : PassType::Compute;
+			steps.back().async = pass.type == PassType::AsyncCompute && async_enabled;
+		}
+		pass.step = static_cast<uint32_t>(steps.size() - 1);
+		steps.back().passes.push_back(&pass);
+	}
+
+	// lifetimes and usage
+	std::vector<bool> attachment_only(resources.size(), true);
+	std::vector<bool> graphics_queue(resources.size(), false);
+	for (auto& resource : resources) {
+		resource.usage = 0;
+		resource.first_step = resource.last_step = -1;
+		resource.async = resource.shared = false;
+	}
+	for (int s = 0; s < static_cast<int>(steps.size()); ++s) {
+		for (const Pass* pass : steps[s].passes) {
+			for (const auto& use : pass->uses) {
+				GraphResource& resource = resources[use.resource];
+				if (resource.size && use.access != Access::StorageRead && use.access != Access::StorageWrite) {
+					throw std::runtime_error("RenderGraph: " + pass->name + " uses buffer " + resource.name + " as an image");
+				}
+				if (resource.imported && steps[s].async) {
+					throw std::runtime_error("RenderGraph: " + pass->name + " uses imported " + resource.name + " on the async compute queue");
+				}
+				if (resource.first_step < 0) {
+					resource.first_step = s;
+				}
+				resource.last_step = s;
+				resource.usage |= UsageOf(use.access);
+				if (!IsAttachment(use.access)) {
+					attachment_only[use.resource] = false;
+				}
+				if (steps[s].async) {
+					resource.async = true;
+				} else {
+					graphics_queue[use.resource] = true;
+				}
+			}
+		}
+	}
+	async_reuses_resources = false;
+	for (Resource r = 0; r < resources.size(); ++r) {
+		GraphResource& resource = resources[r];
+		resource.shared = resource.async && graphics_queue[r];
+		stats.shared_resources += resource.shared ? 1 : 0;
+		async_reuses_resources |= resource.async && resource.copies == 1;
+		resource.transient = !resource.imported && resource.first_step >= 0 && resource.first_step == resource.last_step &&
+			steps[resource.first_step].type == PassType::Graphics && attachment_only[r];
+		if (resource.transient) {
+			resource.usage |= VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
+		}
+		// every frame starts after the previous frame's last accesses; the
+		// contents are never carried over
+		resource.frame_start = State();
+		if (resource.imported) {
+			resource.frame_start.stages = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+		} else if (resource.shared) {
+			// the previous frame's last accesses were on the other queue, the
+			// semaphores between the submissions already wait for them, or
+			// the fence of the frame that last used this copy
+			for (const Pass* pass : steps[resource.first_step].passes) {
+				for (const auto& use : pass->uses) {
+					if (use.resource == r) {
+						resource.frame_start.stages |= UseState(use.access, pass->type, resource.aspect).stages;
+					}
+				}
+			}
+		} else if (resource.last_step >= 0) {
+			for (const Pass* pass : steps[resource.last_step].passes) {
+				for (const auto& use : pass->uses) {
+					if (use.resource == r) {
+						const State state = UseState(use.access, pass->type, resource.aspect);
+						resource.frame_start.stages |= state.stages;
+						resource.frame_start.access |= state.access;
+					}
+				}
+			}
+		}
+	}
+
+	std::vector<State> states(resources.size());
+	std::vector<bool> written(resources.size(), false);
+	std::vector<int> last_queue(resources.size(), -1);
+	for (Resource r = 0; r < resources.size(); ++r) {
+		states[r] = resources[r].frame_start;
+	}
+	async_wait_stages = 0;
+	for (auto& step : steps) {
+		HandOver(step, states, last_queue);
+		if (step.type == PassType::Graphics) {
+			BuildRenderPass(step, states, written);
+			++stats.render_passes;
+		} else {
+			BuildComputeBarriers(step, states, written);
+			++(step.async ? stats.async_compute_passes : stats.compute_passes);
+		}
+		stats.image_barriers += static_cast<uint32_t>(step.barriers.size());
+	}
+}
+
+void RenderGraph::HandOver(const Step& step, std::vector<State>& states, std::vector<int>& last_queue) {
+	// 0: graphics queue, 1: async compute queue, -1: not used yet this frame
+	const int queue = step.async ? 1 : 0;
+	std::map<Resource, VkPipelineStageFlags> handed_over;
+	for (const Pass* pass : step.passes) {
+		for (const auto& use : pass->uses) {
+			if (last_queue[use.resource] < 0 || last_queue[use.resource] == queue) {
+				continue;
+			}
+			if (step.async) {
+				throw std::runtime_error("RenderGraph: async " + pass->name + " uses " + resources[use.resource].name + " after the graphics queue");
+			}
+			handed_over[use.resource] |= UseState(use.access, pass->type, resources[use.resource].aspect).stages;
+		}
+	}
+	// the graphics submission waits for the async one in the stages of the
+	// first uses, which makes the results available and visible; only a
+	// layout transition may be left to do
+	for (const auto& entry : handed_over) {
+		states[entry.first] = State{ states[entry.first].layout, entry.second, 0 };
+		async_wait_stages |= entry.second;
+	}
+	for (const Pass* pass : step.passes) {
+		for (const auto& use : pass->uses) {
+			last_queue[use.resource] = queue;
+		}
+	}
+}
+
+void RenderGraph::BuildComputeBarriers(Step& step, std::vector<State>& states, std::vector<bool>& written) {
+	// all uses of an image by one pass need a single layout
+	std::map<Resource, State> pass_states;
+	for (const Pass* pass : step.passes) {
+		for (const auto& use : pass->uses) {
+			const State state = UseState(use.access, pass->type, resources[use.resource].aspect);
+			auto it = pass_states.find(use.resource);
+			if (it == pass_states.end()) {
+				pass_states[use.resource] = state;
+			} else if (it->second.layout != state.layout) {
+				throw std::runtime_error("RenderGraph: " + pass->name + " uses " + resources[use.resource].name + " in two layouts");
+			} else {
+				it->second.stages |= state.stages;
+				it->second.access |= state.access;
+			}
+		}
+	}
+	for (const auto& entry : pass_states) {
+		const Resource r = entry.first;
+		const State& use = entry.second;
+		if (!written[r] && !HasWrite(use.access)) {
+			throw std::runtime_error("RenderGraph: " + step.passes[0]->name + " reads " + resources[r].name + " before it is written");
+		}
+		if (states[r].layout != use.layout || HasWrite(states[r].access) || HasWrite(use.access)) {
+			State src = states[r];
+			if (!written[r]) {
+				src.layout = VK_IMAGE_LAYOUT_UNDEFINED;	// nothing to keep
+			}
+			step.barriers.push_back(Barrier{ r, src, use });
+			states[r] = use;
+		} else {
+			// reads after reads: a later write has to wait for all of them
+			states[r].stages |= use.stages;
+			states[r].access |= use.access;
+		}
+		written[r] = written[r] || HasWrite(use.access);
+	}
+}
+
+void RenderGraph::BuildRenderPass(Step& step, std::vector<State>& states, std::vector<bool>& written) {
+	const uint32_t step_index = static_cast<uint32_t>(&step - steps.data());
+	std::vector<int> attachment_index(resources.size(), -1);
+	for (const Pass* pass : step.passes) {
+		for (const auto& use : pass->uses) {
+			if (!IsAttachment(use.access)) {
+				// shader resources of the render pass are made ready before it begins
+				const State state = UseState(use.access, pass->type, resources[use.resource].aspect);
+				if (!written[use.resource] && !HasWrite(state.access)) {
+					throw std::runtime_error("RenderGraph: " + pass->name + " reads " + resources[use.resource].name + " before it is written");
+				}
+				if (states[use.resource].layout != state.layout || HasWrite(states[use.resource].access) || HasWrite(state.access)) {
+					step.barriers.push_back(Barrier{ use.resource, states[use.resource], state });
+					states[use.resource] = state;
+				} else {
+					states[use.resource].stages |= state.stages;
+					states[use.resource].access |= state.access;
+				}
+				written[use.resource] = written[use.resource] || HasWrite(state.access);
+			} else if (attachment_index[use.resource] < 0) {
+				attachment_index[use.resource] = static_cast<int>(step.attachments.size());
+				step.attachments.push_back(use.resource);
+			}
+		}
+	}
+
+	const size_t attachment_count = step.attachments.size();
+	const size_t subpass_count = step.passes.size();
+	std::vector<VkAttachmentDescription> attachments(attachment_count);
+	step.clear_values.assign(attachment_count, VkClearValue{});
+	std::vector<std::vector<bool>> used_in(attachment_count, std::vector<bool>(subpass_count, false));
+	for (size_t i = 0; i < attachment_count; ++i) {
+		const Resource r = step.attachments[i];
+		const GraphResource& resource = resources[r];
+		const Pass::Use* first_use = nullptr;
+		const Pass* first_pass = nullptr;
+		VkImageLayout last_layout = VK_IMAGE_LAYOUT_UNDEFINED;
+		for (size_t k = 0; k < subpass_count; ++k) {
+			for (const auto& use : step.passes[k]->uses) {
+				if (use.resource == r) {
+					if (!first_use) {
+						first_use = &use;
+						first_pass = step.passes[k];
+					}
+					used_in[i][k] = true;
+					last_layout = UseState(use.access, PassType::Graphics, resource.aspect).layout;
+				}
+			}
+		}
+
+		VkAttachmentDescription& desc = attachments[i];
+		desc.format = resource.format;
+		desc.samples = VK_SAMPLE_COUNT_1_BIT;
+		if (written[r]) {
+			// produced by an earlier pass: keep it
+			desc.loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+			desc.initialLayout = states[r].layout;
+		} else if (!IsWrite(first_use->access)) {
+			throw std::runtime_error("RenderGraph: " + first_pass->name + " reads " + resource.name + " before it is written");
+		} else {
+			desc.loadOp = first_use->clear ? VK_ATTACHMENT_LOAD_OP_CLEAR : VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+			desc.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+			if (first_use->clear) {
+				step.clear_values[i] = *first_use->clear;
+			}
+		}
+		const bool used_later = resource.imported || resource.last_step > static_cast<int>(step_index);
+		desc.storeOp = used_later ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE;
+		desc.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+		desc.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+		desc.finalLayout = resource.imported && resource.last_step == static_cast<int>(step_index) ? resource.final_layout : last_layout;
+	}
+
+	// subpasses
+	std::vector<std::vector<VkAttachmentReference>> color_refs(subpass_count);
+	std::vector<std::vector<VkAttachmentReference>> input_refs(subpass_count);
+	std::vector<VkAttachmentReference> depth_refs(subpass_count);
+	std::vector<std::vector<uint32_t>> preserves(subpass_count);
+	std::vector<VkSubpassDescription> subpasses(subpass_count);
+	for (size_t k = 0; k < subpass_count; ++k) {
+		Pass* pass = step.passes[k];
+		bool has_depth = false;
+		for (const auto& use : pass->uses) {
+			if (!IsAttachment(use.access)) {
+				continue;
+			}
+			VkAttachmentReference ref;
+			ref.attachment = static_cast<uint32_t>(attachment_index[use.resource]);
+			ref.layout = UseState(use.access, PassType::Graphics, resources[use.resource].aspect).layout;
+			if (use.access == Access::ColorAttachment) {
+				color_refs[k].push_back(ref);
+			} else if (use.access == Access::InputAttachment) {
+				input_refs[k].push_back(ref);
+			} else {
+				if (has_depth) {
+					throw std::runtime_error("RenderGraph: " + pass->name + " writes two depth attachments");
+				}
+				depth_refs[k] = ref;
+				has_depth = true;
+			}
+		}
+		// contents an earlier subpass wrote for a later one have to survive this one
+		for (size_t i = 0; i < attachment_count; ++i) {
+			if (used_in[i][k]) {
+				continue;
+			}
+			bool before = false, after = false;
+			for (size_t j = 0; j < k; ++j) before = before || used_in[i][j];
+			for (size_t j = k + 1; j < subpass_count; ++j) after = after || used_in[i][j];
+			if (before && after) {
+				preserves[k].push_back(static_cast<uint32_t>(i));
+			}
+		}
+
+		VkSubpassDescription& subpass = subpasses[k];
+		subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+		subpass.colorAttachmentCount = static_cast<uint32_t>(color_refs[k].size());
+		subpass.pColorAttachments = color_refs[k].data();
+		subpass.inputAttachmentCount = static_cast<uint32_t>(input_refs[k].size());
+		subpass.pInputAttachments = input_refs[k].data();
+		subpass.pDepthStencilAttachment = has_depth ? &depth_refs[k] : nullptr;
+		subpass.preserveAttachmentCount = static_cast<uint32_t>(preserves[k].size());
+		subpass.pPreserveAttachments = preserves[k].data();
+		pass->subpass = static_cast<uint32_t>(k);
+	}
+
+	// dependencies, merged per subpass pair: from outside the render pass into
+	// the first subpass touching an attachment, and between subpasses for every
+	// hazard on an attachment. The latter are framebuffer-local, by region.
+	std::map<std::pair<uint32_t, uint32_t>, VkSubpassDependency> dependencies;
+	auto Depend = [&](uint32_t src, uint32_t dst, const State& from, const State& to) {
+		VkSubpassDependency& dependency = dependencies[{ src, dst }];
+		dependency.srcSubpass = src;
+		dependency.dstSubpass = dst;
+		dependency.srcStageMask |= from.stages ? from.stages : static_cast<VkPipelineStageFlags>(VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT);
+		dependency.dstStageMask |= to.stages;
+		dependency.srcAccessMask |= from.access & kWriteAccess;
+		dependency.dstAccessMask |= to.access;
+		dependency.dependencyFlags = src == VK_SUBPASS_EXTERNAL ? 0 : VK_DEPENDENCY_BY_REGION_BIT;
+	};
+	std::vector<int> last_subpass(attachment_count, -1);
+	std::vector<State> last_state(attachment_count);
+	for (uint32_t k = 0; k < subpass_count; ++k) {
+		for (const auto& use : step.passes[k]->uses) {
+			if (!IsAttachment(use.access)) {
+				continue;
+			}
+			const int i = attachment_index[use.resource];
+			const State state = UseState(use.access, PassType::Graphics, resources[use.resource].aspect);
+			if (last_subpass[i] < 0) {
+				Depend(VK_SUBPASS_EXTERNAL, k, states[use.resource], state);
+			} else if (last_subpass[i] != static_cast<int>(k) && (HasWrite(last_state[i].access) || HasWrite(state.access))) {
+				Depend(static_cast<uint32_t>(last_subpass[i]), k, last_state[i], state);
+			}
+			if (last_subpass[i] == static_cast<int>(k)) {
+				last_state[i].stages |= state.stages;
+				last_state[i].access |= state.access;
+			} else {
+				last_state[i] = state;
+				last_subpass[i] = static_cast<int>(k);
+			}
+		}
+	}
+	std::vector<VkSubpassDependency> dependency_list;
+	for (const auto& entry : dependencies) {
+		dependency_list.push_back(entry.second);
+	}
+	stats.subpass_dependencies += static_cast<uint32_t>(dependency_list.size());
+
+	// what the next step sees
+	for (size_t i = 0; i < attachment_count; ++i) {
+		const Resource r = step.attachments[i];
+		State end;
+		end.layout = attachments[i].finalLayout;
+		for (size_t k = 0; k < subpass_count; ++k) {
+			for (const auto& use : step.passes[k]->uses) {
+				if (use.resource == r) {
+					const State state = UseState(use.access, PassType::Graphics, resources[r].aspect);
+					end.stages |= state.stages;
+					end.access |= state.access;
+					written[r] = written[r] || IsWrite(use.access);
+				}
+			}
+		}
+		states[r] = end;
+	}
+
+	VkRenderPassCreateInfo render_pass_create_info = {};
+	{
+		render_pass_create_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+		render_pass_create_info.attachmentCount = static_cast<uint32_t>(attachments.size());
+		render_pass_create_info.pAttachments = attachments.data();
+		render_pass_create_info.subpassCount = static_cast<uint32_t>(subpasses.size());
+		render_pass_create_info.pSubpasses = subpasses.data();
+		render_pass_create_info.dependencyCount = static_cast<uint32_t>(dependency_list.size());
+		render_pass_create_info.pDependencies = dependency_list.data();
+	}
+	if (vkCreateRenderPass(vk_device, &render_pass_create_info, nullptr, &step.render_pass) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to create render pass!");
+	}
+	for (Pass* pass : step.passes) {
+		pass->render_pass = step.render_pass;
+	}
+}
+
+template <typename CreateInfo>
+void RenderGraph::SetSharingMode(const GraphResource& resource, CreateInfo& create_info) const {
+	if (resource.shared && queue_families[0] != queue_families[1]) {
+		create_info.sharingMode = VK_SHARING_MODE_CONCURRENT;
+		create_info.queueFamilyIndexCount = 2;
+		create_info.pQueueFamilyIndices = queue_families;
+	} else {
+		create_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	}
+}
+
+bool RenderGraph::HasLazyMemory(uint32_t memory_type_bits) const {
+	for (uint32_t type = 0; type < vk_memory_properties.memoryTypeCount; ++type) {
+		if ((memory_type_bits & (1u << type)) &&
+			(vk_memory_properties.memoryTypes[type].propertyFlags & VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+void RenderGraph::Realize(VkExtent2D extent) {
+	if (!compiled) {
+		throw std::runtime_error("RenderGraph: Realize() before Compile()");
+	}
+	ReleaseResources();
+	this->extent = extent;
+	stats.images = stats.transient_images = stats.buffers = 0;
+	stats.image_bytes = stats.aliased_bytes = 0;
+
+	std::vector<Resource> aliasable;
+	for (Resource r = 0; r < resources.size(); ++r) {
+		GraphResource& resource = resources[r];
+		if (resource.imported || resource.first_step < 0) {
+			continue;
+		}
+		if (resource.size) {
+			VkBufferCreateInfo buffer_create_info = {};
+			{
+				buffer_create_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+				buffer_create_info.size = resource.size;
+				buffer_create_info.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+				SetSharingMode(resource, buffer_create_info);
+			}
+			for (uint32_t copy = 0; copy < resource.copies; ++copy) {
+				VkBuffer buffer;
+				if (vkCreateBuffer(vk_device, &buffer_create_info, nullptr, &buffer) != VK_SUCCESS) {
+					throw std::runtime_error("Failed to create render graph buffer!");
+				}
+				resource.buffers.push_back(buffer);
+				resource.buffer_memory.push_back(allocator.AllocateForBuffer(buffer, MemoryUsage::GpuOnly));
+				++stats.buffers;
+			}
+			continue;
+		}
+		VkImageCreateInfo image_create_info = {};
+		{
+			image_create_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+			image_create_info.imageType = VK_IMAGE_TYPE_2D;
+			image_create_info.format = resource.format;
+			image_create_info.extent = { extent.width, extent.height, 1 };
+			image_create_info.mipLevels = 1;
+			image_create_info.arrayLayers = 1;
+			image_create_info.samples = VK_SAMPLE_COUNT_1_BIT;
+			image_create_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+			image_create_info.usage = resource.usage;
+			SetSharingMode(resource, image_create_info);
+			image_create_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		}
+		if (vkCreateImage(vk_device, &image_create_info, nullptr, &resource.image) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to create render graph image!");
+		}
+		vkGetImageMemoryRequirements(vk_device, resource.image, &resource.requirements);
+		++stats.images;
+		if (resource.transient && HasLazyMemory(resource.requirements.memoryTypeBits)) {
+			// tile memory only, nothing to share
+			resource.memory = allocator.AllocateForImage(resource.image, VK_IMAGE_TILING_OPTIMAL, MemoryUsage::Transient);
+			++stats.transient_images;
+		} else if (resource.async) {
+			// handing memory over between queues would take a semaphore
+			resource.memory = allocator.AllocateForImage(resource.image, VK_IMAGE_TILING_OPTIMAL, MemoryUsage::GpuOnly);
+		} else {
+			aliasable.push_back(r);
+			stats.image_bytes += resource.requirements.size;
+		}
+	}
+
+	// greedy interval packing, largest images first: each joins the first slot
+	// whose images are all dead or not yet alive during its lifetime
+	std::stable_sort(aliasable.begin(), aliasable.end(), [this](Resource a, Resource b) {
+		return resources[a].requirements.size > resources[b].requirements.size;
+	});
+	for (Resource r : aliasable) {
+		const GraphResource& resource = resources[r];
+		AliasSlot* slot = nullptr;
+		for (auto& candidate : alias_slots) {
+			bool fits = (candidate.memory_type_bits & resource.requirements.memoryTypeBits) != 0;
+			for (Resource other : candidate.resources) {
+				fits = fits && !Overlaps(resource.first_step, resource.last_step, resources[other].first_step, resources[other].last_step);
+			}
+			if (fits) {
+				slot = &candidate;
+				break;
+			}
+		}
+		if (!slot) {
+			alias_slots.emplace_back();
+			slot = &alias_slots.back();
+		}
+		slot->size = std::max(slot->size, resource.requirements.size);
+		slot->alignment = std::max(slot->alignment, resource.requirements.alignment);
+		slot->memory_type_bits &= resource.requirements.memoryTypeBits;
+		slot->resources.push_back(r);
+	}
+
+	for (auto& slot : alias_slots) {
+		std::sort(slot.resources.begin(), slot.resources.end(), [this](Resource a, Resource b) {
+			return resources[a].first_step < resources[b].first_step;
+		});
+		VkMemoryRequirements requirements = {};
+		requirements.size = slot.size;
+		requirements.alignment = slot.alignment;
+		requirements.memoryTypeBits = slot.memory_type_bits;
+		slot.memory = allocator.Allocate(requirements, MemoryUsage::GpuOnly, false);
+		stats.aliased_bytes += slot.size;
+		for (Resource r : slot.resources) {
+			if (vkBindImageMemory(vk_device, resources[r].image, slot.memory.memory, slot.memory.offset) != VK_SUCCESS) {
+				throw std::runtime_error("Failed to bind image memory!");
+			}
+		}
+		// each image takes the memory over once the previous one is done with
+		// it; the first one waits for the last one of the previous frame
+		const size_t count = slot.resources.size();
+		for (size_t k = 0; count > 1 && k < count; ++k) {
+			const GraphResource& previous = resources[slot.resources[(k + count - 1) % count]];
+			const GraphResource& next = resources[slot.resources[k]];
+			Step& step = steps[next.first_step];
+			step.alias_src_stages |= previous.frame_start.stages;
+			step.alias_src_access |= previous.frame_start.access & kWriteAccess;
+			for (const Pass* pass : step.passes) {
+				for (const auto& use : pass->uses) {
+					if (use.resource == slot.resources[k]) {
+						const State state = UseState(use.access, pass->type, next.aspect);
+						step.alias_dst_stages |= state.stages;
+						step.alias_dst_access |= state.access;
+					}
+				}
+			}
+		}
+	}
+
+	for (auto& resource : resources) {
+		if (resource.imported || resource.first_step < 0 || resource.size) {
+			continue;
+		}
+		VkImageViewCreateInfo image_view_create_info = {};
+		{
+			image_view_create_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+			image_view_create_info.image = resource.image;
+			image_view_create_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+			image_view_create_info.format = resource.format;
+			// depth only: input attachment and sampled views take a single aspect
+			image_view_create_info.subresourceRange.aspectMask = (resource.aspect & VK_IMAGE_ASPECT_DEPTH_BIT) ? static_cast<VkImageAspectFlags>(VK_IMAGE_ASPECT_DEPTH_BIT) : resource.aspect;
+			image_view_create_info.subresourceRange.baseMipLevel = 0;
+			image_view_create_info.subresourceRange.levelCount = 1;
+			image_view_create_info.subresourceRange.baseArrayLayer = 0;
+			image_view_create_info.subresourceRange.layerCount = 1;
+		}
+		if (vkCreateImageView(vk_device, &image_view_create_info, nullptr, &resource.view) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to create render graph image view!");
+		}
+	}
+}
+
+VkFramebuffer RenderGraph::GetFramebuffer(Step& step) {
+	std::vector<VkImageView> views;
+	for (Resource r : step.attachments) {
+		views.push_back(resources[r].view);
+	}
+	auto it = step.framebuffers.find(views);
+	if (it != step.framebuffers.end()) {
+		return it->second;
+	}
+
+	VkFramebufferCreateInfo framebuffer_create_info = {};
+	{
+		framebuffer_create_info.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+		framebuffer_create_info.renderPass = step.render_pass;
+		framebuffer_create_info.attachmentCount = static_cast<uint32_t>(views.size());
+		framebuffer_create_info.pAttachments = views.data();
+		framebuffer_create_info.width = extent.width;
+		framebuffer_create_info.height = extent.height;
+		framebuffer_create_info.layers = 1;
+	}
+	VkFramebuffer framebuffer;
+	if (vkCreateFramebuffer(vk_device, &framebuffer_create_info, nullptr, &framebuffer) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to create framebuffer!");
+	}
+	step.framebuffers[views] = framebuffer;
+	return framebuffer;
+}
+
+void RenderGraph::Execute(VkCommandBuffer command_buffer) {
+	for (auto& step : steps) {
+		if (!step.async) {
+			RecordStep(step, command_buffer);
+		}
+	}
+}
+
+void RenderGraph::ExecuteAsync(VkCommandBuffer command_buffer) {
+	for (auto& step : steps) {
+		if (step.async) {
+			RecordStep(step, command_buffer);
+		}
+	}
+}
+
+void RenderGraph::RecordStep(Step& step, VkCommandBuffer command_buffer) {
+	if (!step.barriers.empty() || step.alias_src_stages) {
+		VkPipelineStageFlags src_stages = step.alias_src_stages;
+		VkPipelineStageFlags dst_stages = step.alias_dst_stages;
+		std::vector<VkBufferMemoryBarrier> buffer_barriers;
+		std::vector<VkImageMemoryBarrier> image_barriers;
+		for (const auto& barrier : step.barriers) {
+			const GraphResource& resource = resources[barrier.resource];
+			src_stages |= barrier.src.stages;
+			dst_stages |= barrier.dst.stages;
+			if (resource.size) {
+				VkBufferMemoryBarrier buffer_barrier = {};
+				buffer_barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+				buffer_barrier.srcAccessMask = barrier.src.access & kWriteAccess;
+				buffer_barrier.dstAccessMask = barrier.dst.access;
+				buffer_barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+				buffer_barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+				buffer_barrier.buffer = resource.buffers[frame % resource.buffers.size()];
+				buffer_barrier.offset = 0;
+				buffer_barrier.size = VK_WHOLE_SIZE;
+				buffer_barriers.push_back(buffer_barrier);
+				continue;
+			}
+			VkImageMemoryBarrier image_barrier = {};
+			image_barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+			image_barrier.srcAccessMask = barrier.src.access & kWriteAccess;
+			image_barrier.dstAccessMask = barrier.dst.access;
+			image_barrier.oldLayout = barrier.src.layout;
+			image_barrier.newLayout = barrier.dst.layout;
+			image_barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			image_barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			image_barrier.image = resource.image;
+			image_barrier.subresourceRange = { resource.aspect, 0, 1, 0, 1 };
+			image_barriers.push_back(image_barrier);
+		}
+		VkMemoryBarrier memory_barrier = {};
+		memory_barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		memory_barrier.srcAccessMask = step.alias_src_access;
+		memory_barrier.dstAccessMask = step.alias_dst_access;
+		vkCmdPipelineBarrier(command_buffer, src_stages ? src_stages : static_cast<VkPipelineStageFlags>(VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT), dst_stages, 0,
+			step.alias_src_stages ? 1 : 0, &memory_barrier,
+			static_cast<uint32_t>(buffer_barriers.size()), buffer_barriers.data(),
+			static_cast<uint32_t>(image_barriers.size()), image_barriers.data());
+	}
+
+	if (step.type == PassType::Compute) {
+		for (Pass* pass : step.passes) {
+			if (pass->execute) {
+				pass->execute(PassContext{ command_buffer, VK_NULL_HANDLE, 0, VK_NULL_HANDLE });
+			}
+		}
+		return;
+	}
+
+	const VkFramebuffer framebuffer = GetFramebuffer(step);
+	VkRenderPassBeginInfo rp_begin_info = {};
+	rp_begin_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+	rp_begin_info.renderPass = step.render_pass;
+	rp_begin_info.framebuffer = framebuffer;
+	rp_begin_info.renderArea.offset = { 0, 0 };
+	rp_begin_info.renderArea.extent = extent;
+	rp_begin_info.clearValueCount = static_cast<uint32_t>(step.clear_values.size());
+	rp_begin_info.pClearValues = step.clear_values.data();
+	for (size_t k = 0; k < step.passes.size(); ++k) {
+		Pass* pass = step.passes[k];
+		const VkSubpassContents contents = pass->secondary ? VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS : VK_SUBPASS_CONTENTS_INLINE;
+		if (k == 0) {
+			vkCmdBeginRenderPass(command_buffer, &rp_begin_info, contents);
+		} else {
+			vkCmdNextSubpass(command_buffer, contents);
+		}
+		if (pass->execute) {
+			pass->execute(PassContext{ command_buffer, step.render_pass, static_cast<uint32_t>(k), framebuffer });
+		}
+	}
+	vkCmdEndRenderPass(command_buffer);
+}
+
+void RenderGraph::ReleaseResources() {
+	for (auto& step : steps) {
+		for (auto& entry : step.framebuffers) {
+			vkDestroyFramebuffer(vk_device, entry.second, nullptr);
+		}
+		step.framebuffers.clear();
+		step.alias_src_stages = step.alias_dst_stages = 0;
+		step.alias_src_access = step.alias_dst_access = 0;
+	}
+	for (auto& resource : resources) {
+		if (resource.imported) {
+			continue;
+		}
+		if (resource.view != VK_NULL_HANDLE) {
+			vkDestroyImageView(vk_device, resource.view, nullptr);
+			resource.view = VK_NULL_HANDLE;
+		}
+		if (resource.image != VK_NULL_HANDLE) {
+			vkDestroyImage(vk_device, resource.image, nullptr);
+			resource.image = VK_NULL_HANDLE;
+		}
+		for (VkBuffer buffer : resource.buffers) {
+			vkDestroyBuffer(vk_device, buffer, nullptr);
+		}
+		resource.buffers.clear();
+		for (auto& memory : resource.buffer_memory) {
+			allocator.Free(memory);
+		}
+		resource.buffer_memory.clear();
+		allocator.Free(resource.memory);
+		resource.memory = Allocation();
+	}
+	for (auto& slot : alias_slots) {
+		allocator.Free(slot.memory);
+	}
+	alias_slots.clear();
+}
+
+void RenderGraph::ReleaseRenderPasses() {
+	for (auto& step : steps) {
+		vkDestroyRenderPass(vk_device, step.render_pass, nullptr);
+	}
+	steps.clear();
+	compiled = false;
+}
+
+void RenderGraph::DumpStats(std::ostream& out) const {
+	const std::ios::fmtflags flags = out.flags();
+	out << std::fixed << std::setprecision(1);
+	out << "Render graph: " << stats.passes << " passes (" << stats.culled_passes << " culled) in "
+		<< stats.render_passes << " render passes, " << stats.compute_passes << " compute passes and "
+		<< stats.async_compute_passes << " async compute passes, "
+		<< stats.image_barriers << " barriers and " << stats.subpass_dependencies << " subpass dependencies per frame" << std::endl;
+	for (const auto& step : steps) {
+		out << "  " << (step.type == PassType::Graphics ? "render pass:" : step.async ? "async compute:" : "compute:");
+		for (const Pass* pass : step.passes) {
+			out << " " << pass->name;
+		}
+		out << std::endl;
+	}
+	out << "  " << stats.images << " images, " << stats.transient_images << " in lazily allocated memory, "
+		<< MiB(stats.image_bytes) << " MiB aliased into " << MiB(stats.aliased_bytes) << " MiB, "
+		<< stats.buffers << " buffers, " << stats.shared_resources << " shared with the async compute queue" << std::endl;
+	out.flags(flags);
+}
@@ -0,0 +1,276 @@
+#ifndef RENDER_GRAPH_H
+#define RENDER_GRAPH_H
+#include <vulkan/vulkan.h>
+#include "memory_allocator.h"
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Frame graph over images and buffers. Passes declare what they read and write; Compile()
+// then
+//  - culls passes whose results never reach an imported image,
+//  - merges consecutive graphics passes into the subpasses of one render pass
+//    as long as they only consume each other's results as input attachments,
+//    so a tiler keeps the intermediates in tile memory,
+//  - derives load/store ops, layouts, subpass dependencies and the pipeline
+//    barriers between render passes and compute passes from the accesses.
+// Realize() creates the images at the given extent. Images that live inside
+// a single render pass are transient (lazily allocated where the device has
+// it); the others share memory whenever their lifetimes do not overlap.
+// Render passes only depend on formats, so pipelines created against them
+// survive a Realize() at a new extent.
+//
+// All graph images have the extent of the graph and are reused by every
+// frame in flight, like attachments of a render pass would be; frame start
+// waits for the previous frame's last accesses. Buffers are storage buffers
+// of a fixed size, never aliased. A buffer may have a copy per frame in
+// flight, SetFrame() selects the one recorded.
+//
+// AsyncCompute passes run on a compute queue of their own once
+// EnableAsyncCompute() was called, and as compute passes on the graphics queue
+// otherwise. They are recorded by ExecuteAsync(), each frame's submission of
+// it has to
+//  - wait for the previous frame's graphics submission when
+//    AsyncWaitsForPreviousFrame(): the async passes then reuse something the
+//    graphics queue may still read. With only per-frame buffers the frame's
+//    fence guarding the copy is enough, and a frame can be culled while the
+//    previous one renders.
+//  - be waited for by the same frame's graphics submission in
+//    AsyncWaitStages(), the stages that first read async results.
+// Async passes may consume each other's results but nothing the graphics queue
+// produced in the same frame, so declare them first. Resources used on both
+// queues are shared concurrently, they need no ownership transfers.
+class RenderGraph {
+public:
+	using Resource = uint32_t;
+
+	enum class PassType { Graphics, Compute, AsyncCompute };
+
+	enum class Access {
+		ColorAttachment,
+		DepthAttachment,
+		InputAttachment,
+		Sampled,
+		StorageRead,
+		StorageWrite,
+	};
+
+	struct PassContext {
+		VkCommandBuffer command_buffer;
+		// graphics passes only
+		VkRenderPass render_pass;
+		uint32_t subpass;
+		VkFramebuffer framebuffer;
+	};
+	using ExecuteFunction = std::function<void(const PassContext&)>;
+
+	class Pass {
+	public:
+		// `clear`: clear the attachment when its contents are not loaded
+		Pass& WriteColor(Resource resource, std::optional<VkClearValue> clear = std::nullopt);
+		Pass& WriteDepth(Resource resource, std::optional<VkClearValue> clear = std::nullopt);
+		// input attachments are numbered in the order they are declared
+		Pass& ReadInput(Resource resource);
+		Pass& ReadSampled(Resource resource);
+		Pass& ReadStorage(Resource resource);
+		Pass& WriteStorage(Resource resource);
+		// `secondary`: the subpass is recorded into secondary command buffers
+		// that `execute` runs with vkCmdExecuteCommands
+		Pass& SetExecute(ExecuteFunction execute, bool secondary = false);
+
+		const std::string& Name() const { return name; }
+		// valid after Compile()
+		bool Culled() const { return culled; }
+		VkRenderPass RenderPass() const { return render_pass; }
+		uint32_t Subpass() const { return subpass; }
+
+	private:
+		friend class RenderGraph;
+		struct Use {
+			Resource resource;
+			Access access;
+			std::optional<VkClearValue> clear;
+		};
+
+		Pass(std::string name, PassType type) : name(std::move(name)), type(type) {}
+		Pass& AddUse(Resource resource, Access access, std::optional<VkClearValue> clear);
+
+		std::string name;
+		PassType type;
+		std::vector<Use> uses;
+		ExecuteFunction execute;
+		bool secondary{ false };
+		bool culled{ false };
+		uint32_t step{ 0 };
+		VkRenderPass render_pass{ VK_NULL_HANDLE };
+		uint32_t subpass{ 0 };
+	};
+
+	struct Stats {
+		uint32_t passes = 0;
+		uint32_t culled_passes = 0;
+		uint32_t render_passes = 0;
+		uint32_t compute_passes = 0;	// on the graphics queue
+		uint32_t async_compute_passes = 0;
+		uint32_t image_barriers = 0;	// per frame, outside render passes, buffers included
+		uint32_t subpass_dependencies = 0;
+		uint32_t images = 0;
+		uint32_t transient_images = 0;
+		uint32_t buffers = 0;
+		uint32_t shared_resources = 0;	// used on both queues
+		VkDeviceSize image_bytes = 0;	// without aliasing, transient images excluded
+		VkDeviceSize aliased_bytes = 0;	// what was allocated for them
+	};
+
+	RenderGraph(VkPhysicalDevice physical_device, VkDevice device, MemoryAllocator& allocator);
+	RenderGraph(const RenderGraph&) = delete;
+	RenderGraph& operator=(const RenderGraph&) = delete;
+	~RenderGraph();
+
+	Resource CreateImage(const std::string& name, VkFormat format);
+	// an image owned elsewhere (the swapchain image) that the graph renders
+	// into; left in `final_layout`. Its contents are not loaded.
+	Resource ImportImage(const std::string& name, VkFormat format, VkImageLayout final_layout);
+	// the imported image to use from now on, e.g. the acquired swapchain image
+	void SetImportedImage(Resource resource, VkImage image, VkImageView view);
+	// only read and written as a storage buffer; with `copies`, frame i uses
+	// copy i % copies, which no other frame in flight touches
+	Resource CreateBuffer(const std::string& name, VkDeviceSize size, uint32_t copies = 1);
+
+	Pass& AddPass(const std::string& name, PassType type);
+	// before Compile(); the families may be the same for two queues of one family
+	void EnableAsyncCompute(uint32_t graphics_family, uint32_t compute_family);
+
+	void Compile();
+	void Realize(VkExtent2D extent);
+	// both record every pass of their queue that was not culled; Realize()
+	// must have run
+	void Execute(VkCommandBuffer command_buffer);
+	void ExecuteAsync(VkCommandBuffer command_buffer);
+	// the frame in flight the next Execute() and ExecuteAsync() record
+	void SetFrame(uint32_t frame) { this->frame = frame; }
+	bool HasAsyncWork() const { return stats.async_compute_passes != 0; }
+	VkPipelineStageFlags AsyncWaitStages() const { return async_wait_stages; }
+	// valid after Compile()
+	bool AsyncWaitsForPreviousFrame() const { return async_reuses_resources; }
+
+	VkImageView ImageView(Resource resource) const { return resources[resource].view; }
+	VkBuffer Buffer(Resource resource, uint32_t frame) const {
+		const auto& buffers = resources[resource].buffers;
+		return buffers[frame % buffers.size()];
+	}
+	Stats GetStats() const { return stats; }
+	void DumpStats(std::ostream& out) const;
+
+private:
+	struct State {
+		VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+		VkPipelineStageFlags stages = 0;
+		VkAccessFlags access = 0;
+	};
+
+	// an image, or a buffer when size is not 0
+	struct GraphResource {
+		std::string name;
+		VkFormat format;
+		VkImageAspectFlags aspect;
+		bool imported;
+		VkImageLayout final_layout;	// imported images
+		VkDeviceSize size{ 0 };
+		uint32_t copies{ 1 };	// buffers
+
+		// Compile()
+		VkImageUsageFlags usage{ 0 };
+		int first_step{ -1 };
+		int last_step{ -1 };
+		bool transient{ false };
+		bool async{ false };	// used on the async compute queue
+		bool shared{ false };	// and on the graphics queue
+		State frame_start;	// state at the start of every frame
+
+		// Realize(), or SetImportedImage()
+		VkImage image{ VK_NULL_HANDLE };
+		VkImageView view{ VK_NULL_HANDLE };
+		std::vector<VkBuffer> buffers;	// one per copy
+		VkMemoryRequirements requirements{};
+		Allocation memory;	// empty when aliased: the slot owns it
+		std::vector<Allocation> buffer_memory;
+	};
+
+	struct Barrier {
+		Resource resource;
+		State src;
+		State dst;
+	};
+
+	// one render pass (merged graphics passes) or one compute pass
+	struct Step {
+		PassType type;	// Graphics or Compute
+		bool async{ false };	// on the async compute queue
+		std::vector<Pass*> passes;
+		std::vector<Barrier> barriers;	// before the step
+		// memory handed over from the previous image in the same memory
+		VkPipelineStageFlags alias_src_stages{ 0 };
+		VkAccessFlags alias_src_access{ 0 };
+		VkPipelineStageFlags alias_dst_stages{ 0 };
+		VkAccessFlags alias_dst_access{ 0 };
+
+		VkRenderPass render_pass{ VK_NULL_HANDLE };
+		std::vector<Resource> attachments;
+		std::vector<VkClearValue> clear_values;
+		std::map<std::vector<VkImageView>, VkFramebuffer> framebuffers;
+	};
+
+	// images sharing one allocation, with disjoint lifetimes
+	struct AliasSlot {
+		VkDeviceSize size = 0;
+		VkDeviceSize alignment = 1;
+		uint32_t memory_type_bits = ~0u;
+		std::vector<Resource> resources;	// by first step
+		Allocation memory;
+	};
+
+	static State UseState(Access access, PassType type, VkImageAspectFlags aspect);
+	static bool IsWrite(Access access);
+	static bool IsAttachment(Access access);
+
+	void Cull();
+	void BuildSteps();
+	void BuildRenderPass(Step& step, std::vector<State>& states, std::vector<bool>& written);
+	void BuildComputeBarriers(Step& step, std::vector<State>& states, std::vector<bool>& written);
+	void HandOver(const Step& step, std::vector<State>& states, std::vector<int>& last_queue);
+	void ReleaseResources();
+	void ReleaseRenderPasses();
+	bool HasLazyMemory(uint32_t memory_type_bits) const;
+	// VkImageCreateInfo or VkBufferCreateInfo
+	template <typename CreateInfo>
+	void SetSharingMode(const GraphResource& resource, CreateInfo& create_info) const;
+	VkFramebuffer GetFramebuffer(Step& step);
+	void RecordStep(Step& step, VkCommandBuffer command_buffer);
+
+	VkPhysicalDevice vk_physical_device;
+	VkDevice vk_device;
+	MemoryAllocator& allocator;
+	VkPhysicalDeviceMemoryProperties vk_memory_properties;
+
+	std::vector<GraphResource> resources;
+	std::vector<std::unique_ptr<Pass>> passes;
+	std::vector<Step> steps;
+	std::vector<AliasSlot> alias_slots;
+	VkExtent2D extent{ 0, 0 };
+	bool compiled{ false };
+	bool async_enabled{ false };
+	uint32_t queue_families[2]{ 0, 0 };	// graphics, async compute
+	VkPipelineStageFlags async_wait_stages{ 0 };
+	bool async_reuses_resources{ false };	// async resources with a single copy
+	uint32_t frame{ 0 };
+	Stats stats;
+};
+
+#endif // !RENDER_GRAPH_H
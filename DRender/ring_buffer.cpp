@@ -0,0 +1,69 @@
+#include "ring_buffer.h"
+#include <cstring>
+#include <stdexcept>
+
+RingBuffer::RingBuffer(MemoryAllocator& allocator, VkDevice device, VkBufferUsageFlags usage,
+	VkDeviceSize frame_size, uint32_t frame_count)
+	: allocator(allocator), vk_device(device), frame_size(frame_size), frame_count(frame_count ? frame_count : 1) {
+	VkBufferCreateInfo buffer_create_info = {};
+	{
+		buffer_create_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+		buffer_create_info.size = frame_size * this->frame_count;
+		buffer_create_info.usage = usage;
+		buffer_create_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	}
+	if (vkCreateBuffer(vk_device, &buffer_create_info, nullptr, &vk_buffer) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to create ring buffer!");
+	}
+	try {
+		memory = allocator.AllocateForBuffer(vk_buffer, MemoryUsage::CpuToGpu);
+	} catch (...) {
+		vkDestroyBuffer(vk_device, vk_buffer, nullptr);
+		throw;
+	}
+}
+
+RingBuffer::~RingBuffer() {
+	vkDestroyBuffer(vk_device, vk_buffer, nullptr);
+	allocator.Free(memory);
+}
+
+void RingBuffer::BeginFrame(uint32_t frame) {
+	this->frame = frame % frame_count;
+	head = 0;
+	flushed = 0;
+}
+
+RingBuffer::Range RingBuffer::Allocate(VkDeviceSize size, VkDeviceSize alignment) {
+	if (alignment == 0) {
+		alignment = 1;
+	}
+	// region starts are not necessarily aligned, align the absolute offset
+	const VkDeviceSize base = frame * frame_size;
+	const VkDeviceSize offset = (base + head + alignment - 1) / alignment * alignment;
+	if (offset + size > base + frame_size) {
+		return Range();
+	}
+	head = offset + size - base;
+
+	Range range;
+	range.data = static_cast<unsigned char*>(memory.mapped) + offset;
+	range.offset = offset;
+	range.size = size;
+	return range;
+}
+
+RingBuffer::Range RingBuffer::Upload(const void* data, VkDeviceSize size, VkDeviceSize alignment) {
+	Range range = Allocate(size, alignment);
+	if (range) {
+		std::memcpy(range.data, data, static_cast<size_t>(size));
+	}
+	return range;
+}
+
+void RingBuffer::Flush() {
+	if (head > flushed) {
+		allocator.Flush(memory, frame * frame_size + flushed, head - flushed);
+		flushed = head;
+	}
+}
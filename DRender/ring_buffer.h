@@ -0,0 +1,53 @@
+#ifndef RING_BUFFER_H
+#define RING_BUFFER_H
+#include <vulkan/vulkan.h>
+#include "memory_allocator.h"
+
+#include <cstdint>
+
+// Linear allocator for per-frame data (uniforms, instance data, dynamic
+// vertices): one persistently mapped host visible buffer split into a region
+// per frame in flight. Each frame bump-allocates from its own region and the
+// whole region is recycled at once by BeginFrame(), so there is nothing to
+// free and no per-allocation bookkeeping. The caller must have waited on the
+// fence of the frame the region last belonged to.
+class RingBuffer {
+public:
+	struct Range {
+		void* data = nullptr;
+		VkDeviceSize offset = 0;	// into Buffer()
+		VkDeviceSize size = 0;
+		explicit operator bool() const { return data != nullptr; }
+	};
+
+	RingBuffer(MemoryAllocator& allocator, VkDevice device, VkBufferUsageFlags usage,
+		VkDeviceSize frame_size, uint32_t frame_count);
+	RingBuffer(const RingBuffer&) = delete;
+	RingBuffer& operator=(const RingBuffer&) = delete;
+	~RingBuffer();
+
+	VkBuffer Buffer() const { return vk_buffer; }
+
+	void BeginFrame(uint32_t frame);
+	// returns an empty range when the frame region is exhausted
+	Range Allocate(VkDeviceSize size, VkDeviceSize alignment);
+	Range Upload(const void* data, VkDeviceSize size, VkDeviceSize alignment);
+	// makes this frame's writes visible when the memory is not coherent
+	void Flush();
+
+	VkDeviceSize FrameSize() const { return frame_size; }
+	VkDeviceSize FrameUsed() const { return head; }
+
+private:
+	MemoryAllocator& allocator;
+	VkDevice vk_device;
+	VkBuffer vk_buffer{ VK_NULL_HANDLE };
+	Allocation memory;
+	VkDeviceSize frame_size;
+	uint32_t frame_count;
+	uint32_t frame{ 0 };
+	VkDeviceSize head{ 0 };
+	VkDeviceSize flushed{ 0 };
+};
+
+#endif // !RING_BUFFER_H
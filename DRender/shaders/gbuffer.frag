@@ -0,0 +1,30 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_EXT_nonuniform_qualifier : require
+
+layout(location = 0) in vec3 fragNormal;
+layout(location = 1) in vec3 fragAlbedo;
+layout(location = 2) in vec2 fragMaterial;
+layout(location = 3) in vec2 fragUv;
+
+// bindless table, see BindlessTable
+layout(set = 0, binding = 0) uniform sampler2D textures[];
+
+layout(push_constant) uniform PushConstants {
+    layout(offset = 80) ivec4 material;     // x: texture slot or -1, uniform per draw
+} pc;
+
+// G-buffer: stays in tile memory, read back by lighting.frag as input attachments
+layout(location = 0) out vec4 outAlbedo;     // rgb: albedo
+layout(location = 1) out vec4 outNormal;     // rgb: world normal * 0.5 + 0.5 (A2B10G10R10)
+layout(location = 2) out vec4 outMaterial;   // r: roughness, g: metalness
+
+void main() {
+    vec3 albedo = fragAlbedo;
+    if (pc.material.x >= 0) {
+        albedo *= texture(textures[pc.material.x], fragUv).rgb;
+    }
+    outAlbedo = vec4(albedo, 1.0);
+    outNormal = vec4(normalize(fragNormal) * 0.5 + 0.5, 0.0);
+    outMaterial = vec4(fragMaterial, 0.0, 0.0);
+}
@@ -0,0 +1,71 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+// Procedural scene: instance 0 is the floor, the others a grid of boxes of
+// varying height. Every instance is the same 36-vertex cube, built from
+// gl_VertexIndex, so the pass needs no vertex buffers.
+
+layout(push_constant) uniform PushConstants {
+    mat4 viewProj;
+    ivec4 grid;     // x: boxes per row, y: box spacing
+} pc;
+
+layout(location = 0) out vec3 fragNormal;
+layout(location = 1) out vec3 fragAlbedo;
+layout(location = 2) out vec2 fragMaterial;
+layout(location = 3) out vec2 fragUv;
+
+// per face: normal, u, v with cross(u, v) == normal
+const vec3 faces[18] = vec3[](
+    vec3( 1.0, 0.0, 0.0), vec3(0.0, 0.0, -1.0), vec3(0.0, 1.0,  0.0),
+    vec3(-1.0, 0.0, 0.0), vec3(0.0, 0.0,  1.0), vec3(0.0, 1.0,  0.0),
+    vec3( 0.0, 1.0, 0.0), vec3(1.0, 0.0,  0.0), vec3(0.0, 0.0, -1.0),
+    vec3( 0.0,-1.0, 0.0), vec3(1.0, 0.0,  0.0), vec3(0.0, 0.0,  1.0),
+    vec3( 0.0, 0.0, 1.0), vec3(1.0, 0.0,  0.0), vec3(0.0, 1.0,  0.0),
+    vec3( 0.0, 0.0,-1.0), vec3(-1.0, 0.0, 0.0), vec3(0.0, 1.0,  0.0)
+);
+
+// two counter-clockwise triangles per face
+const vec2 corners[6] = vec2[](
+    vec2(-1.0, -1.0), vec2(1.0, -1.0), vec2(1.0, 1.0),
+    vec2(-1.0, -1.0), vec2(1.0, 1.0), vec2(-1.0, 1.0)
+);
+
+float hash(uint x) {
+    x ^= x >> 16;
+    x *= 0x7feb352du;
+    x ^= x >> 15;
+    x *= 0x846ca68bu;
+    x ^= x >> 16;
+    return float(x) / 4294967295.0;
+}
+
+void main() {
+    int face = gl_VertexIndex / 6;
+    vec3 n = faces[face * 3];
+    vec2 c = corners[gl_VertexIndex % 6];
+    vec3 local = n + faces[face * 3 + 1] * c.x + faces[face * 3 + 2] * c.y;
+
+    float extent = 0.5 * float(pc.grid.x * pc.grid.y);
+    vec3 center;
+    vec3 halfSize;
+    if (gl_InstanceIndex == 0) {
+        center = vec3(0.0, -0.05, 0.0);
+        halfSize = vec3(extent + pc.grid.y, 0.05, extent + pc.grid.y);
+        fragAlbedo = vec3(0.55);
+        fragMaterial = vec2(0.8, 0.0);
+    } else {
+        uint box = uint(gl_InstanceIndex - 1);
+        float height = 0.25 + 2.0 * hash(box);
+        vec2 cell = vec2(box % uint(pc.grid.x), box / uint(pc.grid.x));
+        center = vec3((cell.x + 0.5) * pc.grid.y - extent, height, (cell.y + 0.5) * pc.grid.y - extent);
+        halfSize = vec3(0.4 * pc.grid.y, height, 0.4 * pc.grid.y);
+        fragAlbedo = vec3(hash(box + 101u), hash(box + 211u), hash(box + 307u)) * 0.8 + 0.2;
+        fragMaterial = vec2(0.2 + 0.7 * hash(box + 401u), step(0.75, hash(box + 503u)));
+    }
+
+    vec3 world = center + local * halfSize;
+    fragNormal = n;
+    fragUv = world.xz / float(4 * pc.grid.y);  // a texture repeat per 4x4 cells
+    gl_Position = pc.viewProj * vec4(world, 1.0);
+}
@@ -0,0 +1,94 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_EXT_nonuniform_qualifier : require
+
+// Lighting subpass: reads the G-buffer written by gbuffer.frag at the same
+// pixel, so its cost depends on the screen size and the lights, not on the
+// geometry that produced it. Only the lights light_cull.comp found for the
+// pixel's cluster are shaded.
+
+// bindless table, see BindlessTable
+layout(std430, set = 0, binding = 1) readonly buffer ClusterLights {
+    uint lightMasks[];
+} buffers[];
+
+layout(input_attachment_index = 0, set = 1, binding = 0) uniform subpassInput gAlbedo;
+layout(input_attachment_index = 1, set = 1, binding = 1) uniform subpassInput gNormal;
+layout(input_attachment_index = 2, set = 1, binding = 2) uniform subpassInput gMaterial;
+layout(input_attachment_index = 3, set = 1, binding = 3) uniform subpassInput gDepth;
+
+layout(push_constant) uniform PushConstants {
+    mat4 invViewProj;
+    vec4 cameraPos;
+    vec4 depthRange;    // x: near plane, y: far plane
+    uvec4 bindless;     // x: cluster lights slot
+} pc;
+
+layout(location = 0) in vec2 fragNdc;
+
+layout(location = 0) out vec4 outColor;
+
+// must match light_cull.comp
+const uvec3 CLUSTERS = uvec3(16, 9, 24);
+const int LIGHT_COUNT = 16;
+const float LIGHT_RANGE = 9.0;
+const float PI = 3.14159265;
+
+vec3 lightColor(int i) {
+    float hue = float(i) / float(LIGHT_COUNT);
+    return clamp(abs(fract(hue + vec3(0.0, 2.0, 1.0) / 3.0) * 6.0 - 3.0) - 1.0, 0.0, 1.0) * 4.0;
+}
+
+vec3 lightPosition(int i) {
+    float angle = 2.0 * PI * float(i) / float(LIGHT_COUNT);
+    float radius = (i & 1) == 0 ? 6.0 : 11.0;
+    return vec3(cos(angle) * radius, 1.5 + float(i & 3), sin(angle) * radius);
+}
+
+void main() {
+    float depth = subpassLoad(gDepth).r;
+    if (depth == 1.0) {
+        outColor = vec4(0.02, 0.02, 0.03, 1.0);
+        return;
+    }
+    vec4 world = pc.invViewProj * vec4(fragNdc, depth, 1.0);
+    vec3 position = world.xyz / world.w;
+
+    vec3 albedo = subpassLoad(gAlbedo).rgb;
+    vec3 n = normalize(subpassLoad(gNormal).xyz * 2.0 - 1.0);
+    vec2 material = subpassLoad(gMaterial).rg;
+    float roughness = max(material.r, 0.05);
+    float metalness = material.g;
+
+    vec3 v = normalize(pc.cameraPos.xyz - position);
+    vec3 diffuseColor = albedo * (1.0 - metalness);
+    vec3 specularColor = mix(vec3(0.04), albedo, metalness);
+    // Blinn-Phong with a roughness-derived exponent, normalized
+    float shininess = 2.0 / (roughness * roughness * roughness * roughness) - 2.0;
+
+    // the pixel's cluster: its screen tile and the exponential slice of its
+    // view depth
+    float near = pc.depthRange.x;
+    float far = pc.depthRange.y;
+    float viewDepth = far * near / (far - depth * (far - near));
+    uvec2 tile = min(uvec2((fragNdc * 0.5 + 0.5) * vec2(CLUSTERS.xy)), CLUSTERS.xy - 1u);
+    uint slice = min(uint(max(log(viewDepth / near) / log(far / near), 0.0) * float(CLUSTERS.z)), CLUSTERS.z - 1u);
+    uint mask = buffers[pc.bindless.x].lightMasks[(slice * CLUSTERS.y + tile.y) * CLUSTERS.x + tile.x];
+
+    vec3 color = albedo * 0.03;
+    while (mask != 0u) {
+        int i = findLSB(mask);
+        mask &= mask - 1u;
+        vec3 toLight = lightPosition(i) - position;
+        float distance = length(toLight);
+        if (distance > LIGHT_RANGE) continue;
+        vec3 l = toLight / distance;
+        float nl = max(dot(n, l), 0.0);
+        float falloff = clamp(1.0 - pow(distance / LIGHT_RANGE, 4.0), 0.0, 1.0);
+        float attenuation = falloff * falloff / (distance * distance + 1.0);
+        vec3 h = normalize(l + v);
+        float specular = (shininess + 8.0) / (8.0 * PI) * pow(max(dot(n, h), 0.0), shininess);
+        color += (diffuseColor / PI + specularColor * specular) * lightColor(i) * nl * attenuation;
+    }
+    outColor = vec4(pow(color, vec3(1.0 / 2.2)), 1.0);
+}
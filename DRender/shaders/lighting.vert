@@ -0,0 +1,11 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+layout(location = 0) out vec2 fragNdc;
+
+// one triangle covering the screen
+void main() {
+    vec2 ndc = vec2((gl_VertexIndex << 1) & 2, gl_VertexIndex & 2) * 2.0 - 1.0;
+    fragNdc = ndc;
+    gl_Position = vec4(ndc, 0.0, 1.0);
+}
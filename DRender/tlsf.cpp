@@ -0,0 +1,246 @@
+#include "tlsf.h"
+#include <algorithm>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace {
+uint32_t LowestBit(uint64_t x) {
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanForward64(&index, x);
+	return index;
+#else
+	return __builtin_ctzll(x);
+#endif
+}
+
+uint32_t HighestBit(uint64_t x) {
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanReverse64(&index, x);
+	return index;
+#else
+	return 63 - __builtin_clzll(x);
+#endif
+}
+
+uint64_t AlignUp(uint64_t value, uint64_t alignment) {
+	return (value + alignment - 1) / alignment * alignment;
+}
+} // namespace
+
+Tlsf::Tlsf(uint64_t size) : size(size / kGranularity * kGranularity) {
+	for (auto& heads : free_heads) {
+		std::fill(std::begin(heads), std::end(heads), kInvalidNode);
+	}
+	if (this->size == 0) {
+		return;
+	}
+	first_node = NewNode();
+	nodes[first_node].size = this->size;
+	InsertFree(first_node);
+}
+
+void Tlsf::Mapping(uint64_t size, uint32_t& first, uint32_t& second) {
+	if (size < kSmallSize) {
+		first = 0;
+		second = static_cast<uint32_t>(size / kGranularity);
+	} else {
+		const uint32_t msb = HighestBit(size);
+		first = msb - kSmallSizeLog2 + 1;
+		second = static_cast<uint32_t>(size >> (msb - kSecondLevelLog2)) - kSecondLevelCount;
+	}
+}
+
+uint32_t Tlsf::NewNode() {
+	if (!unused_nodes.empty()) {
+		uint32_t node = unused_nodes.back();
+		unused_nodes.pop_back();
+		return node;
+	}
+	nodes.emplace_back();
+	return static_cast<uint32_t>(nodes.size() - 1);
+}
+
+void Tlsf::ReleaseNode(uint32_t node) {
+	nodes[node] = Node();
+	unused_nodes.push_back(node);
+}
+
+void Tlsf::InsertFree(uint32_t node) {
+	uint32_t first, second;
+	Mapping(nodes[node].size, first, second);
+	Node& n = nodes[node];
+	n.free = true;
+	n.prev_free = kInvalidNode;
+	n.next_free = free_heads[first][second];
+	if (n.next_free != kInvalidNode) {
+		nodes[n.next_free].prev_free = node;
+	}
+	free_heads[first][second] = node;
+	first_level_bitmap |= 1ull << first;
+	second_level_bitmaps[first] |= 1u << second;
+}
+
+void Tlsf::RemoveFree(uint32_t node) {
+	uint32_t first, second;
+	Mapping(nodes[node].size, first, second);
+	Node& n = nodes[node];
+	if (n.prev_free != kInvalidNode) {
+		nodes[n.prev_free].next_free = n.next_free;
+	} else {
+		free_heads[first][second] = n.next_free;
+		if (n.next_free == kInvalidNode) {
+			second_level_bitmaps[first] &= ~(1u << second);
+			if (!second_level_bitmaps[first]) {
+				first_level_bitmap &= ~(1ull << first);
+			}
+		}
+	}
+	if (n.next_free != kInvalidNode) {
+		nodes[n.next_free].prev_free = n.prev_free;
+	}
+	n.prev_free = n.next_free = kInvalidNode;
+	n.free = false;
+}
+
+uint32_t Tlsf::FindFree(uint64_t size) const {
+	// round up to the next bin so any region found is large enough
+	if (size >= kSmallSize) {
+		const uint64_t rounded = size + (1ull << (HighestBit(size) - kSecondLevelLog2)) - 1;
+		if (rounded < size) {
+			return kInvalidNode;
+		}
+		size = rounded;
+	}
+	uint32_t first, second;
+	Mapping(size, first, second);
+	if (first >= kFirstLevelCount) {
+		return kInvalidNode;
+	}
+
+	uint32_t second_map = second_level_bitmaps[first] & (~0u << second);
+	if (!second_map) {
+		const uint64_t first_map = first + 1 < 64 ? first_level_bitmap & (~0ull << (first + 1)) : 0;
+		if (!first_map) {
+			return kInvalidNode;
+		}
+		first = LowestBit(first_map);
+		second_map = second_level_bitmaps[first];
+	}
+	return free_heads[first][LowestBit(second_map)];
+}
+
+uint32_t Tlsf::FindFreeInBin(uint64_t size) const {
+	uint32_t first, second;
+	Mapping(size, first, second);
+	for (uint32_t node = free_heads[first][second]; node != kInvalidNode; node = nodes[node].next_free) {
+		if (nodes[node].size >= size) {
+			return node;
+		}
+	}
+	return kInvalidNode;
+}
+
+void Tlsf::SplitTail(uint32_t node, uint64_t size) {
+	if (nodes[node].size <= size) {
+		return;
+	}
+	const uint32_t tail = NewNode();
+	Node& n = nodes[node];
+	Node& t = nodes[tail];
+	t.offset = n.offset + size;
+	t.size = n.size - size;
+	t.prev_physical = node;
+	t.next_physical = n.next_physical;
+	if (t.next_physical != kInvalidNode) {
+		nodes[t.next_physical].prev_physical = tail;
+	}
+	n.next_physical = tail;
+	n.size = size;
+	InsertFree(tail);
+}
+
+Tlsf::Allocation Tlsf::Allocate(uint64_t size, uint64_t alignment) {
+	size = std::max(AlignUp(size, kGranularity), kGranularity);
+	alignment = std::max(alignment, kGranularity);
+	// offsets are granularity-aligned already, larger alignments may need padding
+	const uint64_t padding_bound = alignment - kGranularity;
+	uint32_t node = FindFree(size + padding_bound);
+	if (node == kInvalidNode) {
+		node = FindFreeInBin(size + padding_bound);
+		if (node == kInvalidNode) {
+			return Allocation();
+		}
+	}
+	RemoveFree(node);
+
+	const uint64_t padding = AlignUp(nodes[node].offset, alignment) - nodes[node].offset;
+	if (padding) {
+		// the previous physical node is in use (free neighbours are always
+		// merged), so the padding becomes a free node of its own
+		const uint32_t front = NewNode();
+		Node& n = nodes[node];
+		Node& f = nodes[front];
+		f.offset = n.offset;
+		f.size = padding;
+		f.prev_physical = n.prev_physical;
+		f.next_physical = node;
+		if (f.prev_physical != kInvalidNode) {
+			nodes[f.prev_physical].next_physical = front;
+		} else {
+			first_node = front;
+		}
+		n.prev_physical = front;
+		n.offset += padding;
+		n.size -= padding;
+		InsertFree(front);
+	}
+	SplitTail(node, size);
+
+	used += size;
+	++allocation_count;
+	return Allocation{ nodes[node].offset, size, node };
+}
+
+void Tlsf::Free(uint32_t node) {
+	used -= nodes[node].size;
+	--allocation_count;
+
+	const uint32_t next = nodes[node].next_physical;
+	if (next != kInvalidNode && nodes[next].free) {
+		RemoveFree(next);
+		nodes[node].size += nodes[next].size;
+		nodes[node].next_physical = nodes[next].next_physical;
+		if (nodes[node].next_physical != kInvalidNode) {
+			nodes[nodes[node].next_physical].prev_physical = node;
+		}
+		ReleaseNode(next);
+	}
+	const uint32_t prev = nodes[node].prev_physical;
+	if (prev != kInvalidNode && nodes[prev].free) {
+		RemoveFree(prev);
+		nodes[prev].size += nodes[node].size;
+		nodes[prev].next_physical = nodes[node].next_physical;
+		if (nodes[prev].next_physical != kInvalidNode) {
+			nodes[nodes[prev].next_physical].prev_physical = prev;
+		}
+		ReleaseNode(node);
+		node = prev;
+	}
+	InsertFree(node);
+}
+
+Tlsf::Stats Tlsf::GetStats() const {
+	Stats stats;
+	stats.used = used;
+	stats.allocations = allocation_count;
+	for (uint32_t node = first_node; node != kInvalidNode; node = nodes[node].next_physical) {
+		if (nodes[node].free) {
+			++stats.free_regions;
+			stats.largest_free_region = std::max(stats.largest_free_region, nodes[node].size);
+		}
+	}
+	return stats;
+}
@@ -0,0 +1,96 @@
+#ifndef TLSF_H
+#define TLSF_H
+#include <cstdint>
+#include <vector>
+
+// Two-level segregated fit sub-allocator over an abstract range [0, size).
+// Free regions are binned by size class (a power of two, split linearly into
+// kSecondLevelCount bins), two bitmaps find the first non-empty bin that is
+// guaranteed to fit, so Allocate() and Free() are O(1) regardless of
+// fragmentation. Neighbouring free regions are merged on Free(). Knows
+// nothing about Vulkan: the owner maps offsets into its memory block.
+class Tlsf {
+public:
+	static constexpr uint32_t kInvalidNode = ~0u;
+
+	struct Allocation {
+		uint64_t offset = 0;
+		uint64_t size = 0;
+		uint32_t node = kInvalidNode;
+		explicit operator bool() const { return node != kInvalidNode; }
+	};
+
+	struct Stats {
+		uint64_t used = 0;
+		uint32_t allocations = 0;
+		uint32_t free_regions = 0;
+		uint64_t largest_free_region = 0;
+	};
+
+	explicit Tlsf(uint64_t size);
+
+	// returns an empty allocation when no free region fits
+	Allocation Allocate(uint64_t size, uint64_t alignment);
+	void Free(uint32_t node);
+
+	uint64_t Size() const { return size; }
+	uint64_t Used() const { return used; }
+	uint32_t AllocationCount() const { return allocation_count; }
+	bool Empty() const { return allocation_count == 0; }
+	Stats GetStats() const;
+
+	// visits every live allocation in address order
+	template <typename F>
+	void ForEachAllocation(F&& f) const {
+		for (uint32_t node = first_node; node != kInvalidNode; node = nodes[node].next_physical) {
+			if (!nodes[node].free) f(Allocation{ nodes[node].offset, nodes[node].size, node });
+		}
+	}
+
+private:
+	static constexpr uint32_t kSecondLevelLog2 = 5;
+	static constexpr uint32_t kSecondLevelCount = 1u << kSecondLevelLog2;
+	// below this size the first level is linear instead of logarithmic
+	static constexpr uint32_t kSmallSizeLog2 = 8;
+	static constexpr uint64_t kSmallSize = 1ull << kSmallSizeLog2;
+	static constexpr uint32_t kFirstLevelCount = 64 - kSmallSizeLog2 + 1;
+	// sizes and offsets are kept multiples of this
+	static constexpr uint64_t kGranularity = kSmallSize / kSecondLevelCount;
+
+	struct Node {
+		uint64_t offset = 0;
+		uint64_t size = 0;
+		uint32_t prev_physical = kInvalidNode;
+		uint32_t next_physical = kInvalidNode;
+		uint32_t prev_free = kInvalidNode;
+		uint32_t next_free = kInvalidNode;
+		bool free = false;
+	};
+
+	static void Mapping(uint64_t size, uint32_t& first, uint32_t& second);
+
+	uint32_t NewNode();
+	void ReleaseNode(uint32_t node);
+	void InsertFree(uint32_t node);
+	void RemoveFree(uint32_t node);
+	// free node of at least `size` bytes, or kInvalidNode
+	uint32_t FindFree(uint64_t size) const;
+	// FindFree() skips the bin `size` falls into, which may still hold a node
+	// that fits (the only one when a block is sized for a single allocation)
+	uint32_t FindFreeInBin(uint64_t size) const;
+	// splits the tail off `node` past `size` bytes as a new free node
+	void SplitTail(uint32_t node, uint64_t size);
+
+	uint64_t size;
+	uint64_t used = 0;
+	uint32_t allocation_count = 0;
+	uint32_t first_node = kInvalidNode;
+
+	std::vector<Node> nodes;
+	std::vector<uint32_t> unused_nodes;
+	uint64_t first_level_bitmap = 0;
+	uint32_t second_level_bitmaps[kFirstLevelCount] = {};
+	uint32_t free_heads[kFirstLevelCount][kSecondLevelCount];
+};
+
+#endif // !TLSF_H
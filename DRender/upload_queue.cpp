@@ -0,0 +1,370 @@
+#include "upload_queue.h"
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+
+namespace {
+// copy offsets into the staging buffer: 4 for buffers, a multiple of every
+// supported texel size for images
+const VkDeviceSize kBufferCopyAlignment = 4;
+const VkDeviceSize kImageCopyAlignment = 16;
+
+VkDeviceSize AlignUp(VkDeviceSize value, VkDeviceSize alignment) {
+	return (value + alignment - 1) / alignment * alignment;
+}
+} // namespace
+
+UploadQueue::UploadQueue(MemoryAllocator& allocator, VkDevice device, VkQueue transfer_queue, uint32_t transfer_family,
+	uint32_t graphics_family, VkExtent3D image_granularity, VkDeviceSize slot_size, uint32_t slot_count)
+	: allocator(allocator), vk_device(device), vk_transfer_queue(transfer_queue), transfer_family(transfer_family), graphics_family(graphics_family),
+	row_granularity(image_granularity.height),
+	staging(allocator, device, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, AlignUp(slot_size, kImageCopyAlignment), slot_count ? slot_count : 1) {
+	slots.resize(slot_count ? slot_count : 1);
+	for (auto& slot : slots) {
+		VkCommandPoolCreateInfo command_pool_create_info = {};
+		command_pool_create_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+		command_pool_create_info.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+		command_pool_create_info.queueFamilyIndex = transfer_family;
+		if (vkCreateCommandPool(vk_device, &command_pool_create_info, nullptr, &slot.pool) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to create transfer command pool!");
+		}
+		VkCommandBufferAllocateInfo command_buffer_alloc_info = {};
+		command_buffer_alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		command_buffer_alloc_info.commandPool = slot.pool;
+		command_buffer_alloc_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		command_buffer_alloc_info.commandBufferCount = 1;
+		if (vkAllocateCommandBuffers(vk_device, &command_buffer_alloc_info, &slot.command_buffer) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to allocate transfer command buffer!");
+		}
+	}
+
+	VkSemaphoreTypeCreateInfo semaphore_type_create_info = {};
+	semaphore_type_create_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+	semaphore_type_create_info.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+	semaphore_type_create_info.initialValue = 0;
+	VkSemaphoreCreateInfo semaphore_create_info = {};
+	semaphore_create_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+	semaphore_create_info.pNext = &semaphore_type_create_info;
+	if (vkCreateSemaphore(vk_device, &semaphore_create_info, nullptr, &vk_semaphore) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to create upload timeline semaphore!");
+	}
+}
+
+UploadQueue::~UploadQueue() {
+	WaitIdle();
+	FreeOneOffStaging(std::numeric_limits<uint64_t>::max());
+	for (auto& slot : slots) {
+		vkDestroyCommandPool(vk_device, slot.pool, nullptr);
+	}
+	vkDestroySemaphore(vk_device, vk_semaphore, nullptr);
+}
+
+uint64_t UploadQueue::EnqueueBuffer(VkBuffer buffer, VkDeviceSize offset, std::vector<unsigned char> data,
+	VkPipelineStageFlags dst_stages, VkAccessFlags dst_access) {
+	Request request = {};
+	request.ticket = next_ticket++;
+	request.buffer = buffer;
+	request.buffer_offset = offset;
+	request.dst_stages = dst_stages;
+	request.dst_access = dst_access;
+	request.size = data.size();
+	request.data = std::move(data);
+	requests.push_back(std::move(request));
+	return requests.back().ticket;
+}
+
+uint64_t UploadQueue::EnqueueImage(VkImage image, VkExtent2D extent, VkImageAspectFlags aspect, std::vector<unsigned char> data,
+	VkImageLayout layout, VkPipelineStageFlags dst_stages, VkAccessFlags dst_access) {
+	if (extent.height == 0 || data.size() % extent.height != 0) {
+		throw std::runtime_error("UploadQueue: image data is not a whole number of rows");
+	}
+	// the smallest piece that can be copied on its own has to fit a slot,
+	// otherwise the image is staged on its own
+	const VkDeviceSize row_size = data.size() / extent.height;
+	const VkDeviceSize chunk_size = row_granularity ? row_size * row_granularity : data.size();
+	Request request = {};
+	request.one_off = std::min<VkDeviceSize>(chunk_size, data.size()) > staging.FrameSize();
+	request.ticket = next_ticket++;
+	request.image = image;
+	request.extent = extent;
+	request.aspect = aspect;
+	request.layout = layout;
+	request.dst_stages = dst_stages;
+	request.dst_access = dst_access;
+	request.size = data.size();
+	request.data = std::move(data);
+	requests.push_back(std::move(request));
+	return requests.back().ticket;
+}
+
+uint64_t UploadQueue::CompletedValue() const {
+	uint64_t value = 0;
+	vkGetSemaphoreCounterValue(vk_device, vk_semaphore, &value);
+	return value;
+}
+
+void UploadQueue::Pump() {
+	if (!one_off_staging.empty()) {
+		FreeOneOffStaging(CompletedValue());
+	}
+	if (requests.empty()) {
+		return;
+	}
+	Slot& slot = slots[next_slot];
+	if (slot.value > CompletedValue()) {
+		// the slot's staging memory is still being read, try again next frame
+		return;
+	}
+
+	vkResetCommandPool(vk_device, slot.pool, 0);
+	VkCommandBufferBeginInfo cb_begin_info = {};
+	cb_begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	cb_begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+	if (vkBeginCommandBuffer(slot.command_buffer, &cb_begin_info) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to begin recording transfer command buffer!");
+	}
+	staging.BeginFrame(next_slot);
+	const uint64_t value = timeline_value + 1;
+	while (!requests.empty() && RecordCopies(requests.front(), slot.command_buffer)) {
+		const Request& request = requests.front();
+		RecordRelease(request, slot.command_buffer);
+		released.push_back(Release{ request.ticket, value, request.buffer, request.buffer_offset, request.size,
+			request.image, request.aspect, request.layout, request.dst_stages, request.dst_access });
+		requests.pop_front();
+	}
+	staging.Flush();
+	if (vkEndCommandBuffer(slot.command_buffer) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to record transfer command buffer!");
+	}
+
+	VkTimelineSemaphoreSubmitInfo timeline_submit_info = {};
+	timeline_submit_info.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+	timeline_submit_info.signalSemaphoreValueCount = 1;
+	timeline_submit_info.pSignalSemaphoreValues = &value;
+	VkSubmitInfo submit_info = {};
+	submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submit_info.pNext = &timeline_submit_info;
+	submit_info.commandBufferCount = 1;
+	submit_info.pCommandBuffers = &slot.command_buffer;
+	submit_info.signalSemaphoreCount = 1;
+	submit_info.pSignalSemaphores = &vk_semaphore;
+	if (vkQueueSubmit(vk_transfer_queue, 1, &submit_info, VK_NULL_HANDLE) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to submit transfer command buffer!");
+	}
+	timeline_value = value;
+	slot.value = value;
+	next_slot = (next_slot + 1) % static_cast<uint32_t>(slots.size());
+}
+
+bool UploadQueue::RecordCopies(Request& request, VkCommandBuffer command_buffer) {
+	if (request.image && !request.started) {
+		VkImageMemoryBarrier barrier = {};
+		barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		barrier.srcAccessMask = 0;
+		barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.image = request.image;
+		barrier.subresourceRange = { request.aspect, 0, 1, 0, 1 };
+		vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+			0, nullptr, 0, nullptr, 1, &barrier);
+	}
+	request.started = true;
+	if (request.one_off) {
+		RecordOneOffCopy(request, command_buffer);
+		return true;
+	}
+
+	const VkDeviceSize alignment = request.image ? kImageCopyAlignment : kBufferCopyAlignment;
+	while (request.copied < request.size) {
+		const VkDeviceSize used = AlignUp(staging.FrameUsed(), alignment);
+		const VkDeviceSize available = used < staging.FrameSize() ? staging.FrameSize() - used : 0;
+		VkDeviceSize size = std::min(request.size - request.copied, available);
+		uint32_t first_row = 0, rows = 0;
+		if (request.image) {
+			// whole rows, starting on the transfer granularity unless it is the last chunk
+			const VkDeviceSize row_size = request.size / request.extent.height;
+			first_row = static_cast<uint32_t>(request.copied / row_size);
+			const uint32_t remaining_rows = request.extent.height - first_row;
+			rows = static_cast<uint32_t>(std::min<VkDeviceSize>(size / row_size, remaining_rows));
+			if (rows < remaining_rows) {
+				rows = row_granularity ? rows / row_granularity * row_granularity : 0;
+			}
+			size = rows * row_size;
+		}
+		if (size == 0) {
+			return false;
+		}
+		const RingBuffer::Range range = staging.Upload(request.data.data() + request.copied, size, alignment);
+		if (!range) {
+			return false;
+		}
+
+		if (request.image) {
+			VkBufferImageCopy region = {};
+			region.bufferOffset = range.offset;
+			region.imageSubresource = { request.aspect, 0, 0, 1 };
+			region.imageOffset = { 0, static_cast<int32_t>(first_row), 0 };
+			region.imageExtent = { request.extent.width, rows, 1 };
+			vkCmdCopyBufferToImage(command_buffer, staging.Buffer(), request.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+		} else {
+			VkBufferCopy region = {};
+			region.srcOffset = range.offset;
+			region.dstOffset = request.buffer_offset + request.copied;
+			region.size = size;
+			vkCmdCopyBuffer(command_buffer, staging.Buffer(), request.buffer, 1, &region);
+		}
+		request.copied += size;
+		uploaded_bytes += size;
+	}
+	// the CPU copy is no longer needed
+	std::vector<unsigned char>().swap(request.data);
+	return true;
+}
+
+void UploadQueue::RecordOneOffCopy(Request& request, VkCommandBuffer command_buffer) {
+	OneOffStaging one_off = {};
+	VkBufferCreateInfo buffer_create_info = {};
+	{
+		buffer_create_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+		buffer_create_info.size = request.size;
+		buffer_create_info.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+		buffer_create_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	}
+	if (vkCreateBuffer(vk_device, &buffer_create_info, nullptr, &one_off.buffer) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to create one-off staging buffer!");
+	}
+	try {
+		one_off.memory = allocator.AllocateForBuffer(one_off.buffer, MemoryUsage::CpuToGpu);
+	} catch (...) {
+		vkDestroyBuffer(vk_device, one_off.buffer, nullptr);
+		throw;
+	}
+	std::memcpy(one_off.memory.mapped, request.data.data(), request.size);
+	allocator.Flush(one_off.memory);
+
+	VkBufferImageCopy region = {};
+	region.bufferOffset = 0;
+	region.imageSubresource = { request.aspect, 0, 0, 1 };
+	region.imageOffset = { 0, 0, 0 };
+	region.imageExtent = { request.extent.width, request.extent.height, 1 };
+	vkCmdCopyBufferToImage(command_buffer, one_off.buffer, request.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+
+	// recorded into the submission Pump() is about to make
+	one_off.value = timeline_value + 1;
+	one_off_staging.push_back(one_off);
+	request.copied = request.size;
+	uploaded_bytes += request.size;
+	std::vector<unsigned char>().swap(request.data);
+}
+
+void UploadQueue::FreeOneOffStaging(uint64_t completed) {
+	while (!one_off_staging.empty() && one_off_staging.front().value <= completed) {
+		OneOffStaging& one_off = one_off_staging.front();
+		vkDestroyBuffer(vk_device, one_off.buffer, nullptr);
+		allocator.Free(one_off.memory);
+		one_off_staging.pop_front();
+	}
+}
+
+void UploadQueue::RecordRelease(const Request& request, VkCommandBuffer command_buffer) {
+	// same family: a plain barrier into the graphics stages, the semaphore
+	// orders the submissions. Otherwise the first half of the ownership
+	// transfer; RecordAcquires() records the second.
+	const bool transfer = OwnershipTransfer();
+	const VkPipelineStageFlags dst_stages = transfer ? static_cast<VkPipelineStageFlags>(VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT) : request.dst_stages;
+	const VkAccessFlags dst_access = transfer ? 0 : request.dst_access;
+	const uint32_t src_family = transfer ? transfer_family : VK_QUEUE_FAMILY_IGNORED;
+	const uint32_t dst_family = transfer ? graphics_family : VK_QUEUE_FAMILY_IGNORED;
+	if (request.image) {
+		VkImageMemoryBarrier barrier = {};
+		barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = dst_access;
+		barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		barrier.newLayout = request.layout;
+		barrier.srcQueueFamilyIndex = src_family;
+		barrier.dstQueueFamilyIndex = dst_family;
+		barrier.image = request.image;
+		barrier.subresourceRange = { request.aspect, 0, 1, 0, 1 };
+		vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, dst_stages, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+	} else {
+		VkBufferMemoryBarrier barrier = {};
+		barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = dst_access;
+		barrier.srcQueueFamilyIndex = src_family;
+		barrier.dstQueueFamilyIndex = dst_family;
+		barrier.buffer = request.buffer;
+		barrier.offset = request.buffer_offset;
+		barrier.size = request.size;
+		vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, dst_stages, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+	}
+}
+
+UploadQueue::Wait UploadQueue::RecordAcquires(VkCommandBuffer command_buffer) {
+	Wait wait;
+	if (released.empty()) {
+		return wait;
+	}
+	const uint64_t completed = CompletedValue();
+	std::vector<VkImageMemoryBarrier> image_barriers;
+	std::vector<VkBufferMemoryBarrier> buffer_barriers;
+	while (!released.empty() && released.front().value <= completed) {
+		const Release& release = released.front();
+		if (OwnershipTransfer()) {
+			// must match the release but for the access masks
+			if (release.image) {
+				VkImageMemoryBarrier barrier = {};
+				barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+				barrier.srcAccessMask = 0;
+				barrier.dstAccessMask = release.dst_access;
+				barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+				barrier.newLayout = release.layout;
+				barrier.srcQueueFamilyIndex = transfer_family;
+				barrier.dstQueueFamilyIndex = graphics_family;
+				barrier.image = release.image;
+				barrier.subresourceRange = { release.aspect, 0, 1, 0, 1 };
+				image_barriers.push_back(barrier);
+			} else {
+				VkBufferMemoryBarrier barrier = {};
+				barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+				barrier.srcAccessMask = 0;
+				barrier.dstAccessMask = release.dst_access;
+				barrier.srcQueueFamilyIndex = transfer_family;
+				barrier.dstQueueFamilyIndex = graphics_family;
+				barrier.buffer = release.buffer;
+				barrier.offset = release.buffer_offset;
+				barrier.size = release.size;
+				buffer_barriers.push_back(barrier);
+			}
+		}
+		wait.value = std::max(wait.value, release.value);
+		wait.stages |= release.dst_stages;
+		acquired_tickets = release.ticket;
+		released.pop_front();
+	}
+	if (!image_barriers.empty() || !buffer_barriers.empty()) {
+		// the submission waits on the semaphore in wait.stages, which chains
+		// into these barriers
+		vkCmdPipelineBarrier(command_buffer, wait.stages, wait.stages, 0,
+			0, nullptr, static_cast<uint32_t>(buffer_barriers.size()), buffer_barriers.data(),
+			static_cast<uint32_t>(image_barriers.size()), image_barriers.data());
+	}
+	return wait;
+}
+
+void UploadQueue::WaitIdle() {
+	if (timeline_value == 0) {
+		return;
+	}
+	VkSemaphoreWaitInfo wait_info = {};
+	wait_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+	wait_info.semaphoreCount = 1;
+	wait_info.pSemaphores = &vk_semaphore;
+	wait_info.pValues = &timeline_value;
+	vkWaitSemaphores(vk_device, &wait_info, std::numeric_limits<uint64_t>::max());
+}
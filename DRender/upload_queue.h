@@ -0,0 +1,150 @@
+#ifndef UPLOAD_QUEUE_H
+#define UPLOAD_QUEUE_H
+#include <vulkan/vulkan.h>
+#include "memory_allocator.h"
+#include "ring_buffer.h"
+
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+// Streams buffer and image contents to the GPU on a transfer queue, so asset
+// loads never take time on the graphics queue or block a frame.
+//
+// Enqueued data is kept on the CPU until Pump() finds room for it in a
+// persistently mapped staging ring. The ring is split into slots; each Pump()
+// fills one slot, records the copies into that slot's command buffer and
+// submits them, signaling the next value of a timeline semaphore. A slot is
+// only refilled once the semaphore has passed its value, and Pump() skips a
+// turn instead of waiting, so large uploads trickle through a few slots per
+// frame. Uploads larger than a slot are split into chunks (whole rows for
+// images).
+//
+// Image chunks must start on the transfer family's
+// minImageTransferGranularity. A granularity of (0,0,0), which dedicated
+// transfer families often report, only allows whole mips to be copied. An
+// image whose mip (or whose granularity of rows) does not fit a slot then
+// gets a one-off staging buffer of its own. It is copied in one submission,
+// and the buffer is freed once that submission completes.
+//
+// When the transfer queue is of another family than the graphics queue the
+// resources are released by the transfer queue and acquired by the graphics
+// queue. RecordAcquires() records the acquire barriers for every upload whose
+// copies have completed into a graphics command buffer, and returns the
+// semaphore value that command buffer's submission has to wait for. It never
+// returns an upload that is still in flight, so that wait never stalls.
+class UploadQueue {
+public:
+	// timeline value (and the stages to wait in) for a graphics submission
+	struct Wait {
+		uint64_t value = 0;
+		VkPipelineStageFlags stages = 0;
+		explicit operator bool() const { return value != 0; }
+	};
+
+	// the staging ring holds `slot_count` slots of `slot_size` bytes.
+	// `image_granularity`: minImageTransferGranularity of the transfer family,
+	// image chunks start at multiples of its height, (0,0,0) copies whole mips
+	UploadQueue(MemoryAllocator& allocator, VkDevice device, VkQueue transfer_queue, uint32_t transfer_family,
+		uint32_t graphics_family, VkExtent3D image_granularity, VkDeviceSize slot_size, uint32_t slot_count);
+	UploadQueue(const UploadQueue&) = delete;
+	UploadQueue& operator=(const UploadQueue&) = delete;
+	~UploadQueue();
+
+	// `dst_stages`/`dst_access`: how the graphics queue uses the resource.
+	// Both return a ticket for IsReady().
+	uint64_t EnqueueBuffer(VkBuffer buffer, VkDeviceSize offset, std::vector<unsigned char> data,
+		VkPipelineStageFlags dst_stages, VkAccessFlags dst_access);
+	// mip 0, layer 0 of a 2D image in VK_IMAGE_LAYOUT_UNDEFINED, tightly packed
+	// rows of texels of at most 16 bytes and a power of two; left in `layout`
+	uint64_t EnqueueImage(VkImage image, VkExtent2D extent, VkImageAspectFlags aspect, std::vector<unsigned char> data,
+		VkImageLayout layout, VkPipelineStageFlags dst_stages, VkAccessFlags dst_access);
+
+	// once per frame, never waits
+	void Pump();
+	Wait RecordAcquires(VkCommandBuffer command_buffer);
+	// the upload was acquired by a command buffer recorded by RecordAcquires()
+	bool IsReady(uint64_t ticket) const { return ticket <= acquired_tickets; }
+	bool Idle() const { return requests.empty() && released.empty(); }
+
+	VkSemaphore Semaphore() const { return vk_semaphore; }
+	// blocks until everything submitted so far has been copied
+	void WaitIdle();
+
+	uint64_t UploadedBytes() const { return uploaded_bytes; }
+	uint64_t Submissions() const { return timeline_value; }
+
+private:
+	struct Request {
+		uint64_t ticket;
+		VkBuffer buffer;
+		VkDeviceSize buffer_offset;
+		VkImage image;
+		VkExtent2D extent;
+		VkImageAspectFlags aspect;
+		VkImageLayout layout;
+		VkPipelineStageFlags dst_stages;
+		VkAccessFlags dst_access;
+		std::vector<unsigned char> data;
+		VkDeviceSize size;
+		VkDeviceSize copied;
+		bool started;
+		bool one_off;	// too large for a slot and cannot be split
+	};
+
+	// staging of a one-off request, freed once `value` has completed
+	struct OneOffStaging {
+		VkBuffer buffer;
+		Allocation memory;
+		uint64_t value;
+	};
+
+	// a finished upload waiting for its acquire on the graphics queue
+	struct Release {
+		uint64_t ticket;
+		uint64_t value;	// of the submission that released it
+		VkBuffer buffer;
+		VkDeviceSize buffer_offset;
+		VkDeviceSize size;
+		VkImage image;
+		VkImageAspectFlags aspect;
+		VkImageLayout layout;
+		VkPipelineStageFlags dst_stages;
+		VkAccessFlags dst_access;
+	};
+
+	struct Slot {
+		VkCommandPool pool{ VK_NULL_HANDLE };
+		VkCommandBuffer command_buffer{ VK_NULL_HANDLE };
+		uint64_t value{ 0 };	// last submission using the slot
+	};
+
+	uint64_t CompletedValue() const;
+	// returns false once the slot is full
+	bool RecordCopies(Request& request, VkCommandBuffer command_buffer);
+	void RecordOneOffCopy(Request& request, VkCommandBuffer command_buffer);
+	void FreeOneOffStaging(uint64_t completed);
+	void RecordRelease(const Request& request, VkCommandBuffer command_buffer);
+	bool OwnershipTransfer() const { return transfer_family != graphics_family; }
+
+	MemoryAllocator& allocator;
+	VkDevice vk_device;
+	VkQueue vk_transfer_queue;
+	uint32_t transfer_family;
+	uint32_t graphics_family;
+	uint32_t row_granularity;	// 0: whole images only
+	RingBuffer staging;
+	std::deque<OneOffStaging> one_off_staging;
+	std::vector<Slot> slots;
+	uint32_t next_slot{ 0 };
+	VkSemaphore vk_semaphore{ VK_NULL_HANDLE };
+	uint64_t timeline_value{ 0 };
+
+	std::deque<Request> requests;
+	std::deque<Release> released;
+	uint64_t next_ticket{ 1 };
+	uint64_t acquired_tickets{ 0 };
+	uint64_t uploaded_bytes{ 0 };
+};
+
+#endif // !UPLOAD_QUEUE_H
@@ -0,0 +1,73 @@
+#include "worker_pool.h"
+#include <algorithm>
+
+WorkerPool::WorkerPool(size_t thread_count) {
+	for (size_t worker = 1; worker < thread_count; ++worker) {
+		threads.emplace_back(&WorkerPool::WorkerLoop, this, worker);
+	}
+}
+
+WorkerPool::~WorkerPool() {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stop = true;
+	}
+	start_condition.notify_all();
+	for (auto& thread : threads) {
+		thread.join();
+	}
+}
+
+void WorkerPool::Run(const std::function<void(size_t worker)>& task, size_t worker_count) {
+	const size_t run_count = std::max<size_t>(std::min(worker_count, ThreadCount()), 1);
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		this->task = &task;
+		active = run_count;
+		pending = run_count - 1;
+		error = nullptr;
+		++generation;
+	}
+	if (run_count > 1) {
+		start_condition.notify_all();
+	}
+	Execute(0);
+
+	std::unique_lock<std::mutex> lock(mutex);
+	done_condition.wait(lock, [this] { return pending == 0; });
+	this->task = nullptr;
+	if (error) {
+		std::rethrow_exception(error);
+	}
+}
+
+void WorkerPool::Execute(size_t worker) {
+	try {
+		(*task)(worker);
+	} catch (...) {
+		std::lock_guard<std::mutex> lock(mutex);
+		if (!error) {
+			error = std::current_exception();
+		}
+	}
+}
+
+void WorkerPool::WorkerLoop(size_t worker) {
+	uint64_t seen = 0;
+	for (;;) {
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			start_condition.wait(lock, [&] { return stop || (generation != seen && worker < active); });
+			if (stop) {
+				return;
+			}
+			seen = generation;
+		}
+		Execute(worker);
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			--pending;
+		}
+		done_condition.notify_one();
+	}
+}
@@ -0,0 +1,46 @@
+#ifndef WORKER_POOL_H
+#define WORKER_POOL_H
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of threads that run one task at a time, all of them together:
+// Run() hands every worker the same function with its worker index and
+// returns once all are done. The calling thread takes part as worker 0, so a
+// pool of one thread runs everything inline. Meant for fork-join work where
+// each worker owns per-thread state indexed by its worker index (command
+// pools, scratch memory) and never has to synchronize with the others.
+class WorkerPool {
+public:
+	explicit WorkerPool(size_t thread_count);
+	WorkerPool(const WorkerPool&) = delete;
+	WorkerPool& operator=(const WorkerPool&) = delete;
+	~WorkerPool();
+
+	size_t ThreadCount() const { return threads.size() + 1; }
+
+	// runs `task` on the first `worker_count` workers only, the others keep
+	// sleeping; rethrows the first exception a worker threw
+	void Run(const std::function<void(size_t worker)>& task, size_t worker_count = SIZE_MAX);
+
+private:
+	void WorkerLoop(size_t worker);
+	void Execute(size_t worker);
+
+	std::vector<std::thread> threads;
+	std::mutex mutex;
+	std::condition_variable start_condition;
+	std::condition_variable done_condition;
+	const std::function<void(size_t)>* task{ nullptr };
+	uint64_t generation{ 0 };
+	size_t active{ 0 };	// workers taking part in the current Run()
+	size_t pending{ 0 };
+	bool stop{ false };
+	std::exception_ptr error;
+};
+
+#endif // !WORKER_POOL_H
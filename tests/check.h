@@ -0,0 +1,30 @@
+#ifndef TEST_CHECK_H
+#define TEST_CHECK_H
+// Shared by the CPU-side tests, no framework: every failed CHECK is printed,
+// RunTests() returns the failure count for main() to exit with.
+#include <cstdio>
+#include <initializer_list>
+
+namespace test {
+inline int failures = 0;
+
+inline int RunTests(std::initializer_list<void (*)()> tests) {
+	for (auto run : tests) {
+		run();
+	}
+	if (failures) {
+		std::printf("%d check(s) failed\n", failures);
+	}
+	return failures;
+}
+} // namespace test
+
+#define CHECK(condition) \
+	do { \
+		if (!(condition)) { \
+			std::printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+			++test::failures; \
+		} \
+	} while (0)
+
+#endif // !TEST_CHECK_H
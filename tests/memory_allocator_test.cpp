@@ -0,0 +1,295 @@
+// Tests of DRender's MemoryAllocator above the Tlsf: pool selection, block
+// growth, dedicated allocations and heap budgets. The Vulkan entry points it
+// calls are defined here against a fake device, no driver is involved.
+#include "memory_allocator.h"
+#include "check.h"
+#include <cstddef>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+namespace {
+const VkDeviceSize kMiB = 1024 * 1024;
+const VkDeviceSize kPreferredBlockSize = 1 * kMiB;
+const VkDeviceSize kAtomSize = 64;
+
+// heap 0: device local, heap 1: host; type 2 is host visible but not coherent
+const VkDeviceSize kHeapSizes[] = { 16 * kMiB, 16 * kMiB };
+const uint32_t kDeviceLocal = 0, kHostCoherent = 1, kHostCached = 2;
+
+struct FakeMemory {
+	VkDeviceSize size;
+	uint32_t memory_type;
+	std::vector<char> host;
+};
+
+VkDeviceSize heap_allocated[2] = { 0, 0 };
+uint32_t live_memory_objects = 0;
+bool last_allocate_had_next = false;
+// what vkGet*MemoryRequirements2 report
+VkMemoryRequirements fake_requirements = { 4096, 256, ~0u };
+bool fake_prefers_dedicated = false;
+
+uint32_t HeapOf(uint32_t memory_type) {
+	return memory_type == kDeviceLocal ? 0 : 1;
+}
+
+void FakeRequirements(VkMemoryRequirements2* requirements) {
+	requirements->memoryRequirements = fake_requirements;
+	if (requirements->pNext) {
+		auto* dedicated = static_cast<VkMemoryDedicatedRequirements*>(requirements->pNext);
+		dedicated->prefersDedicatedAllocation = fake_prefers_dedicated ? VK_TRUE : VK_FALSE;
+		dedicated->requiresDedicatedAllocation = VK_FALSE;
+	}
+}
+
+VkMemoryRequirements Requirements(VkDeviceSize size, VkDeviceSize alignment, uint32_t type_bits = ~0u) {
+	return VkMemoryRequirements{ size, alignment, type_bits };
+}
+
+// the range of an allocation inside its VkDeviceMemory
+bool Overlap(const Allocation& a, const Allocation& b) {
+	return a.memory == b.memory && a.offset < b.offset + b.size && b.offset < a.offset + a.size;
+}
+} // namespace
+
+VKAPI_ATTR void VKAPI_CALL vkGetPhysicalDeviceMemoryProperties(VkPhysicalDevice, VkPhysicalDeviceMemoryProperties* properties) {
+	*properties = {};
+	properties->memoryHeapCount = 2;
+	properties->memoryHeaps[0].size = kHeapSizes[0];
+	properties->memoryHeaps[1].size = kHeapSizes[1];
+	properties->memoryTypeCount = 3;
+	properties->memoryTypes[kDeviceLocal] = { VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0 };
+	properties->memoryTypes[kHostCoherent] = { VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, 1 };
+	properties->memoryTypes[kHostCached] = { VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_CACHED_BIT, 1 };
+}
+
+VKAPI_ATTR void VKAPI_CALL vkGetPhysicalDeviceMemoryProperties2(VkPhysicalDevice device, VkPhysicalDeviceMemoryProperties2* properties) {
+	vkGetPhysicalDeviceMemoryProperties(device, &properties->memoryProperties);
+}
+
+VKAPI_ATTR void VKAPI_CALL vkGetPhysicalDeviceProperties(VkPhysicalDevice, VkPhysicalDeviceProperties* properties) {
+	*properties = {};
+	properties->limits.nonCoherentAtomSize = kAtomSize;
+	properties->limits.maxMemoryAllocationCount = 4096;
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL vkAllocateMemory(VkDevice, const VkMemoryAllocateInfo* info, const VkAllocationCallbacks*,
+	VkDeviceMemory* memory) {
+	const uint32_t heap = HeapOf(info->memoryTypeIndex);
+	if (heap_allocated[heap] + info->allocationSize > kHeapSizes[heap]) {
+		return VK_ERROR_OUT_OF_DEVICE_MEMORY;
+	}
+	heap_allocated[heap] += info->allocationSize;
+	++live_memory_objects;
+	last_allocate_had_next = info->pNext != nullptr;
+	*memory = reinterpret_cast<VkDeviceMemory>(new FakeMemory{ info->allocationSize, info->memoryTypeIndex, {} });
+	return VK_SUCCESS;
+}
+
+VKAPI_ATTR void VKAPI_CALL vkFreeMemory(VkDevice, VkDeviceMemory memory, const VkAllocationCallbacks*) {
+	FakeMemory* fake = reinterpret_cast<FakeMemory*>(memory);
+	heap_allocated[HeapOf(fake->memory_type)] -= fake->size;
+	--live_memory_objects;
+	delete fake;
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL vkMapMemory(VkDevice, VkDeviceMemory memory, VkDeviceSize, VkDeviceSize, VkMemoryMapFlags,
+	void** data) {
+	FakeMemory* fake = reinterpret_cast<FakeMemory*>(memory);
+	fake->host.resize(static_cast<size_t>(fake->size));
+	*data = fake->host.data();
+	return VK_SUCCESS;
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL vkFlushMappedMemoryRanges(VkDevice, uint32_t, const VkMappedMemoryRange*) {
+	return VK_SUCCESS;
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL vkInvalidateMappedMemoryRanges(VkDevice, uint32_t, const VkMappedMemoryRange*) {
+	return VK_SUCCESS;
+}
+
+VKAPI_ATTR void VKAPI_CALL vkGetBufferMemoryRequirements2(VkDevice, const VkBufferMemoryRequirementsInfo2*,
+	VkMemoryRequirements2* requirements) {
+	FakeRequirements(requirements);
+}
+
+VKAPI_ATTR void VKAPI_CALL vkGetImageMemoryRequirements2(VkDevice, const VkImageMemoryRequirementsInfo2*,
+	VkMemoryRequirements2* requirements) {
+	FakeRequirements(requirements);
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL vkBindBufferMemory(VkDevice, VkBuffer, VkDeviceMemory, VkDeviceSize) {
+	return VK_SUCCESS;
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL vkBindImageMemory(VkDevice, VkImage, VkDeviceMemory, VkDeviceSize) {
+	return VK_SUCCESS;
+}
+
+namespace {
+std::unique_ptr<MemoryAllocator> NewAllocator() {
+	return std::make_unique<MemoryAllocator>(VK_NULL_HANDLE, VK_NULL_HANDLE, false, kPreferredBlockSize);
+}
+
+// buffers and images never share a block, neighbours of one kind are aligned
+// and disjoint
+void TestLinearAndOptimalPools() {
+	std::unique_ptr<MemoryAllocator> allocator = NewAllocator();
+	Allocation buffers[3];
+	for (auto& buffer : buffers) {
+		buffer = allocator->Allocate(Requirements(1000, 256), MemoryUsage::GpuOnly, true);
+		CHECK(buffer);
+		CHECK(buffer.memory_type == kDeviceLocal);
+		CHECK(buffer.offset % 256 == 0);
+	}
+	Allocation image = allocator->Allocate(Requirements(4096, 4096), MemoryUsage::GpuOnly, false);
+	CHECK(image);
+	CHECK(image.offset % 4096 == 0);
+	CHECK(buffers[0].memory == buffers[1].memory && buffers[1].memory == buffers[2].memory);
+	CHECK(image.memory != buffers[0].memory);
+	CHECK(!Overlap(buffers[0], buffers[1]) && !Overlap(buffers[1], buffers[2]) && !Overlap(buffers[0], buffers[2]));
+
+	MemoryAllocator::Stats stats = allocator->GetStats();
+	CHECK(stats.blocks == 2);
+	CHECK(stats.allocations == 4);
+	CHECK(stats.dedicated_allocations == 0);
+	CHECK(stats.used_bytes == 3 * 1000 + 4096);
+
+	// host visible memory stays mapped, at the allocation's offset
+	Allocation upload = allocator->Allocate(Requirements(256, 16), MemoryUsage::CpuToGpu, true);
+	CHECK(upload.memory_type == kHostCoherent);
+	CHECK(upload.mapped != nullptr);
+	// non-coherent memory is padded to whole atoms, flushes never touch a neighbour
+	Allocation readback[2];
+	for (auto& allocation : readback) {
+		allocation = allocator->Allocate(Requirements(100, 4, 1u << kHostCached), MemoryUsage::GpuToCpu, true);
+		CHECK(allocation.memory_type == kHostCached);
+		CHECK(allocation.offset % kAtomSize == 0);
+		CHECK(allocation.size % kAtomSize == 0);
+	}
+	CHECK(!Overlap(readback[0], readback[1]));
+	CHECK(static_cast<char*>(readback[1].mapped) - static_cast<char*>(readback[0].mapped) ==
+		static_cast<std::ptrdiff_t>(readback[1].offset) - static_cast<std::ptrdiff_t>(readback[0].offset));
+
+	for (auto& buffer : buffers) {
+		allocator->Free(buffer);
+		CHECK(!buffer);
+	}
+	allocator->Free(image);
+	allocator->Free(upload);
+	allocator->Free(readback[0]);
+	allocator->Free(readback[1]);
+	CHECK(allocator->GetStats().allocations == 0);
+	allocator.reset();
+	CHECK(live_memory_objects == 0);
+}
+
+// blocks start at an eighth of the preferred size and double; an emptied
+// block is released unless it is the last of its pool
+void TestBlockGrowth() {
+	std::unique_ptr<MemoryAllocator> allocator = NewAllocator();
+	const VkDeviceSize first_block = kPreferredBlockSize / 8;
+	const VkDeviceSize size = first_block / 2 + first_block / 4;
+	Allocation a = allocator->Allocate(Requirements(size, 256), MemoryUsage::GpuOnly, true);
+	Allocation b = allocator->Allocate(Requirements(size, 256), MemoryUsage::GpuOnly, true);
+	CHECK(a.memory != b.memory);
+	MemoryAllocator::Stats stats = allocator->GetStats();
+	CHECK(stats.blocks == 2);
+	CHECK(stats.block_bytes == first_block + 2 * first_block);
+
+	allocator->Free(a);
+	CHECK(allocator->GetStats().blocks == 1);
+	allocator->Free(b);
+	CHECK(allocator->GetStats().blocks == 1);
+	CHECK(live_memory_objects == 1);
+	allocator.reset();
+	CHECK(live_memory_objects == 0);
+}
+
+// large and transient resources, and resources the driver wants alone, get
+// a VkDeviceMemory of their own
+void TestDedicated() {
+	std::unique_ptr<MemoryAllocator> allocator = NewAllocator();
+	Allocation large = allocator->Allocate(Requirements(kPreferredBlockSize, 256), MemoryUsage::GpuOnly, false);
+	CHECK(large);
+	CHECK(large.offset == 0);
+	CHECK(large.size == kPreferredBlockSize);
+	Allocation transient = allocator->Allocate(Requirements(4096, 256), MemoryUsage::Transient, false);
+	Allocation requested = allocator->Allocate(Requirements(4096, 256), MemoryUsage::GpuOnly, true, true);
+	MemoryAllocator::Stats stats = allocator->GetStats();
+	CHECK(stats.dedicated_allocations == 3);
+	CHECK(stats.dedicated_bytes == kPreferredBlockSize + 2 * 4096);
+	CHECK(stats.blocks == 0);
+
+	// the driver's preference is passed on with VkMemoryDedicatedAllocateInfo
+	fake_prefers_dedicated = true;
+	fake_requirements = Requirements(4096, 256);
+	Allocation buffer = allocator->AllocateForBuffer(VK_NULL_HANDLE, MemoryUsage::GpuOnly);
+	fake_prefers_dedicated = false;
+	CHECK(last_allocate_had_next);
+	CHECK(allocator->GetStats().dedicated_allocations == 4);
+	Allocation pooled = allocator->AllocateForImage(VK_NULL_HANDLE, VK_IMAGE_TILING_OPTIMAL, MemoryUsage::GpuOnly);
+	CHECK(allocator->GetStats().dedicated_allocations == 4);
+	CHECK(allocator->GetStats().blocks == 1);
+
+	allocator->Free(large);
+	allocator->Free(transient);
+	allocator->Free(requested);
+	allocator->Free(buffer);
+	allocator->Free(pooled);
+	stats = allocator->GetStats();
+	CHECK(stats.dedicated_allocations == 0);
+	CHECK(stats.dedicated_bytes == 0);
+	allocator.reset();
+	CHECK(live_memory_objects == 0);
+}
+
+// without VK_EXT_memory_budget the budget is 80% of a heap: past it new memory
+// goes to another heap that has room, and when there is none, over budget
+// until the device is out of memory
+void TestBudgetExhaustion() {
+	std::unique_ptr<MemoryAllocator> allocator = NewAllocator();
+	std::vector<Allocation> allocations;
+	for (int i = 0; i < 3; ++i) {
+		allocations.push_back(allocator->Allocate(Requirements(4 * kMiB, 256), MemoryUsage::GpuOnly, false));
+		CHECK(allocations.back().memory_type == kDeviceLocal);
+	}
+	std::vector<MemoryAllocator::HeapBudget> budgets = allocator->QueryBudgets();
+	CHECK(budgets[0].budget == kHeapSizes[0] / 10 * 8);
+	CHECK(budgets[0].device_bytes == 12 * kMiB);
+	CHECK(budgets[0].usage == 12 * kMiB);
+
+	// heap 0 has no budget left, any type will do: steered to the host heap
+	allocations.push_back(allocator->Allocate(Requirements(4 * kMiB, 256), MemoryUsage::GpuOnly, false));
+	CHECK(HeapOf(allocations.back().memory_type) == 1);
+	// only device local memory allowed: over budget, as long as the heap has room
+	allocations.push_back(allocator->Allocate(Requirements(4 * kMiB, 256, 1u << kDeviceLocal), MemoryUsage::GpuOnly, false));
+	CHECK(allocations.back().memory_type == kDeviceLocal);
+	budgets = allocator->QueryBudgets();
+	CHECK(budgets[0].usage == kHeapSizes[0]);
+	CHECK(budgets[0].usage > budgets[0].budget);
+
+	bool threw = false;
+	try {
+		allocator->Allocate(Requirements(4 * kMiB, 256, 1u << kDeviceLocal), MemoryUsage::GpuOnly, false);
+	} catch (const std::runtime_error&) {
+		threw = true;
+	}
+	CHECK(threw);
+
+	for (auto& allocation : allocations) {
+		allocator->Free(allocation);
+	}
+	budgets = allocator->QueryBudgets();
+	CHECK(budgets[0].device_bytes == 0 && budgets[1].device_bytes == 0);
+	CHECK(budgets[0].usage == 0);
+	allocator.reset();
+	CHECK(live_memory_objects == 0);
+}
+} // namespace
+
+int main() {
+	return test::RunTests({ TestLinearAndOptimalPools, TestBlockGrowth, TestDedicated, TestBudgetExhaustion });
+}
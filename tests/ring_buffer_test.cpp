@@ -0,0 +1,60 @@
+// Offset bookkeeping of gl460::RingBuffer, without a GL context: every
+// allocation of every frame region must honour the requested alignment,
+// also when the region size is not a multiple of it.
+#include "gl460/ring_buffer.h"
+#include "check.h"
+
+namespace {
+using gl460::RingBuffer;
+
+// fills region `frame` with `size` byte allocations, as allocate() does
+void FillRegion(GLsizeiptr frame_size, uint32_t frame, GLsizeiptr size, GLsizeiptr alignment) {
+	const GLintptr base = static_cast<GLintptr>(frame) * frame_size;
+	GLsizeiptr head = 0;
+	int count = 0;
+	for (;;) {
+		const GLintptr offset = RingBuffer::placeAllocation(frame_size, frame, head, size, alignment);
+		if (offset < 0) {
+			break;
+		}
+		CHECK(offset % alignment == 0);
+		CHECK(offset >= base + head);
+		CHECK(offset + size <= base + frame_size);
+		head = offset + size - base;
+		++count;
+	}
+	CHECK(count > 0);
+	// only gives up when the remainder cannot hold an aligned allocation
+	CHECK(frame_size - head < size + alignment - 1);
+}
+
+void TestUnalignedFrameSize() {
+	// the gldemo sizing: 1 MiB plus 64 byte matrices and 48 byte lights, so
+	// regions 1 and 2 start off any 256 byte boundary
+	const GLsizeiptr frame_size = (1 << 20) + 5 * 7 * 64 + 3 * 48;
+	CHECK(frame_size % 256 != 0);
+	for (uint32_t frame = 0; frame < 3; ++frame) {
+		FillRegion(frame_size, frame, 64, 256);
+		FillRegion(frame_size, frame, 48, 16);
+		FillRegion(frame_size, frame, 1000, 256);
+		const GLintptr first = RingBuffer::placeAllocation(frame_size, frame, 0, 64, 256);
+		CHECK(first % 256 == 0);
+		CHECK(first >= static_cast<GLintptr>(frame) * frame_size);
+	}
+}
+
+void TestExhaustion() {
+	// 300 bytes per region: region 1 starts at 300, its only 256 byte
+	// boundary is 512, which leaves room for 88 bytes
+	CHECK(RingBuffer::placeAllocation(300, 1, 0, 88, 256) == 512);
+	CHECK(RingBuffer::placeAllocation(300, 1, 0, 89, 256) == -1);
+	CHECK(RingBuffer::placeAllocation(300, 0, 0, 300, 256) == 0);
+	CHECK(RingBuffer::placeAllocation(300, 0, 1, 8, 256) == 256);
+	CHECK(RingBuffer::placeAllocation(300, 2, 0, 1, 256) == 768);
+	CHECK(RingBuffer::placeAllocation(300, 2, 0, 1, 0) == 600);
+}
+} // namespace
+
+int main() {
+	return test::RunTests({ TestUnalignedFrameSize, TestExhaustion });
+}
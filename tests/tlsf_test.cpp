@@ -0,0 +1,185 @@
+// CPU-side tests of the TLSF core of DRender's MemoryAllocator.
+#include "tlsf.h"
+#include "check.h"
+#include <vector>
+
+namespace {
+// every live allocation and free region tiles [0, size) in address order
+void CheckConsistent(const Tlsf& tlsf) {
+	uint64_t end = 0;
+	uint64_t used = 0;
+	bool ordered = true;
+	tlsf.ForEachAllocation([&](const Tlsf::Allocation& allocation) {
+		ordered = ordered && allocation.offset >= end;
+		end = allocation.offset + allocation.size;
+		used += allocation.size;
+	});
+	CHECK(ordered);
+	CHECK(end <= tlsf.Size());
+	CHECK(used == tlsf.Used());
+	const Tlsf::Stats stats = tlsf.GetStats();
+	CHECK(stats.used == tlsf.Used());
+	CHECK(stats.allocations == tlsf.AllocationCount());
+}
+
+void TestAllocateFree() {
+	Tlsf tlsf(1024);
+	CHECK(tlsf.Size() == 1024);
+	CHECK(tlsf.Empty());
+
+	// sizes are rounded up to the 8 byte granularity
+	Tlsf::Allocation a = tlsf.Allocate(100, 1);
+	CHECK(a);
+	CHECK(a.offset == 0);
+	CHECK(a.size == 104);
+	Tlsf::Allocation b = tlsf.Allocate(200, 1);
+	CHECK(b);
+	CHECK(b.offset == 104);
+	CHECK(b.size == 200);
+	CHECK(tlsf.Used() == 304);
+	CHECK(tlsf.AllocationCount() == 2);
+	CheckConsistent(tlsf);
+
+	tlsf.Free(a.node);
+	CHECK(tlsf.Used() == 200);
+	CHECK(tlsf.GetStats().free_regions == 2);
+	CheckConsistent(tlsf);
+
+	// the freed front region is reused
+	Tlsf::Allocation c = tlsf.Allocate(64, 1);
+	CHECK(c);
+	CHECK(c.offset == 0);
+	tlsf.Free(c.node);
+	tlsf.Free(b.node);
+	CHECK(tlsf.Empty());
+	CHECK(tlsf.GetStats().free_regions == 1);
+	CHECK(tlsf.GetStats().largest_free_region == 1024);
+}
+
+void TestMergeNeighbours() {
+	Tlsf tlsf(4096);
+	Tlsf::Allocation a = tlsf.Allocate(512, 1);
+	Tlsf::Allocation b = tlsf.Allocate(512, 1);
+	Tlsf::Allocation c = tlsf.Allocate(512, 1);
+	Tlsf::Allocation d = tlsf.Allocate(512, 1);	// keeps c off the free tail
+	CHECK(a && b && c && d);
+	CHECK(b.offset == a.offset + a.size);
+	CHECK(c.offset == b.offset + b.size);
+
+	tlsf.Free(a.node);
+	tlsf.Free(c.node);
+	CHECK(tlsf.GetStats().free_regions == 3);	// a, c and the tail
+	// b merges with the free regions on both sides into one of 1536 bytes
+	tlsf.Free(b.node);
+	Tlsf::Stats stats = tlsf.GetStats();
+	CHECK(stats.free_regions == 2);
+	CHECK(stats.largest_free_region == 2048);	// the tail is still larger
+	CheckConsistent(tlsf);
+
+	Tlsf::Allocation merged = tlsf.Allocate(1536, 1);
+	CHECK(merged);
+	CHECK(merged.offset == 0);
+	tlsf.Free(merged.node);
+	// d merges with the front region and the tail
+	tlsf.Free(d.node);
+	stats = tlsf.GetStats();
+	CHECK(stats.free_regions == 1);
+	CHECK(stats.largest_free_region == 4096);
+	CHECK(tlsf.Empty());
+}
+
+void TestAlignmentPadding() {
+	Tlsf tlsf(4096);
+	Tlsf::Allocation a = tlsf.Allocate(8, 1);
+	CHECK(a);
+	CHECK(a.offset == 0);
+	Tlsf::Allocation b = tlsf.Allocate(64, 256);
+	CHECK(b);
+	CHECK(b.offset == 256);
+	CHECK(b.size == 64);
+	// the padding in front of b stays allocatable
+	CHECK(tlsf.GetStats().free_regions == 2);
+	Tlsf::Allocation c = tlsf.Allocate(200, 1);
+	CHECK(c);
+	CHECK(c.offset == 8);
+	CheckConsistent(tlsf);
+
+	Tlsf::Allocation d = tlsf.Allocate(1, 1024);
+	CHECK(d);
+	CHECK(d.offset % 1024 == 0);
+	CheckConsistent(tlsf);
+
+	tlsf.Free(b.node);
+	tlsf.Free(a.node);
+	tlsf.Free(d.node);
+	tlsf.Free(c.node);
+	CHECK(tlsf.Empty());
+	CHECK(tlsf.GetStats().free_regions == 1);
+	CHECK(tlsf.GetStats().largest_free_region == 4096);
+}
+
+void TestFindFreeInBin() {
+	// a block sized for one allocation: FindFree() rounds 1000 up to the next
+	// bin and finds nothing, the region is only found in its own bin
+	Tlsf single(1000);
+	Tlsf::Allocation whole = single.Allocate(1000, 1);
+	CHECK(whole);
+	CHECK(whole.offset == 0);
+	CHECK(whole.size == 1000);
+	single.Free(whole.node);
+
+	// two free regions of the same bin (992 and 1000 bytes), the smaller one
+	// first in the bin's list: the fallback has to walk past it
+	Tlsf tlsf(4096);
+	Tlsf::Allocation a = tlsf.Allocate(992, 1);
+	Tlsf::Allocation separator0 = tlsf.Allocate(8, 1);
+	Tlsf::Allocation b = tlsf.Allocate(1000, 1);
+	Tlsf::Allocation separator1 = tlsf.Allocate(8, 1);
+	Tlsf::Allocation tail = tlsf.Allocate(4096 - 2008, 1);
+	CHECK(a && separator0 && b && separator1 && tail);
+	CHECK(tail.offset + tail.size == 4096);
+	tlsf.Free(b.node);
+	tlsf.Free(a.node);
+	CHECK(tlsf.GetStats().free_regions == 2);
+
+	Tlsf::Allocation fit = tlsf.Allocate(1000, 1);
+	CHECK(fit);
+	CHECK(fit.offset == b.offset);
+	Tlsf::Allocation too_large = tlsf.Allocate(1000, 1);
+	CHECK(!too_large);
+	CheckConsistent(tlsf);
+}
+
+void TestExhaustion() {
+	Tlsf tlsf(1024);
+	CHECK(!tlsf.Allocate(2048, 1));
+	Tlsf::Allocation a = tlsf.Allocate(1024, 1);
+	CHECK(a);
+	CHECK(!tlsf.Allocate(8, 1));
+	CHECK(tlsf.AllocationCount() == 1);
+
+	tlsf.Free(a.node);
+	std::vector<Tlsf::Allocation> allocations;
+	for (Tlsf::Allocation allocation = tlsf.Allocate(64, 1); allocation; allocation = tlsf.Allocate(64, 1)) {
+		allocations.push_back(allocation);
+	}
+	CHECK(allocations.size() == 16);
+	CHECK(tlsf.Used() == 1024);
+	// alignment padding can make a request fail although enough bytes are free
+	tlsf.Free(allocations[1].node);
+	CHECK(!tlsf.Allocate(64, 128));
+	Tlsf::Allocation refill = tlsf.Allocate(64, 1);
+	CHECK(refill);
+	CHECK(refill.offset == 64);
+	CHECK(!tlsf.Allocate(8, 1));
+	CheckConsistent(tlsf);
+
+	Tlsf empty(4);	// below the granularity
+	CHECK(empty.Size() == 0);
+	CHECK(!empty.Allocate(1, 1));
+}
+} // namespace
+
+int main() {
+	return test::RunTests({ TestAllocateFree, TestMergeNeighbours, TestAlignmentPadding, TestFindFreeInBin, TestExhaustion });
+}